@@ -0,0 +1,2505 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memory_manager_api.h"
+#include "string_cache_api.h"
+#include "bytecode_api.h"
+#include "bytecode_optimizer_api.h"
+#include "bytecode_cfg_api.h"
+#include "dead_code_api.h"
+#include "block_layout_api.h"
+#include "scope_api.h"
+#include "fnv_1a_api.h"
+#include "bytecode_utils_api.h"
+#include "vm_api.h"
+#include "jit_api.h"
+#include "aot_api.h"
+#include "opcode_handlers.h"
+#include "object_helpers_api.h"
+#include "data_stack_api.h"
+#include "globals_api.h"
+
+
+// Signature for functions that emit the bytecode for a single test program
+typedef void (*build_program_t)(bytecode_t *);
+
+
+typedef struct
+{
+    const char *name;          // Test name, printed in the results
+    build_program_t build;     // Emits the bytecode for the test program
+    vm_status_e expected_err;  // Expected return value of vm_execute
+    data_type_e expected_type; // Expected data type of the value left on the stack
+    vm_int_t expected_int;     // Expected value, if expected_type is DATATYPE_INT
+    vm_float_t expected_float; // Expected value, if expected_type is DATATYPE_FLOAT
+    const char *expected_str;  // Expected value, if expected_type is DATATYPE_STRING
+} vm_test_case_t;
+
+
+static void _build_int_arithmetic(bytecode_t *program)
+{
+    (void) bytecode_emit_int(program, 6);
+    (void) bytecode_emit_int(program, 7);
+    (void) bytecode_emit_mult(program);
+    (void) bytecode_emit_int(program, 2);
+    (void) bytecode_emit_sub(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_float_arithmetic(bytecode_t *program)
+{
+    (void) bytecode_emit_float(program, 1.5);
+    (void) bytecode_emit_int(program, 3);
+    (void) bytecode_emit_mult(program);
+    (void) bytecode_emit_float(program, 0.5);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_constants(bytecode_t *program)
+{
+    vm_int_t intval = 20;
+    vm_float_t floatval = 8.0;
+
+    (void) bytecode_emit_define_const(program, DATATYPE_INT, &intval);
+    (void) bytecode_emit_define_const(program, DATATYPE_FLOAT, &floatval);
+    (void) bytecode_emit_load_const(program, 0);
+    (void) bytecode_emit_load_const(program, 1);
+    (void) bytecode_emit_div(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_string_constant(bytecode_t *program)
+{
+    (void) bytecode_emit_define_const(program, DATATYPE_STRING, "xy");
+    (void) bytecode_emit_load_const(program, 0);
+    (void) bytecode_emit_load_const(program, 0);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_load_const(program, 0);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_jump_if_false(bytecode_t *program)
+{
+    uint32_t position;
+
+    (void) bytecode_emit_int(program, 10);
+    (void) bytecode_emit_bool(program, 0);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &position);
+    (void) bytecode_emit_int(program, 5);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_backpatch_jump(program, position,
+                                   program->used_bytes - position);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_jump(bytecode_t *program)
+{
+    uint32_t position;
+
+    (void) bytecode_emit_int(program, 3);
+    (void) bytecode_emit_backpatched_jump(program, &position);
+    (void) bytecode_emit_int(program, 100);
+    (void) bytecode_emit_mult(program);
+    (void) bytecode_backpatch_jump(program, position,
+                                   program->used_bytes - position);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_string_ops(bytecode_t *program)
+{
+    (void) bytecode_emit_string(program, "ab");
+    (void) bytecode_emit_int(program, 2);
+    (void) bytecode_emit_mult(program);
+    (void) bytecode_emit_int(program, 42);
+    (void) bytecode_emit_cast(program, DATATYPE_STRING, 0u);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_cast_same_type(bytecode_t *program)
+{
+    (void) bytecode_emit_int(program, 9);
+    (void) bytecode_emit_cast(program, DATATYPE_INT, 0u);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_mixed_types_at_join(bytecode_t *program)
+{
+    uint32_t else_position;
+    uint32_t end_position;
+
+    (void) bytecode_emit_bool(program, 1);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &else_position);
+    (void) bytecode_emit_float(program, 2.5);
+    (void) bytecode_emit_backpatched_jump(program, &end_position);
+    (void) bytecode_backpatch_jump(program, else_position,
+                                   program->used_bytes - else_position);
+    (void) bytecode_emit_int(program, 2);
+    (void) bytecode_backpatch_jump(program, end_position,
+                                   program->used_bytes - end_position);
+    (void) bytecode_emit_int(program, 3);
+    (void) bytecode_emit_mult(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_int_division_by_zero(bytecode_t *program)
+{
+    (void) bytecode_emit_int(program, 7);
+    (void) bytecode_emit_int(program, 0);
+    (void) bytecode_emit_div(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_deep_expression(bytecode_t *program)
+{
+    // ((1 + (2 + (3 * (9 - 5)))) * 2.5), deeper than the cached top of the stack
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_int(program, 2);
+    (void) bytecode_emit_int(program, 3);
+    (void) bytecode_emit_int(program, 9);
+    (void) bytecode_emit_int(program, 5);
+    (void) bytecode_emit_sub(program);
+    (void) bytecode_emit_mult(program);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_cast(program, DATATYPE_FLOAT, 0u);
+    (void) bytecode_emit_float(program, 2.5);
+    (void) bytecode_emit_mult(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_runtime_error(bytecode_t *program)
+{
+    (void) bytecode_emit_string(program, "abc");
+    (void) bytecode_emit_string(program, "def");
+    (void) bytecode_emit_div(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+/* Pop a condition, and add a value to the int below it if the condition is true */
+static void _add_if_true(bytecode_t *program, vm_int_t value)
+{
+    uint32_t position;
+
+    (void) bytecode_emit_backpatched_jump_if_false(program, &position);
+    (void) bytecode_emit_int(program, value);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_backpatch_jump(program, position,
+                                   program->used_bytes - position);
+}
+
+
+static void _build_comparisons(bytecode_t *program)
+{
+    // Adds a different power of two for each comparison that holds
+    (void) bytecode_emit_int(program, 0);
+
+    // Not a literal, so the optimizer fuses this into a compare-and-branch on ints
+    (void) bytecode_emit_string(program, "3");
+    (void) bytecode_emit_cast(program, DATATYPE_INT, 10u);
+    (void) bytecode_emit_int(program, 4);
+    (void) bytecode_emit_less(program);
+    _add_if_true(program, 1);
+
+    (void) bytecode_emit_int(program, 5);
+    (void) bytecode_emit_float(program, 5.0);
+    (void) bytecode_emit_equal(program);
+    _add_if_true(program, 2);
+
+    (void) bytecode_emit_string(program, "ab");
+    (void) bytecode_emit_string(program, "abc");
+    (void) bytecode_emit_less_equal(program);
+    _add_if_true(program, 4);
+
+    (void) bytecode_emit_string(program, "1");
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_not_equal(program);
+    _add_if_true(program, 8);
+
+    (void) bytecode_emit_float(program, NAN);
+    (void) bytecode_emit_float(program, NAN);
+    (void) bytecode_emit_equal(program);
+    _add_if_true(program, 16);
+
+    (void) bytecode_emit_float(program, NAN);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_greater(program);
+    _add_if_true(program, 32);
+
+    (void) bytecode_emit_int(program, 2);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_less_equal(program);
+    _add_if_true(program, 64);
+
+    (void) bytecode_emit_string(program, "b");
+    (void) bytecode_emit_string(program, "a");
+    (void) bytecode_emit_greater_equal(program);
+    _add_if_true(program, 128);
+
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_compare_string_with_int(bytecode_t *program)
+{
+    (void) bytecode_emit_string(program, "abc");
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_less(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+/* Push a string created at runtime, which is not immortal; the string passes
+ * through a local variable so that the optimizer can't fold it */
+static void _emit_new_string(bytecode_t *program)
+{
+    (void) bytecode_emit_string(program, "ab");
+    (void) bytecode_emit_string(program, "ab");
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, 0u);
+    (void) bytecode_emit_load_local(program, 0u);
+}
+
+
+/* Runtime errors on a string created at runtime, whose operands must be
+ * released before the error is returned */
+static void _build_new_string_arithmetic_error(bytecode_t *program)
+{
+    _emit_new_string(program);
+    (void) bytecode_emit_float(program, 1.5);
+    (void) bytecode_emit_sub(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_new_string_compare_error(bytecode_t *program)
+{
+    _emit_new_string(program);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_less(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_new_string_cast_error(bytecode_t *program)
+{
+    _emit_new_string(program);
+    (void) bytecode_emit_cast(program, DATATYPE_INT, 10);
+    (void) bytecode_emit_end(program);
+}
+
+
+/* Sum the numbers 0 to 99, held in local variables */
+static void _build_local_loop(bytecode_t *program)
+{
+    scope_t scope;
+    uint16_t i, sum;
+    uint32_t position;
+
+    (void) scope_create(&scope);
+    (void) scope_resolve(&scope, "i", 1u, &i);
+    (void) scope_resolve(&scope, "sum", 3u, &sum);
+
+    // Both locals start out as int 0
+    uint32_t loop = program->used_bytes;
+    (void) bytecode_emit_load_local(program, i);
+    (void) bytecode_emit_int(program, 100);
+    (void) bytecode_emit_less(program);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &position);
+
+    (void) bytecode_emit_load_local(program, sum);
+    (void) bytecode_emit_load_local(program, i);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, sum);
+
+    (void) bytecode_emit_load_local(program, i);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, i);
+
+    (void) bytecode_emit_jump(program, (int32_t) loop - (int32_t) program->used_bytes);
+    (void) bytecode_backpatch_jump(program, position,
+                                   program->used_bytes - position);
+
+    (void) bytecode_emit_load_local(program, sum);
+    (void) bytecode_emit_end(program);
+    (void) scope_destroy(&scope);
+}
+
+
+/* Overwrite a local holding a string that nothing else refers to */
+static void _build_string_locals(bytecode_t *program)
+{
+    (void) bytecode_emit_string(program, "ab");
+    (void) bytecode_emit_string(program, "ab");
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, 0u);
+
+    // Storing a local's own value in it must not free the value
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_store_local(program, 0u);
+
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_string(program, "c");
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, 1u);
+
+    (void) bytecode_emit_load_local(program, 1u);
+    (void) bytecode_emit_store_local(program, 0u);
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_end(program);
+}
+
+
+/* Sum the numbers 0 to 99, held in global variables */
+static void _build_global_loop(bytecode_t *program)
+{
+    uint32_t position;
+
+    (void) bytecode_emit_define_const(program, DATATYPE_STRING, "i");
+    (void) bytecode_emit_define_const(program, DATATYPE_STRING, "sum");
+    (void) bytecode_emit_int(program, 0);
+    (void) bytecode_emit_store_global(program, 0u);
+    (void) bytecode_emit_int(program, 0);
+    (void) bytecode_emit_store_global(program, 1u);
+
+    uint32_t loop = program->used_bytes;
+    (void) bytecode_emit_load_global(program, 0u);
+    (void) bytecode_emit_int(program, 100);
+    (void) bytecode_emit_less(program);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &position);
+
+    (void) bytecode_emit_load_global(program, 1u);
+    (void) bytecode_emit_load_global(program, 0u);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_global(program, 1u);
+
+    (void) bytecode_emit_load_global(program, 0u);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_global(program, 0u);
+
+    (void) bytecode_emit_jump(program, (int32_t) loop - (int32_t) program->used_bytes);
+    (void) bytecode_backpatch_jump(program, position,
+                                   program->used_bytes - position);
+
+    (void) bytecode_emit_load_global(program, 1u);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_undefined_global(bytecode_t *program)
+{
+    (void) bytecode_emit_define_const(program, DATATYPE_STRING, "nope");
+    (void) bytecode_emit_load_global(program, 0u);
+    (void) bytecode_emit_end(program);
+}
+
+
+/* Overwrite a global and a local while a copy of the string each one held is
+ * still on the data stack, and then use the copy */
+static void _build_overwrite_loaded_variables(bytecode_t *program)
+{
+    (void) bytecode_emit_define_const(program, DATATYPE_STRING, "g");
+    (void) bytecode_emit_string(program, "aaaa");
+    (void) bytecode_emit_store_global(program, 0u);
+
+    // Not a literal, so the string is created at runtime and owned by the global
+    (void) bytecode_emit_load_global(program, 0u);
+    (void) bytecode_emit_string(program, "bbbb");
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_global(program, 0u);
+
+    (void) bytecode_emit_load_global(program, 0u);
+    (void) bytecode_emit_string(program, "zz");
+    (void) bytecode_emit_store_global(program, 0u);
+    (void) bytecode_emit_load_global(program, 0u);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, 0u);
+
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_string(program, "y");
+    (void) bytecode_emit_store_local(program, 0u);
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static vm_test_case_t _test_cases[] =
+{
+    {"int arithmetic", _build_int_arithmetic, VM_OK, DATATYPE_INT, 40, 0.0, NULL},
+    {"float arithmetic", _build_float_arithmetic, VM_OK, DATATYPE_FLOAT, 0, 5.0, NULL},
+    {"constants", _build_constants, VM_OK, DATATYPE_FLOAT, 0, 2.5, NULL},
+    {"string constant", _build_string_constant, VM_OK, DATATYPE_STRING, 0, 0.0, "xyxyxy"},
+    {"jump if false", _build_jump_if_false, VM_OK, DATATYPE_INT, 11, 0.0, NULL},
+    {"jump", _build_jump, VM_OK, DATATYPE_INT, 3, 0.0, NULL},
+    {"string ops", _build_string_ops, VM_OK, DATATYPE_STRING, 0, 0.0, "abab42"},
+    {"cast to same type", _build_cast_same_type, VM_OK, DATATYPE_INT, 9, 0.0, NULL},
+    {"mixed types at join", _build_mixed_types_at_join, VM_OK, DATATYPE_FLOAT, 0, 7.5, NULL},
+    {"int division by zero", _build_int_division_by_zero, VM_RUNTIME_ERROR, DATATYPE_INT, 0, 0.0, NULL},
+    {"deep expression", _build_deep_expression, VM_OK, DATATYPE_FLOAT, 0, 37.5, NULL},
+    {"runtime error", _build_runtime_error, VM_RUNTIME_ERROR, DATATYPE_INT, 0, 0.0, NULL},
+    {"comparisons", _build_comparisons, VM_OK, DATATYPE_INT, 191, 0.0, NULL},
+    {"compare string with int", _build_compare_string_with_int, VM_RUNTIME_ERROR, DATATYPE_INT, 0, 0.0, NULL},
+    {"new string arithmetic error", _build_new_string_arithmetic_error, VM_RUNTIME_ERROR, DATATYPE_INT, 0, 0.0, NULL},
+    {"new string compare error", _build_new_string_compare_error, VM_RUNTIME_ERROR, DATATYPE_INT, 0, 0.0, NULL},
+    {"new string cast error", _build_new_string_cast_error, VM_RUNTIME_ERROR, DATATYPE_INT, 0, 0.0, NULL},
+    {"local loop", _build_local_loop, VM_OK, DATATYPE_INT, 4950, 0.0, NULL},
+    {"string locals", _build_string_locals, VM_OK, DATATYPE_STRING, 0, 0.0, "ababc"},
+    {"global loop", _build_global_loop, VM_OK, DATATYPE_INT, 4950, 0.0, NULL},
+    {"undefined global", _build_undefined_global, VM_RUNTIME_ERROR, DATATYPE_INT, 0, 0.0, NULL},
+    {"overwrite loaded variables", _build_overwrite_loaded_variables, VM_OK, DATATYPE_STRING, 0, 0.0, "aaaabbbbzzy"},
+};
+
+
+#define NUM_TEST_CASES (sizeof(_test_cases) / sizeof(_test_cases[0]))
+
+
+static const char *_engine_names[NUM_VM_ENGINES] =
+{
+    [VM_ENGINE_STACK] = "stack",
+    [VM_ENGINE_REGISTER] = "register",
+    [VM_ENGINE_TOS_CACHE] = "top-of-stack cache",
+    [VM_ENGINE_JIT] = "jit",
+    [VM_ENGINE_TRACE_JIT] = "trace jit",
+    [VM_ENGINE_AOT] = "aot",
+};
+
+
+/**
+ * Fetch the value on top of the data stack in the current callstack frame
+ */
+static int _stack_top(vm_instance_t *instance, value_t *value)
+{
+    callstack_frame_t *frame = instance->callstack.current_frame;
+
+    if (frame->sp == frame->base)
+    {
+        return 1;
+    }
+
+    *value = frame->sp[-1];
+    return 0;
+}
+
+
+static int _check_result(vm_test_case_t *test, vm_instance_t *instance)
+{
+    value_t value;
+
+    if (_stack_top(instance, &value) != 0)
+    {
+        printf("no value left on the stack\n");
+        return 1;
+    }
+
+    if (test->expected_type != value.type)
+    {
+        printf("expected data type %d, got %d\n", test->expected_type,
+               value.type);
+        return 1;
+    }
+
+    switch (value.type)
+    {
+        case DATATYPE_INT:
+            if (test->expected_int != value.payload.int_value)
+            {
+                printf("expected %d, got %d\n", test->expected_int,
+                       value.payload.int_value);
+                return 1;
+            }
+            break;
+
+        case DATATYPE_FLOAT:
+            if (test->expected_float != value.payload.float_value)
+            {
+                printf("expected %f, got %f\n", test->expected_float,
+                       value.payload.float_value);
+                return 1;
+            }
+            break;
+
+        case DATATYPE_STRING:
+            if (strcmp(test->expected_str, VALUE_STRING(value)->bytes) != 0)
+            {
+                printf("expected '%s', got '%s'\n", test->expected_str,
+                       VALUE_STRING(value)->bytes);
+                return 1;
+            }
+            break;
+
+        default:
+            printf("unexpected data type %d\n", value.type);
+            return 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Compile a program ahead of time into a temporary shared object, and load it
+ * for VM_ENGINE_AOT. The shared object stays loaded after it is deleted.
+ */
+static int _load_aot(bytecode_t *program, vm_program_t *loaded)
+{
+    static size_t count = 0u;
+    char path[256];
+    vm_status_e err;
+
+    (void) snprintf(path, sizeof(path), "%s/vm_test_aot_%d_%zu.so", P_tmpdir,
+                    (int) getpid(), count++);
+
+    if ((err = aot_compile(program, path)) != VM_OK)
+    {
+        printf("aot_compile failed, status %d\n", err);
+        return 1;
+    }
+
+    err = aot_load(loaded, path);
+
+    (void) remove(path);
+    (void) strcat(path, ".c");
+    (void) remove(path);
+
+    if (VM_OK != err)
+    {
+        printf("aot_load failed, status %d\n", err);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static int _run_test_case(vm_test_case_t *test, int optimize, vm_engine_e engine)
+{
+    bytecode_t program;
+    vm_program_t loaded;
+    vm_instance_t instance;
+    vm_status_e err;
+    int ret = 0;
+
+    if (BYTECODE_OK != bytecode_create(&program))
+    {
+        printf("bytecode_create failed\n");
+        return 1;
+    }
+
+    test->build(&program);
+
+    if (optimize)
+    {
+        bytecode_optimizer_stats_t stats;
+        bytecode_status_e bytecode_err;
+
+        if ((bytecode_err = dead_code_eliminate(&program, NULL)) != BYTECODE_OK)
+        {
+            printf("dead_code_eliminate failed, status %d\n", bytecode_err);
+            return 1;
+        }
+
+        if ((bytecode_err = bytecode_optimize(&program, &stats)) != BYTECODE_OK)
+        {
+            printf("bytecode_optimize failed, status %d\n", bytecode_err);
+            return 1;
+        }
+
+        printf("optimized: %zu instructions before, %zu after, %zu superinstructions\n",
+               stats.instructions_before, stats.instructions_after,
+               stats.superinstructions);
+    }
+
+    if ((err = vm_verify(&program)) != VM_OK)
+    {
+        printf("vm_verify failed, status %d\n", err);
+        return 1;
+    }
+
+    if ((err = vm_load(&program, &loaded)) != VM_OK)
+    {
+        printf("vm_load failed, status %d\n", err);
+        return 1;
+    }
+
+    if ((VM_ENGINE_AOT == engine) && (_load_aot(&program, &loaded) != 0))
+    {
+        return 1;
+    }
+
+    if ((err = vm_create(&instance)) != VM_OK)
+    {
+        printf("vm_create failed, status %d\n", err);
+        return 1;
+    }
+
+    err = vm_execute(&instance, &loaded, engine);
+    if (test->expected_err != err)
+    {
+        printf("expected vm_execute status %d, got %d\n", test->expected_err, err);
+        ret = 1;
+    }
+    else if (VM_OK == err)
+    {
+        ret = _check_result(test, &instance);
+    }
+
+#ifdef VM_PROFILE
+    FILE *profile_fp = fopen(VM_PROFILE_OUTPUT, "a");
+    if (NULL != profile_fp)
+    {
+        (void) vm_profile_write(&instance, profile_fp);
+        (void) fclose(profile_fp);
+    }
+#endif /* VM_PROFILE */
+
+    if ((err = vm_destroy(&instance)) != VM_OK)
+    {
+        printf("vm_destroy failed, status %d\n", err);
+        ret = 1;
+    }
+
+    (void) vm_unload(&loaded);
+    (void) bytecode_destroy(&program);
+    return ret;
+}
+
+
+/**
+ * Run the "string ops" program twice, and check that every arithmetic and cast
+ * instruction misses its inline cache the first time and hits it the second time
+ */
+static int _test_inline_cache(void)
+{
+    bytecode_t program;
+    vm_program_t loaded;
+    vm_instance_t instance;
+    vm_inline_cache_stats_t stats;
+    int ret = 0;
+
+    if (BYTECODE_OK != bytecode_create(&program))
+    {
+        printf("bytecode_create failed\n");
+        return 1;
+    }
+
+    _build_string_ops(&program);
+
+    if ((VM_OK != vm_verify(&program)) || (VM_OK != vm_load(&program, &loaded)))
+    {
+        printf("failed to load program\n");
+        return 1;
+    }
+
+    if (VM_OK != vm_create(&instance))
+    {
+        printf("vm_create failed\n");
+        return 1;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (VM_OK != vm_execute(&instance, &loaded, VM_ENGINE_STACK))
+        {
+            printf("vm_execute failed\n");
+            ret = 1;
+        }
+    }
+
+    if (VM_OK != vm_inline_cache_stats(&loaded, &stats))
+    {
+        printf("vm_inline_cache_stats failed\n");
+        ret = 1;
+    }
+    else if ((3u != stats.sites) || (3u != stats.hits) || (3u != stats.misses))
+    {
+        printf("expected 3 sites, 3 hits, 3 misses, got %zu sites, %zu hits, %zu misses\n",
+               stats.sites, stats.hits, stats.misses);
+        ret = 1;
+    }
+
+    (void) vm_destroy(&instance);
+    (void) vm_unload(&loaded);
+    (void) bytecode_destroy(&program);
+    return ret;
+}
+
+
+/**
+ * Run the "string constant" and "string ops" programs three times each, and
+ * check that the result is the same every time, and that the string, constant
+ * and cast instructions were quickened after the first execution
+ */
+static int _test_quickening(void)
+{
+    // "string constant" and "string ops"
+    vm_test_case_t *tests[] = {_test_cases + 3, _test_cases + 6};
+    int ret = 0;
+
+    for (size_t i = 0u; i < (sizeof(tests) / sizeof(tests[0])); i++)
+    {
+        bytecode_t program;
+        vm_program_t loaded;
+        vm_instance_t instance;
+
+        if (BYTECODE_OK != bytecode_create(&program))
+        {
+            printf("bytecode_create failed\n");
+            return 1;
+        }
+
+        tests[i]->build(&program);
+
+        if ((VM_OK != vm_verify(&program)) || (VM_OK != vm_load(&program, &loaded)) ||
+            (VM_OK != vm_create(&instance)))
+        {
+            printf("failed to load program\n");
+            return 1;
+        }
+
+        for (int run = 0; run < 3; run++)
+        {
+            if (VM_OK != vm_execute(&instance, &loaded, VM_ENGINE_STACK))
+            {
+                printf("vm_execute failed on run %d\n", run);
+                ret = 1;
+            }
+            else
+            {
+                ret |= _check_result(tests[i], &instance);
+            }
+        }
+
+        for (size_t j = 0u; j < loaded.num_instructions; j++)
+        {
+            opcode_e opcode = loaded.instructions[j].opcode;
+
+            if ((OPCODE_STRING == opcode) || (OPCODE_LOAD_CONST == opcode) ||
+                (OPCODE_CAST == opcode))
+            {
+                printf("instruction %zu was not quickened\n", j);
+                ret = 1;
+            }
+        }
+
+        (void) vm_destroy(&instance);
+        (void) vm_unload(&loaded);
+        (void) bytecode_destroy(&program);
+    }
+
+    return ret;
+}
+
+
+#define COUNT_SUPERINSTRUCTION(op, handler, pops, pushes) + 1u
+
+
+/**
+ * Optimize every test program, and check that the number of superinstructions
+ * reported by the optimizer matches the number of loaded instructions with a
+ * superinstruction opcode. The results of the optimized programs are already
+ * checked by _run_test_case.
+ */
+static int _test_superinstructions(void)
+{
+    size_t total = 0u;
+    int ret = 0;
+
+    for (size_t i = 0u; i < NUM_TEST_CASES; i++)
+    {
+        bytecode_optimizer_stats_t stats;
+        bytecode_t program;
+        vm_program_t loaded;
+        size_t fused = 0u;
+
+        if (BYTECODE_OK != bytecode_create(&program))
+        {
+            printf("bytecode_create failed\n");
+            return 1;
+        }
+
+        _test_cases[i].build(&program);
+
+        if ((BYTECODE_OK != bytecode_optimize(&program, &stats)) ||
+            (VM_OK != vm_verify(&program)) || (VM_OK != vm_load(&program, &loaded)))
+        {
+            printf("failed to load program\n");
+            return 1;
+        }
+
+        for (size_t j = 0u; j < loaded.num_instructions; j++)
+        {
+            opcode_e opcode = (opcode_e) program.bytecode[loaded.instructions[j].offset];
+
+            if (bytecode_utils_base_opcode(opcode) != opcode)
+            {
+                fused += 1u;
+            }
+        }
+
+        printf("%s: %zu superinstructions\n", _test_cases[i].name, fused);
+
+        if (fused != stats.superinstructions)
+        {
+            printf("optimizer reported %zu superinstructions\n", stats.superinstructions);
+            ret = 1;
+        }
+
+        total += fused;
+
+        (void) vm_unload(&loaded);
+        (void) bytecode_destroy(&program);
+    }
+
+#ifndef VM_PROFILE
+    // Profiling builds never create superinstructions
+    if ((0u == total) && (0u < (0u SUPERINSTRUCTION_LIST(COUNT_SUPERINSTRUCTION))))
+    {
+        printf("no superinstructions were created\n");
+        ret = 1;
+    }
+#endif /* VM_PROFILE */
+
+    return ret;
+}
+
+
+/**
+ * Check that every test program can be translated to register instructions,
+ * and that immediate values and constants are folded into the instructions
+ * that use them, so there are fewer register instructions than stack ones
+ */
+static int _test_register_translation(void)
+{
+    size_t stack_total = 0u;
+    size_t register_total = 0u;
+    int ret = 0;
+
+    for (size_t i = 0u; i < NUM_TEST_CASES; i++)
+    {
+        bytecode_t program;
+        vm_program_t loaded;
+
+        if (BYTECODE_OK != bytecode_create(&program))
+        {
+            printf("bytecode_create failed\n");
+            return 1;
+        }
+
+        _test_cases[i].build(&program);
+
+        if ((VM_OK != vm_verify(&program)) || (VM_OK != vm_load(&program, &loaded)))
+        {
+            printf("failed to load program\n");
+            return 1;
+        }
+
+        if (NULL == loaded.registers.instructions)
+        {
+            printf("%s: not translated\n", _test_cases[i].name);
+            ret = 1;
+        }
+        else
+        {
+            printf("%s: %zu stack instructions, %zu register instructions, %u registers\n",
+                   _test_cases[i].name, loaded.num_instructions,
+                   loaded.registers.num_instructions, loaded.registers.num_registers);
+
+            stack_total += loaded.num_instructions;
+            register_total += loaded.registers.num_instructions;
+        }
+
+        (void) vm_unload(&loaded);
+        (void) bytecode_destroy(&program);
+    }
+
+    if (register_total >= stack_total)
+    {
+        printf("expected fewer register instructions than stack instructions\n");
+        ret = 1;
+    }
+
+    return ret;
+}
+
+
+/**
+ * Run every test program a few times more than VM_JIT_THRESHOLD with
+ * VM_ENGINE_JIT, and check that the result is the same every time, and that
+ * the program was compiled to native code (where the JIT is supported)
+ */
+static int _test_jit(void)
+{
+    int ret = 0;
+
+    for (size_t i = 0u; i < NUM_TEST_CASES; i++)
+    {
+        bytecode_t program;
+        vm_program_t loaded;
+        vm_instance_t instance;
+
+        if (BYTECODE_OK != bytecode_create(&program))
+        {
+            printf("bytecode_create failed\n");
+            return 1;
+        }
+
+        _test_cases[i].build(&program);
+
+        if ((VM_OK != vm_verify(&program)) || (VM_OK != vm_load(&program, &loaded)) ||
+            (VM_OK != vm_create(&instance)))
+        {
+            printf("failed to load program\n");
+            return 1;
+        }
+
+        for (unsigned run = 0u; run < (VM_JIT_THRESHOLD + 2u); run++)
+        {
+            vm_status_e err = vm_execute(&instance, &loaded, VM_ENGINE_JIT);
+
+            if (_test_cases[i].expected_err != err)
+            {
+                printf("%s: vm_execute returned %d on run %u\n", _test_cases[i].name, err, run);
+                ret = 1;
+            }
+            else if (VM_OK == err)
+            {
+                ret |= _check_result(_test_cases + i, &instance);
+            }
+        }
+
+#ifdef JIT_SUPPORTED
+        if (NULL == loaded.jit.code)
+        {
+            printf("%s: not compiled\n", _test_cases[i].name);
+            ret = 1;
+        }
+#endif /* JIT_SUPPORTED */
+
+        (void) vm_destroy(&instance);
+        (void) vm_unload(&loaded);
+        (void) bytecode_destroy(&program);
+    }
+
+    return ret;
+}
+
+
+/* Add 1 to a local for each of the numbers 0 to 49, and 2 for each of the
+ * numbers 50 to 99, so that the branch taken when a trace is recorded later
+ * goes the other way */
+static void _build_branch_changing_loop(bytecode_t *program)
+{
+    uint32_t done, other, join;
+
+    uint32_t loop = program->used_bytes;
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_int(program, 100);
+    (void) bytecode_emit_less(program);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &done);
+
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_int(program, 50);
+    (void) bytecode_emit_less(program);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &other);
+
+    (void) bytecode_emit_load_local(program, 1u);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, 1u);
+    (void) bytecode_emit_backpatched_jump(program, &join);
+
+    (void) bytecode_backpatch_jump(program, other, program->used_bytes - other);
+    (void) bytecode_emit_load_local(program, 1u);
+    (void) bytecode_emit_int(program, 2);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, 1u);
+
+    (void) bytecode_backpatch_jump(program, join, program->used_bytes - join);
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, 0u);
+    (void) bytecode_emit_jump(program, (int32_t) loop - (int32_t) program->used_bytes);
+
+    (void) bytecode_backpatch_jump(program, done, program->used_bytes - done);
+    (void) bytecode_emit_load_local(program, 1u);
+    (void) bytecode_emit_end(program);
+}
+
+
+/**
+ * Run loops with the trace JIT, and check that every loop was recorded and
+ * compiled, and that a loop whose branch goes the other way after recording
+ * leaves its trace at the guard and still gives the right result
+ */
+static int _test_trace_jit(void)
+{
+    static vm_test_case_t cases[] =
+    {
+        {"local loop", _build_local_loop, VM_OK, DATATYPE_INT, 4950, 0.0, NULL},
+        {"branch changing loop", _build_branch_changing_loop, VM_OK, DATATYPE_INT, 150, 0.0, NULL},
+    };
+    int ret = 0;
+
+    for (size_t i = 0u; i < (sizeof(cases) / sizeof(cases[0])); i++)
+    {
+        bytecode_t program;
+        vm_program_t loaded;
+        vm_instance_t instance;
+
+        if (BYTECODE_OK != bytecode_create(&program))
+        {
+            printf("bytecode_create failed\n");
+            return 1;
+        }
+
+        cases[i].build(&program);
+
+        if ((VM_OK != vm_verify(&program)) || (VM_OK != vm_load(&program, &loaded)) ||
+            (VM_OK != vm_create(&instance)))
+        {
+            printf("%s: failed to load program\n", cases[i].name);
+            return 1;
+        }
+
+        vm_status_e err = vm_execute(&instance, &loaded, VM_ENGINE_TRACE_JIT);
+        if (VM_OK != err)
+        {
+            printf("%s: vm_execute returned %d\n", cases[i].name, err);
+            ret = 1;
+        }
+        else
+        {
+            ret |= _check_result(cases + i, &instance);
+        }
+
+        printf("%s: %zu loops\n", cases[i].name, loaded.num_loops);
+        if (0u == loaded.num_loops)
+        {
+            printf("%s: no loops found\n", cases[i].name);
+            ret = 1;
+        }
+
+#ifdef JIT_SUPPORTED
+        for (size_t j = 0u; j < loaded.num_loops; j++)
+        {
+            if ((NULL == loaded.loops[j].entry) || (0u != loaded.loops[j].abandoned))
+            {
+                printf("%s: loop %zu was not traced\n", cases[i].name, j);
+                ret = 1;
+            }
+        }
+#endif /* JIT_SUPPORTED */
+
+        (void) vm_destroy(&instance);
+        (void) vm_unload(&loaded);
+        (void) bytecode_destroy(&program);
+    }
+
+    return ret;
+}
+
+
+static void _build_stack_underflow(bytecode_t *program)
+{
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_underflow_on_one_path(bytecode_t *program)
+{
+    uint32_t position;
+
+    // PRINT only has a value to pop if the jump is not taken
+    (void) bytecode_emit_bool(program, 0);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &position);
+    (void) bytecode_emit_int(program, 2);
+    (void) bytecode_backpatch_jump(program, position, program->used_bytes - position);
+    (void) bytecode_emit_print(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_jump_into_instruction(bytecode_t *program)
+{
+    // Lands on the operand of the jump itself
+    (void) bytecode_emit_jump(program, 2);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_constant_out_of_range(bytecode_t *program)
+{
+    (void) bytecode_emit_load_const(program, 0);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_growing_loop(bytecode_t *program)
+{
+    uint32_t position = program->used_bytes;
+
+    // Pushes another int on every iteration
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_jump(program, ((int32_t) position) - ((int32_t) program->used_bytes));
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_unproven_typed_operands(bytecode_t *program)
+{
+    (void) bytecode_emit_string(program, "a");
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_add_int_int(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_typed_operands_on_one_path(bytecode_t *program)
+{
+    uint32_t else_position;
+    uint32_t end_position;
+
+    (void) bytecode_emit_bool(program, 1);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &else_position);
+    (void) bytecode_emit_float(program, 2.5);
+    (void) bytecode_emit_backpatched_jump(program, &end_position);
+    (void) bytecode_backpatch_jump(program, else_position,
+                                   program->used_bytes - else_position);
+    (void) bytecode_emit_int(program, 2);
+    (void) bytecode_backpatch_jump(program, end_position,
+                                   program->used_bytes - end_position);
+    (void) bytecode_emit_int(program, 3);
+    (void) bytecode_emit_mult_int_int(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_proven_typed_operands(bytecode_t *program)
+{
+    (void) bytecode_emit_int(program, 2);
+    (void) bytecode_emit_int(program, 3);
+    (void) bytecode_emit_add_int_int(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+/**
+ * Check that vm_verify rejects programs with invalid jumps, constant pool
+ * indices, stack effects and operand types of specialised instructions, and
+ * that vm_load only uses the unchecked handlers for programs whose stack depth
+ * is bounded
+ */
+static int _test_verify(void)
+{
+    struct
+    {
+        const char *name;
+        build_program_t build;
+        vm_status_e expected_err;
+        uint8_t expected_unchecked;
+    } cases[] =
+    {
+        {"stack underflow", _build_stack_underflow, VM_INVALID_STACK, 0u},
+        {"underflow on one path", _build_underflow_on_one_path, VM_INVALID_STACK, 0u},
+        {"jump into instruction", _build_jump_into_instruction, VM_INVALID_JUMP, 0u},
+        {"constant out of range", _build_constant_out_of_range, VM_INVALID_CONSTANT, 0u},
+        {"growing loop", _build_growing_loop, VM_OK, 0u},
+        {"deep expression", _build_deep_expression, VM_OK, 1u},
+        {"mixed types at join", _build_mixed_types_at_join, VM_OK, 1u},
+        {"unproven typed operands", _build_unproven_typed_operands, VM_INVALID_TYPES, 0u},
+        {"typed operands on one path", _build_typed_operands_on_one_path, VM_INVALID_TYPES, 0u},
+        {"proven typed operands", _build_proven_typed_operands, VM_OK, 1u},
+    };
+
+    int ret = 0;
+
+    for (size_t i = 0u; i < (sizeof(cases) / sizeof(cases[0])); i++)
+    {
+        bytecode_t program;
+        vm_program_t loaded;
+        vm_status_e err;
+
+        if (BYTECODE_OK != bytecode_create(&program))
+        {
+            printf("bytecode_create failed\n");
+            return 1;
+        }
+
+        cases[i].build(&program);
+
+        if ((err = vm_verify(&program)) != cases[i].expected_err)
+        {
+            printf("%s: expected vm_verify status %d, got %d\n", cases[i].name,
+                   cases[i].expected_err, err);
+            ret = 1;
+        }
+        else if (VM_OK == err)
+        {
+            if ((err = vm_load(&program, &loaded)) != VM_OK)
+            {
+                printf("%s: vm_load failed, status %d\n", cases[i].name, err);
+                ret = 1;
+            }
+            else
+            {
+                if (cases[i].expected_unchecked != loaded.unchecked)
+                {
+                    printf("%s: expected unchecked %u, got %u\n", cases[i].name,
+                           cases[i].expected_unchecked, loaded.unchecked);
+                    ret = 1;
+                }
+
+                (void) vm_unload(&loaded);
+            }
+        }
+
+        (void) bytecode_destroy(&program);
+    }
+
+    return ret;
+}
+
+
+/**
+ * Build the graph for the "jump if false" program, check its blocks and the
+ * results of liveness and reaching definitions, then make the condition true
+ * and move the block that adds 5 to the end, and check that the linearised
+ * program gives the new result
+ */
+static int _test_cfg(void)
+{
+    bytecode_t program, output;
+    bytecode_cfg_t cfg;
+    cfg_dataflow_t liveness, reaching;
+    cfg_definition_t *definitions;
+    size_t num_definitions;
+    vm_program_t loaded;
+    vm_instance_t instance;
+    value_t value;
+    int ret = 0;
+
+    if (BYTECODE_OK != bytecode_create(&program))
+    {
+        printf("bytecode_create failed\n");
+        return 1;
+    }
+
+    _build_jump_if_false(&program);
+
+    if ((BYTECODE_OK != bytecode_cfg_build(&program, &cfg)) ||
+        (BYTECODE_OK != bytecode_cfg_stack_depths(&cfg)))
+    {
+        printf("failed to build graph\n");
+        return 1;
+    }
+
+    // INT BOOL JUMP_IF_FALSE | INT ADD | INT ADD END
+    printf("%zu blocks, max depth %u\n", cfg.num_blocks, cfg.max_depth);
+    if ((3u != cfg.num_blocks) || (2u != cfg.max_depth) ||
+        (2u != cfg.blocks[0].num_successors) || (2u != cfg.blocks[2].num_predecessors) ||
+        (1u != cfg.blocks[2].entry_depth))
+    {
+        printf("unexpected graph\n");
+        ret = 1;
+    }
+
+    if ((BYTECODE_OK != bytecode_cfg_liveness(&cfg, &liveness)) ||
+        (BYTECODE_OK != bytecode_cfg_reaching_definitions(&cfg, &reaching, &definitions,
+                                                          &num_definitions)))
+    {
+        printf("failed to analyse graph\n");
+        return 1;
+    }
+
+    // Only the bottom stack slot is live between blocks
+    cfg_word_t *live_out = CFG_BLOCK_SET(&liveness, liveness.out, 0u);
+    if (!CFG_BIT_TEST(live_out, 0u) || CFG_BIT_TEST(live_out, 1u))
+    {
+        printf("unexpected liveness\n");
+        ret = 1;
+    }
+
+    // Slot 0 is written by "INT 10" or by the first ADD, on the way to the last block
+    size_t reaching_slot0 = 0u;
+    for (size_t i = 0u; i < num_definitions; i++)
+    {
+        if (CFG_BIT_TEST(CFG_BLOCK_SET(&reaching, reaching.in, 2u), i))
+        {
+            reaching_slot0 += (0u == definitions[i].slot);
+        }
+    }
+
+    printf("%zu definitions, %zu reach the last block\n", num_definitions, reaching_slot0);
+    if ((6u != num_definitions) || (2u != reaching_slot0))
+    {
+        printf("unexpected reaching definitions\n");
+        ret = 1;
+    }
+
+    memory_manager_free(definitions);
+    bytecode_cfg_dataflow_destroy(&liveness);
+    bytecode_cfg_dataflow_destroy(&reaching);
+
+    cfg.blocks[0].instructions[1].operand.immediate.bool_value = 1u;
+    cfg.layout[1] = 2u;
+    cfg.layout[2] = 1u;
+
+    if (BYTECODE_OK != bytecode_cfg_linearise(&cfg, &output))
+    {
+        printf("failed to linearise graph\n");
+        return 1;
+    }
+
+    bytecode_cfg_destroy(&cfg);
+    (void) bytecode_destroy(&program);
+
+    if ((VM_OK != vm_verify(&output)) || (VM_OK != vm_load(&output, &loaded)) ||
+        (VM_OK != vm_create(&instance)))
+    {
+        printf("failed to load linearised program\n");
+        return 1;
+    }
+
+    if ((VM_OK != vm_execute(&instance, &loaded, VM_ENGINE_STACK)) ||
+        (0 != _stack_top(&instance, &value)) || (DATATYPE_INT != value.type) ||
+        (16 != value.payload.int_value))
+    {
+        printf("linearised program gave the wrong result\n");
+        ret = 1;
+    }
+
+    (void) vm_destroy(&instance);
+    (void) vm_unload(&loaded);
+    (void) bytecode_destroy(&output);
+    return ret;
+}
+
+
+static void _build_dead_branches(bytecode_t *program)
+{
+    vm_int_t unused = 7;
+    vm_int_t used = 3;
+    uint32_t skip, dead, chain;
+
+    (void) bytecode_emit_define_const(program, DATATYPE_INT, &unused);
+    (void) bytecode_emit_define_const(program, DATATYPE_INT, &used);
+    (void) bytecode_emit_bool(program, 0);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &skip);
+    (void) bytecode_emit_int(program, 100);
+    (void) bytecode_emit_backpatched_jump(program, &dead);
+    (void) bytecode_backpatch_jump(program, skip, program->used_bytes - skip);
+    (void) bytecode_emit_backpatched_jump(program, &chain);
+    (void) bytecode_backpatch_jump(program, dead, program->used_bytes - dead);
+    (void) bytecode_emit_int(program, 5);
+    (void) bytecode_emit_print(program);
+    (void) bytecode_backpatch_jump(program, chain, program->used_bytes - chain);
+    (void) bytecode_emit_load_const(program, 1);
+    (void) bytecode_emit_end(program);
+}
+
+
+/**
+ * Check that a branch on a literal is folded, the jump chain it leads to is
+ * threaded, the blocks left unreachable are removed along with the constant
+ * that only they used, and that the program gives the same result afterwards.
+ * Every test program is also run through dead_code_eliminate by _run_test_case.
+ */
+static int _test_dead_code(void)
+{
+    dead_code_stats_t stats;
+    bytecode_t program;
+    vm_program_t loaded;
+    vm_instance_t instance;
+    value_t value;
+    bytecode_status_e err;
+    int ret = 0;
+
+    if (BYTECODE_OK != bytecode_create(&program))
+    {
+        printf("bytecode_create failed\n");
+        return 1;
+    }
+
+    _build_dead_branches(&program);
+    size_t size_before = program.used_bytes;
+
+    if ((err = dead_code_eliminate(&program, &stats)) != BYTECODE_OK)
+    {
+        printf("dead_code_eliminate failed, status %d\n", err);
+        return 1;
+    }
+
+    printf("%zu bytes before, %zu after; %zu branches folded, %zu jumps threaded, "
+           "%zu blocks removed, %zu constants removed\n", size_before, program.used_bytes,
+           stats.branches_folded, stats.jumps_threaded, stats.blocks_removed,
+           stats.constants_removed);
+
+    if ((1u != stats.branches_folded) || (1u > stats.jumps_threaded) ||
+        (3u != stats.blocks_removed) || (1u != stats.constants_removed))
+    {
+        printf("unexpected statistics\n");
+        ret = 1;
+    }
+
+    if ((VM_OK != vm_verify(&program)) || (VM_OK != vm_load(&program, &loaded)) ||
+        (VM_OK != vm_create(&instance)))
+    {
+        printf("failed to load program\n");
+        return 1;
+    }
+
+    // DEFINE_CONST, LOAD_CONST and END are all that is left
+    if (3u != loaded.num_instructions)
+    {
+        printf("expected 3 instructions, got %zu\n", loaded.num_instructions);
+        ret = 1;
+    }
+
+    if ((VM_OK != vm_execute(&instance, &loaded, VM_ENGINE_STACK)) ||
+        (0 != _stack_top(&instance, &value)) || (DATATYPE_INT != value.type) ||
+        (3 != value.payload.int_value))
+    {
+        printf("program gave the wrong result\n");
+        ret = 1;
+    }
+
+    (void) vm_destroy(&instance);
+    (void) vm_unload(&loaded);
+    (void) bytecode_destroy(&program);
+    return ret;
+}
+
+
+/**
+ * Lay out the "mixed types at join" program for a profile in which its branch
+ * always jumped, and check that the branch is inverted, the block it jumped
+ * over is moved to the end, and the program still gives the same result. The
+ * profile is read from a file, along with a line for another program that
+ * must be skipped. Builds with VM_BRANCH_PROFILE also check the counts
+ * recorded by running the program.
+ */
+/* Defines constant 0 on both sides of a branch; the jump is always taken */
+static void _build_constants_in_branches(bytecode_t *program)
+{
+    vm_int_t first = 111;
+    vm_int_t second = 222;
+    uint32_t taken, join;
+
+    (void) bytecode_emit_int(program, 0);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &taken);
+    (void) bytecode_emit_define_const(program, DATATYPE_INT, &first);
+    (void) bytecode_emit_backpatched_jump(program, &join);
+    (void) bytecode_backpatch_jump(program, taken, program->used_bytes - taken);
+    (void) bytecode_emit_define_const(program, DATATYPE_INT, &second);
+    (void) bytecode_backpatch_jump(program, join, program->used_bytes - join);
+    (void) bytecode_emit_load_const(program, 0u);
+    (void) bytecode_emit_end(program);
+}
+
+
+/**
+ * Lay out a program whose cold block defines the first constant, and check
+ * that the constants keep their numbers
+ */
+static int _test_layout_constants(void)
+{
+    block_layout_profile_t profile;
+    bytecode_instruction_t decoded;
+    bytecode_t program;
+    vm_program_t loaded;
+    vm_instance_t instance;
+    value_t value;
+    int ret = 0;
+
+    if (BYTECODE_OK != bytecode_create(&program))
+    {
+        printf("bytecode_create failed\n");
+        return 1;
+    }
+
+    _build_constants_in_branches(&program);
+
+    uint32_t branch_offset = 0u;
+    for (size_t offset = 0u; offset < program.used_bytes; offset += decoded.size)
+    {
+        (void) bytecode_utils_decode_instruction(&program, offset, &decoded);
+        if (bytecode_utils_is_conditional_jump(decoded.opcode))
+        {
+            branch_offset = decoded.offset;
+        }
+    }
+
+    FILE *fp = tmpfile();
+    if (NULL == fp)
+    {
+        printf("failed to create profile\n");
+        return 1;
+    }
+
+    uint32_t hash = fnv_1a_32_hash(program.bytecode, program.used_bytes);
+    fprintf(fp, "%08" PRIx32 " %" PRIu32 " 5 0\n", hash, branch_offset);
+    rewind(fp);
+
+    if ((BYTECODE_OK != block_layout_read_profile(&program, fp, &profile)) ||
+        (BYTECODE_OK != block_layout_apply(&program, &profile, NULL)))
+    {
+        printf("failed to lay out program\n");
+        ret = 1;
+    }
+
+    (void) fclose(fp);
+    block_layout_destroy_profile(&profile);
+
+    if ((VM_OK != vm_verify(&program)) || (VM_OK != vm_load(&program, &loaded)) ||
+        (VM_OK != vm_create(&instance)))
+    {
+        printf("failed to load program\n");
+        return 1;
+    }
+
+    if ((VM_OK != vm_execute(&instance, &loaded, VM_ENGINE_STACK)) ||
+        (0 != _stack_top(&instance, &value)) || (DATATYPE_INT != value.type) ||
+        (111 != value.payload.int_value))
+    {
+        printf("constants were renumbered by the layout\n");
+        ret = 1;
+    }
+
+    (void) vm_destroy(&instance);
+    (void) vm_unload(&loaded);
+    (void) bytecode_destroy(&program);
+    return ret;
+}
+
+
+static int _test_block_layout(void)
+{
+    block_layout_profile_t profile;
+    block_layout_stats_t stats;
+    bytecode_instruction_t decoded;
+    bytecode_t program;
+    vm_program_t loaded;
+    vm_instance_t instance;
+    value_t value;
+    bytecode_status_e err;
+    int ret = 0;
+
+    if (BYTECODE_OK != bytecode_create(&program))
+    {
+        printf("bytecode_create failed\n");
+        return 1;
+    }
+
+    _build_mixed_types_at_join(&program);
+
+    uint32_t branch_offset = 0u;
+    for (size_t offset = 0u; offset < program.used_bytes; offset += decoded.size)
+    {
+        (void) bytecode_utils_decode_instruction(&program, offset, &decoded);
+        if (bytecode_utils_is_conditional_jump(decoded.opcode))
+        {
+            branch_offset = decoded.offset;
+        }
+    }
+
+#ifdef VM_BRANCH_PROFILE
+    if ((VM_OK != vm_load(&program, &loaded)) || (VM_OK != vm_create(&instance)) ||
+        (VM_OK != vm_execute(&instance, &loaded, VM_ENGINE_STACK)))
+    {
+        printf("failed to run program\n");
+        return 1;
+    }
+
+    // The condition is true, so the jump is never taken
+    if ((1u != loaded.num_branches) || (0u != loaded.branches[0].taken) ||
+        (1u != loaded.branches[0].not_taken))
+    {
+        printf("unexpected branch counts\n");
+        ret = 1;
+    }
+
+    (void) vm_destroy(&instance);
+    (void) vm_unload(&loaded);
+#endif /* VM_BRANCH_PROFILE */
+
+    FILE *fp = tmpfile();
+    if (NULL == fp)
+    {
+        printf("failed to create profile\n");
+        return 1;
+    }
+
+    uint32_t hash = fnv_1a_32_hash(program.bytecode, program.used_bytes);
+    fprintf(fp, "%08" PRIx32 " %" PRIu32 " 600 0\n", hash, branch_offset);
+    fprintf(fp, "%08" PRIx32 " %" PRIu32 " 0 1000\n", hash + 1u, branch_offset);
+    fprintf(fp, "%08" PRIx32 " %" PRIu32 " 300 0\n", hash, branch_offset);
+    rewind(fp);
+
+    err = block_layout_read_profile(&program, fp, &profile);
+    (void) fclose(fp);
+
+    if ((BYTECODE_OK != err) || (1u != profile.num_branches) ||
+        (900u != profile.branches[0].taken) || (0u != profile.branches[0].not_taken))
+    {
+        printf("unexpected profile\n");
+        return 1;
+    }
+
+    if ((err = block_layout_apply(&program, &profile, &stats)) != BYTECODE_OK)
+    {
+        printf("block_layout_apply failed, status %d\n", err);
+        return 1;
+    }
+
+    block_layout_destroy_profile(&profile);
+
+    printf("%zu branches profiled, %zu inverted, %zu cold blocks\n", stats.branches_profiled,
+           stats.branches_inverted, stats.cold_blocks);
+
+    if ((1u != stats.branches_profiled) || (1u != stats.branches_inverted) ||
+        (1u != stats.cold_blocks))
+    {
+        printf("unexpected statistics\n");
+        ret = 1;
+    }
+
+    if ((VM_OK != vm_verify(&program)) || (VM_OK != vm_load(&program, &loaded)) ||
+        (VM_OK != vm_create(&instance)))
+    {
+        printf("failed to load program\n");
+        return 1;
+    }
+
+    // BOOL JUMP_IF_TRUE | INT | INT MULT END | FLOAT JUMP, and the END added after it
+    if ((9u != loaded.num_instructions) || (OPCODE_JUMP_IF_TRUE != loaded.instructions[1].opcode) ||
+        (OPCODE_FLOAT != loaded.instructions[6].opcode))
+    {
+        printf("unexpected layout\n");
+        ret = 1;
+    }
+
+    if ((VM_OK != vm_execute(&instance, &loaded, VM_ENGINE_STACK)) ||
+        (0 != _stack_top(&instance, &value)) || (DATATYPE_FLOAT != value.type) ||
+        (7.5 != value.payload.float_value))
+    {
+        printf("program gave the wrong result\n");
+        ret = 1;
+    }
+
+    (void) vm_destroy(&instance);
+    (void) vm_unload(&loaded);
+    (void) bytecode_destroy(&program);
+
+    ret |= _test_layout_constants();
+    return ret;
+}
+
+
+/**
+ * Check that the optimizer fuses each comparison followed by a conditional
+ * jump into a single compare-and-branch, that type inference specialises the
+ * one whose operands are ints, and that every conditional jump can be inverted
+ */
+static int _test_compare_jumps(void)
+{
+    bytecode_t program;
+    vm_program_t loaded;
+    bytecode_status_e err;
+    size_t fused = 0u;
+    size_t specialised = 0u;
+    int ret = 0;
+
+    for (int opcode = 0; opcode < NUM_OPCODES; opcode++)
+    {
+        if (bytecode_utils_is_conditional_jump((opcode_e) opcode) &&
+            (opcode != bytecode_utils_invert_jump(bytecode_utils_invert_jump((opcode_e) opcode))))
+        {
+            printf("opcode %d can't be inverted\n", opcode);
+            ret = 1;
+        }
+    }
+
+    if (BYTECODE_OK != bytecode_create(&program))
+    {
+        printf("bytecode_create failed\n");
+        return 1;
+    }
+
+    _build_comparisons(&program);
+
+    if ((err = bytecode_optimize(&program, NULL)) != BYTECODE_OK)
+    {
+        printf("bytecode_optimize failed, status %d\n", err);
+        return 1;
+    }
+
+    if ((VM_OK != vm_verify(&program)) || (VM_OK != vm_load(&program, &loaded)))
+    {
+        printf("failed to load program\n");
+        return 1;
+    }
+
+    for (size_t i = 0u; i < loaded.num_instructions; i++)
+    {
+        opcode_e opcode = loaded.instructions[i].opcode;
+
+        if ((OPCODE_EQUAL <= opcode) && (OPCODE_GREATER_EQUAL >= opcode))
+        {
+            printf("instruction %zu was not fused\n", i);
+            ret = 1;
+        }
+
+        fused += bytecode_utils_is_compare_jump(opcode) ? 1u : 0u;
+        specialised += (OPCODE_JUMP_IF_GREATER_EQUAL_INT == opcode) ? 1u : 0u;
+    }
+
+    // Comparisons of literal numbers are folded instead
+    printf("%zu compare-and-branch instructions, %zu specialised\n", fused, specialised);
+    if ((4u != fused) || (1u != specialised))
+    {
+        printf("unexpected compare-and-branch instructions\n");
+        ret = 1;
+    }
+
+    (void) vm_unload(&loaded);
+    (void) bytecode_destroy(&program);
+    return ret;
+}
+
+
+/**
+ * Check that names resolve to the same slot every time they are seen, and
+ * that type inference specialises a loop over int locals
+ */
+static int _test_locals(void)
+{
+    bytecode_t program;
+    vm_program_t loaded;
+    scope_t scope;
+    uint16_t slots[3];
+    size_t specialised = 0u;
+    int ret = 0;
+
+    if (BYTECODE_OK != scope_create(&scope))
+    {
+        printf("scope_create failed\n");
+        return 1;
+    }
+
+    (void) scope_resolve(&scope, "x", 1u, &slots[0]);
+    (void) scope_resolve(&scope, "xy", 2u, &slots[1]);
+    (void) scope_resolve(&scope, "x", 1u, &slots[2]);
+
+    printf("slots %u, %u, %u\n", slots[0], slots[1], slots[2]);
+    if ((0u != slots[0]) || (1u != slots[1]) || (0u != slots[2]) || (2u != scope.num_slots))
+    {
+        printf("unexpected slots\n");
+        ret = 1;
+    }
+
+    (void) scope_destroy(&scope);
+
+    if (BYTECODE_OK != bytecode_create(&program))
+    {
+        printf("bytecode_create failed\n");
+        return 1;
+    }
+
+    _build_local_loop(&program);
+
+    if ((BYTECODE_OK != bytecode_optimize(&program, NULL)) ||
+        (VM_OK != vm_verify(&program)) || (VM_OK != vm_load(&program, &loaded)))
+    {
+        printf("failed to load program\n");
+        return 1;
+    }
+
+    for (size_t i = 0u; i < loaded.num_instructions; i++)
+    {
+        opcode_e opcode = bytecode_utils_base_opcode(loaded.instructions[i].opcode);
+
+        specialised += ((OPCODE_ADD_INT_INT == opcode) ||
+                        (OPCODE_JUMP_IF_GREATER_EQUAL_INT == opcode)) ? 1u : 0u;
+    }
+
+    printf("%" PRIu32 " locals, %zu specialised instructions\n", loaded.num_locals, specialised);
+    if ((2u != loaded.num_locals) || (3u != specialised))
+    {
+        printf("unexpected locals or specialisation\n");
+        ret = 1;
+    }
+
+    (void) vm_unload(&loaded);
+    (void) bytecode_destroy(&program);
+    return ret;
+}
+
+
+/* Total inline cache misses of every LOAD_GLOBAL and STORE_GLOBAL instruction */
+static size_t _global_misses(vm_program_t *loaded)
+{
+    size_t misses = 0u;
+
+    for (size_t i = 0u; i < loaded->num_instructions; i++)
+    {
+        opcode_e opcode = loaded->instructions[i].opcode;
+
+        if ((OPCODE_LOAD_GLOBAL == opcode) || (OPCODE_STORE_GLOBAL == opcode))
+        {
+            misses += loaded->instructions[i].cache->misses;
+        }
+    }
+
+    return misses;
+}
+
+
+/**
+ * Run the "global loop" program repeatedly in the same instance, and check that
+ * the globals table version only changes when a global is added or deleted,
+ * that global accesses stop missing their inline caches once the table stops
+ * changing, and that deleting a global invalidates the cached addresses
+ */
+static int _test_globals(void)
+{
+    bytecode_t program;
+    vm_program_t loaded;
+    vm_instance_t instance;
+    byte_string_t *name;
+    value_t *slot;
+    size_t misses[3];
+    int ret = 0;
+
+    if (BYTECODE_OK != bytecode_create(&program))
+    {
+        printf("bytecode_create failed\n");
+        return 1;
+    }
+
+    _build_global_loop(&program);
+
+    if ((VM_OK != vm_verify(&program)) || (VM_OK != vm_load(&program, &loaded)) ||
+        (VM_OK != vm_create(&instance)))
+    {
+        printf("failed to load program\n");
+        return 1;
+    }
+
+    for (int run = 0; run < 3; run++)
+    {
+        uint64_t version = instance.globals.version;
+
+        if (VM_OK != vm_execute(&instance, &loaded, VM_ENGINE_STACK))
+        {
+            printf("vm_execute failed\n");
+            ret = 1;
+        }
+
+        misses[run] = _global_misses(&loaded);
+        printf("run %d: %zu globals, %zu misses, version %s\n", run, instance.globals.count,
+               misses[run], (version == instance.globals.version) ? "unchanged" : "changed");
+
+        // Only the first run adds globals
+        if ((2u != instance.globals.count) ||
+            ((0 == run) == (version == instance.globals.version)))
+        {
+            printf("unexpected globals table\n");
+            ret = 1;
+        }
+
+    }
+
+    /* The first store of "i" was cached before "sum" was added, so it misses
+     * once more on the second run; nothing misses on the third */
+    if (misses[2] != misses[1])
+    {
+        printf("global accesses missed in steady state\n");
+        ret = 1;
+    }
+
+    // Deleting a global must make every cached address out of date
+    uint64_t before = instance.globals.version;
+
+    (void) string_cache_add("sum", 3u, &name);
+    if ((GLOBALS_OK != globals_delete(&instance.globals, name)) ||
+        (GLOBALS_NO_NAME != globals_lookup(&instance.globals, name, &slot)) ||
+        (before == instance.globals.version))
+    {
+        printf("globals_delete failed\n");
+        ret = 1;
+    }
+
+    if ((VM_OK != vm_execute(&instance, &loaded, VM_ENGINE_STACK)) ||
+        (_global_misses(&loaded) <= misses[2]))
+    {
+        printf("deleting a global didn't invalidate cached addresses\n");
+        ret = 1;
+    }
+
+    value_t result;
+    if ((0 != _stack_top(&instance, &result)) || (4950 != result.payload.int_value))
+    {
+        printf("wrong result\n");
+        ret = 1;
+    }
+
+    (void) vm_destroy(&instance);
+    (void) vm_unload(&loaded);
+    (void) bytecode_destroy(&program);
+    return ret;
+}
+
+
+/* Add up the numbers 1 to 100 with a recursive function, and subtract 8 from
+ * 50 with a function of two arguments. Both functions come after the main
+ * program, and are followed by the END that every program finishes with */
+static void _build_calls(bytecode_t *program)
+{
+    uint32_t call_sum, call_sub, position;
+
+    (void) bytecode_emit_int(program, 100);
+    (void) bytecode_emit_backpatched_call(program, 1u, &call_sum);
+    (void) bytecode_emit_int(program, 50);
+    (void) bytecode_emit_int(program, 8);
+    (void) bytecode_emit_backpatched_call(program, 2u, &call_sub);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_end(program);
+
+    // sum(n): n + sum(n - 1), or 0 if n is 0
+    uint32_t sum = program->used_bytes;
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_int(program, 0);
+    (void) bytecode_emit_equal(program);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &position);
+    (void) bytecode_emit_int(program, 0);
+    (void) bytecode_emit_return(program);
+    (void) bytecode_backpatch_jump(program, position, program->used_bytes - position);
+
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_sub(program);
+    (void) bytecode_emit_call(program, (int32_t) sum - (int32_t) program->used_bytes, 1u);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_return(program);
+
+    // sub(a, b): a - b
+    uint32_t sub = program->used_bytes;
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_load_local(program, 1u);
+    (void) bytecode_emit_sub(program);
+    (void) bytecode_emit_return(program);
+    (void) bytecode_emit_end(program);
+
+    (void) bytecode_backpatch_jump(program, call_sum, sum - call_sum);
+    (void) bytecode_backpatch_jump(program, call_sub, sub - call_sub);
+}
+
+
+/* Pass a string that nothing else refers to, and return a new one made from it */
+static void _build_string_call(bytecode_t *program)
+{
+    uint32_t position;
+
+    (void) bytecode_emit_string(program, "a");
+    (void) bytecode_emit_string(program, "b");
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_backpatched_call(program, 1u, &position);
+    (void) bytecode_emit_end(program);
+
+    (void) bytecode_backpatch_jump(program, position, program->used_bytes - position);
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_return(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+/* h(): return g(f()), where f() returns 3 and g(x) returns x * 2. The optimizer
+ * turns the call to g into a tail call, which f returns to */
+static void _build_return_call_of_call(bytecode_t *program)
+{
+    uint32_t call_h, call_f, call_g;
+
+    (void) bytecode_emit_backpatched_call(program, 0u, &call_h);
+    (void) bytecode_emit_end(program);
+
+    uint32_t h = program->used_bytes;
+    (void) bytecode_emit_backpatched_call(program, 0u, &call_f);
+    (void) bytecode_emit_backpatched_call(program, 1u, &call_g);
+    (void) bytecode_emit_return(program);
+
+    uint32_t f = program->used_bytes;
+    (void) bytecode_emit_int(program, 3);
+    (void) bytecode_emit_return(program);
+
+    uint32_t g = program->used_bytes;
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_int(program, 2);
+    (void) bytecode_emit_mult(program);
+    (void) bytecode_emit_return(program);
+    (void) bytecode_emit_end(program);
+
+    (void) bytecode_backpatch_jump(program, call_h, h - call_h);
+    (void) bytecode_backpatch_jump(program, call_f, f - call_f);
+    (void) bytecode_backpatch_jump(program, call_g, g - call_g);
+}
+
+
+/* Call a function that overwrites a global, while the caller has a copy of
+ * the string it held on the stack and passes another copy as an argument.
+ * The caller creates another string before using its copy, which would take
+ * the place of the old string if it had been freed. */
+static void _build_call_overwrites_global(bytecode_t *program)
+{
+    uint32_t call;
+
+    (void) bytecode_emit_define_const(program, DATATYPE_STRING, "g");
+    (void) bytecode_emit_string(program, "q");
+    (void) bytecode_emit_store_local(program, 0u);
+    (void) bytecode_emit_string(program, "aaaa");
+    (void) bytecode_emit_store_global(program, 0u);
+    (void) bytecode_emit_load_global(program, 0u);
+    (void) bytecode_emit_string(program, "bbbb");
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_global(program, 0u);
+
+    (void) bytecode_emit_load_global(program, 0u);
+    (void) bytecode_emit_load_global(program, 0u);
+    (void) bytecode_emit_backpatched_call(program, 1u, &call);
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_end(program);
+
+    // f(x): g = "zz", then x + g
+    uint32_t f = program->used_bytes;
+    (void) bytecode_emit_string(program, "zz");
+    (void) bytecode_emit_store_global(program, 0u);
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_load_global(program, 0u);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_return(program);
+    (void) bytecode_emit_end(program);
+
+    (void) bytecode_backpatch_jump(program, call, f - call);
+}
+
+
+/* The optimizer turns the call into a tail call, which must still fail once
+ * the function returns */
+static void _build_tail_call_outside_function(bytecode_t *program)
+{
+    uint32_t position;
+
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_backpatched_call(program, 1u, &position);
+    (void) bytecode_emit_return(program);
+    (void) bytecode_emit_end(program);
+
+    (void) bytecode_backpatch_jump(program, position, program->used_bytes - position);
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_return(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+static void _build_return_outside_function(bytecode_t *program)
+{
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_return(program);
+    (void) bytecode_emit_end(program);
+}
+
+
+/**
+ * Run programs that call functions on every engine that supports them, as
+ * emitted and after optimizing, and check that running them again in the same
+ * instance doesn't grow the saved frames or the value stack
+ */
+static int _test_calls(void)
+{
+    static vm_test_case_t cases[] =
+    {
+        {"calls", _build_calls, VM_OK, DATATYPE_INT, 5092, 0.0, NULL},
+        {"string call", _build_string_call, VM_OK, DATATYPE_STRING, 0, 0.0, "abab"},
+        {"return call of call", _build_return_call_of_call, VM_OK, DATATYPE_INT, 6, 0.0, NULL},
+        {"call overwrites global", _build_call_overwrites_global, VM_OK, DATATYPE_STRING, 0, 0.0,
+         "aaaabbbbaaaabbbbzzqq"},
+        {"return outside function", _build_return_outside_function, VM_RUNTIME_ERROR,
+         DATATYPE_INT, 0, 0.0, NULL},
+        {"tail call outside function", _build_tail_call_outside_function, VM_RUNTIME_ERROR,
+         DATATYPE_INT, 0, 0.0, NULL},
+    };
+    static const vm_engine_e engines[] =
+    {
+        VM_ENGINE_STACK, VM_ENGINE_TOS_CACHE, VM_ENGINE_JIT, VM_ENGINE_TRACE_JIT
+    };
+    int ret = 0;
+
+    for (size_t i = 0u; i < (sizeof(cases) / sizeof(cases[0])); i++)
+    {
+        for (int run = 0; run < (int) (2u * (sizeof(engines) / sizeof(engines[0]))); run++)
+        {
+            vm_engine_e engine = engines[run / 2];
+            bytecode_t program;
+            vm_program_t loaded;
+            vm_instance_t instance;
+
+            if (BYTECODE_OK != bytecode_create(&program))
+            {
+                printf("bytecode_create failed\n");
+                return 1;
+            }
+
+            cases[i].build(&program);
+
+            if ((run & 1) && ((BYTECODE_OK != dead_code_eliminate(&program, NULL)) ||
+                              (BYTECODE_OK != bytecode_optimize(&program, NULL))))
+            {
+                printf("%s: failed to optimize\n", cases[i].name);
+                return 1;
+            }
+
+            if ((VM_OK != vm_verify(&program)) || (VM_OK != vm_load(&program, &loaded)) ||
+                (VM_OK != vm_create(&instance)))
+            {
+                printf("%s: failed to load program\n", cases[i].name);
+                return 1;
+            }
+
+            size_t capacity = 0u;
+            value_t *stack = NULL;
+
+            for (unsigned execution = 0u; execution < (VM_JIT_THRESHOLD + 3u); execution++)
+            {
+                vm_status_e err = vm_execute(&instance, &loaded, engine);
+
+                if (cases[i].expected_err != err)
+                {
+                    printf("%s (%s): vm_execute returned %d\n", cases[i].name,
+                           _engine_names[engine], err);
+                    ret = 1;
+                    break;
+                }
+
+                if (VM_OK == err)
+                {
+                    ret |= _check_result(cases + i, &instance);
+                }
+
+                // The first run sizes the value stack and saved frames for the rest
+                if ((0u < execution) && ((capacity != instance.callstack.capacity) ||
+                                         (stack != instance.callstack.stack)))
+                {
+                    printf("%s (%s): call frames were allocated in steady state\n",
+                           cases[i].name, _engine_names[engine]);
+                    ret = 1;
+                }
+
+                capacity = instance.callstack.capacity;
+                stack = instance.callstack.stack;
+            }
+
+            printf("%s (%s, %s): %zu saved frames\n", cases[i].name, _engine_names[engine],
+                   (run & 1) ? "optimized" : "unoptimized", capacity);
+
+            if ((0u != instance.callstack.depth) && (VM_OK == cases[i].expected_err))
+            {
+                printf("frames left on the callstack\n");
+                ret = 1;
+            }
+
+            // Functions have frames of their own, which registers don't model
+            if ((0 == i) && (0 == run) &&
+                (VM_UNSUPPORTED != vm_execute(&instance, &loaded, VM_ENGINE_REGISTER)))
+            {
+                printf("register engine ran a program with calls\n");
+                ret = 1;
+            }
+
+            (void) vm_destroy(&instance);
+            (void) vm_unload(&loaded);
+            (void) bytecode_destroy(&program);
+        }
+    }
+
+    return ret;
+}
+
+
+/* Deep enough to need many saved frames without tail calls */
+#define TAIL_CALL_DEPTH (100000)
+
+
+/* count(n, total): total if n is 0, otherwise count(n - 1, total + 2), with
+ * the recursive call emitted as CALL followed by RETURN */
+static void _build_tail_recursion(bytecode_t *program)
+{
+    uint32_t call, position;
+
+    (void) bytecode_emit_int(program, TAIL_CALL_DEPTH);
+    (void) bytecode_emit_int(program, 0);
+    (void) bytecode_emit_backpatched_call(program, 2u, &call);
+    (void) bytecode_emit_end(program);
+
+    uint32_t count = program->used_bytes;
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_int(program, 0);
+    (void) bytecode_emit_equal(program);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &position);
+    (void) bytecode_emit_load_local(program, 1u);
+    (void) bytecode_emit_return(program);
+    (void) bytecode_backpatch_jump(program, position, program->used_bytes - position);
+
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_sub(program);
+    (void) bytecode_emit_load_local(program, 1u);
+    (void) bytecode_emit_int(program, 2);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_call(program, (int32_t) count - (int32_t) program->used_bytes, 2u);
+    (void) bytecode_emit_return(program);
+    (void) bytecode_emit_end(program);
+
+    (void) bytecode_backpatch_jump(program, call, count - call);
+}
+
+
+/**
+ * Run a deeply recursive function as emitted, and after the optimizer has
+ * turned its recursive call into a tail call, and check that the tail calls
+ * don't save any frames beyond the one for the first call
+ */
+static int _test_tail_calls(void)
+{
+    static const vm_engine_e engines[] =
+    {
+        VM_ENGINE_STACK, VM_ENGINE_TOS_CACHE, VM_ENGINE_JIT, VM_ENGINE_TRACE_JIT
+    };
+    vm_test_case_t test = {"tail recursion", _build_tail_recursion, VM_OK, DATATYPE_INT,
+                           2 * TAIL_CALL_DEPTH, 0.0, NULL};
+    int ret = 0;
+
+    for (int run = 0; run < (int) (2u * (sizeof(engines) / sizeof(engines[0]))); run++)
+    {
+        vm_engine_e engine = engines[run / 2];
+        int optimize = run & 1;
+        bytecode_t program;
+        vm_program_t loaded;
+        vm_instance_t instance;
+        size_t tail_calls = 0u;
+
+        if (BYTECODE_OK != bytecode_create(&program))
+        {
+            printf("bytecode_create failed\n");
+            return 1;
+        }
+
+        _build_tail_recursion(&program);
+
+        if ((optimize && (BYTECODE_OK != bytecode_optimize(&program, NULL))) ||
+            (VM_OK != vm_verify(&program)) || (VM_OK != vm_load(&program, &loaded)) ||
+            (VM_OK != vm_create(&instance)))
+        {
+            printf("failed to load program\n");
+            return 1;
+        }
+
+        for (size_t i = 0u; i < loaded.num_instructions; i++)
+        {
+            tail_calls += (OPCODE_TAIL_CALL == loaded.instructions[i].opcode) ? 1u : 0u;
+        }
+
+        vm_status_e err = vm_execute(&instance, &loaded, engine);
+        if (VM_OK != err)
+        {
+            printf("vm_execute returned %d\n", err);
+            ret = 1;
+        }
+        else
+        {
+            ret |= _check_result(&test, &instance);
+        }
+
+        printf("%s, %s: %zu tail calls, %zu saved frames\n", _engine_names[engine],
+               optimize ? "optimized" : "unoptimized", tail_calls, instance.callstack.capacity);
+
+        // Only the first call saves a frame once the recursive call is a tail call
+        if (optimize ? ((1u != tail_calls) ||
+                        (DATA_STACK_INITIAL_FRAMES != instance.callstack.capacity)) :
+                       (TAIL_CALL_DEPTH >= instance.callstack.capacity))
+        {
+            printf("unexpected number of saved frames\n");
+            ret = 1;
+        }
+
+        (void) vm_destroy(&instance);
+        (void) vm_unload(&loaded);
+        (void) bytecode_destroy(&program);
+    }
+
+    return ret;
+}
+
+
+int main(int argc, char *argv[])
+{
+    int failures = 0;
+
+    memory_manager_status_e mem_err = memory_manager_init();
+    if (MEMORY_MANAGER_OK != mem_err)
+    {
+        printf("Failed to initialize memory manager, status %d\n", mem_err);
+        return mem_err;
+    }
+
+    string_cache_status_e cache_err = string_cache_init();
+    if (STRING_CACHE_OK != cache_err)
+    {
+        printf("Failed to initialize string cache, status %d\n", cache_err);
+        return cache_err;
+    }
+
+    for (size_t i = 0; i < NUM_TEST_CASES; i++)
+    {
+        vm_test_case_t *test = _test_cases + i;
+
+        // Run every test case as emitted, and again after optimizing, on every engine
+        for (int run = 0; run < (2 * NUM_VM_ENGINES); run++)
+        {
+            int optimize = run & 1;
+            vm_engine_e engine = (vm_engine_e) (run / 2);
+            const char *mode = optimize ? "optimized" : "unoptimized";
+            const char *engine_name = _engine_names[engine];
+
+            printf("\n---- %s (%s, %s) ----\n\n", test->name, mode, engine_name);
+            int failed = _run_test_case(test, optimize, engine);
+            printf("\n%s (%s, %s): %s\n", test->name, mode, engine_name,
+                   failed ? "FAILED" : "OK");
+            failures += failed;
+        }
+    }
+
+    printf("\n---- inline cache ----\n\n");
+    int failed = _test_inline_cache();
+    printf("\ninline cache: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    printf("\n---- quickening ----\n\n");
+    failed = _test_quickening();
+    printf("\nquickening: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    printf("\n---- superinstructions ----\n\n");
+    failed = _test_superinstructions();
+    printf("\nsuperinstructions: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    printf("\n---- register translation ----\n\n");
+    failed = _test_register_translation();
+    printf("\nregister translation: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    printf("\n---- jit ----\n\n");
+    failed = _test_jit();
+    printf("\njit: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    printf("\n---- trace jit ----\n\n");
+    failed = _test_trace_jit();
+    printf("\ntrace jit: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    printf("\n---- verify ----\n\n");
+    failed = _test_verify();
+    printf("\nverify: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    printf("\n---- control-flow graph ----\n\n");
+    failed = _test_cfg();
+    printf("\ncontrol-flow graph: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    printf("\n---- dead code ----\n\n");
+    failed = _test_dead_code();
+    printf("\ndead code: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    printf("\n---- block layout ----\n\n");
+    failed = _test_block_layout();
+    printf("\nblock layout: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    printf("\n---- compare and branch ----\n\n");
+    failed = _test_compare_jumps();
+    printf("\ncompare and branch: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    printf("\n---- locals ----\n\n");
+    failed = _test_locals();
+    printf("\nlocals: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    printf("\n---- globals ----\n\n");
+    failed = _test_globals();
+    printf("\nglobals: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    printf("\n---- calls ----\n\n");
+    failed = _test_calls();
+    printf("\ncalls: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    printf("\n---- tail calls ----\n\n");
+    failed = _test_tail_calls();
+    printf("\ntail calls: %s\n", failed ? "FAILED" : "OK");
+    failures += failed;
+
+    size_t total = (NUM_TEST_CASES * 2u * NUM_VM_ENGINES) + 15u;
+    printf("\n%d/%zu tests passed\n\n", (int) (total - failures), total);
+
+    cache_err = string_cache_destroy();
+    if (STRING_CACHE_OK != cache_err)
+    {
+        printf("Failed to destroy string cache, status %d\n", cache_err);
+        return cache_err;
+    }
+
+    mem_err = memory_manager_destroy();
+    if (MEMORY_MANAGER_OK != mem_err)
+    {
+        printf("Failed to shut down memory manager, status %d\n", mem_err);
+        return mem_err;
+    }
+
+    return (0 == failures) ? 0 : 1;
+}
@@ -0,0 +1,441 @@
+/**
+ * Profile-guided layout of basic blocks
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "memory_manager_api.h"
+#include "fnv_1a_api.h"
+#include "block_layout_api.h"
+#include "bytecode_cfg_api.h"
+
+
+/* Longest line expected in a branch profile */
+#define MAX_PROFILE_LINE (128u)
+
+
+typedef struct
+{
+    bytecode_cfg_t cfg;
+    block_layout_branch_t **counts;  // Counts for the jump at the end of each block, or NULL
+    uint8_t *warm;                   // 1 for each block that isn't cold
+    uint8_t *placed;                 // 1 for each block already in the new layout
+    size_t num_placed;
+    block_layout_stats_t stats;
+} block_layout_t;
+
+
+/* Returns the counts for the conditional jump at the given offset, or NULL */
+static block_layout_branch_t *_find_branch(block_layout_profile_t *profile, uint32_t offset)
+{
+    for (size_t i = 0u; i < profile->num_branches; i++)
+    {
+        if (profile->branches[i].offset == offset)
+        {
+            return profile->branches + i;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @see block_layout_api.h
+ */
+bytecode_status_e block_layout_read_profile(bytecode_t *program, FILE *fp,
+                                            block_layout_profile_t *profile)
+{
+    char line[MAX_PROFILE_LINE];
+    size_t capacity = 0u;
+
+    if ((NULL == program) || (NULL == fp) || (NULL == profile))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    profile->branches = NULL;
+    profile->num_branches = 0u;
+
+    uint32_t hash = fnv_1a_32_hash(program->bytecode, program->used_bytes);
+
+    while (NULL != fgets(line, sizeof(line), fp))
+    {
+        uint32_t line_hash, offset;
+        uint64_t taken, not_taken;
+
+        if ((4 != sscanf(line, "%" SCNx32 " %" SCNu32 " %" SCNu64 " %" SCNu64,
+                         &line_hash, &offset, &taken, &not_taken)) || (hash != line_hash))
+        {
+            continue;
+        }
+
+        block_layout_branch_t *branch = _find_branch(profile, offset);
+        if (NULL == branch)
+        {
+            if (capacity == profile->num_branches)
+            {
+                capacity = (0u == capacity) ? 8u : (capacity * 2u);
+                void *branches = memory_manager_realloc(profile->branches,
+                                                        capacity * sizeof(block_layout_branch_t));
+                if (NULL == branches)
+                {
+                    block_layout_destroy_profile(profile);
+                    return BYTECODE_MEMORY_ERROR;
+                }
+
+                profile->branches = branches;
+            }
+
+            branch = profile->branches + profile->num_branches++;
+            branch->offset = offset;
+            branch->taken = 0u;
+            branch->not_taken = 0u;
+        }
+
+        branch->taken += taken;
+        branch->not_taken += not_taken;
+    }
+
+    return BYTECODE_OK;
+}
+
+
+/**
+ * @see block_layout_api.h
+ */
+void block_layout_destroy_profile(block_layout_profile_t *profile)
+{
+    if (NULL == profile)
+    {
+        return;
+    }
+
+    memory_manager_free(profile->branches);
+    profile->branches = NULL;
+    profile->num_branches = 0u;
+}
+
+
+/**
+ * Find the counts for the conditional jump at the end of each block, and
+ * invert the jumps that were taken more often than not
+ */
+static void _apply_counts(block_layout_t *layout, block_layout_profile_t *profile)
+{
+    bytecode_cfg_t *cfg = &layout->cfg;
+
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        cfg_block_t *block = cfg->blocks + i;
+        cfg_instruction_t *last = bytecode_cfg_last(block);
+
+        layout->counts[i] = NULL;
+
+        if ((NULL == last) || !bytecode_utils_is_conditional_jump(last->opcode))
+        {
+            continue;
+        }
+
+        block_layout_branch_t *branch = _find_branch(profile, last->offset);
+        if (NULL == branch)
+        {
+            continue;
+        }
+
+        layout->counts[i] = branch;
+        layout->stats.branches_profiled += 1u;
+
+        if ((branch->taken <= branch->not_taken) || (CFG_NO_BLOCK == block->fallthrough) ||
+            (last->target == block->fallthrough))
+        {
+            continue;
+        }
+
+        // Counts are swapped along with the successors
+        size_t target = last->target;
+        uint64_t taken = branch->taken;
+
+        last->opcode = bytecode_utils_invert_jump(last->opcode);
+        last->target = block->fallthrough;
+        block->fallthrough = target;
+        branch->taken = branch->not_taken;
+        branch->not_taken = taken;
+        layout->stats.branches_inverted += 1u;
+    }
+}
+
+
+/* Returns 1 if control never went from a block to the given successor */
+static int _is_cold_edge(block_layout_t *layout, size_t index, size_t successor)
+{
+    cfg_block_t *block = layout->cfg.blocks + index;
+    block_layout_branch_t *branch = layout->counts[index];
+
+    if (NULL == branch)
+    {
+        return 0;
+    }
+
+    // The target and fall-through may be the same block
+    uint64_t count = (successor == bytecode_cfg_last(block)->target) ? branch->taken : 0u;
+    count += (successor == block->fallthrough) ? branch->not_taken : 0u;
+    return (0u == count);
+}
+
+
+/**
+ * Mark the blocks that can be reached from the entry block, or from the first
+ * block of a function, without following a cold edge
+ */
+static bytecode_status_e _mark_warm(block_layout_t *layout)
+{
+    bytecode_cfg_t *cfg = &layout->cfg;
+    size_t num_pending = 0u;
+
+    size_t *pending = memory_manager_alloc(cfg->num_blocks * sizeof(size_t));
+    if (NULL == pending)
+    {
+        return BYTECODE_MEMORY_ERROR;
+    }
+
+    (void) memset(layout->warm, 0, cfg->num_blocks);
+
+    // Functions are entered through calls, which aren't edges of the graph
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        if ((0u == i) || cfg->blocks[i].called)
+        {
+            layout->warm[i] = 1u;
+            pending[num_pending++] = i;
+        }
+    }
+
+    while (0u < num_pending)
+    {
+        size_t index = pending[--num_pending];
+        cfg_block_t *block = cfg->blocks + index;
+
+        for (size_t i = 0u; i < block->num_successors; i++)
+        {
+            size_t successor = block->successors[i];
+
+            if (!layout->warm[successor] && !_is_cold_edge(layout, index, successor))
+            {
+                layout->warm[successor] = 1u;
+                pending[num_pending++] = successor;
+            }
+        }
+    }
+
+    memory_manager_free(pending);
+    return BYTECODE_OK;
+}
+
+
+/* Returns the block that should be written after the given one, or CFG_NO_BLOCK */
+static size_t _chain_next(cfg_block_t *block)
+{
+    cfg_instruction_t *last = bytecode_cfg_last(block);
+
+    if ((NULL != last) && (OPCODE_JUMP == last->opcode))
+    {
+        // Written next, the jump is dropped by bytecode_cfg_linearise
+        return last->target;
+    }
+
+    if ((NULL != last) && bytecode_utils_is_exit(last->opcode))
+    {
+        return CFG_NO_BLOCK;
+    }
+
+    return block->fallthrough;
+}
+
+
+/**
+ * Add a chain of blocks to the layout, starting with the given block, and
+ * following each block with the one it passes control to, until a block that
+ * is already placed, or is not as warm as the first, is reached
+ */
+static void _place_chain(block_layout_t *layout, size_t index)
+{
+    bytecode_cfg_t *cfg = &layout->cfg;
+    uint8_t warm = layout->warm[index];
+
+    while ((CFG_NO_BLOCK != index) && !layout->placed[index] && (warm == layout->warm[index]))
+    {
+        cfg->layout[layout->num_placed++] = index;
+        layout->placed[index] = 1u;
+        layout->stats.cold_blocks += warm ? 0u : 1u;
+        index = _chain_next(cfg->blocks + index);
+    }
+}
+
+
+/**
+ * Constants are only defined by the position of their DEFINE_CONST
+ * instructions, so moving blocks around would renumber them. Move them all to
+ * the start of the entry block, which is always placed first, in their
+ * original order.
+ */
+static bytecode_status_e _hoist_constants(block_layout_t *layout)
+{
+    bytecode_cfg_t *cfg = &layout->cfg;
+    bytecode_status_e err = BYTECODE_OK;
+    size_t num_constants = 0u;
+    size_t position = 0u;
+
+    for (size_t i = 1u; i < cfg->num_blocks; i++)
+    {
+        for (size_t j = 0u; j < cfg->blocks[i].num_instructions; j++)
+        {
+            num_constants += (OPCODE_DEFINE_CONST == cfg->blocks[i].instructions[j].opcode) ? 1u : 0u;
+        }
+    }
+
+    // Nothing to do if the entry block already defines every constant
+    if (0u == num_constants)
+    {
+        return BYTECODE_OK;
+    }
+
+    for (size_t i = 0u; (i < cfg->num_blocks) && (BYTECODE_OK == err); i++)
+    {
+        cfg_block_t *block = cfg->blocks + i;
+        size_t j = 0u;
+
+        while ((BYTECODE_OK == err) && (j < block->num_instructions))
+        {
+            cfg_instruction_t constant = block->instructions[j];
+
+            if (OPCODE_DEFINE_CONST != constant.opcode)
+            {
+                j += 1u;
+                continue;
+            }
+
+            // Constants already at the start of the entry block stay where they are
+            if ((0u == i) && (position == j))
+            {
+                position += 1u;
+                j += 1u;
+                continue;
+            }
+
+            if ((err = bytecode_cfg_remove(cfg, i, j)) == BYTECODE_OK)
+            {
+                err = bytecode_cfg_insert(cfg, 0u, position++, &constant);
+                j += (0u == i) ? 1u : 0u;
+            }
+        }
+    }
+
+    return err;
+}
+
+
+/* Lay out the warm blocks, starting with the entry block, and then the cold ones */
+static void _place_blocks(block_layout_t *layout)
+{
+    bytecode_cfg_t *cfg = &layout->cfg;
+
+    static const uint8_t passes[] = {1u, 0u};
+
+    (void) memset(layout->placed, 0, cfg->num_blocks);
+    layout->num_placed = 0u;
+
+    for (size_t pass = 0u; pass < (sizeof(passes) / sizeof(passes[0])); pass++)
+    {
+        for (size_t i = 0u; i < cfg->num_blocks; i++)
+        {
+            if (!layout->placed[i] && (passes[pass] == layout->warm[i]))
+            {
+                _place_chain(layout, i);
+            }
+        }
+    }
+}
+
+
+/**
+ * @see block_layout_api.h
+ */
+bytecode_status_e block_layout_apply(bytecode_t *program, block_layout_profile_t *profile,
+                                     block_layout_stats_t *stats)
+{
+    block_layout_t layout;
+    bytecode_t output;
+    bytecode_status_e err;
+
+    if ((NULL == program) || (NULL == profile) || (0u == program->used_bytes))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    (void) memset(&layout, 0, sizeof(layout));
+
+    if ((err = bytecode_cfg_build(program, &layout.cfg)) != BYTECODE_OK)
+    {
+        return err;
+    }
+
+    size_t num_blocks = layout.cfg.num_blocks;
+    layout.counts = memory_manager_alloc(num_blocks * sizeof(block_layout_branch_t *));
+    layout.warm = memory_manager_alloc(num_blocks);
+    layout.placed = memory_manager_alloc(num_blocks);
+
+    // Counts are swapped when jumps are inverted, so the caller's profile is left alone
+    block_layout_profile_t copy = {.branches=NULL, .num_branches=profile->num_branches};
+    if (0u < profile->num_branches)
+    {
+        copy.branches = memory_manager_alloc(profile->num_branches * sizeof(block_layout_branch_t));
+    }
+
+    if ((NULL == layout.counts) || (NULL == layout.warm) || (NULL == layout.placed) ||
+        ((NULL == copy.branches) && (0u < copy.num_branches)))
+    {
+        err = BYTECODE_MEMORY_ERROR;
+    }
+    else
+    {
+        if (0u < copy.num_branches)
+        {
+            (void) memcpy(copy.branches, profile->branches,
+                          copy.num_branches * sizeof(block_layout_branch_t));
+        }
+
+        _apply_counts(&layout, &copy);
+
+        if (((err = _hoist_constants(&layout)) == BYTECODE_OK) &&
+            ((err = bytecode_cfg_link(&layout.cfg)) == BYTECODE_OK) &&
+            ((err = _mark_warm(&layout)) == BYTECODE_OK))
+        {
+            _place_blocks(&layout);
+
+            // String operands point into the original bytecode, so it is kept until now
+            err = bytecode_cfg_linearise(&layout.cfg, &output);
+        }
+    }
+
+    bytecode_cfg_destroy(&layout.cfg);
+    memory_manager_free(layout.counts);
+    memory_manager_free(layout.warm);
+    memory_manager_free(layout.placed);
+    memory_manager_free(copy.branches);
+
+    if (BYTECODE_OK != err)
+    {
+        return err;
+    }
+
+    if (NULL != stats)
+    {
+        *stats = layout.stats;
+    }
+
+    (void) bytecode_destroy(program);
+    *program = output;
+    return BYTECODE_OK;
+}
@@ -0,0 +1,106 @@
+/**
+ * Profile-guided layout of basic blocks (see bytecode_cfg_api.h). Blocks are
+ * reordered so that the successor a conditional jump went to most often in
+ * profiled runs is the one that falls through, and blocks that were never
+ * reached are moved to the end of the program, out of the way of the hot
+ * code.
+ *
+ * Profiles are written by vm_branch_profile_write, in a build with
+ * VM_BRANCH_PROFILE defined, and read back with block_layout_read_profile.
+ */
+
+#ifndef BLOCK_LAYOUT_API_H_
+#define BLOCK_LAYOUT_API_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bytecode_api.h"
+
+
+/* Number of times a single conditional jump went each way */
+typedef struct
+{
+    uint32_t offset;               // Offset of the jump in the profiled bytecode
+    uint64_t taken;                // Executions that jumped to the target
+    uint64_t not_taken;            // Executions that continued with the next instruction
+} block_layout_branch_t;
+
+
+/* Branch counts for a single program */
+typedef struct
+{
+    block_layout_branch_t *branches;
+    size_t num_branches;
+} block_layout_profile_t;
+
+
+/* Statistics reported by a single run of block layout */
+typedef struct
+{
+    size_t branches_profiled;      // Conditional jumps that had counts in the profile
+    size_t branches_inverted;      // Conditional jumps inverted so the hot successor falls through
+    size_t cold_blocks;            // Blocks moved to the end of the program
+} block_layout_stats_t;
+
+
+/**
+ * Read the counts for a program from a branch profile. Lines written for
+ * other programs (identified by the hash of their bytecode) are skipped, as
+ * are lines that can't be parsed, and the counts of lines for the same jump
+ * are added together, so the profiles of several runs can be appended to the
+ * same file.
+ *
+ * @param    program    Pointer to bytecode that the profile was collected for
+ * @param    fp         File to read the profile from
+ * @param    profile    Pointer to profile to populate
+ *
+ * @return   BYTECODE_OK if successful, even if no counts were found
+ */
+bytecode_status_e block_layout_read_profile(bytecode_t *program, FILE *fp,
+                                            block_layout_profile_t *profile);
+
+
+/**
+ * Free all memory held by a profile read by block_layout_read_profile
+ *
+ * @param    profile    Pointer to profile to destroy
+ */
+void block_layout_destroy_profile(block_layout_profile_t *profile);
+
+
+/**
+ * Reorder the basic blocks of a program, using the branch counts in a profile
+ * collected for exactly the same bytecode:
+ *
+ * - a conditional jump that was taken more often than not is inverted
+ *   (JUMP_IF_FALSE becomes JUMP_IF_TRUE, JUMP_IF_LESS becomes
+ *   JUMP_IF_GREATER_EQUAL, and so on), so that the block it jumped to becomes
+ *   the one that falls through
+ * - a block is cold if it can't be reached from the start of the program
+ *   without following a conditional jump in a direction it never went, and
+ *   cold blocks are moved to the end of the program, in their original order
+ * - the remaining blocks are written in chains, each block followed by its
+ *   fall-through block (or the target of its unconditional jump), so the hot
+ *   path through the program runs without jumping wherever possible
+ *
+ * Jumps without counts in the profile are left alone. Constants are defined
+ * by the position of their DEFINE_CONST instructions, so those are all moved
+ * to the start of the program first, in their original order. The program
+ * behaves exactly as before; only the order of the blocks changes. Superinstructions
+ * are not re-created, so bytecode_optimize should be run afterwards.
+ *
+ * @param    program    Pointer to bytecode to lay out
+ * @param    profile    Pointer to branch counts for the program
+ * @param    stats      Pointer to location to store statistics (may be NULL)
+ *
+ * @return   BYTECODE_OK if successful, BYTECODE_ERROR if the bytecode contains
+ *           invalid instructions or jumps. If layout fails, the original
+ *           bytecode is left unchanged.
+ */
+bytecode_status_e block_layout_apply(bytecode_t *program, block_layout_profile_t *profile,
+                                     block_layout_stats_t *stats);
+
+
+#endif /* BLOCK_LAYOUT_API_H_ */
@@ -248,6 +248,51 @@ bytecode_status_e bytecode_emit_jump_if_false(bytecode_t *program, int32_t offse
 }
 
 
+bytecode_status_e bytecode_emit_jump_if_true(bytecode_t *program, int32_t offset)
+{
+    if (NULL == program)
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    size_t op_bytes = 1 + sizeof(int32_t);
+    REQUIRE_SPACE(program, op_bytes);
+
+    opcode_t *ip = program->bytecode + program->used_bytes;
+
+    *ip = (opcode_t) OPCODE_JUMP_IF_TRUE;
+    ip = (opcode_t *) INCREMENT_PTR_BYTES(ip, 1);
+
+    *((int32_t *) ip) = offset;
+
+    program->used_bytes += op_bytes;
+    return BYTECODE_OK;
+}
+
+
+bytecode_status_e bytecode_emit_compare_jump(bytecode_t *program, opcode_e opcode,
+                                             int32_t offset)
+{
+    if ((NULL == program) || !bytecode_utils_is_compare_jump(opcode))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    size_t op_bytes = 1 + sizeof(int32_t);
+    REQUIRE_SPACE(program, op_bytes);
+
+    opcode_t *ip = program->bytecode + program->used_bytes;
+
+    *ip = (opcode_t) opcode;
+    ip = (opcode_t *) INCREMENT_PTR_BYTES(ip, 1);
+
+    *((int32_t *) ip) = offset;
+
+    program->used_bytes += op_bytes;
+    return BYTECODE_OK;
+}
+
+
 bytecode_status_e bytecode_emit_backpatched_jump(bytecode_t *program,
                                                  uint32_t *position)
 {
@@ -276,6 +321,20 @@ bytecode_status_e bytecode_emit_backpatched_jump_if_false(bytecode_t *program,
 }
 
 
+bytecode_status_e bytecode_emit_backpatched_call(bytecode_t *program, uint8_t num_args,
+                                                 uint32_t *position)
+{
+    if (NULL == position)
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    *position = program->used_bytes;
+    (void) bytecode_emit_call(program, 0, num_args);
+    return BYTECODE_OK;
+}
+
+
 bytecode_status_e bytecode_backpatch_jump(bytecode_t *program, uint32_t position,
                                           int32_t offset)
 {
@@ -288,7 +347,7 @@ bytecode_status_e bytecode_backpatch_jump(bytecode_t *program, uint32_t position
 
     // Sanity check on patch location
     opcode_e opcode = (opcode_e) *patch_location;
-    if ((OPCODE_JUMP != opcode) && (OPCODE_JUMP_IF_FALSE != opcode))
+    if (!bytecode_utils_has_target(opcode))
     {
         return BYTECODE_INVALID_BACKPATCH;
     }
@@ -342,6 +401,90 @@ bytecode_status_e bytecode_emit_div(bytecode_t *program)
 }
 
 
+bytecode_status_e bytecode_emit_add_int_int(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_ADD_INT_INT);
+}
+
+
+bytecode_status_e bytecode_emit_sub_int_int(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_SUB_INT_INT);
+}
+
+
+bytecode_status_e bytecode_emit_mult_int_int(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_MULT_INT_INT);
+}
+
+
+bytecode_status_e bytecode_emit_div_int_int(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_DIV_INT_INT);
+}
+
+
+bytecode_status_e bytecode_emit_add_float_float(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_ADD_FLOAT_FLOAT);
+}
+
+
+bytecode_status_e bytecode_emit_sub_float_float(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_SUB_FLOAT_FLOAT);
+}
+
+
+bytecode_status_e bytecode_emit_mult_float_float(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_MULT_FLOAT_FLOAT);
+}
+
+
+bytecode_status_e bytecode_emit_div_float_float(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_DIV_FLOAT_FLOAT);
+}
+
+
+bytecode_status_e bytecode_emit_equal(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_EQUAL);
+}
+
+
+bytecode_status_e bytecode_emit_not_equal(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_NOT_EQUAL);
+}
+
+
+bytecode_status_e bytecode_emit_less(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_LESS);
+}
+
+
+bytecode_status_e bytecode_emit_less_equal(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_LESS_EQUAL);
+}
+
+
+bytecode_status_e bytecode_emit_greater(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_GREATER);
+}
+
+
+bytecode_status_e bytecode_emit_greater_equal(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_GREATER_EQUAL);
+}
+
+
 bytecode_status_e bytecode_emit_print(bytecode_t *program)
 {
     return _single_byte_op(program, OPCODE_PRINT);
@@ -396,7 +539,8 @@ bytecode_status_e bytecode_emit_define_const(bytecode_t *program,
 }
 
 
-bytecode_status_e bytecode_emit_load_const(bytecode_t *program, uint32_t index)
+/* Add an instruction that refers to an entry in the constant pool */
+static bytecode_status_e _const_op(bytecode_t *program, opcode_e opcode, uint32_t index)
 {
     if (NULL == program)
     {
@@ -406,7 +550,7 @@ bytecode_status_e bytecode_emit_load_const(bytecode_t *program, uint32_t index)
     size_t op_bytes = 1 + sizeof(uint32_t);
     REQUIRE_SPACE(program, op_bytes);
 
-    program->bytecode[program->used_bytes] = (opcode_t) OPCODE_LOAD_CONST;
+    program->bytecode[program->used_bytes] = (opcode_t) opcode;
     program->used_bytes += 1;
 
     *((uint32_t *) (program->bytecode + program->used_bytes)) = index;
@@ -415,6 +559,100 @@ bytecode_status_e bytecode_emit_load_const(bytecode_t *program, uint32_t index)
 }
 
 
+bytecode_status_e bytecode_emit_load_const(bytecode_t *program, uint32_t index)
+{
+    return _const_op(program, OPCODE_LOAD_CONST, index);
+}
+
+
+/* Add an instruction that operates on a local variable slot */
+static bytecode_status_e _local_op(bytecode_t *program, opcode_e opcode, uint16_t slot)
+{
+    if (NULL == program)
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    size_t op_bytes = 1 + sizeof(uint16_t);
+    REQUIRE_SPACE(program, op_bytes);
+
+    program->bytecode[program->used_bytes] = (opcode_t) opcode;
+    program->used_bytes += 1;
+
+    *((uint16_t *) (program->bytecode + program->used_bytes)) = slot;
+    program->used_bytes += sizeof(uint16_t);
+    return BYTECODE_OK;
+}
+
+
+bytecode_status_e bytecode_emit_load_local(bytecode_t *program, uint16_t slot)
+{
+    return _local_op(program, OPCODE_LOAD_LOCAL, slot);
+}
+
+
+bytecode_status_e bytecode_emit_store_local(bytecode_t *program, uint16_t slot)
+{
+    return _local_op(program, OPCODE_STORE_LOCAL, slot);
+}
+
+
+bytecode_status_e bytecode_emit_load_global(bytecode_t *program, uint32_t name_index)
+{
+    return _const_op(program, OPCODE_LOAD_GLOBAL, name_index);
+}
+
+
+bytecode_status_e bytecode_emit_store_global(bytecode_t *program, uint32_t name_index)
+{
+    return _const_op(program, OPCODE_STORE_GLOBAL, name_index);
+}
+
+
+static bytecode_status_e _call_op(bytecode_t *program, opcode_e op, int32_t offset,
+                                  uint8_t num_args)
+{
+    if (NULL == program)
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    size_t op_bytes = 1 + sizeof(int32_t) + sizeof(uint8_t);
+    REQUIRE_SPACE(program, op_bytes);
+
+    opcode_t *ip = program->bytecode + program->used_bytes;
+
+    *ip = (opcode_t) op;
+    ip = (opcode_t *) INCREMENT_PTR_BYTES(ip, 1);
+
+    *((int32_t *) ip) = offset;
+    ip = (opcode_t *) INCREMENT_PTR_BYTES(ip, sizeof(int32_t));
+
+    *ip = (opcode_t) num_args;
+
+    program->used_bytes += op_bytes;
+    return BYTECODE_OK;
+}
+
+
+bytecode_status_e bytecode_emit_call(bytecode_t *program, int32_t offset, uint8_t num_args)
+{
+    return _call_op(program, OPCODE_CALL, offset, num_args);
+}
+
+
+bytecode_status_e bytecode_emit_tail_call(bytecode_t *program, int32_t offset, uint8_t num_args)
+{
+    return _call_op(program, OPCODE_TAIL_CALL, offset, num_args);
+}
+
+
+bytecode_status_e bytecode_emit_return(bytecode_t *program)
+{
+    return _single_byte_op(program, OPCODE_RETURN);
+}
+
+
 bytecode_status_e bytecode_emit_end(bytecode_t *program)
 {
     return _single_byte_op(program, OPCODE_END);
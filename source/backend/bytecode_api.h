@@ -19,6 +19,7 @@ typedef enum
     BYTECODE_INVALID_PARAM,      // Invalid parameter passed to function
     BYTECODE_INVALID_BACKPATCH,  // Position value points to instruction that can't be backpatched
     BYTECODE_MEMORY_ERROR,       // Failed to allocate memory
+    BYTECODE_INVALID_TYPES,      // Operand types of a typed instruction can't be proven
     BYTECODE_ERROR               // Unspecified internal error
 } bytecode_status_e;
 
@@ -134,6 +135,33 @@ bytecode_status_e bytecode_emit_jump(bytecode_t *program, int32_t offset);
 bytecode_status_e bytecode_emit_jump_if_false(bytecode_t *program, int32_t offset);
 
 
+/**
+ * Add JUMP_IF_TRUE instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ * @param    offset    Offset to jump to, in bytes, relative to current position
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_jump_if_true(bytecode_t *program, int32_t offset);
+
+
+/**
+ * Add a fused compare-and-branch instruction (OPCODE_JUMP_IF_EQUAL through
+ * OPCODE_JUMP_IF_GREATER_EQUAL_INT) to a bytecode chunk. These are normally
+ * created by the optimizer from a comparison followed by a conditional jump.
+ *
+ * @param    program   Pointer to bytecode_t instance
+ * @param    opcode    Opcode of the compare-and-branch instruction
+ * @param    offset    Offset to jump to, in bytes, relative to current position
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly, BYTECODE_INVALID_PARAM
+ *           if the opcode is not a compare-and-branch instruction
+ */
+bytecode_status_e bytecode_emit_compare_jump(bytecode_t *program, opcode_e opcode,
+                                             int32_t offset);
+
+
 /**
  * Add JUMP instruction to a bytecode chunk, but omit the offset value, to be
  * filled in later.
@@ -167,7 +195,23 @@ bytecode_status_e bytecode_emit_backpatched_jump_if_false(bytecode_t *program,
 
 
 /**
- * Backpatch a jump instruction that was previously added without an offset value
+ * Add CALL instruction to a bytecode chunk, but omit the offset value, to be
+ * filled in later with bytecode_backpatch_jump (e.g. for a call to a function
+ * that is emitted after the caller).
+ *
+ * @param    program   Pointer to bytecode_t instance
+ * @param    num_args  Number of values passed from the data stack
+ * @param    position  Pointer to location to store the position of the instruction
+ *                     that is being added
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_backpatched_call(bytecode_t *program, uint8_t num_args,
+                                                 uint32_t *position);
+
+
+/**
+ * Backpatch a jump or call instruction that was previously added without an offset value
  *
  * @param    program   Pointer to bytecode_t instance
  * @param    position  Position value that was populated when backpatched instruction
@@ -218,6 +262,146 @@ bytecode_status_e bytecode_emit_mult(bytecode_t *program);
 bytecode_status_e bytecode_emit_div(bytecode_t *program);
 
 
+/**
+ * Add ADD_INT_INT instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_add_int_int(bytecode_t *program);
+
+
+/**
+ * Add SUB_INT_INT instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_sub_int_int(bytecode_t *program);
+
+
+/**
+ * Add MULT_INT_INT instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_mult_int_int(bytecode_t *program);
+
+
+/**
+ * Add DIV_INT_INT instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_div_int_int(bytecode_t *program);
+
+
+/**
+ * Add ADD_FLOAT_FLOAT instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_add_float_float(bytecode_t *program);
+
+
+/**
+ * Add SUB_FLOAT_FLOAT instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_sub_float_float(bytecode_t *program);
+
+
+/**
+ * Add MULT_FLOAT_FLOAT instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_mult_float_float(bytecode_t *program);
+
+
+/**
+ * Add DIV_FLOAT_FLOAT instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_div_float_float(bytecode_t *program);
+
+
+/**
+ * Add EQUAL instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_equal(bytecode_t *program);
+
+
+/**
+ * Add NOT_EQUAL instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_not_equal(bytecode_t *program);
+
+
+/**
+ * Add LESS instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_less(bytecode_t *program);
+
+
+/**
+ * Add LESS_EQUAL instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_less_equal(bytecode_t *program);
+
+
+/**
+ * Add GREATER instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_greater(bytecode_t *program);
+
+
+/**
+ * Add GREATER_EQUAL instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_greater_equal(bytecode_t *program);
+
+
 /**
  * Add PRINT instruction to a bytecode chunk
  *
@@ -252,6 +436,109 @@ bytecode_status_e bytecode_emit_define_const(bytecode_t *program,
 bytecode_status_e bytecode_emit_load_const(bytecode_t *program, uint32_t index);
 
 
+/**
+ * Add LOAD_LOCAL instruction to a bytecode chunk. Slots are numbered by the
+ * compiler, so no names are looked up at runtime; a slot that hasn't been
+ * stored to yet holds the int 0.
+ *
+ * @param    program   Pointer to bytecode_t instance
+ * @param    slot      Local variable slot to load
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_load_local(bytecode_t *program, uint16_t slot);
+
+
+/**
+ * Add STORE_LOCAL instruction to a bytecode chunk
+ *
+ * @param    program   Pointer to bytecode_t instance
+ * @param    slot      Local variable slot to store to
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_store_local(bytecode_t *program, uint16_t slot);
+
+
+/**
+ * Add LOAD_GLOBAL instruction to a bytecode chunk. Loading a global variable
+ * that has never been stored to is a runtime error.
+ *
+ * @param    program      Pointer to bytecode_t instance
+ * @param    name_index   Constant pool index of a string constant holding
+ *                        the name of the global variable
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_load_global(bytecode_t *program, uint32_t name_index);
+
+
+/**
+ * Add STORE_GLOBAL instruction to a bytecode chunk. The global variable is
+ * created if it doesn't exist yet.
+ *
+ * @param    program      Pointer to bytecode_t instance
+ * @param    name_index   Constant pool index of a string constant holding
+ *                        the name of the global variable
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_store_global(bytecode_t *program, uint32_t name_index);
+
+
+/**
+ * Add CALL instruction to a bytecode chunk. The top 'num_args' values on the
+ * data stack are popped, and become the first local variable slots of the
+ * function, in the order they were pushed. The function runs until it
+ * executes RETURN, and the value it returns is pushed.
+ *
+ * Functions are part of the same program as their callers, and are entered
+ * with an empty data stack. Bytecode should not run into a function from
+ * the code before it; functions are usually emitted after the END
+ * instruction of the main program, and followed by another END, since every
+ * program must finish with one.
+ *
+ * @param    program   Pointer to bytecode_t instance
+ * @param    offset    Offset of the first instruction of the function,
+ *                     relative to the CALL instruction
+ * @param    num_args  Number of values passed from the data stack
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_call(bytecode_t *program, int32_t offset, uint8_t num_args);
+
+
+/**
+ * Add TAIL_CALL instruction to a bytecode chunk. Works like CALL followed by
+ * RETURN, except that the function being called takes over the frame of the
+ * current function instead of getting a new one, so recursion through
+ * TAIL_CALL runs in constant frame memory. Outside of a function, TAIL_CALL
+ * works like an ordinary CALL, except that there is nothing to return to, so
+ * the RETURN of the called function is a runtime error. The optimizer (see
+ * bytecode_optimize) replaces calls in tail position with TAIL_CALL.
+ *
+ * @param    program   Pointer to bytecode_t instance
+ * @param    offset    Offset of the first instruction of the function,
+ *                     relative to the TAIL_CALL instruction
+ * @param    num_args  Number of values passed from the data stack
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_tail_call(bytecode_t *program, int32_t offset, uint8_t num_args);
+
+
+/**
+ * Add RETURN instruction to a bytecode chunk. Pops a value and returns it
+ * from the current function; executing RETURN outside of a function is a
+ * runtime error.
+ *
+ * @param    program   Pointer to bytecode_t instance
+ *
+ * @return   BYTECODE_OK if instruction was addedd successfuly
+ */
+bytecode_status_e bytecode_emit_return(bytecode_t *program);
+
+
 /**
  * Add END instruction to a bytecode chunk
  *
@@ -0,0 +1,1169 @@
+/**
+ * Control-flow graph for bytecode, with a dataflow framework for analyses
+ * that work on it
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "memory_manager_api.h"
+#include "bytecode_cfg_api.h"
+
+
+/* Number of instructions allocated when a block first needs to grow */
+#define MIN_BLOCK_CAPACITY (8u)
+
+
+/* A jump written by bytecode_cfg_linearise, whose offset is filled in once
+ * every block has been written */
+typedef struct
+{
+    uint32_t position;             // Offset of the jump instruction
+    size_t target;                 // Index of block jumped to
+} pending_jump_t;
+
+
+/* Returns 1 if control can leave a block without jumping */
+static int _falls_through(cfg_block_t *block)
+{
+    cfg_instruction_t *last = bytecode_cfg_last(block);
+
+    return (NULL == last) || ((OPCODE_JUMP != last->opcode) && !bytecode_utils_is_exit(last->opcode));
+}
+
+
+/**
+ * Decode all instructions, and find the instructions that start a block
+ *
+ * @param    program         Pointer to bytecode to decode
+ * @param    instructions    Pointer to location to store decoded instructions
+ * @param    leaders         Pointer to location to store 1 for each instruction
+ *                           that starts a block, and 0 for the others
+ * @param    count           Pointer to location to store number of instructions
+ */
+static bytecode_status_e _decode(bytecode_t *program, bytecode_instruction_t **instructions,
+                                 uint8_t **leaders, size_t *count)
+{
+    bytecode_instruction_t decoded;
+    uint32_t *offset_map;
+    size_t offset, i;
+    size_t num_instructions = 0u;
+
+    if ((offset_map = memory_manager_alloc(program->used_bytes * sizeof(uint32_t))) == NULL)
+    {
+        return BYTECODE_MEMORY_ERROR;
+    }
+
+    (void) memset(offset_map, 0xff, program->used_bytes * sizeof(uint32_t));
+
+    for (offset = 0u; offset < program->used_bytes; offset += decoded.size)
+    {
+        if (!bytecode_utils_decode_instruction(program, offset, &decoded))
+        {
+            memory_manager_free(offset_map);
+            return BYTECODE_ERROR;
+        }
+
+        offset_map[offset] = (uint32_t) num_instructions;
+        num_instructions += 1u;
+    }
+
+    if (OPCODE_END != decoded.opcode)
+    {
+        memory_manager_free(offset_map);
+        return BYTECODE_ERROR;
+    }
+
+    *instructions = memory_manager_alloc(num_instructions * sizeof(bytecode_instruction_t));
+    *leaders = memory_manager_alloc(num_instructions);
+
+    if ((NULL == *instructions) || (NULL == *leaders))
+    {
+        memory_manager_free(offset_map);
+        return BYTECODE_MEMORY_ERROR;
+    }
+
+    (void) memset(*leaders, 0, num_instructions);
+    (*leaders)[0] = 1u;
+
+    for (offset = 0u, i = 0u; offset < program->used_bytes; offset += decoded.size, i++)
+    {
+        (void) bytecode_utils_decode_instruction(program, offset, &decoded);
+
+        // The rest of a superinstruction sequence is already encoded separately
+        decoded.opcode = bytecode_utils_base_opcode(decoded.opcode);
+        (*instructions)[i] = decoded;
+
+        if (bytecode_utils_has_target(decoded.opcode))
+        {
+            int64_t target = ((int64_t) offset) + decoded.operand.jump_offset;
+
+            if ((0 > target) || (((int64_t) program->used_bytes) <= target) ||
+                (UINT32_MAX == offset_map[target]))
+            {
+                memory_manager_free(offset_map);
+                return BYTECODE_ERROR;
+            }
+
+            // Jump and call offsets are replaced with the instruction index, until blocks are created
+            (*instructions)[i].operand.jump_offset = (int32_t) offset_map[target];
+            (*leaders)[offset_map[target]] = 1u;
+        }
+
+        if ((bytecode_utils_is_jump(decoded.opcode) || bytecode_utils_is_exit(decoded.opcode)) &&
+            ((i + 1u) < num_instructions))
+        {
+            (*leaders)[i + 1u] = 1u;
+        }
+    }
+
+    memory_manager_free(offset_map);
+    *count = num_instructions;
+    return BYTECODE_OK;
+}
+
+
+/**
+ * @see bytecode_cfg_api.h
+ */
+bytecode_status_e bytecode_cfg_build(bytecode_t *program, bytecode_cfg_t *cfg)
+{
+    bytecode_instruction_t *decoded = NULL;
+    uint8_t *leaders = NULL;
+    size_t *block_of = NULL;
+    size_t num_instructions = 0u;
+    bytecode_status_e err;
+
+    if ((NULL == program) || (NULL == cfg) || (0u == program->used_bytes))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    (void) memset(cfg, 0, sizeof(bytecode_cfg_t));
+
+    if ((err = _decode(program, &decoded, &leaders, &num_instructions)) != BYTECODE_OK)
+    {
+        goto done;
+    }
+
+    for (size_t i = 0u; i < num_instructions; i++)
+    {
+        cfg->num_blocks += leaders[i];
+    }
+
+    block_of = memory_manager_alloc(num_instructions * sizeof(size_t));
+    cfg->blocks = memory_manager_alloc(cfg->num_blocks * sizeof(cfg_block_t));
+    cfg->layout = memory_manager_alloc(cfg->num_blocks * sizeof(size_t));
+
+    if ((NULL == block_of) || (NULL == cfg->blocks) || (NULL == cfg->layout))
+    {
+        err = BYTECODE_MEMORY_ERROR;
+        goto done;
+    }
+
+    (void) memset(cfg->blocks, 0, cfg->num_blocks * sizeof(cfg_block_t));
+
+    // Find the size of each block
+    size_t block = 0u;
+    for (size_t i = 0u; i < num_instructions; i++)
+    {
+        block += ((0u < i) && leaders[i]) ? 1u : 0u;
+        block_of[i] = block;
+        cfg->blocks[block].capacity += 1u;
+    }
+
+    for (block = 0u; block < cfg->num_blocks; block++)
+    {
+        cfg_block_t *b = cfg->blocks + block;
+
+        b->instructions = memory_manager_alloc(b->capacity * sizeof(cfg_instruction_t));
+        if (NULL == b->instructions)
+        {
+            err = BYTECODE_MEMORY_ERROR;
+            goto done;
+        }
+
+        b->fallthrough = ((block + 1u) < cfg->num_blocks) ? (block + 1u) : CFG_NO_BLOCK;
+        cfg->layout[block] = block;
+    }
+
+    for (size_t i = 0u; i < num_instructions; i++)
+    {
+        cfg_block_t *b = cfg->blocks + block_of[i];
+        cfg_instruction_t *ins = b->instructions + b->num_instructions++;
+
+        ins->opcode = decoded[i].opcode;
+        ins->operand = decoded[i].operand;
+        ins->target = CFG_NO_BLOCK;
+        ins->offset = decoded[i].offset;
+
+        if (bytecode_utils_has_target(ins->opcode))
+        {
+            ins->target = block_of[ins->operand.jump_offset];
+            ins->operand.jump_offset = 0;
+        }
+    }
+
+    err = bytecode_cfg_link(cfg);
+
+done:
+    memory_manager_free(block_of);
+    memory_manager_free(leaders);
+    memory_manager_free(decoded);
+
+    if (BYTECODE_OK != err)
+    {
+        bytecode_cfg_destroy(cfg);
+    }
+
+    return err;
+}
+
+
+/**
+ * @see bytecode_cfg_api.h
+ */
+void bytecode_cfg_destroy(bytecode_cfg_t *cfg)
+{
+    if (NULL == cfg)
+    {
+        return;
+    }
+
+    if (NULL != cfg->blocks)
+    {
+        for (size_t i = 0u; i < cfg->num_blocks; i++)
+        {
+            memory_manager_free(cfg->blocks[i].instructions);
+            memory_manager_free(cfg->blocks[i].predecessors);
+        }
+    }
+
+    memory_manager_free(cfg->blocks);
+    memory_manager_free(cfg->layout);
+    (void) memset(cfg, 0, sizeof(bytecode_cfg_t));
+}
+
+
+/* Add a successor to a block, unless it is already there */
+static void _add_successor(cfg_block_t *block, size_t successor)
+{
+    for (size_t i = 0u; i < block->num_successors; i++)
+    {
+        if (block->successors[i] == successor)
+        {
+            return;
+        }
+    }
+
+    block->successors[block->num_successors++] = successor;
+}
+
+
+/**
+ * @see bytecode_cfg_api.h
+ */
+bytecode_status_e bytecode_cfg_link(bytecode_cfg_t *cfg)
+{
+    if ((NULL == cfg) || (NULL == cfg->blocks))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        cfg->blocks[i].num_successors = 0u;
+        cfg->blocks[i].num_predecessors = 0u;
+        cfg->blocks[i].reachable = 0u;
+        cfg->blocks[i].called = 0u;
+    }
+
+    // Successors, and the number of predecessors of each block
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        cfg_block_t *block = cfg->blocks + i;
+        cfg_instruction_t *last = bytecode_cfg_last(block);
+
+        if (block->removed)
+        {
+            continue;
+        }
+
+        if (_falls_through(block))
+        {
+            if ((CFG_NO_BLOCK == block->fallthrough) || cfg->blocks[block->fallthrough].removed)
+            {
+                return BYTECODE_ERROR;
+            }
+
+            _add_successor(block, block->fallthrough);
+        }
+
+        if ((NULL != last) && bytecode_utils_is_jump(last->opcode))
+        {
+            if ((cfg->num_blocks <= last->target) || cfg->blocks[last->target].removed)
+            {
+                return BYTECODE_ERROR;
+            }
+
+            _add_successor(block, last->target);
+        }
+
+        for (size_t j = 0u; j < block->num_successors; j++)
+        {
+            cfg->blocks[block->successors[j]].num_predecessors += 1u;
+        }
+    }
+
+    // Predecessors
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        cfg_block_t *block = cfg->blocks + i;
+
+        memory_manager_free(block->predecessors);
+        block->predecessors = NULL;
+
+        if (0u < block->num_predecessors)
+        {
+            block->predecessors = memory_manager_alloc(block->num_predecessors * sizeof(size_t));
+            if (NULL == block->predecessors)
+            {
+                return BYTECODE_MEMORY_ERROR;
+            }
+        }
+
+        block->num_predecessors = 0u;
+    }
+
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        cfg_block_t *block = cfg->blocks + i;
+
+        for (size_t j = 0u; j < block->num_successors; j++)
+        {
+            cfg_block_t *successor = cfg->blocks + block->successors[j];
+            successor->predecessors[successor->num_predecessors++] = i;
+        }
+    }
+
+    // Reachability, by depth-first search from the entry block
+    size_t *stack = memory_manager_alloc(cfg->num_blocks * sizeof(size_t));
+    size_t count = 0u;
+
+    if (NULL == stack)
+    {
+        return BYTECODE_MEMORY_ERROR;
+    }
+
+    if (!cfg->blocks[0].removed)
+    {
+        cfg->blocks[0].reachable = 1u;
+        stack[count++] = 0u;
+    }
+
+    while (0u < count)
+    {
+        cfg_block_t *block = cfg->blocks + stack[--count];
+
+        for (size_t j = 0u; j < block->num_successors; j++)
+        {
+            cfg_block_t *successor = cfg->blocks + block->successors[j];
+
+            if (!successor->reachable)
+            {
+                successor->reachable = 1u;
+                stack[count++] = block->successors[j];
+            }
+        }
+
+        // Functions are reachable if they are called from a reachable block
+        for (size_t j = 0u; j < block->num_instructions; j++)
+        {
+            cfg_instruction_t *ins = block->instructions + j;
+            cfg_block_t *callee;
+
+            if (!bytecode_utils_is_call(ins->opcode))
+            {
+                continue;
+            }
+
+            if ((cfg->num_blocks <= ins->target) || cfg->blocks[ins->target].removed)
+            {
+                memory_manager_free(stack);
+                return BYTECODE_ERROR;
+            }
+
+            callee = cfg->blocks + ins->target;
+            callee->called = 1u;
+
+            if (!callee->reachable)
+            {
+                callee->reachable = 1u;
+                stack[count++] = ins->target;
+            }
+        }
+    }
+
+    memory_manager_free(stack);
+    return BYTECODE_OK;
+}
+
+
+/**
+ * @see bytecode_cfg_api.h
+ */
+bytecode_status_e bytecode_cfg_insert(bytecode_cfg_t *cfg, size_t block, size_t index,
+                                      cfg_instruction_t *instruction)
+{
+    if ((NULL == cfg) || (NULL == instruction) || (cfg->num_blocks <= block) ||
+        (cfg->blocks[block].num_instructions < index))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    cfg_block_t *b = cfg->blocks + block;
+
+    if (b->num_instructions == b->capacity)
+    {
+        size_t capacity = (MIN_BLOCK_CAPACITY > b->capacity) ? MIN_BLOCK_CAPACITY : b->capacity * 2u;
+        cfg_instruction_t *instructions = memory_manager_realloc(b->instructions,
+                                                                 capacity * sizeof(cfg_instruction_t));
+        if (NULL == instructions)
+        {
+            return BYTECODE_MEMORY_ERROR;
+        }
+
+        b->instructions = instructions;
+        b->capacity = capacity;
+    }
+
+    (void) memmove(b->instructions + index + 1u, b->instructions + index,
+                   (b->num_instructions - index) * sizeof(cfg_instruction_t));
+
+    b->instructions[index] = *instruction;
+    b->num_instructions += 1u;
+    return BYTECODE_OK;
+}
+
+
+/**
+ * @see bytecode_cfg_api.h
+ */
+bytecode_status_e bytecode_cfg_remove(bytecode_cfg_t *cfg, size_t block, size_t index)
+{
+    if ((NULL == cfg) || (cfg->num_blocks <= block) ||
+        (cfg->blocks[block].num_instructions <= index))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    cfg_block_t *b = cfg->blocks + block;
+
+    b->num_instructions -= 1u;
+    (void) memmove(b->instructions + index, b->instructions + index + 1u,
+                   (b->num_instructions - index) * sizeof(cfg_instruction_t));
+
+    return BYTECODE_OK;
+}
+
+
+/**
+ * @see bytecode_cfg_api.h
+ */
+cfg_instruction_t *bytecode_cfg_last(cfg_block_t *block)
+{
+    if (0u == block->num_instructions)
+    {
+        return NULL;
+    }
+
+    return block->instructions + (block->num_instructions - 1u);
+}
+
+
+/**
+ * @see bytecode_cfg_api.h
+ */
+void bytecode_cfg_stack_effect(cfg_instruction_t *instruction, uint32_t *pops,
+                               uint32_t *pushes)
+{
+    *pops = 0u;
+    *pushes = 0u;
+
+    switch (instruction->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MULT:
+        case OPCODE_DIV:
+        case OPCODE_ADD_INT_INT:
+        case OPCODE_SUB_INT_INT:
+        case OPCODE_MULT_INT_INT:
+        case OPCODE_DIV_INT_INT:
+        case OPCODE_ADD_FLOAT_FLOAT:
+        case OPCODE_SUB_FLOAT_FLOAT:
+        case OPCODE_MULT_FLOAT_FLOAT:
+        case OPCODE_DIV_FLOAT_FLOAT:
+        case OPCODE_EQUAL:
+        case OPCODE_NOT_EQUAL:
+        case OPCODE_LESS:
+        case OPCODE_LESS_EQUAL:
+        case OPCODE_GREATER:
+        case OPCODE_GREATER_EQUAL:
+            *pops = 2u;
+            *pushes = 1u;
+            break;
+
+        case OPCODE_INT:
+        case OPCODE_FLOAT:
+        case OPCODE_STRING:
+        case OPCODE_BOOL:
+        case OPCODE_LOAD_CONST:
+        case OPCODE_LOAD_LOCAL:
+        case OPCODE_LOAD_GLOBAL:
+            *pushes = 1u;
+            break;
+
+        case OPCODE_PRINT:
+        case OPCODE_STORE_LOCAL:
+        case OPCODE_STORE_GLOBAL:
+        case OPCODE_JUMP_IF_FALSE:
+        case OPCODE_JUMP_IF_TRUE:
+        case OPCODE_RETURN:
+            *pops = 1u;
+            break;
+
+        case OPCODE_CAST:
+            *pops = 1u;
+            *pushes = 1u;
+            break;
+
+        case OPCODE_CALL:
+            *pops = instruction->operand.call.num_args;
+            *pushes = 1u;
+            break;
+
+        case OPCODE_TAIL_CALL:
+            *pops = instruction->operand.call.num_args;
+            break;
+
+        default:
+            if (bytecode_utils_is_compare_jump(instruction->opcode))
+            {
+                *pops = 2u;
+            }
+
+            // No other effect on the data stack
+            break;
+    }
+}
+
+
+/**
+ * @see bytecode_cfg_api.h
+ */
+bytecode_status_e bytecode_cfg_stack_depths(bytecode_cfg_t *cfg)
+{
+    bytecode_status_e err = BYTECODE_OK;
+    uint8_t *visited;
+    size_t *worklist;
+    size_t count = 0u;
+
+    if ((NULL == cfg) || (NULL == cfg->blocks))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    visited = memory_manager_alloc(cfg->num_blocks);
+    worklist = memory_manager_alloc(cfg->num_blocks * sizeof(size_t));
+
+    if ((NULL == visited) || (NULL == worklist))
+    {
+        memory_manager_free(visited);
+        memory_manager_free(worklist);
+        return BYTECODE_MEMORY_ERROR;
+    }
+
+    (void) memset(visited, 0, cfg->num_blocks);
+    cfg->max_depth = 0u;
+
+    // The data stack is empty on entry to the program, and to each function
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        if (cfg->blocks[i].reachable && ((0u == i) || cfg->blocks[i].called))
+        {
+            cfg->blocks[i].entry_depth = 0u;
+            visited[i] = 1u;
+            worklist[count++] = i;
+        }
+    }
+
+    // Every block is visited once, since the depth on entry can't change
+    while ((0u < count) && (BYTECODE_OK == err))
+    {
+        cfg_block_t *block = cfg->blocks + worklist[--count];
+        uint32_t depth = block->entry_depth;
+
+        for (size_t i = 0u; i < block->num_instructions; i++)
+        {
+            uint32_t pops, pushes;
+
+            bytecode_cfg_stack_effect(block->instructions + i, &pops, &pushes);
+            if (depth < pops)
+            {
+                err = BYTECODE_ERROR;
+                break;
+            }
+
+            depth += pushes - pops;
+            cfg->max_depth = (depth > cfg->max_depth) ? depth : cfg->max_depth;
+        }
+
+        for (size_t j = 0u; (j < block->num_successors) && (BYTECODE_OK == err); j++)
+        {
+            size_t successor = block->successors[j];
+
+            if (!visited[successor])
+            {
+                visited[successor] = 1u;
+                cfg->blocks[successor].entry_depth = depth;
+                worklist[count++] = successor;
+            }
+            else if (cfg->blocks[successor].entry_depth != depth)
+            {
+                err = BYTECODE_ERROR;
+            }
+        }
+    }
+
+    memory_manager_free(visited);
+    memory_manager_free(worklist);
+    return err;
+}
+
+
+/**
+ * @see bytecode_cfg_api.h
+ */
+bytecode_status_e bytecode_cfg_dataflow_init(bytecode_cfg_t *cfg, cfg_dataflow_t *dataflow,
+                                             size_t num_bits)
+{
+    if ((NULL == cfg) || (NULL == dataflow))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    dataflow->num_bits = num_bits;
+
+    // Always at least one word, so that sets with no facts still have an address
+    dataflow->words = (0u < num_bits) ? CFG_BITSET_WORDS(num_bits) : 1u;
+
+    size_t size = cfg->num_blocks * dataflow->words * sizeof(cfg_word_t);
+
+    dataflow->gen = memory_manager_alloc(size);
+    dataflow->kill = memory_manager_alloc(size);
+    dataflow->in = memory_manager_alloc(size);
+    dataflow->out = memory_manager_alloc(size);
+
+    if ((NULL == dataflow->gen) || (NULL == dataflow->kill) ||
+        (NULL == dataflow->in) || (NULL == dataflow->out))
+    {
+        bytecode_cfg_dataflow_destroy(dataflow);
+        return BYTECODE_MEMORY_ERROR;
+    }
+
+    (void) memset(dataflow->gen, 0, size);
+    (void) memset(dataflow->kill, 0, size);
+    (void) memset(dataflow->in, 0, size);
+    (void) memset(dataflow->out, 0, size);
+    return BYTECODE_OK;
+}
+
+
+/**
+ * @see bytecode_cfg_api.h
+ */
+void bytecode_cfg_dataflow_destroy(cfg_dataflow_t *dataflow)
+{
+    if (NULL == dataflow)
+    {
+        return;
+    }
+
+    memory_manager_free(dataflow->gen);
+    memory_manager_free(dataflow->kill);
+    memory_manager_free(dataflow->in);
+    memory_manager_free(dataflow->out);
+    (void) memset(dataflow, 0, sizeof(cfg_dataflow_t));
+}
+
+
+/**
+ * Combine the facts from the neighbours of a block (predecessors for forward
+ * problems, successors for backward ones) into a single set
+ *
+ * @param    boundary     1 if no facts hold where the block meets the boundary
+ *                        of the graph (entry to the entry block, or exit from
+ *                        a block with no successors)
+ */
+static void _meet(bytecode_cfg_t *cfg, cfg_dataflow_t *dataflow, cfg_meet_e meet,
+                  size_t *neighbours, size_t num_neighbours, cfg_word_t *sets,
+                  int boundary, cfg_word_t *result)
+{
+    cfg_word_t identity = (CFG_MEET_UNION == meet) ? 0u : ~((cfg_word_t) 0u);
+
+    for (size_t w = 0u; w < dataflow->words; w++)
+    {
+        result[w] = boundary ? 0u : identity;
+    }
+
+    for (size_t i = 0u; i < num_neighbours; i++)
+    {
+        cfg_word_t *set;
+
+        if (!cfg->blocks[neighbours[i]].reachable)
+        {
+            continue;
+        }
+
+        set = CFG_BLOCK_SET(dataflow, sets, neighbours[i]);
+
+        for (size_t w = 0u; w < dataflow->words; w++)
+        {
+            result[w] = (CFG_MEET_UNION == meet) ? (result[w] | set[w]) : (result[w] & set[w]);
+        }
+    }
+}
+
+
+/**
+ * @see bytecode_cfg_api.h
+ */
+void bytecode_cfg_solve(bytecode_cfg_t *cfg, cfg_dataflow_t *dataflow,
+                        cfg_direction_e direction, cfg_meet_e meet)
+{
+    size_t size = cfg->num_blocks * dataflow->words * sizeof(cfg_word_t);
+    int forward = (CFG_FORWARD == direction);
+
+    // Sets computed by the transfer functions start at the top of the lattice
+    (void) memset(dataflow->in, 0, size);
+    (void) memset(dataflow->out, 0, size);
+
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        cfg_word_t *result = CFG_BLOCK_SET(dataflow, forward ? dataflow->out : dataflow->in, i);
+
+        if (cfg->blocks[i].reachable && (CFG_MEET_INTERSECTION == meet))
+        {
+            (void) memset(result, 0xff, dataflow->words * sizeof(cfg_word_t));
+        }
+    }
+
+    int changed;
+
+    do
+    {
+        changed = 0;
+
+        for (size_t k = 0u; k < cfg->num_blocks; k++)
+        {
+            // Visit blocks in layout order for forward problems, and reverse order for backward ones
+            size_t i = cfg->layout[forward ? k : (cfg->num_blocks - k - 1u)];
+            cfg_block_t *block = cfg->blocks + i;
+            cfg_word_t *input, *output;
+
+            if (!block->reachable)
+            {
+                continue;
+            }
+
+            if (forward)
+            {
+                input = CFG_BLOCK_SET(dataflow, dataflow->in, i);
+                output = CFG_BLOCK_SET(dataflow, dataflow->out, i);
+                _meet(cfg, dataflow, meet, block->predecessors, block->num_predecessors,
+                      dataflow->out, (0u == i) || block->called, input);
+            }
+            else
+            {
+                input = CFG_BLOCK_SET(dataflow, dataflow->out, i);
+                output = CFG_BLOCK_SET(dataflow, dataflow->in, i);
+                _meet(cfg, dataflow, meet, block->successors, block->num_successors,
+                      dataflow->in, (0u == block->num_successors), input);
+            }
+
+            cfg_word_t *gen = CFG_BLOCK_SET(dataflow, dataflow->gen, i);
+            cfg_word_t *kill = CFG_BLOCK_SET(dataflow, dataflow->kill, i);
+
+            for (size_t w = 0u; w < dataflow->words; w++)
+            {
+                cfg_word_t value = gen[w] | (input[w] & ~kill[w]);
+
+                if (value != output[w])
+                {
+                    output[w] = value;
+                    changed = 1;
+                }
+            }
+        }
+    }
+    while (changed);
+}
+
+
+/**
+ * @see bytecode_cfg_api.h
+ */
+bytecode_status_e bytecode_cfg_liveness(bytecode_cfg_t *cfg, cfg_dataflow_t *liveness)
+{
+    bytecode_status_e err;
+
+    if ((NULL == cfg) || (NULL == liveness))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    if ((err = bytecode_cfg_dataflow_init(cfg, liveness, cfg->max_depth)) != BYTECODE_OK)
+    {
+        return err;
+    }
+
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        cfg_block_t *block = cfg->blocks + i;
+        cfg_word_t *gen = CFG_BLOCK_SET(liveness, liveness->gen, i);
+        cfg_word_t *kill = CFG_BLOCK_SET(liveness, liveness->kill, i);
+        uint32_t depth = block->entry_depth;
+
+        if (!block->reachable)
+        {
+            continue;
+        }
+
+        for (size_t j = 0u; j < block->num_instructions; j++)
+        {
+            uint32_t pops, pushes;
+
+            bytecode_cfg_stack_effect(block->instructions + j, &pops, &pushes);
+
+            // Slots popped before being pushed in this block are used on entry
+            for (uint32_t slot = depth - pops; slot < depth; slot++)
+            {
+                if (!CFG_BIT_TEST(kill, slot))
+                {
+                    CFG_BIT_SET(gen, slot);
+                }
+            }
+
+            depth -= pops;
+
+            for (uint32_t slot = depth; slot < (depth + pushes); slot++)
+            {
+                CFG_BIT_SET(kill, slot);
+            }
+
+            depth += pushes;
+        }
+    }
+
+    bytecode_cfg_solve(cfg, liveness, CFG_BACKWARD, CFG_MEET_UNION);
+    return BYTECODE_OK;
+}
+
+
+/**
+ * Number every value pushed by a reachable instruction
+ *
+ * @return   Number of definitions found; if 'definitions' is not NULL, they
+ *           are also stored there
+ */
+static size_t _find_definitions(bytecode_cfg_t *cfg, cfg_definition_t *definitions)
+{
+    size_t count = 0u;
+
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        cfg_block_t *block = cfg->blocks + i;
+        uint32_t depth = block->entry_depth;
+
+        if (!block->reachable)
+        {
+            continue;
+        }
+
+        for (size_t j = 0u; j < block->num_instructions; j++)
+        {
+            uint32_t pops, pushes;
+
+            bytecode_cfg_stack_effect(block->instructions + j, &pops, &pushes);
+            depth -= pops;
+
+            for (uint32_t p = 0u; p < pushes; p++, count++)
+            {
+                if (NULL != definitions)
+                {
+                    definitions[count].block = i;
+                    definitions[count].instruction = j;
+                    definitions[count].slot = depth + p;
+                }
+            }
+
+            depth += pushes;
+        }
+    }
+
+    return count;
+}
+
+
+/**
+ * @see bytecode_cfg_api.h
+ */
+bytecode_status_e bytecode_cfg_reaching_definitions(bytecode_cfg_t *cfg,
+                                                    cfg_dataflow_t *reaching,
+                                                    cfg_definition_t **definitions,
+                                                    size_t *num_definitions)
+{
+    cfg_definition_t *defs = NULL;
+    size_t *last_def = NULL;
+    cfg_word_t *defined = NULL;
+    bytecode_status_e err;
+
+    if ((NULL == cfg) || (NULL == reaching) || (NULL == definitions) || (NULL == num_definitions))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    size_t count = _find_definitions(cfg, NULL);
+
+    if ((err = bytecode_cfg_dataflow_init(cfg, reaching, count)) != BYTECODE_OK)
+    {
+        return err;
+    }
+
+    // Blocks with no definitions still need somewhere to point
+    defs = memory_manager_alloc(((0u < count) ? count : 1u) * sizeof(cfg_definition_t));
+    last_def = memory_manager_alloc(((0u < cfg->max_depth) ? cfg->max_depth : 1u) * sizeof(size_t));
+    defined = memory_manager_alloc(CFG_BITSET_WORDS(cfg->max_depth + 1u) * sizeof(cfg_word_t));
+
+    if ((NULL == defs) || (NULL == last_def) || (NULL == defined))
+    {
+        memory_manager_free(defs);
+        memory_manager_free(last_def);
+        memory_manager_free(defined);
+        bytecode_cfg_dataflow_destroy(reaching);
+        return BYTECODE_MEMORY_ERROR;
+    }
+
+    (void) _find_definitions(cfg, defs);
+
+    size_t d = 0u;
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        cfg_word_t *gen = CFG_BLOCK_SET(reaching, reaching->gen, i);
+        cfg_word_t *kill = CFG_BLOCK_SET(reaching, reaching->kill, i);
+
+        (void) memset(defined, 0, CFG_BITSET_WORDS(cfg->max_depth + 1u) * sizeof(cfg_word_t));
+
+        // Definitions are numbered in block order, so each block's are together
+        for (; (d < count) && (defs[d].block == i); d++)
+        {
+            CFG_BIT_SET(defined, defs[d].slot);
+            last_def[defs[d].slot] = d;
+        }
+
+        // The last definition of each slot in the block reaches the end of it,
+        // and every other definition of those slots is killed
+        for (uint32_t slot = 0u; slot < cfg->max_depth; slot++)
+        {
+            if (CFG_BIT_TEST(defined, slot))
+            {
+                CFG_BIT_SET(gen, last_def[slot]);
+            }
+        }
+
+        for (size_t k = 0u; k < count; k++)
+        {
+            if (CFG_BIT_TEST(defined, defs[k].slot) && !CFG_BIT_TEST(gen, k))
+            {
+                CFG_BIT_SET(kill, k);
+            }
+        }
+    }
+
+    memory_manager_free(last_def);
+    memory_manager_free(defined);
+
+    bytecode_cfg_solve(cfg, reaching, CFG_FORWARD, CFG_MEET_UNION);
+
+    *definitions = defs;
+    *num_definitions = count;
+    return BYTECODE_OK;
+}
+
+
+/* Emit a jump or call with a placeholder offset, and record it to be fixed up later */
+static bytecode_status_e _emit_jump(bytecode_t *output, opcode_e opcode,
+                                    bytecode_operand_t *operand, size_t target,
+                                    pending_jump_t *jumps, size_t *num_jumps)
+{
+    bytecode_operand_t placeholder = *operand;
+
+    placeholder.jump_offset = 0;
+    jumps[*num_jumps].position = (uint32_t) output->used_bytes;
+    jumps[*num_jumps].target = target;
+    *num_jumps += 1u;
+
+    return bytecode_utils_emit_instruction(output, opcode, &placeholder);
+}
+
+
+/* Write every block that hasn't been removed, in layout order */
+static bytecode_status_e _linearise(bytecode_cfg_t *cfg, bytecode_t *output,
+                                    uint32_t *offsets, pending_jump_t *jumps,
+                                    size_t *num_jumps)
+{
+    opcode_e last_opcode = OPCODE_NOP;
+    bytecode_status_e err;
+
+    for (size_t k = 0u; k < cfg->num_blocks; k++)
+    {
+        size_t i = cfg->layout[k];
+        cfg_block_t *block = cfg->blocks + i;
+        size_t next = CFG_NO_BLOCK;
+
+        if (block->removed)
+        {
+            continue;
+        }
+
+        for (size_t n = k + 1u; n < cfg->num_blocks; n++)
+        {
+            if (!cfg->blocks[cfg->layout[n]].removed)
+            {
+                next = cfg->layout[n];
+                break;
+            }
+        }
+
+        offsets[i] = (uint32_t) output->used_bytes;
+
+        for (size_t j = 0u; j < block->num_instructions; j++)
+        {
+            cfg_instruction_t *ins = block->instructions + j;
+
+            if (bytecode_utils_has_target(ins->opcode))
+            {
+                // Jumps to the block written next are just a fall-through
+                if ((OPCODE_JUMP == ins->opcode) && (ins->target == next) &&
+                    ((j + 1u) == block->num_instructions))
+                {
+                    continue;
+                }
+
+                err = _emit_jump(output, ins->opcode, &ins->operand, ins->target,
+                                 jumps, num_jumps);
+            }
+            else
+            {
+                err = bytecode_utils_emit_instruction(output, ins->opcode, &ins->operand);
+            }
+
+            if (BYTECODE_OK != err)
+            {
+                return err;
+            }
+
+            last_opcode = ins->opcode;
+        }
+
+        if (_falls_through(block) && (block->fallthrough != next))
+        {
+            bytecode_operand_t operand = {.jump_offset=0};
+
+            if (CFG_NO_BLOCK == block->fallthrough)
+            {
+                return BYTECODE_ERROR;
+            }
+
+            if ((err = _emit_jump(output, OPCODE_JUMP, &operand, block->fallthrough,
+                                  jumps, num_jumps)) != BYTECODE_OK)
+            {
+                return err;
+            }
+
+            last_opcode = OPCODE_JUMP;
+        }
+    }
+
+    // Bytecode always ends with OPCODE_END, even if it can't be reached
+    if (OPCODE_END != last_opcode)
+    {
+        if ((err = bytecode_emit_end(output)) != BYTECODE_OK)
+        {
+            return err;
+        }
+    }
+
+    // Fix up jump offsets for the new block positions
+    for (size_t j = 0u; j < *num_jumps; j++)
+    {
+        if ((cfg->num_blocks <= jumps[j].target) || cfg->blocks[jumps[j].target].removed)
+        {
+            return BYTECODE_ERROR;
+        }
+
+        int32_t offset = (int32_t) (offsets[jumps[j].target] - jumps[j].position);
+        if ((err = bytecode_backpatch_jump(output, jumps[j].position, offset)) != BYTECODE_OK)
+        {
+            return err;
+        }
+    }
+
+    return BYTECODE_OK;
+}
+
+
+/**
+ * @see bytecode_cfg_api.h
+ */
+bytecode_status_e bytecode_cfg_linearise(bytecode_cfg_t *cfg, bytecode_t *output)
+{
+    bytecode_status_e err;
+    size_t max_jumps = 0u;
+    size_t num_jumps = 0u;
+
+    if ((NULL == cfg) || (NULL == cfg->blocks) || (NULL == output))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    // At most one jump per instruction, plus one added after each block
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        max_jumps += cfg->blocks[i].num_instructions + 1u;
+    }
+
+    uint32_t *offsets = memory_manager_alloc(cfg->num_blocks * sizeof(uint32_t));
+    pending_jump_t *jumps = memory_manager_alloc(max_jumps * sizeof(pending_jump_t));
+
+    if ((NULL == offsets) || (NULL == jumps))
+    {
+        memory_manager_free(offsets);
+        memory_manager_free(jumps);
+        return BYTECODE_MEMORY_ERROR;
+    }
+
+    if ((err = bytecode_create(output)) == BYTECODE_OK)
+    {
+        err = _linearise(cfg, output, offsets, jumps, &num_jumps);
+        if (BYTECODE_OK != err)
+        {
+            (void) bytecode_destroy(output);
+        }
+    }
+
+    memory_manager_free(offsets);
+    memory_manager_free(jumps);
+    return err;
+}
@@ -0,0 +1,317 @@
+/**
+ * Control-flow graph for bytecode, with a dataflow framework for analyses
+ * that work on it.
+ *
+ * A program is split into basic blocks; straight-line runs of instructions
+ * that are only entered at the first instruction, and only left after the
+ * last one. Jumps refer to the block they land on rather than to a byte
+ * offset, so passes can insert, remove and reorder instructions and blocks
+ * freely, and bytecode_cfg_linearise works out the new jump offsets when the
+ * graph is turned back into bytecode.
+ */
+
+#ifndef BYTECODE_CFG_API_H_
+#define BYTECODE_CFG_API_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bytecode_api.h"
+#include "bytecode_utils_api.h"
+
+
+/* Block index used where there is no block */
+#define CFG_NO_BLOCK (SIZE_MAX)
+
+
+/* Bitsets used by the dataflow framework are arrays of these */
+typedef uint32_t cfg_word_t;
+
+#define CFG_WORD_BITS (32u)
+
+/* Number of words needed for a bitset of the given size */
+#define CFG_BITSET_WORDS(bits) (((bits) + (CFG_WORD_BITS - 1u)) / CFG_WORD_BITS)
+
+#define CFG_BIT_TEST(set, bit) (((set)[(bit) / CFG_WORD_BITS] >> ((bit) % CFG_WORD_BITS)) & 1u)
+#define CFG_BIT_SET(set, bit) ((set)[(bit) / CFG_WORD_BITS] |= (1u << ((bit) % CFG_WORD_BITS)))
+#define CFG_BIT_CLEAR(set, bit) ((set)[(bit) / CFG_WORD_BITS] &= ~(1u << ((bit) % CFG_WORD_BITS)))
+
+
+/* A single instruction in a basic block. String operands point into the
+ * bytecode the graph was built from, so it must not be destroyed first. */
+typedef struct
+{
+    opcode_e opcode;               // Superinstructions are split into their components
+    bytecode_operand_t operand;    // Decoded operands; jump_offset is not used
+    size_t target;                 // Index of block jumped to or called, for jumps and calls
+    uint32_t offset;               // Offset in the bytecode the graph was built from
+} cfg_instruction_t;
+
+
+typedef struct
+{
+    cfg_instruction_t *instructions;
+    size_t num_instructions;
+    size_t capacity;               // Number of instructions allocated
+
+    /* Block that runs next if control reaches the end of this one without
+     * jumping, or CFG_NO_BLOCK. Set to the following block when the graph is
+     * built, and kept when blocks are reordered. */
+    size_t fallthrough;
+
+    /* Set by bytecode_cfg_link */
+    size_t successors[2];          // Fall-through successor first, if there is one
+    size_t num_successors;
+    size_t *predecessors;
+    size_t num_predecessors;
+    uint8_t reachable;             // 1 if there is a path from the entry block, maybe through calls
+    uint8_t called;                // 1 if a reachable call lands on this block
+
+    /* Set by bytecode_cfg_stack_depths */
+    uint32_t entry_depth;          // Number of values on the data stack on entry
+
+    uint8_t removed;               // 1 if this block has been removed
+} cfg_block_t;
+
+
+typedef struct
+{
+    cfg_block_t *blocks;           // Block 0 is the entry block
+    size_t num_blocks;
+
+    /* Order in which blocks are written by bytecode_cfg_linearise. Holds
+     * every block index once, starting with the entry block. */
+    size_t *layout;
+
+    uint32_t max_depth;            // Set by bytecode_cfg_stack_depths
+} bytecode_cfg_t;
+
+
+/* Direction in which facts flow through the graph */
+typedef enum
+{
+    CFG_FORWARD,                   // From predecessors to successors, e.g. reaching definitions
+    CFG_BACKWARD                   // From successors to predecessors, e.g. liveness
+} cfg_direction_e;
+
+
+/* How facts are combined where paths meet */
+typedef enum
+{
+    CFG_MEET_UNION,                // True on any path
+    CFG_MEET_INTERSECTION          // True on every path
+} cfg_meet_e;
+
+
+/**
+ * Sets of facts for a single dataflow problem. Each array holds one bitset of
+ * 'words' words for each block, in block index order; use CFG_BLOCK_SET to
+ * find the set for a block. The transfer function of a block is
+ * out = gen | (in & ~kill) (with in and out swapped for backward problems).
+ */
+typedef struct
+{
+    size_t num_bits;               // Number of facts
+    size_t words;                  // Words in each bitset
+    cfg_word_t *gen;               // Facts created by each block
+    cfg_word_t *kill;              // Facts destroyed by each block
+    cfg_word_t *in;                // Facts on entry to each block, once solved
+    cfg_word_t *out;               // Facts on exit from each block, once solved
+} cfg_dataflow_t;
+
+
+#define CFG_BLOCK_SET(dataflow, sets, block) ((sets) + ((block) * (dataflow)->words))
+
+
+/* A value pushed onto the data stack; the facts of reaching definitions */
+typedef struct
+{
+    size_t block;                  // Block containing the instruction
+    size_t instruction;            // Index of the instruction in the block
+    uint32_t slot;                 // Data stack slot written, counting from the bottom
+} cfg_definition_t;
+
+
+/**
+ * Build the control-flow graph for a chunk of bytecode. Blocks start at the
+ * first instruction, at every jump and call target, and after every jump,
+ * OPCODE_END, OPCODE_RETURN and OPCODE_TAIL_CALL; they are numbered in bytecode order. Successors and
+ * predecessors are set up with bytecode_cfg_link.
+ *
+ * @param    program    Pointer to bytecode to build the graph for
+ * @param    cfg        Pointer to graph to populate
+ *
+ * @return   BYTECODE_OK if successful, BYTECODE_ERROR if the bytecode
+ *           contains invalid instructions or jumps, or doesn't end with
+ *           OPCODE_END
+ */
+bytecode_status_e bytecode_cfg_build(bytecode_t *program, bytecode_cfg_t *cfg);
+
+
+/**
+ * Free all memory held by a control-flow graph
+ *
+ * @param    cfg    Pointer to graph to destroy
+ */
+void bytecode_cfg_destroy(bytecode_cfg_t *cfg);
+
+
+/**
+ * Find the successors and predecessors of every block, and which blocks are
+ * reachable from the entry block. Blocks that are called are reachable if
+ * the block holding the call is. Must be called again after changing jumps,
+ * fall-throughs or the last instruction of any block. Removed blocks have no
+ * successors or predecessors.
+ *
+ * @param    cfg    Pointer to graph to update
+ *
+ * @return   BYTECODE_OK if successful, BYTECODE_ERROR if a block that has not
+ *           been removed jumps or falls through to one that has
+ */
+bytecode_status_e bytecode_cfg_link(bytecode_cfg_t *cfg);
+
+
+/**
+ * Insert an instruction into a block
+ *
+ * @param    cfg            Pointer to graph to edit
+ * @param    block          Index of block to insert into
+ * @param    index          Position of the new instruction in the block
+ * @param    instruction    Instruction to insert
+ *
+ * @return   BYTECODE_OK if successful
+ */
+bytecode_status_e bytecode_cfg_insert(bytecode_cfg_t *cfg, size_t block, size_t index,
+                                      cfg_instruction_t *instruction);
+
+
+/**
+ * Remove an instruction from a block
+ *
+ * @param    cfg      Pointer to graph to edit
+ * @param    block    Index of block to remove from
+ * @param    index    Position of the instruction in the block
+ *
+ * @return   BYTECODE_OK if successful
+ */
+bytecode_status_e bytecode_cfg_remove(bytecode_cfg_t *cfg, size_t block, size_t index);
+
+
+/**
+ * Returns the last instruction of a block, or NULL if the block is empty
+ */
+cfg_instruction_t *bytecode_cfg_last(cfg_block_t *block);
+
+
+/**
+ * Find how many values an instruction pops from and pushes onto the data
+ * stack
+ *
+ * @param    instruction    Instruction to look up
+ * @param    pops           Pointer to location to store number of values popped
+ * @param    pushes         Pointer to location to store number of values pushed
+ */
+void bytecode_cfg_stack_effect(cfg_instruction_t *instruction, uint32_t *pops,
+                               uint32_t *pushes);
+
+
+/**
+ * Find the depth of the data stack on entry to every reachable block, and the
+ * maximum depth anywhere in the program. The stack is empty on entry to the
+ * entry block and to every called block. The graph must have been linked.
+ *
+ * @param    cfg    Pointer to graph to analyse
+ *
+ * @return   BYTECODE_OK if successful, BYTECODE_ERROR if the stack underflows,
+ *           or if paths reach a block with different stack depths (the stack
+ *           slots of such programs can't be analysed)
+ */
+bytecode_status_e bytecode_cfg_stack_depths(bytecode_cfg_t *cfg);
+
+
+/**
+ * Allocate the sets for a dataflow problem; gen and kill are cleared, and
+ * must be filled in before calling bytecode_cfg_solve
+ *
+ * @param    cfg         Pointer to graph the problem is for
+ * @param    dataflow    Pointer to problem to initialise
+ * @param    num_bits    Number of facts
+ *
+ * @return   BYTECODE_OK if successful
+ */
+bytecode_status_e bytecode_cfg_dataflow_init(bytecode_cfg_t *cfg, cfg_dataflow_t *dataflow,
+                                             size_t num_bits);
+
+
+/**
+ * Free the sets allocated by bytecode_cfg_dataflow_init
+ *
+ * @param    dataflow    Pointer to problem to destroy
+ */
+void bytecode_cfg_dataflow_destroy(cfg_dataflow_t *dataflow);
+
+
+/**
+ * Solve a dataflow problem, by iterating the transfer functions of all
+ * reachable blocks until the in and out sets stop changing. No facts hold on
+ * entry to the entry block or a called block (forward problems), or on exit
+ * from blocks with no successors (backward problems). Unreachable blocks are left with empty sets.
+ *
+ * @param    cfg          Pointer to linked graph
+ * @param    dataflow     Pointer to problem, with gen and kill filled in
+ * @param    direction    Direction in which facts flow
+ * @param    meet         How facts are combined where paths meet
+ */
+void bytecode_cfg_solve(bytecode_cfg_t *cfg, cfg_dataflow_t *dataflow,
+                        cfg_direction_e direction, cfg_meet_e meet);
+
+
+/**
+ * Find which data stack slots are live (hold a value that will be popped
+ * later) on entry to and exit from every block. Fact N is stack slot N,
+ * counting from the bottom of the stack.
+ *
+ * @param    cfg         Pointer to graph, after bytecode_cfg_stack_depths
+ * @param    liveness    Pointer to problem to initialise and solve
+ *
+ * @return   BYTECODE_OK if successful
+ */
+bytecode_status_e bytecode_cfg_liveness(bytecode_cfg_t *cfg, cfg_dataflow_t *liveness);
+
+
+/**
+ * Find which values pushed onto the data stack reach the entry to and exit
+ * from every block. Each instruction that pushes a value is a definition of
+ * the stack slot it writes; fact N is definitions[N].
+ *
+ * @param    cfg                Pointer to graph, after bytecode_cfg_stack_depths
+ * @param    reaching           Pointer to problem to initialise and solve
+ * @param    definitions        Pointer to location to store array of definitions,
+ *                              freed by the caller with memory_manager_free
+ * @param    num_definitions    Pointer to location to store number of definitions
+ *
+ * @return   BYTECODE_OK if successful
+ */
+bytecode_status_e bytecode_cfg_reaching_definitions(bytecode_cfg_t *cfg,
+                                                    cfg_dataflow_t *reaching,
+                                                    cfg_definition_t **definitions,
+                                                    size_t *num_definitions);
+
+
+/**
+ * Write the blocks out as bytecode, in layout order. Removed blocks are
+ * skipped, a JUMP is added after any block whose fall-through block isn't
+ * written next, and a JUMP to the block written next is dropped. Jump offsets
+ * are calculated for the new block positions. If the last block written
+ * doesn't end with OPCODE_END, one is added, since vm_verify requires it. Superinstructions are not
+ * re-created; run bytecode_optimize afterwards for that.
+ *
+ * @param    cfg       Pointer to linked graph
+ * @param    output    Pointer to bytecode to create
+ *
+ * @return   BYTECODE_OK if successful
+ */
+bytecode_status_e bytecode_cfg_linearise(bytecode_cfg_t *cfg, bytecode_t *output);
+
+
+#endif /* BYTECODE_CFG_API_H_ */
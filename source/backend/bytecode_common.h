@@ -1,6 +1,8 @@
 #ifndef BYTECODE_COMMON_H
 #define BYTECODE_COMMON_H
 
+#include "superinstructions.h"
+
 
 /* C type representing an encoded opcode */
 typedef uint8_t opcode_t;
@@ -16,6 +18,9 @@ typedef struct
 } bytecode_t;
 
 
+#define SUPERINSTRUCTION_OPCODE(op, handler, pops, pushes) op,
+
+
 /* Enumeration of all valid opcode values */
 typedef enum
 {
@@ -35,6 +40,61 @@ typedef enum
     OPCODE_DEFINE_CONST,  // Add a new value to the constant pool
     OPCODE_LOAD_CONST,    // Load a value from constant pool and push
     OPCODE_END,           // Sentinel value indicating end of the program
+
+    /* Arithmetic specialised for operand types proven by type inference
+     * (see type_inference_api.h), rather than emitted by a compiler */
+    OPCODE_ADD_INT_INT,       // ADD, both operands are known to be ints
+    OPCODE_SUB_INT_INT,       // SUB, both operands are known to be ints
+    OPCODE_MULT_INT_INT,      // MULT, both operands are known to be ints
+    OPCODE_DIV_INT_INT,       // DIV, both operands are known to be ints
+    OPCODE_ADD_FLOAT_FLOAT,   // ADD, both operands are known to be floats
+    OPCODE_SUB_FLOAT_FLOAT,   // SUB, both operands are known to be floats
+    OPCODE_MULT_FLOAT_FLOAT,  // MULT, both operands are known to be floats
+    OPCODE_DIV_FLOAT_FLOAT,   // DIV, both operands are known to be floats
+
+    /* Inverted branch, emitted when blocks are reordered (see block_layout_api.h) */
+    OPCODE_JUMP_IF_TRUE,      // Pop a value, cast to bool, jump to offset if true
+
+    /* Comparisons */
+    OPCODE_EQUAL,             // Pop two values, push true if they are equal
+    OPCODE_NOT_EQUAL,         // Pop two values, push true if they are not equal
+    OPCODE_LESS,              // Pop two values, push true if the first pushed is less
+    OPCODE_LESS_EQUAL,        // Pop two values, push true if the first pushed is less or equal
+    OPCODE_GREATER,           // Pop two values, push true if the first pushed is greater
+    OPCODE_GREATER_EQUAL,     // Pop two values, push true if the first pushed is greater or equal
+
+    /* Comparison followed by a conditional jump, fused by the optimizer
+     * (see bytecode_optimizer_api.h) */
+    OPCODE_JUMP_IF_EQUAL,          // Pop two values, jump to offset if they are equal
+    OPCODE_JUMP_IF_NOT_EQUAL,      // Pop two values, jump to offset if they are not equal
+    OPCODE_JUMP_IF_LESS,           // Pop two values, jump to offset if the first pushed is less
+    OPCODE_JUMP_IF_LESS_EQUAL,     // Pop two values, jump to offset if the first pushed is less or equal
+    OPCODE_JUMP_IF_GREATER,        // Pop two values, jump to offset if the first pushed is greater
+    OPCODE_JUMP_IF_GREATER_EQUAL,  // Pop two values, jump to offset if the first pushed is greater or equal
+
+    /* Fused compare-and-branch specialised for int operands proven by type inference */
+    OPCODE_JUMP_IF_EQUAL_INT,          // JUMP_IF_EQUAL, both operands are known to be ints
+    OPCODE_JUMP_IF_NOT_EQUAL_INT,      // JUMP_IF_NOT_EQUAL, both operands are known to be ints
+    OPCODE_JUMP_IF_LESS_INT,           // JUMP_IF_LESS, both operands are known to be ints
+    OPCODE_JUMP_IF_LESS_EQUAL_INT,     // JUMP_IF_LESS_EQUAL, both operands are known to be ints
+    OPCODE_JUMP_IF_GREATER_INT,        // JUMP_IF_GREATER, both operands are known to be ints
+    OPCODE_JUMP_IF_GREATER_EQUAL_INT,  // JUMP_IF_GREATER_EQUAL, both operands are known to be ints
+
+    /* Variables held in the slot array of the current call frame */
+    OPCODE_LOAD_LOCAL,        // Push the value held by a local variable slot
+    OPCODE_STORE_LOCAL,       // Pop a value and store it in a local variable slot
+
+    /* Variables held in the globals table of the VM instance */
+    OPCODE_LOAD_GLOBAL,       // Push the value of a global variable
+    OPCODE_STORE_GLOBAL,      // Pop a value and store it in a global variable
+
+    /* Functions, whose bodies are part of the same program as their callers */
+    OPCODE_CALL,              // Call the function at an offset, passing values from the data stack
+    OPCODE_TAIL_CALL,         // Call a function in place of the current one, reusing its frame
+    OPCODE_RETURN,            // Pop a value, return from the current function and push it for the caller
+
+    /* Superinstructions substituted by the optimizer (see superinstructions.h) */
+    SUPERINSTRUCTION_LIST(SUPERINSTRUCTION_OPCODE)
     NUM_OPCODES
 } opcode_e;
 
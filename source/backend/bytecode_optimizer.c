@@ -0,0 +1,1081 @@
+/**
+ * Peephole optimizer for bytecode
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "memory_manager_api.h"
+#include "object_helpers_api.h"
+#include "type_operations_api.h"
+#include "bytecode_optimizer_api.h"
+#include "bytecode_utils_api.h"
+
+
+/* Maximum number of jumps followed when collapsing a chain of jumps */
+#define MAX_JUMP_CHAIN (16u)
+
+
+/* Folded strings longer than this are left for the VM to build at runtime,
+ * so that folding can't blow up the size of the bytecode */
+#define MAX_FOLDED_STRING_SIZE (1024u)
+
+
+/* A literal value that is known when the bytecode is optimized */
+typedef struct
+{
+    data_type_e data_type;
+    bytecode_immediate_t value;  // Strings point into the bytecode, or at a folded string
+} literal_t;
+
+
+/* A single instruction being optimized */
+typedef struct
+{
+    opcode_e opcode;
+    bytecode_operand_t operand;
+    size_t target;               // Index of jump target, for jump instructions
+    uint32_t new_offset;         // Offset of this instruction in the optimized bytecode
+    uint8_t removed;             // 1 if this instruction has been removed
+    uint8_t is_target;           // 1 if any jump lands on this instruction
+    opcode_e superinstruction;   // Superinstruction starting here, or OPCODE_NOP
+} opt_instruction_t;
+
+
+/* A sequence of instructions that can be replaced with a superinstruction */
+typedef struct
+{
+    opcode_e opcode;             // Superinstruction opcode
+    uint32_t length;             // Number of instructions in the sequence
+    opcode_e components[3];      // Opcodes of the instructions in the sequence
+} sequence_t;
+
+
+#define SEQUENCE_ENTRY(op, handler, length, first, second, third)             \
+    {op, length, {first, second, third}},
+
+
+/* All superinstructions, in order of preference. Ends with an empty entry,
+ * since there may not be any superinstructions. */
+static const sequence_t _sequences[] =
+{
+    SUPERINSTRUCTION_SEQUENCES(SEQUENCE_ENTRY)
+    {OPCODE_NOP, 0u, {OPCODE_NOP, OPCODE_NOP, OPCODE_NOP}}
+};
+
+
+typedef struct
+{
+    opt_instruction_t *instructions;
+    size_t num_instructions;
+    literal_t *constants;        // Values defined by OPCODE_DEFINE_CONST, in order
+    uint32_t num_constants;
+    char **strings;              // Strings created by folding, freed when done
+    size_t num_strings;
+} optimizer_t;
+
+
+/**
+ * Returns the index of the first instruction that has not been removed,
+ * starting at the given index. OPCODE_END is never removed, so this always
+ * finds an instruction.
+ */
+static size_t _next_live(optimizer_t *opt, size_t index)
+{
+    while (opt->instructions[index].removed)
+    {
+        index += 1u;
+    }
+
+    return index;
+}
+
+
+/**
+ * Remove an instruction. Jumps to a removed instruction land on the next live
+ * instruction instead, so that instruction becomes a jump target.
+ */
+static void _remove(optimizer_t *opt, size_t index)
+{
+    opt_instruction_t *ins = opt->instructions + index;
+
+    ins->removed = 1u;
+    if (ins->is_target)
+    {
+        opt->instructions[_next_live(opt, index + 1u)].is_target = 1u;
+    }
+}
+
+
+/**
+ * Fetch the literal value pushed by an instruction
+ *
+ * @return   1 if the instruction pushes a literal, 0 otherwise
+ */
+static int _get_literal(optimizer_t *opt, opt_instruction_t *ins, literal_t *literal)
+{
+    switch (ins->opcode)
+    {
+        case OPCODE_INT:
+            literal->data_type = DATATYPE_INT;
+            break;
+
+        case OPCODE_FLOAT:
+            literal->data_type = DATATYPE_FLOAT;
+            break;
+
+        case OPCODE_BOOL:
+            literal->data_type = DATATYPE_BOOL;
+            break;
+
+        case OPCODE_STRING:
+            literal->data_type = DATATYPE_STRING;
+            break;
+
+        case OPCODE_LOAD_CONST:
+            if (opt->num_constants <= ins->operand.const_index)
+            {
+                return 0;
+            }
+
+            *literal = opt->constants[ins->operand.const_index];
+            return 1;
+
+        default:
+            return 0;
+    }
+
+    literal->value = ins->operand.immediate;
+    return 1;
+}
+
+
+/**
+ * Replace an instruction with one that pushes the given literal value
+ */
+static void _set_literal(opt_instruction_t *ins, literal_t *literal)
+{
+    static const opcode_e push_opcodes[NUM_DATATYPES] =
+    {
+        [DATATYPE_INT] = OPCODE_INT,
+        [DATATYPE_FLOAT] = OPCODE_FLOAT,
+        [DATATYPE_STRING] = OPCODE_STRING,
+        [DATATYPE_BOOL] = OPCODE_BOOL
+    };
+
+    ins->opcode = push_opcodes[literal->data_type];
+    ins->operand.immediate = literal->value;
+}
+
+
+/**
+ * Take a copy of string data produced by folding; the copy is owned by the
+ * optimizer and is freed once the optimized bytecode has been emitted
+ *
+ * @return   1 if successful, 0 if memory allocation failed
+ */
+static int _new_string(optimizer_t *opt, const char *bytes, size_t size, literal_t *literal)
+{
+    char *copy;
+    char **strings;
+
+    if ((copy = memory_manager_alloc(size + 1u)) == NULL)
+    {
+        return 0;
+    }
+
+    strings = memory_manager_realloc(opt->strings, (opt->num_strings + 1u) * sizeof(char *));
+    if (NULL == strings)
+    {
+        memory_manager_free(copy);
+        return 0;
+    }
+
+    (void) memcpy(copy, bytes, size);
+    copy[size] = '\0';
+
+    opt->strings = strings;
+    opt->strings[opt->num_strings++] = copy;
+
+    literal->data_type = DATATYPE_STRING;
+    literal->value.string.bytes = copy;
+    literal->value.string.size = (uint32_t) size;
+    return 1;
+}
+
+
+static int _fold_string_mult(optimizer_t *opt, literal_t *string, vm_int_t count,
+                             literal_t *result)
+{
+    size_t size = string->value.string.size;
+    char buf[MAX_FOLDED_STRING_SIZE];
+
+    if ((1 > count) || (0u == size) || ((MAX_FOLDED_STRING_SIZE / size) < (size_t) count))
+    {
+        return 0;
+    }
+
+    for (vm_int_t i = 0; i < count; i++)
+    {
+        (void) memcpy(buf + (i * size), string->value.string.bytes, size);
+    }
+
+    return _new_string(opt, buf, size * count, result);
+}
+
+
+static int _fold_string_add(optimizer_t *opt, literal_t *lhs, literal_t *rhs,
+                            literal_t *result)
+{
+    size_t lsize = lhs->value.string.size;
+    size_t rsize = rhs->value.string.size;
+    char buf[MAX_FOLDED_STRING_SIZE];
+
+    if ((0u == (lsize + rsize)) || (MAX_FOLDED_STRING_SIZE < (lsize + rsize)))
+    {
+        return 0;
+    }
+
+    (void) memcpy(buf, lhs->value.string.bytes, lsize);
+    (void) memcpy(buf + lsize, rhs->value.string.bytes, rsize);
+
+    return _new_string(opt, buf, lsize + rsize, result);
+}
+
+
+static int _fold_int(int64_t lhs, int64_t rhs, opcode_e opcode, literal_t *result)
+{
+    int64_t value;
+
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+            value = lhs + rhs;
+            break;
+
+        case OPCODE_SUB:
+            value = lhs - rhs;
+            break;
+
+        case OPCODE_MULT:
+            value = lhs * rhs;
+            break;
+
+        case OPCODE_DIV:
+            if (0 == rhs)
+            {
+                return 0;
+            }
+
+            value = lhs / rhs;
+            break;
+
+        default:
+            return 0;
+    }
+
+    // Leave anything that overflows a vm_int_t for the VM
+    if ((INT32_MIN > value) || (INT32_MAX < value))
+    {
+        return 0;
+    }
+
+    result->data_type = DATATYPE_INT;
+    result->value.int_value = (vm_int_t) value;
+    return 1;
+}
+
+
+static int _fold_float(vm_float_t lhs, vm_float_t rhs, opcode_e opcode, literal_t *result)
+{
+    vm_float_t value;
+
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+            value = lhs + rhs;
+            break;
+
+        case OPCODE_SUB:
+            value = lhs - rhs;
+            break;
+
+        case OPCODE_MULT:
+            value = lhs * rhs;
+            break;
+
+        case OPCODE_DIV:
+            value = lhs / rhs;
+            break;
+
+        default:
+            return 0;
+    }
+
+    result->data_type = DATATYPE_FLOAT;
+    result->value.float_value = value;
+    return 1;
+}
+
+
+/**
+ * Fold a binary operation with two literal operands. Only combinations of
+ * data types that the VM supports without a runtime error are folded.
+ *
+ * @return   1 if the operation was folded, 0 otherwise
+ */
+static int _fold_binary(optimizer_t *opt, literal_t *lhs, literal_t *rhs,
+                        opcode_e opcode, literal_t *result)
+{
+    bytecode_immediate_t *l = &lhs->value;
+    bytecode_immediate_t *r = &rhs->value;
+
+    switch (lhs->data_type)
+    {
+        case DATATYPE_INT:
+            if (DATATYPE_INT == rhs->data_type)
+            {
+                return _fold_int(l->int_value, r->int_value, opcode, result);
+            }
+            else if (DATATYPE_FLOAT == rhs->data_type)
+            {
+                return _fold_float((vm_float_t) l->int_value, r->float_value, opcode, result);
+            }
+            else if ((DATATYPE_STRING == rhs->data_type) && (OPCODE_MULT == opcode))
+            {
+                return _fold_string_mult(opt, rhs, l->int_value, result);
+            }
+            break;
+
+        case DATATYPE_FLOAT:
+            if (DATATYPE_INT == rhs->data_type)
+            {
+                return _fold_float(l->float_value, (vm_float_t) r->int_value, opcode, result);
+            }
+            else if (DATATYPE_FLOAT == rhs->data_type)
+            {
+                return _fold_float(l->float_value, r->float_value, opcode, result);
+            }
+            break;
+
+        case DATATYPE_STRING:
+            if ((DATATYPE_INT == rhs->data_type) && (OPCODE_MULT == opcode))
+            {
+                return _fold_string_mult(opt, lhs, r->int_value, result);
+            }
+            else if ((DATATYPE_STRING == rhs->data_type) && (OPCODE_ADD == opcode))
+            {
+                return _fold_string_add(opt, lhs, rhs, result);
+            }
+            break;
+
+        case DATATYPE_BOOL:
+            if (DATATYPE_INT == rhs->data_type)
+            {
+                return _fold_int(l->bool_value, r->int_value, opcode, result);
+            }
+            else if (DATATYPE_FLOAT == rhs->data_type)
+            {
+                return _fold_float((vm_float_t) l->bool_value, r->float_value, opcode, result);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+
+/* Numerical value of an int, float or bool literal, for comparisons */
+static vm_float_t _literal_number(literal_t *literal)
+{
+    switch (literal->data_type)
+    {
+        case DATATYPE_INT:
+            return (vm_float_t) literal->value.int_value;
+
+        case DATATYPE_FLOAT:
+            return literal->value.float_value;
+
+        default:
+            return (vm_float_t) literal->value.bool_value;
+    }
+}
+
+
+/**
+ * Fold a comparison of two numeric literals, ordering numbers exactly like
+ * type_compare does (NaN is equal to itself, and greater than any other
+ * number). Comparisons of strings are left for the VM.
+ *
+ * @return   1 if the comparison was folded, 0 otherwise
+ */
+static int _fold_compare(literal_t *lhs, literal_t *rhs, opcode_e opcode, literal_t *result)
+{
+    int order;
+
+    if ((DATATYPE_STRING == lhs->data_type) || (DATATYPE_STRING == rhs->data_type) ||
+        (OPCODE_NOP == bytecode_utils_compare_jump(opcode)))
+    {
+        return 0;
+    }
+
+    if ((DATATYPE_INT == lhs->data_type) && (DATATYPE_INT == rhs->data_type))
+    {
+        vm_int_t a = lhs->value.int_value;
+        vm_int_t b = rhs->value.int_value;
+        order = (a < b) ? -1 : ((a > b) ? 1 : 0);
+    }
+    else
+    {
+        vm_float_t a = _literal_number(lhs);
+        vm_float_t b = _literal_number(rhs);
+
+        if ((a == b) || (isnan(a) && isnan(b)))
+        {
+            order = 0;
+        }
+        else
+        {
+            order = ((a < b) || isnan(b)) ? -1 : 1;
+        }
+    }
+
+    switch (opcode)
+    {
+        case OPCODE_EQUAL:
+            result->value.bool_value = (0 == order);
+            break;
+
+        case OPCODE_NOT_EQUAL:
+            result->value.bool_value = (0 != order);
+            break;
+
+        case OPCODE_LESS:
+            result->value.bool_value = (0 > order);
+            break;
+
+        case OPCODE_LESS_EQUAL:
+            result->value.bool_value = (0 >= order);
+            break;
+
+        case OPCODE_GREATER:
+            result->value.bool_value = (0 < order);
+            break;
+
+        default:
+            result->value.bool_value = (0 <= order);
+            break;
+    }
+
+    result->data_type = DATATYPE_BOOL;
+    return 1;
+}
+
+
+/**
+ * Fold a cast of a literal value, with the same cast functions and string
+ * formatting as the VM (see type_operations_api.h). Casts from strings are
+ * left for the VM.
+ *
+ * @return   1 if the cast was folded, 0 otherwise
+ */
+static int _fold_cast(optimizer_t *opt, literal_t *input, data_type_e type,
+                      uint16_t extra_data, literal_t *result)
+{
+    char buf[TYPE_MAX_STRING_NUM_SIZE + TYPE_MAX_FLOAT_PLACES];
+    value_t value, output;
+    int printed;
+
+    if (input->data_type == type)
+    {
+        *result = *input;
+        return 1;
+    }
+
+    if ((DATATYPE_STRING == input->data_type) || (NUM_DATATYPES <= type))
+    {
+        return 0;
+    }
+
+    // The VM creates a string object, so only the formatting is shared
+    if (DATATYPE_STRING == type)
+    {
+        switch (input->data_type)
+        {
+            case DATATYPE_INT:
+                printed = type_format_int(input->value.int_value, buf, sizeof(buf));
+                break;
+
+            case DATATYPE_FLOAT:
+                // Too many decimal places is a runtime error
+                if (TYPE_MAX_FLOAT_PLACES < extra_data)
+                {
+                    return 0;
+                }
+
+                printed = type_format_float(input->value.float_value, extra_data,
+                                            buf, sizeof(buf));
+                break;
+
+            default:
+                printed = snprintf(buf, sizeof(buf), "%s",
+                                   type_format_bool(input->value.bool_value));
+                break;
+        }
+
+        if ((0 > printed) || (sizeof(buf) <= (size_t) printed))
+        {
+            return 0;
+        }
+
+        return _new_string(opt, buf, (size_t) printed, result);
+    }
+
+    switch (input->data_type)
+    {
+        case DATATYPE_INT:
+            value = INT_VALUE(input->value.int_value);
+            break;
+
+        case DATATYPE_FLOAT:
+            // Leave anything that doesn't fit in a vm_int_t for the VM
+            if ((DATATYPE_INT == type) &&
+                !((input->value.float_value > (vm_float_t) INT32_MIN - 1.0) &&
+                  (input->value.float_value < (vm_float_t) INT32_MAX + 1.0)))
+            {
+                return 0;
+            }
+
+            value = FLOAT_VALUE(input->value.float_value);
+            break;
+
+        default:
+            value = BOOL_VALUE(input->value.bool_value);
+            break;
+    }
+
+    cast_func_t cast = type_cast_lookup(input->data_type, type);
+    if ((NULL == cast) || (TYPE_OK != cast(&value, &output, extra_data)))
+    {
+        return 0;
+    }
+
+    result->data_type = type;
+
+    switch (type)
+    {
+        case DATATYPE_INT:
+            result->value.int_value = output.payload.int_value;
+            break;
+
+        case DATATYPE_FLOAT:
+            result->value.float_value = output.payload.float_value;
+            break;
+
+        default:
+            result->value.bool_value = output.payload.bool_value;
+            break;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Find the truth value of a literal, as a conditional jump would see it
+ *
+ * @return   1 if the truth value is known, 0 otherwise
+ */
+static int _literal_truth(literal_t *literal, int *truth)
+{
+    switch (literal->data_type)
+    {
+        case DATATYPE_INT:
+            *truth = (0 != literal->value.int_value);
+            return 1;
+
+        case DATATYPE_FLOAT:
+            *truth = (0.0 != literal->value.float_value);
+            return 1;
+
+        case DATATYPE_BOOL:
+            *truth = (0u != literal->value.bool_value);
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+
+/**
+ * Point all jumps and calls at live instructions, collapse chains of
+ * unconditional jumps, and mark every instruction that is the target of a
+ * jump or call
+ */
+static void _resolve_jumps(optimizer_t *opt)
+{
+    for (size_t i = 0u; i < opt->num_instructions; i++)
+    {
+        opt->instructions[i].is_target = 0u;
+    }
+
+    for (size_t i = 0u; i < opt->num_instructions; i++)
+    {
+        opt_instruction_t *ins = opt->instructions + i;
+
+        if (ins->removed || !bytecode_utils_has_target(ins->opcode))
+        {
+            continue;
+        }
+
+        size_t target = _next_live(opt, ins->target);
+
+        for (unsigned hops = 0u; hops < MAX_JUMP_CHAIN; hops++)
+        {
+            opt_instruction_t *next = opt->instructions + target;
+            if ((OPCODE_JUMP != next->opcode) || (next == ins))
+            {
+                break;
+            }
+
+            target = _next_live(opt, next->target);
+        }
+
+        ins->target = target;
+        opt->instructions[target].is_target = 1u;
+    }
+}
+
+
+/**
+ * Apply a single rewrite starting at the given instruction, if possible
+ *
+ * @return   1 if the instructions were changed, 0 if nothing was done
+ */
+static int _rewrite(optimizer_t *opt, size_t i)
+{
+    opt_instruction_t *ins = opt->instructions + i;
+    literal_t lhs, rhs, result;
+
+    if (OPCODE_NOP == ins->opcode)
+    {
+        _remove(opt, i);
+        return 1;
+    }
+
+    if (bytecode_utils_is_exit(ins->opcode))
+    {
+        return 0;
+    }
+
+    size_t b = _next_live(opt, i + 1u);
+    opt_instruction_t *next = opt->instructions + b;
+
+    // A call whose result is returned straight away takes over the frame of the current function
+    if (OPCODE_CALL == ins->opcode)
+    {
+        size_t after = (OPCODE_JUMP == next->opcode) ? _next_live(opt, next->target) : b;
+
+        if (OPCODE_RETURN != opt->instructions[after].opcode)
+        {
+            return 0;
+        }
+
+        ins->opcode = OPCODE_TAIL_CALL;
+        if (!next->is_target)
+        {
+            _remove(opt, b);
+        }
+
+        return 1;
+    }
+
+    if ((OPCODE_JUMP == ins->opcode) && (_next_live(opt, ins->target) == b))
+    {
+        _remove(opt, i);
+        return 1;
+    }
+
+    // A comparison followed by a conditional jump becomes a single compare-and-branch
+    opcode_e compare_jump = bytecode_utils_compare_jump(ins->opcode);
+    if ((OPCODE_NOP != compare_jump) && !next->is_target &&
+        ((OPCODE_JUMP_IF_FALSE == next->opcode) || (OPCODE_JUMP_IF_TRUE == next->opcode)))
+    {
+        ins->opcode = (OPCODE_JUMP_IF_TRUE == next->opcode) ? compare_jump :
+                                                              bytecode_utils_invert_jump(compare_jump);
+        ins->operand = next->operand;
+        ins->target = next->target;
+        _remove(opt, b);
+        return 1;
+    }
+
+    if (!_get_literal(opt, ins, &lhs) || next->is_target)
+    {
+        return 0;
+    }
+
+    if ((OPCODE_JUMP_IF_FALSE == next->opcode) || (OPCODE_JUMP_IF_TRUE == next->opcode))
+    {
+        int truth;
+
+        if (!_literal_truth(&lhs, &truth))
+        {
+            return 0;
+        }
+
+        _remove(opt, i);
+        if (truth != (OPCODE_JUMP_IF_TRUE == next->opcode))
+        {
+            _remove(opt, b);
+        }
+        else
+        {
+            next->opcode = OPCODE_JUMP;
+        }
+
+        return 1;
+    }
+
+    if (OPCODE_CAST == next->opcode)
+    {
+        if (!_fold_cast(opt, &lhs, next->operand.cast.data_type,
+                        next->operand.cast.extra_data, &result))
+        {
+            return 0;
+        }
+
+        _set_literal(ins, &result);
+        _remove(opt, b);
+        return 1;
+    }
+
+    if (!_get_literal(opt, next, &rhs))
+    {
+        return 0;
+    }
+
+    size_t c = _next_live(opt, b + 1u);
+    opt_instruction_t *op = opt->instructions + c;
+
+    if (op->is_target || (!_fold_binary(opt, &lhs, &rhs, op->opcode, &result) &&
+                          !_fold_compare(&lhs, &rhs, op->opcode, &result)))
+    {
+        return 0;
+    }
+
+    _set_literal(ins, &result);
+    _remove(opt, b);
+    _remove(opt, c);
+    return 1;
+}
+
+
+/**
+ * Decode bytecode into the optimizer's instruction array, and resolve jump
+ * targets to instruction indices
+ */
+static bytecode_status_e _decode(bytecode_t *program, optimizer_t *opt)
+{
+    bytecode_instruction_t decoded;
+    uint32_t *offset_map;
+    size_t offset, i;
+    bytecode_status_e ret = BYTECODE_OK;
+
+    if ((offset_map = memory_manager_alloc(program->used_bytes * sizeof(uint32_t))) == NULL)
+    {
+        return BYTECODE_MEMORY_ERROR;
+    }
+
+    (void) memset(offset_map, 0xff, program->used_bytes * sizeof(uint32_t));
+
+    // First pass; count instructions and constants, and find instruction boundaries
+    for (offset = 0u; offset < program->used_bytes; offset += decoded.size)
+    {
+        if (!bytecode_utils_decode_instruction(program, offset, &decoded))
+        {
+            memory_manager_free(offset_map);
+            return BYTECODE_ERROR;
+        }
+
+        offset_map[offset] = (uint32_t) opt->num_instructions;
+        opt->num_instructions += 1u;
+
+        if (OPCODE_DEFINE_CONST == decoded.opcode)
+        {
+            opt->num_constants += 1u;
+        }
+    }
+
+    if (OPCODE_END != decoded.opcode)
+    {
+        memory_manager_free(offset_map);
+        return BYTECODE_ERROR;
+    }
+
+    opt->instructions = memory_manager_alloc(opt->num_instructions * sizeof(opt_instruction_t));
+    if (0u < opt->num_constants)
+    {
+        opt->constants = memory_manager_alloc(opt->num_constants * sizeof(literal_t));
+    }
+
+    if ((NULL == opt->instructions) || ((0u < opt->num_constants) && (NULL == opt->constants)))
+    {
+        memory_manager_free(offset_map);
+        return BYTECODE_MEMORY_ERROR;
+    }
+
+    // Second pass; populate instructions and constants, and resolve jump targets
+    uint32_t const_index = 0u;
+    for (offset = 0u, i = 0u; offset < program->used_bytes; offset += decoded.size, i++)
+    {
+        opt_instruction_t *ins = opt->instructions + i;
+
+        (void) bytecode_utils_decode_instruction(program, offset, &decoded);
+
+        // Superinstructions are split up again, and re-created after optimizing
+        ins->opcode = bytecode_utils_base_opcode(decoded.opcode);
+        ins->operand = decoded.operand;
+        ins->target = 0u;
+        ins->removed = 0u;
+        ins->is_target = 0u;
+        ins->superinstruction = OPCODE_NOP;
+
+        if (bytecode_utils_has_target(ins->opcode))
+        {
+            int64_t target = ((int64_t) offset) + decoded.operand.jump_offset;
+
+            if ((0 > target) || (((int64_t) program->used_bytes) <= target) ||
+                (UINT32_MAX == offset_map[target]))
+            {
+                ret = BYTECODE_ERROR;
+                break;
+            }
+
+            ins->target = offset_map[target];
+        }
+        else if (OPCODE_DEFINE_CONST == decoded.opcode)
+        {
+            literal_t *constant = opt->constants + const_index++;
+            constant->data_type = decoded.operand.constant.data_type;
+            constant->value = decoded.operand.constant.value;
+        }
+    }
+
+    memory_manager_free(offset_map);
+    return ret;
+}
+
+
+/**
+ * Returns 1 if the live instructions starting at the given index match a
+ * superinstruction sequence
+ */
+static int _sequence_matches(optimizer_t *opt, size_t index, const sequence_t *sequence)
+{
+    for (uint32_t i = 0u; i < sequence->length; i++)
+    {
+        if (opt->instructions[index].opcode != sequence->components[i])
+        {
+            return 0;
+        }
+
+        // Sequences never contain OPCODE_END, so there is always a next instruction
+        if ((i + 1u) < sequence->length)
+        {
+            index = _next_live(opt, index + 1u);
+        }
+    }
+
+    return 1;
+}
+
+
+/**
+ * Mark the first instruction of each sequence that matches a superinstruction.
+ * The other instructions in the sequence are emitted as normal, so sequences
+ * don't overlap.
+ *
+ * @return   Number of superinstructions created
+ */
+static size_t _fuse(optimizer_t *opt)
+{
+#ifdef VM_PROFILE
+    // Profiling builds keep instructions separate, so the profile shows every sequence
+    return 0u;
+#endif /* VM_PROFILE */
+
+    size_t count = 0u;
+    size_t i = _next_live(opt, 0u);
+
+    // Functions may come after the END of the main program; the last instruction is always END
+    while (i != (opt->num_instructions - 1u))
+    {
+        uint32_t length = 1u;
+
+        for (const sequence_t *seq = _sequences; 0u < seq->length; seq++)
+        {
+            if (_sequence_matches(opt, i, seq))
+            {
+                opt->instructions[i].superinstruction = seq->opcode;
+                length = seq->length;
+                count += 1u;
+                break;
+            }
+        }
+
+        for (uint32_t j = 0u; j < length; j++)
+        {
+            i = _next_live(opt, i + 1u);
+        }
+    }
+
+    return count;
+}
+
+
+/**
+ * Emit all live instructions into a new chunk of bytecode
+ */
+static bytecode_status_e _emit(optimizer_t *opt, bytecode_t *output, size_t *count)
+{
+    bytecode_status_e err;
+
+    *count = 0u;
+
+    for (size_t i = 0u; i < opt->num_instructions; i++)
+    {
+        opt_instruction_t *ins = opt->instructions + i;
+
+        if (ins->removed)
+        {
+            continue;
+        }
+
+        // Jump offsets are filled in once all instructions have been emitted
+        ins->new_offset = (uint32_t) output->used_bytes;
+        err = bytecode_utils_emit_instruction(output, ins->opcode, &ins->operand);
+        if (BYTECODE_OK != err)
+        {
+            return err;
+        }
+
+        // Superinstructions are encoded like their first instruction
+        if (OPCODE_NOP != ins->superinstruction)
+        {
+            output->bytecode[ins->new_offset] = (opcode_t) ins->superinstruction;
+        }
+
+        *count += 1u;
+    }
+
+    // Fix up jump offsets for the new instruction positions
+    for (size_t i = 0u; i < opt->num_instructions; i++)
+    {
+        opt_instruction_t *ins = opt->instructions + i;
+
+        if (ins->removed || !bytecode_utils_has_target(ins->opcode))
+        {
+            continue;
+        }
+
+        int32_t offset = (int32_t) (opt->instructions[ins->target].new_offset - ins->new_offset);
+        if ((err = bytecode_backpatch_jump(output, ins->new_offset, offset)) != BYTECODE_OK)
+        {
+            return err;
+        }
+    }
+
+    return BYTECODE_OK;
+}
+
+
+static void _destroy(optimizer_t *opt)
+{
+    for (size_t i = 0u; i < opt->num_strings; i++)
+    {
+        memory_manager_free(opt->strings[i]);
+    }
+
+    memory_manager_free(opt->strings);
+    memory_manager_free(opt->constants);
+    memory_manager_free(opt->instructions);
+}
+
+
+/**
+ * @see bytecode_optimizer_api.h
+ */
+bytecode_status_e bytecode_optimize(bytecode_t *program,
+                                    bytecode_optimizer_stats_t *stats)
+{
+    optimizer_t opt = {0};
+    bytecode_t output;
+    bytecode_status_e err;
+    size_t count;
+    size_t superinstructions = 0u;
+    int changed;
+
+    if ((NULL == program) || (0u == program->used_bytes))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    if ((err = _decode(program, &opt)) != BYTECODE_OK)
+    {
+        _destroy(&opt);
+        return err;
+    }
+
+    // Keep rewriting until nothing changes
+    do
+    {
+        changed = 0;
+        _resolve_jumps(&opt);
+
+        for (size_t i = 0u; i < opt.num_instructions; i++)
+        {
+            /* Every rewrite removes at least one instruction, except for turning
+             * a CALL into a TAIL_CALL, and no rewrite applies to a TAIL_CALL, so
+             * this terminates */
+            while (!opt.instructions[i].removed && _rewrite(&opt, i))
+            {
+                changed = 1;
+            }
+        }
+    }
+    while (changed);
+
+    superinstructions = _fuse(&opt);
+
+    if ((err = bytecode_create(&output)) != BYTECODE_OK)
+    {
+        _destroy(&opt);
+        return err;
+    }
+
+    if ((err = _emit(&opt, &output, &count)) != BYTECODE_OK)
+    {
+        (void) bytecode_destroy(&output);
+        _destroy(&opt);
+        return err;
+    }
+
+    if (NULL != stats)
+    {
+        stats->instructions_before = opt.num_instructions;
+        stats->instructions_after = count;
+        stats->superinstructions = superinstructions;
+    }
+
+    _destroy(&opt);
+    (void) bytecode_destroy(program);
+    *program = output;
+
+    return BYTECODE_OK;
+}
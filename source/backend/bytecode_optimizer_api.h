@@ -0,0 +1,60 @@
+/**
+ * Peephole optimizer for bytecode
+ */
+
+#ifndef BYTECODE_OPTIMIZER_API_H_
+#define BYTECODE_OPTIMIZER_API_H_
+
+#include <stddef.h>
+
+#include "bytecode_api.h"
+
+
+/* Statistics reported by a single run of the optimizer */
+typedef struct
+{
+    size_t instructions_before;  // Number of instructions in the input bytecode
+    size_t instructions_after;   // Number of instructions in the optimized bytecode
+    size_t superinstructions;    // Number of superinstructions created
+} bytecode_optimizer_stats_t;
+
+
+/**
+ * Optimize a chunk of bytecode in place. Should be called after all bytecode
+ * has been emitted, and before vm_verify. The following rewrites are applied
+ * repeatedly, until no more changes can be made:
+ *
+ * - arithmetic, casts and comparisons of numbers with literal operands
+ *   (including values loaded from the constant pool) are folded into a single
+ *   literal
+ * - NOPs are removed
+ * - JUMP_IF_FALSE or JUMP_IF_TRUE on a literal is replaced with either
+ *   nothing (and the literal push is removed), or an unconditional JUMP
+ * - a comparison followed by JUMP_IF_FALSE or JUMP_IF_TRUE is replaced with a
+ *   single compare-and-branch instruction (e.g. LESS followed by JUMP_IF_FALSE
+ *   becomes JUMP_IF_GREATER_EQUAL)
+ * - chains of unconditional jumps are collapsed, and jumps to the next
+ *   instruction are removed
+ * - a CALL followed by RETURN, or by a JUMP to a RETURN, is replaced with a
+ *   TAIL_CALL, which reuses the frame of the current function
+ *
+ * Finally, the first instruction of each sequence listed in superinstructions.h
+ * is replaced with the corresponding superinstruction (unless built with
+ * VM_PROFILE, so that profiles always show the individual instructions).
+ *
+ * Operations that would generate a runtime error are never folded, so the
+ * optimized program behaves exactly like the original. Jump offsets are fixed
+ * up for the new instruction positions.
+ *
+ * @param    program    Pointer to bytecode to optimize
+ * @param    stats      Pointer to location to store statistics (may be NULL)
+ *
+ * @return   BYTECODE_OK if optimization was successful, BYTECODE_ERROR if the
+ *           bytecode contains invalid instructions or jumps. If optimization
+ *           fails, the original bytecode is left unchanged.
+ */
+bytecode_status_e bytecode_optimize(bytecode_t *program,
+                                    bytecode_optimizer_stats_t *stats);
+
+
+#endif /* BYTECODE_OPTIMIZER_API_H_ */
@@ -1,8 +1,32 @@
+#include <string.h>
+
 #include "bytecode_utils_api.h"
+#include "memory_manager_api.h"
 #include "data_types.h"
 #include "common.h"
 
 
+// Read a value of the given type from a possibly unaligned location in bytecode
+#define READ_OPERAND(ptr, type)                                               \
+    ({                                                                        \
+        type __value;                                                         \
+        (void) memcpy(&__value, (ptr), sizeof(type));                         \
+        __value;                                                              \
+    })
+
+
+// Check that the given number of bytes are available at an offset in bytecode
+#define REQUIRE_BYTES(prog, offset, num_bytes)                                \
+    do {                                                                      \
+        if (((prog)->used_bytes < (offset)) ||                                \
+            (((prog)->used_bytes - (offset)) < (num_bytes)))                  \
+        {                                                                     \
+            return 0;                                                         \
+        }                                                                     \
+    }                                                                         \
+    while (0)
+
+
 /**
  * @see bytecode_utils_api.h
  */
@@ -80,3 +104,533 @@ size_t bytecode_utils_data_object_encoded_size_bytes(data_object_t *data_obj)
     return ret;
 }
 
+
+
+/**
+ * Decode an immediate value of the given data type, and return the number of
+ * bytes it occupies in the bytecode (0 if the data type is invalid, or the
+ * value runs past the end of the bytecode).
+ */
+static size_t _decode_immediate(bytecode_t *program, size_t offset,
+                                data_type_e data_type,
+                                bytecode_immediate_t *immediate)
+{
+    opcode_t *data = program->bytecode + offset;
+
+    switch (data_type)
+    {
+        case DATATYPE_INT:
+            REQUIRE_BYTES(program, offset, sizeof(vm_int_t));
+            immediate->int_value = READ_OPERAND(data, vm_int_t);
+            return sizeof(vm_int_t);
+
+        case DATATYPE_FLOAT:
+            REQUIRE_BYTES(program, offset, sizeof(vm_float_t));
+            immediate->float_value = READ_OPERAND(data, vm_float_t);
+            return sizeof(vm_float_t);
+
+        case DATATYPE_BOOL:
+            REQUIRE_BYTES(program, offset, sizeof(vm_bool_t));
+            immediate->bool_value = READ_OPERAND(data, vm_bool_t);
+            return sizeof(vm_bool_t);
+
+        case DATATYPE_STRING:
+        {
+            REQUIRE_BYTES(program, offset, sizeof(uint32_t));
+            uint32_t string_size = READ_OPERAND(data, uint32_t);
+
+            REQUIRE_BYTES(program, offset + sizeof(uint32_t), string_size);
+            immediate->string.size = string_size;
+            immediate->string.bytes = (char *) INCREMENT_PTR_BYTES(data, sizeof(uint32_t));
+            return sizeof(uint32_t) + string_size;
+        }
+
+        default:
+            return 0u;
+    }
+}
+
+
+/**
+ * @see bytecode_utils_api.h
+ */
+int bytecode_utils_decode_instruction(bytecode_t *program, size_t offset,
+                                      bytecode_instruction_t *instruction)
+{
+    REQUIRE_BYTES(program, offset, 1u);
+
+    opcode_t *ip = program->bytecode + offset;
+    opcode_t *operands = INCREMENT_PTR_BYTES(ip, 1);
+    size_t operand_offset = offset + 1u;
+    size_t operand_bytes = 0u;
+
+    if (NUM_OPCODES <= *ip)
+    {
+        return 0;
+    }
+
+    instruction->opcode = (opcode_e) *ip;
+    instruction->offset = (uint32_t) offset;
+
+    // Operands of a superinstruction are encoded as for its first instruction
+    switch (bytecode_utils_base_opcode(instruction->opcode))
+    {
+        case OPCODE_INT:
+            operand_bytes = _decode_immediate(program, operand_offset, DATATYPE_INT,
+                                              &instruction->operand.immediate);
+            if (0u == operand_bytes)
+            {
+                return 0;
+            }
+            break;
+
+        case OPCODE_FLOAT:
+            operand_bytes = _decode_immediate(program, operand_offset, DATATYPE_FLOAT,
+                                              &instruction->operand.immediate);
+            if (0u == operand_bytes)
+            {
+                return 0;
+            }
+            break;
+
+        case OPCODE_BOOL:
+            operand_bytes = _decode_immediate(program, operand_offset, DATATYPE_BOOL,
+                                              &instruction->operand.immediate);
+            if (0u == operand_bytes)
+            {
+                return 0;
+            }
+            break;
+
+        case OPCODE_STRING:
+            operand_bytes = _decode_immediate(program, operand_offset, DATATYPE_STRING,
+                                              &instruction->operand.immediate);
+            if (0u == operand_bytes)
+            {
+                return 0;
+            }
+            break;
+
+        case OPCODE_CAST:
+            operand_bytes = sizeof(uint8_t) + sizeof(uint16_t);
+            REQUIRE_BYTES(program, operand_offset, operand_bytes);
+            instruction->operand.cast.data_type = (data_type_e) *operands;
+            instruction->operand.cast.extra_data =
+                READ_OPERAND(INCREMENT_PTR_BYTES(operands, 1), uint16_t);
+            break;
+
+        case OPCODE_JUMP:
+        case OPCODE_JUMP_IF_FALSE:
+        case OPCODE_JUMP_IF_TRUE:
+        case OPCODE_JUMP_IF_EQUAL:
+        case OPCODE_JUMP_IF_NOT_EQUAL:
+        case OPCODE_JUMP_IF_LESS:
+        case OPCODE_JUMP_IF_LESS_EQUAL:
+        case OPCODE_JUMP_IF_GREATER:
+        case OPCODE_JUMP_IF_GREATER_EQUAL:
+        case OPCODE_JUMP_IF_EQUAL_INT:
+        case OPCODE_JUMP_IF_NOT_EQUAL_INT:
+        case OPCODE_JUMP_IF_LESS_INT:
+        case OPCODE_JUMP_IF_LESS_EQUAL_INT:
+        case OPCODE_JUMP_IF_GREATER_INT:
+        case OPCODE_JUMP_IF_GREATER_EQUAL_INT:
+            operand_bytes = sizeof(int32_t);
+            REQUIRE_BYTES(program, operand_offset, operand_bytes);
+            instruction->operand.jump_offset = READ_OPERAND(operands, int32_t);
+            break;
+
+        case OPCODE_CALL:
+        case OPCODE_TAIL_CALL:
+            operand_bytes = sizeof(int32_t) + sizeof(uint8_t);
+            REQUIRE_BYTES(program, operand_offset, operand_bytes);
+            instruction->operand.call.jump_offset = READ_OPERAND(operands, int32_t);
+            instruction->operand.call.num_args = *INCREMENT_PTR_BYTES(operands, sizeof(int32_t));
+            break;
+
+        case OPCODE_LOAD_CONST:
+        case OPCODE_LOAD_GLOBAL:
+        case OPCODE_STORE_GLOBAL:
+            operand_bytes = sizeof(uint32_t);
+            REQUIRE_BYTES(program, operand_offset, operand_bytes);
+            instruction->operand.const_index = READ_OPERAND(operands, uint32_t);
+            break;
+
+        case OPCODE_LOAD_LOCAL:
+        case OPCODE_STORE_LOCAL:
+            operand_bytes = sizeof(uint16_t);
+            REQUIRE_BYTES(program, operand_offset, operand_bytes);
+            instruction->operand.local_index = READ_OPERAND(operands, uint16_t);
+            break;
+
+        case OPCODE_DEFINE_CONST:
+        {
+            REQUIRE_BYTES(program, operand_offset, 1u);
+            data_type_e data_type = (data_type_e) *operands;
+
+            instruction->operand.constant.data_type = data_type;
+            operand_bytes = _decode_immediate(program, operand_offset + 1u, data_type,
+                                              &instruction->operand.constant.value);
+            if (0u == operand_bytes)
+            {
+                return 0;
+            }
+
+            // +1 for the data type
+            operand_bytes += 1u;
+            break;
+        }
+
+        default:
+            // No operands
+            break;
+    }
+
+    instruction->size = (uint32_t) (1u + operand_bytes);
+    return 1;
+}
+
+
+#define SEQUENCE_BASE_CASE(op, handler, length, first, second, third)         \
+    case op:                                                                  \
+        return first;
+
+
+#define SEQUENCE_LENGTH_CASE(op, handler, length, first, second, third)       \
+    case op:                                                                  \
+        return length;
+
+
+/**
+ * @see bytecode_utils_api.h
+ */
+opcode_e bytecode_utils_base_opcode(opcode_e opcode)
+{
+    switch (opcode)
+    {
+        SUPERINSTRUCTION_SEQUENCES(SEQUENCE_BASE_CASE)
+
+        default:
+            return opcode;
+    }
+}
+
+
+/**
+ * @see bytecode_utils_api.h
+ */
+uint32_t bytecode_utils_sequence_length(opcode_e opcode)
+{
+    switch (opcode)
+    {
+        SUPERINSTRUCTION_SEQUENCES(SEQUENCE_LENGTH_CASE)
+
+        default:
+            return 1u;
+    }
+}
+
+
+/**
+ * @see bytecode_utils_api.h
+ */
+int bytecode_utils_is_compare_jump(opcode_e opcode)
+{
+    return (OPCODE_JUMP_IF_EQUAL <= opcode) && (OPCODE_JUMP_IF_GREATER_EQUAL_INT >= opcode);
+}
+
+
+/**
+ * @see bytecode_utils_api.h
+ */
+int bytecode_utils_is_conditional_jump(opcode_e opcode)
+{
+    return (OPCODE_JUMP_IF_FALSE == opcode) || (OPCODE_JUMP_IF_TRUE == opcode) ||
+           bytecode_utils_is_compare_jump(opcode);
+}
+
+
+/**
+ * @see bytecode_utils_api.h
+ */
+opcode_e bytecode_utils_invert_jump(opcode_e opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_JUMP_IF_FALSE:
+            return OPCODE_JUMP_IF_TRUE;
+        case OPCODE_JUMP_IF_TRUE:
+            return OPCODE_JUMP_IF_FALSE;
+
+        case OPCODE_JUMP_IF_EQUAL:
+            return OPCODE_JUMP_IF_NOT_EQUAL;
+        case OPCODE_JUMP_IF_NOT_EQUAL:
+            return OPCODE_JUMP_IF_EQUAL;
+        case OPCODE_JUMP_IF_LESS:
+            return OPCODE_JUMP_IF_GREATER_EQUAL;
+        case OPCODE_JUMP_IF_LESS_EQUAL:
+            return OPCODE_JUMP_IF_GREATER;
+        case OPCODE_JUMP_IF_GREATER:
+            return OPCODE_JUMP_IF_LESS_EQUAL;
+        case OPCODE_JUMP_IF_GREATER_EQUAL:
+            return OPCODE_JUMP_IF_LESS;
+
+        case OPCODE_JUMP_IF_EQUAL_INT:
+            return OPCODE_JUMP_IF_NOT_EQUAL_INT;
+        case OPCODE_JUMP_IF_NOT_EQUAL_INT:
+            return OPCODE_JUMP_IF_EQUAL_INT;
+        case OPCODE_JUMP_IF_LESS_INT:
+            return OPCODE_JUMP_IF_GREATER_EQUAL_INT;
+        case OPCODE_JUMP_IF_LESS_EQUAL_INT:
+            return OPCODE_JUMP_IF_GREATER_INT;
+        case OPCODE_JUMP_IF_GREATER_INT:
+            return OPCODE_JUMP_IF_LESS_EQUAL_INT;
+        case OPCODE_JUMP_IF_GREATER_EQUAL_INT:
+            return OPCODE_JUMP_IF_LESS_INT;
+
+        default:
+            return OPCODE_NOP;
+    }
+}
+
+
+/**
+ * @see bytecode_utils_api.h
+ */
+opcode_e bytecode_utils_compare_jump(opcode_e opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_EQUAL:
+            return OPCODE_JUMP_IF_EQUAL;
+        case OPCODE_NOT_EQUAL:
+            return OPCODE_JUMP_IF_NOT_EQUAL;
+        case OPCODE_LESS:
+            return OPCODE_JUMP_IF_LESS;
+        case OPCODE_LESS_EQUAL:
+            return OPCODE_JUMP_IF_LESS_EQUAL;
+        case OPCODE_GREATER:
+            return OPCODE_JUMP_IF_GREATER;
+        case OPCODE_GREATER_EQUAL:
+            return OPCODE_JUMP_IF_GREATER_EQUAL;
+        default:
+            return OPCODE_NOP;
+    }
+}
+
+
+/**
+ * @see bytecode_utils_api.h
+ */
+int bytecode_utils_is_jump(opcode_e opcode)
+{
+    return (OPCODE_JUMP == opcode) || bytecode_utils_is_conditional_jump(opcode);
+}
+
+
+/**
+ * @see bytecode_utils_api.h
+ */
+int bytecode_utils_is_call(opcode_e opcode)
+{
+    return (OPCODE_CALL == opcode) || (OPCODE_TAIL_CALL == opcode);
+}
+
+
+/**
+ * @see bytecode_utils_api.h
+ */
+int bytecode_utils_has_target(opcode_e opcode)
+{
+    return bytecode_utils_is_call(opcode) || bytecode_utils_is_jump(opcode);
+}
+
+
+/**
+ * @see bytecode_utils_api.h
+ */
+int bytecode_utils_is_exit(opcode_e opcode)
+{
+    return (OPCODE_END == opcode) || (OPCODE_RETURN == opcode) || (OPCODE_TAIL_CALL == opcode);
+}
+
+
+/**
+ * Emit a string literal or constant; string data decoded from bytecode is not
+ * null terminated, so it is copied before being passed to the emitter
+ */
+static bytecode_status_e _emit_string(bytecode_t *program, opcode_e opcode,
+                                      bytecode_immediate_t *value)
+{
+    bytecode_status_e err;
+    char *string;
+
+    if ((string = memory_manager_alloc(value->string.size + 1u)) == NULL)
+    {
+        return BYTECODE_MEMORY_ERROR;
+    }
+
+    (void) memcpy(string, value->string.bytes, value->string.size);
+    string[value->string.size] = '\0';
+
+    if (OPCODE_STRING == opcode)
+    {
+        err = bytecode_emit_string(program, string);
+    }
+    else
+    {
+        err = bytecode_emit_define_const(program, DATATYPE_STRING, string);
+    }
+
+    memory_manager_free(string);
+    return err;
+}
+
+
+/**
+ * @see bytecode_utils_api.h
+ */
+bytecode_status_e bytecode_utils_emit_instruction(bytecode_t *program, opcode_e opcode,
+                                                  bytecode_operand_t *operand)
+{
+    switch (opcode)
+    {
+        case OPCODE_NOP:
+            return BYTECODE_OK;
+
+        case OPCODE_ADD:
+            return bytecode_emit_add(program);
+
+        case OPCODE_SUB:
+            return bytecode_emit_sub(program);
+
+        case OPCODE_MULT:
+            return bytecode_emit_mult(program);
+
+        case OPCODE_DIV:
+            return bytecode_emit_div(program);
+
+        case OPCODE_ADD_INT_INT:
+            return bytecode_emit_add_int_int(program);
+
+        case OPCODE_SUB_INT_INT:
+            return bytecode_emit_sub_int_int(program);
+
+        case OPCODE_MULT_INT_INT:
+            return bytecode_emit_mult_int_int(program);
+
+        case OPCODE_DIV_INT_INT:
+            return bytecode_emit_div_int_int(program);
+
+        case OPCODE_ADD_FLOAT_FLOAT:
+            return bytecode_emit_add_float_float(program);
+
+        case OPCODE_SUB_FLOAT_FLOAT:
+            return bytecode_emit_sub_float_float(program);
+
+        case OPCODE_MULT_FLOAT_FLOAT:
+            return bytecode_emit_mult_float_float(program);
+
+        case OPCODE_DIV_FLOAT_FLOAT:
+            return bytecode_emit_div_float_float(program);
+
+        case OPCODE_INT:
+            return bytecode_emit_int(program, operand->immediate.int_value);
+
+        case OPCODE_FLOAT:
+            return bytecode_emit_float(program, operand->immediate.float_value);
+
+        case OPCODE_BOOL:
+            return bytecode_emit_bool(program, operand->immediate.bool_value);
+
+        case OPCODE_STRING:
+            return _emit_string(program, opcode, &operand->immediate);
+
+        case OPCODE_EQUAL:
+            return bytecode_emit_equal(program);
+
+        case OPCODE_NOT_EQUAL:
+            return bytecode_emit_not_equal(program);
+
+        case OPCODE_LESS:
+            return bytecode_emit_less(program);
+
+        case OPCODE_LESS_EQUAL:
+            return bytecode_emit_less_equal(program);
+
+        case OPCODE_GREATER:
+            return bytecode_emit_greater(program);
+
+        case OPCODE_GREATER_EQUAL:
+            return bytecode_emit_greater_equal(program);
+
+        case OPCODE_PRINT:
+            return bytecode_emit_print(program);
+
+        case OPCODE_CAST:
+            return bytecode_emit_cast(program, operand->cast.data_type,
+                                      operand->cast.extra_data);
+
+        case OPCODE_JUMP:
+            return bytecode_emit_jump(program, operand->jump_offset);
+
+        case OPCODE_JUMP_IF_FALSE:
+            return bytecode_emit_jump_if_false(program, operand->jump_offset);
+
+        case OPCODE_JUMP_IF_TRUE:
+            return bytecode_emit_jump_if_true(program, operand->jump_offset);
+
+        case OPCODE_JUMP_IF_EQUAL:
+        case OPCODE_JUMP_IF_NOT_EQUAL:
+        case OPCODE_JUMP_IF_LESS:
+        case OPCODE_JUMP_IF_LESS_EQUAL:
+        case OPCODE_JUMP_IF_GREATER:
+        case OPCODE_JUMP_IF_GREATER_EQUAL:
+        case OPCODE_JUMP_IF_EQUAL_INT:
+        case OPCODE_JUMP_IF_NOT_EQUAL_INT:
+        case OPCODE_JUMP_IF_LESS_INT:
+        case OPCODE_JUMP_IF_LESS_EQUAL_INT:
+        case OPCODE_JUMP_IF_GREATER_INT:
+        case OPCODE_JUMP_IF_GREATER_EQUAL_INT:
+            return bytecode_emit_compare_jump(program, opcode, operand->jump_offset);
+
+        case OPCODE_DEFINE_CONST:
+            if (DATATYPE_STRING == operand->constant.data_type)
+            {
+                return _emit_string(program, opcode, &operand->constant.value);
+            }
+
+            return bytecode_emit_define_const(program, operand->constant.data_type,
+                                              &operand->constant.value);
+
+        case OPCODE_LOAD_CONST:
+            return bytecode_emit_load_const(program, operand->const_index);
+
+        case OPCODE_LOAD_LOCAL:
+            return bytecode_emit_load_local(program, operand->local_index);
+
+        case OPCODE_STORE_LOCAL:
+            return bytecode_emit_store_local(program, operand->local_index);
+
+        case OPCODE_LOAD_GLOBAL:
+            return bytecode_emit_load_global(program, operand->const_index);
+
+        case OPCODE_STORE_GLOBAL:
+            return bytecode_emit_store_global(program, operand->const_index);
+
+        case OPCODE_CALL:
+            return bytecode_emit_call(program, operand->call.jump_offset, operand->call.num_args);
+
+        case OPCODE_TAIL_CALL:
+            return bytecode_emit_tail_call(program, operand->call.jump_offset,
+                                           operand->call.num_args);
+
+        case OPCODE_RETURN:
+            return bytecode_emit_return(program);
+
+        case OPCODE_END:
+            return bytecode_emit_end(program);
+
+        default:
+            return BYTECODE_ERROR;
+    }
+}
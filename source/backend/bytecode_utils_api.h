@@ -4,10 +4,64 @@
 
 #include "data_types.h"
 #include "bytecode_common.h"
+#include "bytecode_api.h"
 
 #include <stddef.h>
 
 
+/* Immediate data value encoded in bytecode */
+typedef union
+{
+    vm_int_t int_value;          // DATATYPE_INT
+    vm_float_t float_value;      // DATATYPE_FLOAT
+    vm_bool_t bool_value;        // DATATYPE_BOOL
+    struct
+    {
+        char *bytes;             // Points directly at string data in bytecode
+        uint32_t size;           // Size of string data in bytes
+    } string;                    // DATATYPE_STRING
+} bytecode_immediate_t;
+
+
+/* Operands for a single decoded instruction; which member is valid depends
+ * on the opcode */
+typedef union
+{
+    bytecode_immediate_t immediate;  // OPCODE_INT, OPCODE_FLOAT, OPCODE_BOOL, OPCODE_STRING
+    int32_t jump_offset;             // OPCODE_JUMP and conditional jumps, and calls (see below)
+    uint32_t const_index;            // OPCODE_LOAD_CONST, and the name of OPCODE_LOAD_GLOBAL and OPCODE_STORE_GLOBAL
+    uint16_t local_index;            // OPCODE_LOAD_LOCAL, OPCODE_STORE_LOCAL
+
+    struct
+    {
+        int32_t jump_offset;         // Offset of the function, shared with jump_offset
+        uint8_t num_args;            // Number of values passed from the data stack
+    } call;                          // OPCODE_CALL, OPCODE_TAIL_CALL
+
+    struct
+    {
+        data_type_e data_type;       // Data type to cast to
+        uint16_t extra_data;         // Numerical base or decimal places
+    } cast;                          // OPCODE_CAST
+
+    struct
+    {
+        data_type_e data_type;       // Data type of constant value
+        bytecode_immediate_t value;  // Constant value
+    } constant;                      // OPCODE_DEFINE_CONST
+} bytecode_operand_t;
+
+
+/* Structure representing a single instruction decoded from bytecode */
+typedef struct
+{
+    opcode_e opcode;                 // Instruction opcode
+    uint32_t offset;                 // Offset of instruction in bytecode, in bytes
+    uint32_t size;                   // Encoded size of instruction, in bytes
+    bytecode_operand_t operand;      // Decoded operands
+} bytecode_instruction_t;
+
+
 /**
  * Given a pointer to an immediate data value encoded in bytecode,
  * return the size in bytes of the data object
@@ -28,4 +82,145 @@ size_t bytecode_utils_data_object_size_bytes(opcode_t *opcode);
 size_t bytecode_utils_data_object_encoded_size_bytes(data_object_t *data_obj);
 
 
+/**
+ * Decode the instruction at the given offset in a chunk of bytecode. Checks that
+ * the opcode is valid, and that the encoded operands do not run past the end
+ * of the bytecode.
+ *
+ * @param    program      Pointer to bytecode to decode from
+ * @param    offset       Offset of instruction to decode, in bytes
+ * @param    instruction  Pointer to location to store decoded instruction
+ *
+ * @return   1 if the instruction was decoded successfully, 0 otherwise
+ */
+int bytecode_utils_decode_instruction(bytecode_t *program, size_t offset,
+                                      bytecode_instruction_t *instruction);
+
+
+/**
+ * Returns the opcode of the first instruction in a superinstruction, which
+ * determines how the operands of the superinstruction are encoded and how it
+ * affects the data stack. Any other opcode is returned unchanged.
+ *
+ * @param    opcode    Opcode to look up
+ *
+ * @return   Opcode of the first instruction in the superinstruction
+ */
+opcode_e bytecode_utils_base_opcode(opcode_e opcode);
+
+
+/**
+ * Returns the number of instructions executed by a superinstruction, including
+ * the first one, or 1 for any other opcode.
+ *
+ * @param    opcode    Opcode to look up
+ *
+ * @return   Number of instructions executed by a single dispatch
+ */
+uint32_t bytecode_utils_sequence_length(opcode_e opcode);
+
+
+/**
+ * Returns 1 if an opcode pops a condition and jumps to its operand offset
+ * depending on the value (OPCODE_JUMP_IF_FALSE, OPCODE_JUMP_IF_TRUE), or pops
+ * two values and jumps depending on how they compare (see
+ * bytecode_utils_is_compare_jump), and carries on with the next instruction
+ * otherwise. Returns 0 for any other opcode, including superinstructions.
+ *
+ * @param    opcode    Opcode to look up
+ */
+int bytecode_utils_is_conditional_jump(opcode_e opcode);
+
+
+/**
+ * Returns 1 if an opcode is a fused compare-and-branch instruction, i.e. one of
+ * OPCODE_JUMP_IF_EQUAL through OPCODE_JUMP_IF_GREATER_EQUAL_INT, 0 otherwise.
+ *
+ * @param    opcode    Opcode to look up
+ */
+int bytecode_utils_is_compare_jump(opcode_e opcode);
+
+
+/**
+ * Returns the conditional jump that jumps exactly when the given one carries on
+ * with the next instruction, e.g. OPCODE_JUMP_IF_GREATER_EQUAL for
+ * OPCODE_JUMP_IF_LESS. Comparisons are totally ordered (see type_compare), so
+ * this is exact for every pair of operands.
+ *
+ * @param    opcode    Conditional jump opcode to invert
+ *
+ * @return   Inverted opcode, or OPCODE_NOP if the opcode is not a conditional jump
+ */
+opcode_e bytecode_utils_invert_jump(opcode_e opcode);
+
+
+/**
+ * Returns the compare-and-branch opcode that jumps when the given comparison is
+ * true, e.g. OPCODE_JUMP_IF_LESS for OPCODE_LESS.
+ *
+ * @param    opcode    Comparison opcode to look up
+ *
+ * @return   Compare-and-branch opcode, or OPCODE_NOP if the opcode is not a
+ *           comparison
+ */
+opcode_e bytecode_utils_compare_jump(opcode_e opcode);
+
+
+/**
+ * Returns 1 if an opcode has a jump offset operand, i.e. it is OPCODE_JUMP or
+ * a conditional jump (see bytecode_utils_is_conditional_jump), 0 otherwise.
+ * Superinstructions should be looked up with bytecode_utils_base_opcode first.
+ *
+ * @param    opcode    Opcode to look up
+ */
+int bytecode_utils_is_jump(opcode_e opcode);
+
+
+/**
+ * Returns 1 if an opcode calls a function, i.e. it is OPCODE_CALL or
+ * OPCODE_TAIL_CALL, 0 otherwise.
+ *
+ * @param    opcode    Opcode to look up
+ */
+int bytecode_utils_is_call(opcode_e opcode);
+
+
+/**
+ * Returns 1 if an opcode has an offset operand that refers to another
+ * instruction, i.e. it is a jump (see bytecode_utils_is_jump) or a call
+ * (see bytecode_utils_is_call), 0 otherwise. Unlike a jump, OPCODE_CALL always
+ * carries on with the next instruction once the function returns.
+ *
+ * @param    opcode    Opcode to look up
+ */
+int bytecode_utils_has_target(opcode_e opcode);
+
+
+/**
+ * Returns 1 if control never passes from an opcode to the next instruction
+ * or to a jump target, i.e. it is OPCODE_END, OPCODE_RETURN or
+ * OPCODE_TAIL_CALL, 0 otherwise.
+ *
+ * @param    opcode    Opcode to look up
+ */
+int bytecode_utils_is_exit(opcode_e opcode);
+
+
+/**
+ * Emit a single instruction from its decoded form; the inverse of
+ * bytecode_utils_decode_instruction. Jumps and calls are emitted with the offset
+ * in operand->jump_offset. OPCODE_NOP emits nothing, and superinstructions can't
+ * be emitted (emit their first instruction, and overwrite the opcode).
+ *
+ * @param    program    Pointer to bytecode to emit into
+ * @param    opcode     Opcode of instruction to emit
+ * @param    operand    Pointer to decoded operands of instruction to emit
+ *
+ * @return   BYTECODE_OK if successful, BYTECODE_ERROR if the opcode can't be
+ *           emitted
+ */
+bytecode_status_e bytecode_utils_emit_instruction(bytecode_t *program, opcode_e opcode,
+                                                  bytecode_operand_t *operand);
+
+
 #endif /* BYTECODE_UTILS_API_H */
@@ -0,0 +1,470 @@
+/**
+ * Dead-code elimination and jump threading for bytecode, working on the basic
+ * blocks of the program
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "memory_manager_api.h"
+#include "dead_code_api.h"
+#include "bytecode_cfg_api.h"
+
+
+/* Maximum number of jumps followed when threading a jump */
+#define MAX_JUMP_CHAIN (16u)
+
+
+/* Index used for constants that are removed */
+#define CONSTANT_REMOVED (UINT32_MAX)
+
+
+typedef struct
+{
+    bytecode_cfg_t cfg;
+    cfg_instruction_t *constants;   // DEFINE_CONST instructions, in constant pool order
+    uint32_t num_constants;
+    dead_code_stats_t stats;
+} dead_code_t;
+
+
+/**
+ * Find the truth value of the condition pushed by an instruction, as a
+ * conditional jump would see it
+ *
+ * @return   1 if the truth value is known, 0 otherwise
+ */
+static int _known_truth(dead_code_t *dce, cfg_instruction_t *ins, int *truth)
+{
+    data_type_e data_type;
+    bytecode_immediate_t *value;
+
+    switch (ins->opcode)
+    {
+        case OPCODE_INT:
+            data_type = DATATYPE_INT;
+            value = &ins->operand.immediate;
+            break;
+
+        case OPCODE_FLOAT:
+            data_type = DATATYPE_FLOAT;
+            value = &ins->operand.immediate;
+            break;
+
+        case OPCODE_BOOL:
+            data_type = DATATYPE_BOOL;
+            value = &ins->operand.immediate;
+            break;
+
+        case OPCODE_LOAD_CONST:
+            if (dce->num_constants <= ins->operand.const_index)
+            {
+                return 0;
+            }
+
+            data_type = dce->constants[ins->operand.const_index].operand.constant.data_type;
+            value = &dce->constants[ins->operand.const_index].operand.constant.value;
+            break;
+
+        default:
+            return 0;
+    }
+
+    switch (data_type)
+    {
+        case DATATYPE_INT:
+            *truth = (0 != value->int_value);
+            return 1;
+
+        case DATATYPE_FLOAT:
+            *truth = (0.0 != value->float_value);
+            return 1;
+
+        case DATATYPE_BOOL:
+            *truth = (0u != value->bool_value);
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+
+/**
+ * Replace a conditional jump with a known condition at the end of a block
+ *
+ * @return   1 if the block was changed, 0 otherwise
+ */
+static int _fold_branch(dead_code_t *dce, size_t index)
+{
+    cfg_block_t *block = dce->cfg.blocks + index;
+    cfg_instruction_t *last = bytecode_cfg_last(block);
+    int truth;
+
+    // Compare-and-branch pops two values, so a single literal can't decide it
+    if ((NULL == last) || !bytecode_utils_is_conditional_jump(last->opcode) ||
+        bytecode_utils_is_compare_jump(last->opcode) || (2u > block->num_instructions))
+    {
+        return 0;
+    }
+
+    size_t push = block->num_instructions - 2u;
+    if (!_known_truth(dce, block->instructions + push, &truth))
+    {
+        return 0;
+    }
+
+    if (truth != (OPCODE_JUMP_IF_TRUE == last->opcode))
+    {
+        // Falls through to the next block
+        block->num_instructions -= 2u;
+    }
+    else
+    {
+        last->opcode = OPCODE_JUMP;
+        (void) bytecode_cfg_remove(&dce->cfg, index, push);
+    }
+
+    dce->stats.branches_folded += 1u;
+    return 1;
+}
+
+
+/**
+ * Returns the block that control ends up in after entering the given block,
+ * if the block does nothing but pass control on (it is empty, or holds only
+ * a JUMP); otherwise, the given block is returned
+ */
+static size_t _final_destination(dead_code_t *dce, size_t index)
+{
+    for (unsigned hops = 0u; hops < MAX_JUMP_CHAIN; hops++)
+    {
+        cfg_block_t *block = dce->cfg.blocks + index;
+        size_t next;
+
+        if (0u == block->num_instructions)
+        {
+            next = block->fallthrough;
+        }
+        else if ((1u == block->num_instructions) && (OPCODE_JUMP == block->instructions[0].opcode))
+        {
+            next = block->instructions[0].target;
+        }
+        else
+        {
+            break;
+        }
+
+        // Loops with no instructions in them are left alone
+        if ((CFG_NO_BLOCK == next) || (next == index))
+        {
+            break;
+        }
+
+        index = next;
+    }
+
+    return index;
+}
+
+
+/**
+ * Redirect the jump and fall-through at the end of a block to their final
+ * destinations
+ *
+ * @return   1 if the block was changed, 0 otherwise
+ */
+static int _thread_jumps(dead_code_t *dce, size_t index)
+{
+    cfg_block_t *block = dce->cfg.blocks + index;
+    cfg_instruction_t *last = bytecode_cfg_last(block);
+    int changed = 0;
+
+    if ((NULL != last) && bytecode_utils_is_jump(last->opcode))
+    {
+        size_t target = _final_destination(dce, last->target);
+
+        if ((target != last->target) && (target != index))
+        {
+            last->target = target;
+            dce->stats.jumps_threaded += 1u;
+            changed = 1;
+        }
+    }
+
+    // The fall-through only matters if the block doesn't end with a JUMP, END or RETURN
+    if ((CFG_NO_BLOCK != block->fallthrough) &&
+        ((NULL == last) || ((OPCODE_JUMP != last->opcode) && !bytecode_utils_is_exit(last->opcode))))
+    {
+        size_t target = _final_destination(dce, block->fallthrough);
+
+        if ((target != block->fallthrough) && (target != index))
+        {
+            block->fallthrough = target;
+            dce->stats.jumps_threaded += 1u;
+            changed = 1;
+        }
+    }
+
+    return changed;
+}
+
+
+/**
+ * Take a copy of every DEFINE_CONST instruction, in constant pool order, so
+ * that constants can still be found after the blocks that define them are
+ * removed
+ */
+static bytecode_status_e _find_constants(dead_code_t *dce)
+{
+    bytecode_cfg_t *cfg = &dce->cfg;
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        dce->num_constants = 0u;
+
+        // Blocks are numbered in bytecode order, which is the constant pool order
+        for (size_t i = 0u; i < cfg->num_blocks; i++)
+        {
+            for (size_t j = 0u; j < cfg->blocks[i].num_instructions; j++)
+            {
+                cfg_instruction_t *ins = cfg->blocks[i].instructions + j;
+
+                if (OPCODE_DEFINE_CONST != ins->opcode)
+                {
+                    continue;
+                }
+
+                if (NULL != dce->constants)
+                {
+                    dce->constants[dce->num_constants] = *ins;
+                }
+
+                dce->num_constants += 1u;
+            }
+        }
+
+        if ((0u == dce->num_constants) || (NULL != dce->constants))
+        {
+            break;
+        }
+
+        dce->constants = memory_manager_alloc(dce->num_constants * sizeof(cfg_instruction_t));
+        if (NULL == dce->constants)
+        {
+            return BYTECODE_MEMORY_ERROR;
+        }
+    }
+
+    return BYTECODE_OK;
+}
+
+
+/* Returns 1 if the const_index operand of an instruction refers to the constant pool */
+static int _uses_constant(opcode_e opcode)
+{
+    return (OPCODE_LOAD_CONST == opcode) || (OPCODE_LOAD_GLOBAL == opcode) ||
+           (OPCODE_STORE_GLOBAL == opcode);
+}
+
+
+/**
+ * Remove DEFINE_CONST instructions for constants that are never used, and
+ * renumber the instructions that refer to them (LOAD_CONST, and the names of
+ * LOAD_GLOBAL and STORE_GLOBAL). Only reachable blocks remain.
+ */
+static bytecode_status_e _remove_constants(dead_code_t *dce)
+{
+    bytecode_cfg_t *cfg = &dce->cfg;
+    bytecode_status_e err = BYTECODE_OK;
+    uint32_t num_used = 0u;
+
+    if (0u == dce->num_constants)
+    {
+        return BYTECODE_OK;
+    }
+
+    uint32_t *new_index = memory_manager_alloc(dce->num_constants * sizeof(uint32_t));
+    if (NULL == new_index)
+    {
+        return BYTECODE_MEMORY_ERROR;
+    }
+
+    for (uint32_t c = 0u; c < dce->num_constants; c++)
+    {
+        new_index[c] = CONSTANT_REMOVED;
+    }
+
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        for (size_t j = 0u; (!cfg->blocks[i].removed) && (j < cfg->blocks[i].num_instructions); j++)
+        {
+            cfg_instruction_t *ins = cfg->blocks[i].instructions + j;
+
+            if (_uses_constant(ins->opcode) && (dce->num_constants > ins->operand.const_index))
+            {
+                new_index[ins->operand.const_index] = 0u;
+            }
+        }
+    }
+
+    for (uint32_t c = 0u; c < dce->num_constants; c++)
+    {
+        if (CONSTANT_REMOVED != new_index[c])
+        {
+            new_index[c] = num_used++;
+        }
+    }
+
+    // Nothing to do if every constant is used, and none were in removed blocks
+    int moved = 0;
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        for (size_t j = 0u; cfg->blocks[i].removed && (j < cfg->blocks[i].num_instructions); j++)
+        {
+            moved |= (OPCODE_DEFINE_CONST == cfg->blocks[i].instructions[j].opcode);
+        }
+    }
+
+    if ((num_used == dce->num_constants) && !moved)
+    {
+        memory_manager_free(new_index);
+        return BYTECODE_OK;
+    }
+
+    // Constants are only defined by their position, so the ones still used
+    // can all go at the start of the program
+    for (size_t i = 0u; i < cfg->num_blocks; i++)
+    {
+        cfg_block_t *block = cfg->blocks + i;
+        size_t j = 0u;
+
+        while ((BYTECODE_OK == err) && (j < block->num_instructions))
+        {
+            cfg_instruction_t *ins = block->instructions + j;
+
+            if (OPCODE_DEFINE_CONST == ins->opcode)
+            {
+                err = bytecode_cfg_remove(cfg, i, j);
+                continue;
+            }
+
+            if (_uses_constant(ins->opcode) && (dce->num_constants > ins->operand.const_index))
+            {
+                ins->operand.const_index = new_index[ins->operand.const_index];
+            }
+
+            j += 1u;
+        }
+    }
+
+    size_t position = 0u;
+    for (uint32_t c = 0u; (c < dce->num_constants) && (BYTECODE_OK == err); c++)
+    {
+        if (CONSTANT_REMOVED == new_index[c])
+        {
+            dce->stats.constants_removed += 1u;
+            continue;
+        }
+
+        err = bytecode_cfg_insert(cfg, 0u, position++, dce->constants + c);
+    }
+
+    memory_manager_free(new_index);
+    return err;
+}
+
+
+/* Apply all the block-level rewrites until nothing changes */
+static bytecode_status_e _eliminate(dead_code_t *dce)
+{
+    bytecode_cfg_t *cfg = &dce->cfg;
+    bytecode_status_e err;
+    int changed;
+
+    do
+    {
+        changed = 0;
+
+        for (size_t i = 0u; i < cfg->num_blocks; i++)
+        {
+            if (!cfg->blocks[i].removed)
+            {
+                changed |= _fold_branch(dce, i);
+                changed |= _thread_jumps(dce, i);
+            }
+        }
+
+        if ((err = bytecode_cfg_link(cfg)) != BYTECODE_OK)
+        {
+            return err;
+        }
+
+        for (size_t i = 0u; i < cfg->num_blocks; i++)
+        {
+            cfg_block_t *block = cfg->blocks + i;
+
+            if (!block->removed && !block->reachable)
+            {
+                block->removed = 1u;
+                dce->stats.blocks_removed += 1u;
+                changed = 1;
+            }
+        }
+
+        if ((err = bytecode_cfg_link(cfg)) != BYTECODE_OK)
+        {
+            return err;
+        }
+    }
+    while (changed);
+
+    return _remove_constants(dce);
+}
+
+
+/**
+ * @see dead_code_api.h
+ */
+bytecode_status_e dead_code_eliminate(bytecode_t *program, dead_code_stats_t *stats)
+{
+    dead_code_t dce;
+    bytecode_t output;
+    bytecode_status_e err;
+
+    if ((NULL == program) || (0u == program->used_bytes))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    (void) memset(&dce, 0, sizeof(dce));
+
+    if ((err = bytecode_cfg_build(program, &dce.cfg)) != BYTECODE_OK)
+    {
+        return err;
+    }
+
+    if (((err = _find_constants(&dce)) == BYTECODE_OK) &&
+        ((err = _eliminate(&dce)) == BYTECODE_OK))
+    {
+        // String operands point into the original bytecode, so it is kept until now
+        err = bytecode_cfg_linearise(&dce.cfg, &output);
+    }
+
+    bytecode_cfg_destroy(&dce.cfg);
+    memory_manager_free(dce.constants);
+
+    if (BYTECODE_OK != err)
+    {
+        return err;
+    }
+
+    if (NULL != stats)
+    {
+        *stats = dce.stats;
+    }
+
+    (void) bytecode_destroy(program);
+    *program = output;
+    return BYTECODE_OK;
+}
@@ -0,0 +1,55 @@
+/**
+ * Dead-code elimination and jump threading for bytecode, working on the basic
+ * blocks of the program (see bytecode_cfg_api.h)
+ */
+
+#ifndef DEAD_CODE_API_H_
+#define DEAD_CODE_API_H_
+
+#include <stddef.h>
+
+#include "bytecode_api.h"
+
+
+/* Statistics reported by a single run of dead-code elimination */
+typedef struct
+{
+    size_t branches_folded;     // Conditional jumps with a known condition
+    size_t jumps_threaded;      // Jumps and fall-throughs redirected past a JUMP
+    size_t blocks_removed;      // Unreachable blocks removed
+    size_t constants_removed;   // DEFINE_CONST instructions that were never loaded
+} dead_code_stats_t;
+
+
+/**
+ * Remove code that can never run, and jumps that only lead to other jumps.
+ * The following are applied repeatedly, until no more changes can be made:
+ *
+ * - a conditional jump whose condition is pushed by the instruction before
+ *   it, as an int, float or bool literal, or loaded from an int, float or bool
+ *   constant, is replaced with an unconditional JUMP (if the jump is always
+ *   taken) or removed (if it never is), along with the push
+ * - jumps and fall-throughs to a block that does nothing but jump somewhere
+ *   else go straight to the final destination instead
+ * - blocks that can't be reached from the start of the program are removed
+ *
+ * Finally, DEFINE_CONST instructions whose constant is never used by a
+ * reachable LOAD_CONST, LOAD_GLOBAL or STORE_GLOBAL are removed, and the
+ * constant indices of those instructions are renumbered to match. The remaining DEFINE_CONST instructions are moved to the start of the
+ * program, in their original order.
+ *
+ * Arithmetic on literals is folded by bytecode_optimize, so running it first
+ * exposes more conditions that are known; running it afterwards re-creates
+ * the superinstructions, which this pass splits up.
+ *
+ * @param    program    Pointer to bytecode to optimize
+ * @param    stats      Pointer to location to store statistics (may be NULL)
+ *
+ * @return   BYTECODE_OK if successful, BYTECODE_ERROR if the bytecode contains
+ *           invalid instructions or jumps. If elimination fails, the original
+ *           bytecode is left unchanged.
+ */
+bytecode_status_e dead_code_eliminate(bytecode_t *program, dead_code_stats_t *stats);
+
+
+#endif /* DEAD_CODE_API_H_ */
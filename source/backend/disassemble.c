@@ -2,9 +2,28 @@
 
 #include "byte_string_api.h"
 #include "disassemble_api.h"
+#include "bytecode_utils_api.h"
 #include "data_types.h"
 
 
+#define SUPERINSTRUCTION_NAME_CASE(op, handler, length, first, second, third) \
+    case op:                                                                  \
+        return (#op) + (sizeof("OPCODE_") - 1u);
+
+
+/* Returns the name of a superinstruction opcode, without the OPCODE_ prefix */
+static const char *_superinstruction_name(opcode_e opcode)
+{
+    switch (opcode)
+    {
+        SUPERINSTRUCTION_SEQUENCES(SUPERINSTRUCTION_NAME_CASE)
+
+        default:
+            return "????";
+    }
+}
+
+
 const char * _datatype_name(data_type_e data_type)
 {
     switch (data_type)
@@ -106,7 +125,15 @@ disassemble_status_e disassemble_bytecode(bytecode_t *program, size_t offset_byt
         ip = program->bytecode + bytes_consumed;
         chars_printed += printf("%08zx ", bytes_consumed);
 
-        switch ((opcode_e)  *ip)
+        /* Superinstructions are shown with the first instruction in the
+         * sequence, which determines how the operands are encoded */
+        opcode_e opcode = (opcode_e) *ip;
+        if (bytecode_utils_base_opcode(opcode) != opcode)
+        {
+            chars_printed += printf("<%s> ", _superinstruction_name(opcode));
+        }
+
+        switch (bytecode_utils_base_opcode(opcode))
         {
             case OPCODE_NOP:
                 chars_printed += printf("NOP");
@@ -133,6 +160,76 @@ disassemble_status_e disassemble_bytecode(bytecode_t *program, size_t offset_byt
                 bytes_consumed += 1;
                 break;
 
+            case OPCODE_ADD_INT_INT:
+                chars_printed += printf("ADD_INT_INT");
+                bytes_consumed += 1;
+                break;
+
+            case OPCODE_SUB_INT_INT:
+                chars_printed += printf("SUB_INT_INT");
+                bytes_consumed += 1;
+                break;
+
+            case OPCODE_MULT_INT_INT:
+                chars_printed += printf("MULT_INT_INT");
+                bytes_consumed += 1;
+                break;
+
+            case OPCODE_DIV_INT_INT:
+                chars_printed += printf("DIV_INT_INT");
+                bytes_consumed += 1;
+                break;
+
+            case OPCODE_ADD_FLOAT_FLOAT:
+                chars_printed += printf("ADD_FLOAT_FLOAT");
+                bytes_consumed += 1;
+                break;
+
+            case OPCODE_SUB_FLOAT_FLOAT:
+                chars_printed += printf("SUB_FLOAT_FLOAT");
+                bytes_consumed += 1;
+                break;
+
+            case OPCODE_MULT_FLOAT_FLOAT:
+                chars_printed += printf("MULT_FLOAT_FLOAT");
+                bytes_consumed += 1;
+                break;
+
+            case OPCODE_DIV_FLOAT_FLOAT:
+                chars_printed += printf("DIV_FLOAT_FLOAT");
+                bytes_consumed += 1;
+                break;
+
+            case OPCODE_EQUAL:
+                chars_printed += printf("EQUAL");
+                bytes_consumed += 1;
+                break;
+
+            case OPCODE_NOT_EQUAL:
+                chars_printed += printf("NOT_EQUAL");
+                bytes_consumed += 1;
+                break;
+
+            case OPCODE_LESS:
+                chars_printed += printf("LESS");
+                bytes_consumed += 1;
+                break;
+
+            case OPCODE_LESS_EQUAL:
+                chars_printed += printf("LESS_EQUAL");
+                bytes_consumed += 1;
+                break;
+
+            case OPCODE_GREATER:
+                chars_printed += printf("GREATER");
+                bytes_consumed += 1;
+                break;
+
+            case OPCODE_GREATER_EQUAL:
+                chars_printed += printf("GREATER_EQUAL");
+                bytes_consumed += 1;
+                break;
+
             case OPCODE_INT:
                 chars_printed += printf("INT %d", *((vm_int_t *) (ip + 1)));
                 bytes_consumed += sizeof(vm_int_t) + 1;
@@ -197,6 +294,110 @@ disassemble_status_e disassemble_bytecode(bytecode_t *program, size_t offset_byt
                 bytes_consumed += 1 + sizeof(int32_t);
                 break;
 
+            case OPCODE_JUMP_IF_TRUE:
+                ip += 1;
+
+                offset = *((uint32_t *) ip);
+                chars_printed += printf("JUMP_IF_TRUE %x", offset);
+                bytes_consumed += 1 + sizeof(int32_t);
+                break;
+
+            case OPCODE_JUMP_IF_EQUAL:
+                ip += 1;
+
+                offset = *((uint32_t *) ip);
+                chars_printed += printf("JUMP_IF_EQUAL %x", offset);
+                bytes_consumed += 1 + sizeof(int32_t);
+                break;
+
+            case OPCODE_JUMP_IF_NOT_EQUAL:
+                ip += 1;
+
+                offset = *((uint32_t *) ip);
+                chars_printed += printf("JUMP_IF_NOT_EQUAL %x", offset);
+                bytes_consumed += 1 + sizeof(int32_t);
+                break;
+
+            case OPCODE_JUMP_IF_LESS:
+                ip += 1;
+
+                offset = *((uint32_t *) ip);
+                chars_printed += printf("JUMP_IF_LESS %x", offset);
+                bytes_consumed += 1 + sizeof(int32_t);
+                break;
+
+            case OPCODE_JUMP_IF_LESS_EQUAL:
+                ip += 1;
+
+                offset = *((uint32_t *) ip);
+                chars_printed += printf("JUMP_IF_LESS_EQUAL %x", offset);
+                bytes_consumed += 1 + sizeof(int32_t);
+                break;
+
+            case OPCODE_JUMP_IF_GREATER:
+                ip += 1;
+
+                offset = *((uint32_t *) ip);
+                chars_printed += printf("JUMP_IF_GREATER %x", offset);
+                bytes_consumed += 1 + sizeof(int32_t);
+                break;
+
+            case OPCODE_JUMP_IF_GREATER_EQUAL:
+                ip += 1;
+
+                offset = *((uint32_t *) ip);
+                chars_printed += printf("JUMP_IF_GREATER_EQUAL %x", offset);
+                bytes_consumed += 1 + sizeof(int32_t);
+                break;
+
+            case OPCODE_JUMP_IF_EQUAL_INT:
+                ip += 1;
+
+                offset = *((uint32_t *) ip);
+                chars_printed += printf("JUMP_IF_EQUAL_INT %x", offset);
+                bytes_consumed += 1 + sizeof(int32_t);
+                break;
+
+            case OPCODE_JUMP_IF_NOT_EQUAL_INT:
+                ip += 1;
+
+                offset = *((uint32_t *) ip);
+                chars_printed += printf("JUMP_IF_NOT_EQUAL_INT %x", offset);
+                bytes_consumed += 1 + sizeof(int32_t);
+                break;
+
+            case OPCODE_JUMP_IF_LESS_INT:
+                ip += 1;
+
+                offset = *((uint32_t *) ip);
+                chars_printed += printf("JUMP_IF_LESS_INT %x", offset);
+                bytes_consumed += 1 + sizeof(int32_t);
+                break;
+
+            case OPCODE_JUMP_IF_LESS_EQUAL_INT:
+                ip += 1;
+
+                offset = *((uint32_t *) ip);
+                chars_printed += printf("JUMP_IF_LESS_EQUAL_INT %x", offset);
+                bytes_consumed += 1 + sizeof(int32_t);
+                break;
+
+            case OPCODE_JUMP_IF_GREATER_INT:
+                ip += 1;
+
+                offset = *((uint32_t *) ip);
+                chars_printed += printf("JUMP_IF_GREATER_INT %x", offset);
+                bytes_consumed += 1 + sizeof(int32_t);
+                break;
+
+            case OPCODE_JUMP_IF_GREATER_EQUAL_INT:
+                ip += 1;
+
+                offset = *((uint32_t *) ip);
+                chars_printed += printf("JUMP_IF_GREATER_EQUAL_INT %x", offset);
+                bytes_consumed += 1 + sizeof(int32_t);
+                break;
+
             case OPCODE_LOAD_CONST:
             {
                 ip += 1;
@@ -205,6 +406,61 @@ disassemble_status_e disassemble_bytecode(bytecode_t *program, size_t offset_byt
                 bytes_consumed += 1 + sizeof(uint32_t);
                 break;
             }
+            case OPCODE_LOAD_LOCAL:
+            {
+                ip += 1;
+                uint16_t slot = *((uint16_t *) ip);
+                chars_printed += printf("LOAD_LOCAL %u", slot);
+                bytes_consumed += 1 + sizeof(uint16_t);
+                break;
+            }
+            case OPCODE_STORE_LOCAL:
+            {
+                ip += 1;
+                uint16_t slot = *((uint16_t *) ip);
+                chars_printed += printf("STORE_LOCAL %u", slot);
+                bytes_consumed += 1 + sizeof(uint16_t);
+                break;
+            }
+            case OPCODE_LOAD_GLOBAL:
+            {
+                ip += 1;
+                uint32_t index = *((uint32_t *) ip);
+                chars_printed += printf("LOAD_GLOBAL %d", index);
+                bytes_consumed += 1 + sizeof(uint32_t);
+                break;
+            }
+            case OPCODE_STORE_GLOBAL:
+            {
+                ip += 1;
+                uint32_t index = *((uint32_t *) ip);
+                chars_printed += printf("STORE_GLOBAL %d", index);
+                bytes_consumed += 1 + sizeof(uint32_t);
+                break;
+            }
+            case OPCODE_CALL:
+            {
+                ip += 1;
+                offset = *((uint32_t *) ip);
+                uint8_t num_args = *(ip + sizeof(int32_t));
+                chars_printed += printf("CALL %x %u", offset, num_args);
+                bytes_consumed += 1 + sizeof(int32_t) + sizeof(uint8_t);
+                break;
+            }
+            case OPCODE_TAIL_CALL:
+            {
+                ip += 1;
+                offset = *((uint32_t *) ip);
+                uint8_t num_args = *(ip + sizeof(int32_t));
+                chars_printed += printf("TAIL_CALL %x %u", offset, num_args);
+                bytes_consumed += 1 + sizeof(int32_t) + sizeof(uint8_t);
+                break;
+            }
+            case OPCODE_RETURN:
+                chars_printed += printf("RETURN");
+                bytes_consumed += 1;
+                break;
+
             case OPCODE_DEFINE_CONST:
             {
                 ip += 1;
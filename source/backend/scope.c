@@ -0,0 +1,109 @@
+/**
+ * Compile-time resolution of variable names to local variable slots
+ */
+
+#include "scope_api.h"
+#include "hashtables_api.h"
+#include "string_cache_api.h"
+
+
+/* Returns the bytecode_status_e for a failed hashtable operation */
+static bytecode_status_e _hashtable_status(hashtable_status_e err)
+{
+    return (HASHTABLE_MEMORY_ERROR == err) ? BYTECODE_MEMORY_ERROR : BYTECODE_ERROR;
+}
+
+
+/**
+ * @see scope_api.h
+ */
+bytecode_status_e scope_create(scope_t *scope)
+{
+    if (NULL == scope)
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    hashtable_status_e err = create_pointer_comparison_hashtable(&scope->slots,
+                                                                 sizeof(uint16_t));
+    if (HASHTABLE_OK != err)
+    {
+        return _hashtable_status(err);
+    }
+
+    scope->num_slots = 0u;
+    return BYTECODE_OK;
+}
+
+
+/**
+ * @see scope_api.h
+ */
+bytecode_status_e scope_destroy(scope_t *scope)
+{
+    if (NULL == scope)
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    // Keys belong to the string cache, so only the table itself is freed
+    hashtable_status_e err = hashtable_destroy(&scope->slots);
+    if (HASHTABLE_OK != err)
+    {
+        return _hashtable_status(err);
+    }
+
+    scope->num_slots = 0u;
+    return BYTECODE_OK;
+}
+
+
+/**
+ * @see scope_api.h
+ */
+bytecode_status_e scope_resolve(scope_t *scope, char *name, size_t size, uint16_t *slot)
+{
+    byte_string_t *cached;
+    uint16_t *found;
+
+    if ((NULL == scope) || (NULL == name) || (NULL == slot))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    string_cache_status_e cache_err = string_cache_add(name, (unsigned) size, &cached);
+    if (STRING_CACHE_ALREADY_CACHED < cache_err)
+    {
+        return (STRING_CACHE_MEMORY_ERROR == cache_err) ? BYTECODE_MEMORY_ERROR : BYTECODE_ERROR;
+    }
+
+    hashtable_status_e err = hashtable_get(&scope->slots, cached->bytes, cached->size,
+                                           (void **) &found);
+    if (HASHTABLE_OK == err)
+    {
+        *slot = *found;
+        return BYTECODE_OK;
+    }
+
+    if (HASHTABLE_NO_ITEM != err)
+    {
+        return _hashtable_status(err);
+    }
+
+    if (SCOPE_MAX_SLOTS <= scope->num_slots)
+    {
+        return BYTECODE_ERROR;
+    }
+
+    uint16_t new_slot = (uint16_t) scope->num_slots;
+
+    err = hashtable_put(&scope->slots, cached->bytes, cached->size, &new_slot);
+    if (HASHTABLE_OK != err)
+    {
+        return _hashtable_status(err);
+    }
+
+    scope->num_slots += 1u;
+    *slot = new_slot;
+    return BYTECODE_OK;
+}
@@ -0,0 +1,69 @@
+/**
+ * Compile-time resolution of variable names to local variable slots. Each
+ * name is interned with string_cache_add, so after the first lookup the
+ * scope only compares string pointers, and the emitted OPCODE_LOAD_LOCAL and
+ * OPCODE_STORE_LOCAL instructions refer to variables by slot number; names
+ * are never looked up while the program is running.
+ */
+
+#ifndef SCOPE_API_H_
+#define SCOPE_API_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hashtable_api.h"
+#include "bytecode_api.h"
+
+
+/* Maximum number of local variables in a single scope, limited by the size
+ * of the slot operand of OPCODE_LOAD_LOCAL and OPCODE_STORE_LOCAL */
+#define SCOPE_MAX_SLOTS (UINT16_MAX + 1u)
+
+
+/* Names of the variables local to a single scope */
+typedef struct
+{
+    hashtable_t slots;      // Slot number of each name, keyed by cached string pointer
+    uint32_t num_slots;     // Number of slots assigned so far
+} scope_t;
+
+
+/**
+ * Initialize an empty scope
+ *
+ * @param    scope    Pointer to scope to initialize
+ *
+ * @return   BYTECODE_OK if initialization was successful
+ */
+bytecode_status_e scope_create(scope_t *scope);
+
+
+/**
+ * Free all memory allocated for a scope
+ *
+ * @param    scope    Pointer to scope to destroy
+ *
+ * @return   BYTECODE_OK if de-allocation was successful
+ */
+bytecode_status_e scope_destroy(scope_t *scope);
+
+
+/**
+ * Find the local variable slot for a name. The first time a name is seen, it
+ * is assigned the next free slot; slots are numbered from 0 in the order that
+ * names are first seen, so scope->num_slots is also the number of slots that
+ * the program will use.
+ *
+ * @param    scope    Pointer to scope to resolve the name in
+ * @param    name     Pointer to name of variable
+ * @param    size     Size of name in bytes
+ * @param    slot     Pointer to location to store slot number
+ *
+ * @return   BYTECODE_OK if the name was resolved, BYTECODE_ERROR if the scope
+ *           already has SCOPE_MAX_SLOTS names
+ */
+bytecode_status_e scope_resolve(scope_t *scope, char *name, size_t size, uint16_t *slot);
+
+
+#endif /* SCOPE_API_H_ */
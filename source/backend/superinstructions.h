@@ -0,0 +1,47 @@
+/**
+ * Superinstructions; commonly executed sequences of instructions that the VM
+ * executes with a single dispatch. The opcode of the first instruction in the
+ * sequence is replaced with the superinstruction opcode, and the remaining
+ * instructions are left in place, so jumps into the middle of a sequence still
+ * work (see bytecode_optimize).
+ *
+ * Generated by tools/gen_superinstructions.py from tools/opcode_profile.txt;
+ * do not edit by hand, run "make superinstructions" to regenerate.
+ */
+
+#ifndef SUPERINSTRUCTIONS_H_
+#define SUPERINSTRUCTIONS_H_
+
+
+/**
+ * Format: X(opcode, handler function, items popped, items pushed), the same as
+ * VM_OPCODE_LIST. The stack effect is that of the first instruction only, since
+ * the remaining instructions are still decoded separately.
+ */
+#define SUPERINSTRUCTION_LIST(X) \
+    X(OPCODE_LOAD_LOCAL_INT, opcode_handler_load_local_int, 0u, 1u) \
+    X(OPCODE_LOAD_LOCAL_INT_JUMP_IF_GREATER_EQUAL, opcode_handler_load_local_int_jump_if_greater_equal, 0u, 1u) \
+    X(OPCODE_INT_ADD_STORE_LOCAL, opcode_handler_int_add_store_local, 0u, 1u) \
+    X(OPCODE_LOAD_LOCAL_INT_ADD, opcode_handler_load_local_int_add, 0u, 1u) \
+    X(OPCODE_INT_JUMP_IF_GREATER_EQUAL, opcode_handler_int_jump_if_greater_equal, 0u, 1u) \
+    X(OPCODE_STORE_LOCAL_LOAD_LOCAL_INT, opcode_handler_store_local_load_local_int, 1u, 0u) \
+    X(OPCODE_INT_ADD, opcode_handler_int_add, 0u, 1u) \
+    X(OPCODE_STORE_LOCAL_JUMP, opcode_handler_store_local_jump, 1u, 0u)
+
+
+/**
+ * Format: X(opcode, handler function, number of instructions, first, second, third)
+ * Unused instructions are given as OPCODE_NOP.
+ */
+#define SUPERINSTRUCTION_SEQUENCES(X) \
+    X(OPCODE_LOAD_LOCAL_INT, opcode_handler_load_local_int, 2u, OPCODE_LOAD_LOCAL, OPCODE_INT, OPCODE_NOP) \
+    X(OPCODE_LOAD_LOCAL_INT_JUMP_IF_GREATER_EQUAL, opcode_handler_load_local_int_jump_if_greater_equal, 3u, OPCODE_LOAD_LOCAL, OPCODE_INT, OPCODE_JUMP_IF_GREATER_EQUAL) \
+    X(OPCODE_INT_ADD_STORE_LOCAL, opcode_handler_int_add_store_local, 3u, OPCODE_INT, OPCODE_ADD, OPCODE_STORE_LOCAL) \
+    X(OPCODE_LOAD_LOCAL_INT_ADD, opcode_handler_load_local_int_add, 3u, OPCODE_LOAD_LOCAL, OPCODE_INT, OPCODE_ADD) \
+    X(OPCODE_INT_JUMP_IF_GREATER_EQUAL, opcode_handler_int_jump_if_greater_equal, 2u, OPCODE_INT, OPCODE_JUMP_IF_GREATER_EQUAL, OPCODE_NOP) \
+    X(OPCODE_STORE_LOCAL_LOAD_LOCAL_INT, opcode_handler_store_local_load_local_int, 3u, OPCODE_STORE_LOCAL, OPCODE_LOAD_LOCAL, OPCODE_INT) \
+    X(OPCODE_INT_ADD, opcode_handler_int_add, 2u, OPCODE_INT, OPCODE_ADD, OPCODE_NOP) \
+    X(OPCODE_STORE_LOCAL_JUMP, opcode_handler_store_local_jump, 2u, OPCODE_STORE_LOCAL, OPCODE_JUMP, OPCODE_NOP)
+
+
+#endif /* SUPERINSTRUCTIONS_H_ */
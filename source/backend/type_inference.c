@@ -0,0 +1,663 @@
+/**
+ * Static type inference for bytecode, used to replace generic arithmetic with
+ * opcodes specialised for the operand types
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "memory_manager_api.h"
+#include "type_inference_api.h"
+#include "bytecode_utils_api.h"
+
+
+/* Number of data stack slots (counting from the bottom of the stack) whose
+ * types are tracked; anything deeper is treated as an unknown type */
+#define MAX_TRACKED_DEPTH (32u)
+
+
+/* Number of local variable slots whose types are tracked; anything higher is
+ * treated as an unknown type */
+#define MAX_TRACKED_LOCALS (32u)
+
+
+/* Type of a stack slot that could hold more than one data type */
+#define TYPE_UNKNOWN ((uint8_t) NUM_DATATYPES)
+
+
+/* Abstract state of the data stack before an instruction is executed */
+typedef struct
+{
+    uint8_t visited;                    // 1 if any path reaches this instruction
+    uint8_t queued;                     // 1 if this instruction is on the worklist
+    uint32_t depth;                     // Number of values on the data stack
+    uint8_t types[MAX_TRACKED_DEPTH];   // Data type of each value on the data stack
+    uint8_t locals[MAX_TRACKED_LOCALS]; // Data type of each local variable slot
+} stack_state_t;
+
+
+typedef struct
+{
+    bytecode_instruction_t *instructions;
+    stack_state_t *states;
+    size_t num_instructions;
+    uint8_t *constant_types;            // Data type of each constant pool entry
+    uint32_t num_constants;
+    uint32_t *offset_map;               // Instruction index at each bytecode offset
+    size_t *worklist;
+    size_t worklist_count;
+} inference_t;
+
+
+static uint8_t _pop(stack_state_t *state)
+{
+    if (0u == state->depth)
+    {
+        // Stack underflow is a runtime error, so the type doesn't matter
+        return TYPE_UNKNOWN;
+    }
+
+    state->depth -= 1u;
+    return (MAX_TRACKED_DEPTH > state->depth) ? state->types[state->depth] : TYPE_UNKNOWN;
+}
+
+
+static void _push(stack_state_t *state, uint8_t type)
+{
+    if (MAX_TRACKED_DEPTH > state->depth)
+    {
+        state->types[state->depth] = type;
+    }
+
+    state->depth += 1u;
+}
+
+
+/* Returns the type of a stack slot, counting down from the top of the stack */
+static uint8_t _peek(stack_state_t *state, uint32_t from_top)
+{
+    if (state->depth <= from_top)
+    {
+        return TYPE_UNKNOWN;
+    }
+
+    uint32_t slot = state->depth - from_top - 1u;
+    return (MAX_TRACKED_DEPTH > slot) ? state->types[slot] : TYPE_UNKNOWN;
+}
+
+
+/**
+ * Returns the type of the result of an arithmetic operation, following the
+ * rules implemented in type_operations.c. Combinations that generate a
+ * runtime error produce TYPE_UNKNOWN, since execution never continues.
+ */
+static uint8_t _arithmetic_result(uint8_t lhs, uint8_t rhs, opcode_e opcode)
+{
+    if ((DATATYPE_STRING == lhs) || (DATATYPE_STRING == rhs))
+    {
+        if (((DATATYPE_INT == lhs) || (DATATYPE_INT == rhs)) && (OPCODE_MULT == opcode))
+        {
+            return DATATYPE_STRING;
+        }
+
+        if ((lhs == rhs) && ((OPCODE_ADD == opcode) || (OPCODE_SUB == opcode)))
+        {
+            return DATATYPE_STRING;
+        }
+
+        return TYPE_UNKNOWN;
+    }
+
+    if ((DATATYPE_INT == rhs) && ((DATATYPE_INT == lhs) || (DATATYPE_BOOL == lhs)))
+    {
+        return DATATYPE_INT;
+    }
+
+    if (((DATATYPE_FLOAT == lhs) && ((DATATYPE_INT == rhs) || (DATATYPE_FLOAT == rhs))) ||
+        ((DATATYPE_FLOAT == rhs) && ((DATATYPE_INT == lhs) || (DATATYPE_BOOL == lhs))))
+    {
+        return DATATYPE_FLOAT;
+    }
+
+    return TYPE_UNKNOWN;
+}
+
+
+/**
+ * Returns the specialised opcode for an arithmetic or compare-and-branch
+ * instruction with the given operand types, or the original opcode if there
+ * isn't one
+ */
+static opcode_e _specialised_opcode(opcode_e opcode, uint8_t lhs, uint8_t rhs)
+{
+    static const opcode_e int_ops[] =
+    {
+        [OPCODE_ADD] = OPCODE_ADD_INT_INT,
+        [OPCODE_SUB] = OPCODE_SUB_INT_INT,
+        [OPCODE_MULT] = OPCODE_MULT_INT_INT,
+        [OPCODE_DIV] = OPCODE_DIV_INT_INT
+    };
+
+    static const opcode_e float_ops[] =
+    {
+        [OPCODE_ADD] = OPCODE_ADD_FLOAT_FLOAT,
+        [OPCODE_SUB] = OPCODE_SUB_FLOAT_FLOAT,
+        [OPCODE_MULT] = OPCODE_MULT_FLOAT_FLOAT,
+        [OPCODE_DIV] = OPCODE_DIV_FLOAT_FLOAT
+    };
+
+    if (bytecode_utils_is_compare_jump(opcode))
+    {
+        // Only comparisons of two ints are specialised
+        if ((DATATYPE_INT == lhs) && (DATATYPE_INT == rhs) && (OPCODE_JUMP_IF_EQUAL_INT > opcode))
+        {
+            return OPCODE_JUMP_IF_EQUAL_INT + (opcode - OPCODE_JUMP_IF_EQUAL);
+        }
+
+        return opcode;
+    }
+
+    if ((DATATYPE_INT == lhs) && (DATATYPE_INT == rhs))
+    {
+        return int_ops[opcode];
+    }
+
+    if ((DATATYPE_FLOAT == lhs) && (DATATYPE_FLOAT == rhs))
+    {
+        return float_ops[opcode];
+    }
+
+    return opcode;
+}
+
+
+/**
+ * Returns the type that both operands of a specialised instruction must have,
+ * or TYPE_UNKNOWN if the instruction doesn't depend on its operand types
+ */
+static uint8_t _required_type(opcode_e opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD_INT_INT:
+        case OPCODE_SUB_INT_INT:
+        case OPCODE_MULT_INT_INT:
+        case OPCODE_DIV_INT_INT:
+            return DATATYPE_INT;
+
+        case OPCODE_ADD_FLOAT_FLOAT:
+        case OPCODE_SUB_FLOAT_FLOAT:
+        case OPCODE_MULT_FLOAT_FLOAT:
+        case OPCODE_DIV_FLOAT_FLOAT:
+            return DATATYPE_FLOAT;
+
+        default:
+            if (bytecode_utils_is_compare_jump(opcode) && (OPCODE_JUMP_IF_EQUAL_INT <= opcode))
+            {
+                return DATATYPE_INT;
+            }
+
+            return TYPE_UNKNOWN;
+    }
+}
+
+
+/**
+ * Apply the effect of a single instruction to the abstract stack state
+ */
+static void _transfer(inference_t *inf, bytecode_instruction_t *ins, stack_state_t *state)
+{
+    // The rest of a superinstruction sequence is still visited separately
+    opcode_e opcode = bytecode_utils_base_opcode(ins->opcode);
+    uint8_t lhs, rhs;
+
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MULT:
+        case OPCODE_DIV:
+            rhs = _pop(state);
+            lhs = _pop(state);
+            _push(state, _arithmetic_result(lhs, rhs, opcode));
+            break;
+
+        case OPCODE_ADD_INT_INT:
+        case OPCODE_SUB_INT_INT:
+        case OPCODE_MULT_INT_INT:
+        case OPCODE_DIV_INT_INT:
+            (void) _pop(state);
+            (void) _pop(state);
+            _push(state, DATATYPE_INT);
+            break;
+
+        case OPCODE_ADD_FLOAT_FLOAT:
+        case OPCODE_SUB_FLOAT_FLOAT:
+        case OPCODE_MULT_FLOAT_FLOAT:
+        case OPCODE_DIV_FLOAT_FLOAT:
+            (void) _pop(state);
+            (void) _pop(state);
+            _push(state, DATATYPE_FLOAT);
+            break;
+
+        case OPCODE_INT:
+            _push(state, DATATYPE_INT);
+            break;
+
+        case OPCODE_FLOAT:
+            _push(state, DATATYPE_FLOAT);
+            break;
+
+        case OPCODE_STRING:
+            _push(state, DATATYPE_STRING);
+            break;
+
+        case OPCODE_BOOL:
+            _push(state, DATATYPE_BOOL);
+            break;
+
+        case OPCODE_PRINT:
+        case OPCODE_JUMP_IF_FALSE:
+        case OPCODE_JUMP_IF_TRUE:
+            (void) _pop(state);
+            break;
+
+        case OPCODE_EQUAL:
+        case OPCODE_NOT_EQUAL:
+        case OPCODE_LESS:
+        case OPCODE_LESS_EQUAL:
+        case OPCODE_GREATER:
+        case OPCODE_GREATER_EQUAL:
+            (void) _pop(state);
+            (void) _pop(state);
+            _push(state, DATATYPE_BOOL);
+            break;
+
+        case OPCODE_CAST:
+            (void) _pop(state);
+            _push(state, (NUM_DATATYPES > ins->operand.cast.data_type) ?
+                         (uint8_t) ins->operand.cast.data_type : TYPE_UNKNOWN);
+            break;
+
+        case OPCODE_LOAD_CONST:
+            _push(state, (inf->num_constants > ins->operand.const_index) ?
+                         inf->constant_types[ins->operand.const_index] : TYPE_UNKNOWN);
+            break;
+
+        case OPCODE_LOAD_LOCAL:
+            _push(state, (MAX_TRACKED_LOCALS > ins->operand.local_index) ?
+                         state->locals[ins->operand.local_index] : TYPE_UNKNOWN);
+            break;
+
+        case OPCODE_LOAD_GLOBAL:
+            // Globals can be changed by any program run by the same VM instance
+            _push(state, TYPE_UNKNOWN);
+            break;
+
+        case OPCODE_STORE_GLOBAL:
+        case OPCODE_RETURN:
+            (void) _pop(state);
+            break;
+
+        case OPCODE_CALL:
+        case OPCODE_TAIL_CALL:
+            for (uint8_t i = 0u; i < ins->operand.call.num_args; i++)
+            {
+                (void) _pop(state);
+            }
+
+            // Functions can return any type
+            if (OPCODE_CALL == ins->opcode)
+            {
+                _push(state, TYPE_UNKNOWN);
+            }
+            break;
+
+        case OPCODE_STORE_LOCAL:
+            lhs = _pop(state);
+            if (MAX_TRACKED_LOCALS > ins->operand.local_index)
+            {
+                state->locals[ins->operand.local_index] = lhs;
+            }
+            break;
+
+        default:
+            if (bytecode_utils_is_compare_jump(opcode))
+            {
+                (void) _pop(state);
+                (void) _pop(state);
+            }
+
+            // No other effect on the data stack
+            break;
+    }
+}
+
+
+/**
+ * Merge the state reaching an instruction along one path with the state
+ * already recorded for that instruction, and queue the instruction to be
+ * visited again if anything changed
+ */
+static void _merge(inference_t *inf, size_t index, stack_state_t *incoming)
+{
+    stack_state_t *state = inf->states + index;
+    int changed = 0;
+
+    if (!state->visited)
+    {
+        *state = *incoming;
+        state->visited = 1u;
+        state->queued = 0u;
+        changed = 1;
+    }
+    else
+    {
+        for (uint32_t i = 0u; i < MAX_TRACKED_LOCALS; i++)
+        {
+            if (state->locals[i] != incoming->locals[i])
+            {
+                changed |= (TYPE_UNKNOWN != state->locals[i]);
+                state->locals[i] = TYPE_UNKNOWN;
+            }
+        }
+
+        if (state->depth != incoming->depth)
+        {
+            /* Paths reach this instruction with different stack depths, so
+             * nothing is known about any of the values already on the stack */
+            uint32_t depth = (state->depth < incoming->depth) ? state->depth : incoming->depth;
+
+            for (uint32_t i = 0u; (i < depth) && (i < MAX_TRACKED_DEPTH); i++)
+            {
+                if (TYPE_UNKNOWN != state->types[i])
+                {
+                    state->types[i] = TYPE_UNKNOWN;
+                    changed = 1;
+                }
+            }
+
+            if (state->depth != depth)
+            {
+                state->depth = depth;
+                changed = 1;
+            }
+        }
+        else
+        {
+            for (uint32_t i = 0u; (i < state->depth) && (i < MAX_TRACKED_DEPTH); i++)
+            {
+                if (state->types[i] != incoming->types[i])
+                {
+                    changed |= (TYPE_UNKNOWN != state->types[i]);
+                    state->types[i] = TYPE_UNKNOWN;
+                }
+            }
+        }
+    }
+
+    if (changed && !state->queued)
+    {
+        state->queued = 1u;
+        inf->worklist[inf->worklist_count++] = index;
+    }
+}
+
+
+/**
+ * Returns the index of the instruction targeted by a jump, or SIZE_MAX if the
+ * jump doesn't land on an instruction (vm_load will reject the program)
+ */
+static size_t _jump_target(bytecode_t *program, inference_t *inf, bytecode_instruction_t *ins)
+{
+    int64_t target = ((int64_t) ins->offset) + ins->operand.jump_offset;
+
+    if ((0 > target) || (((int64_t) program->used_bytes) <= target) ||
+        (UINT32_MAX == inf->offset_map[target]))
+    {
+        return SIZE_MAX;
+    }
+
+    return inf->offset_map[target];
+}
+
+
+/**
+ * Decode all instructions, and find the data type of each constant pool entry
+ */
+static bytecode_status_e _decode(bytecode_t *program, inference_t *inf)
+{
+    bytecode_instruction_t decoded;
+    size_t offset;
+
+    inf->offset_map = memory_manager_alloc(program->used_bytes * sizeof(uint32_t));
+    if (NULL == inf->offset_map)
+    {
+        return BYTECODE_MEMORY_ERROR;
+    }
+
+    (void) memset(inf->offset_map, 0xff, program->used_bytes * sizeof(uint32_t));
+
+    for (offset = 0u; offset < program->used_bytes; offset += decoded.size)
+    {
+        if (!bytecode_utils_decode_instruction(program, offset, &decoded))
+        {
+            return BYTECODE_ERROR;
+        }
+
+        inf->offset_map[offset] = (uint32_t) inf->num_instructions;
+        inf->num_instructions += 1u;
+
+        if (OPCODE_DEFINE_CONST == decoded.opcode)
+        {
+            inf->num_constants += 1u;
+        }
+    }
+
+    inf->instructions = memory_manager_alloc(inf->num_instructions * sizeof(bytecode_instruction_t));
+    inf->states = memory_manager_alloc(inf->num_instructions * sizeof(stack_state_t));
+    inf->worklist = memory_manager_alloc(inf->num_instructions * sizeof(size_t));
+
+    if (0u < inf->num_constants)
+    {
+        inf->constant_types = memory_manager_alloc(inf->num_constants);
+    }
+
+    if ((NULL == inf->instructions) || (NULL == inf->states) || (NULL == inf->worklist) ||
+        ((0u < inf->num_constants) && (NULL == inf->constant_types)))
+    {
+        return BYTECODE_MEMORY_ERROR;
+    }
+
+    uint32_t const_index = 0u;
+    size_t i = 0u;
+
+    for (offset = 0u; offset < program->used_bytes; offset += decoded.size, i++)
+    {
+        (void) bytecode_utils_decode_instruction(program, offset, &decoded);
+        inf->instructions[i] = decoded;
+        inf->states[i].visited = 0u;
+        inf->states[i].queued = 0u;
+
+        if (OPCODE_DEFINE_CONST == decoded.opcode)
+        {
+            data_type_e type = decoded.operand.constant.data_type;
+            inf->constant_types[const_index++] = (NUM_DATATYPES > type) ? (uint8_t) type : TYPE_UNKNOWN;
+        }
+    }
+
+    return BYTECODE_OK;
+}
+
+
+/**
+ * Visit every reachable instruction until the abstract stack states stop
+ * changing
+ */
+static void _solve(bytecode_t *program, inference_t *inf)
+{
+    stack_state_t entry = {.depth=0u};
+
+    stack_state_t function_entry = {.depth=0u};
+
+    // vm_execute sets every local variable to int 0 before the program starts
+    (void) memset(entry.locals, DATATYPE_INT, sizeof(entry.locals));
+    (void) memset(function_entry.locals, TYPE_UNKNOWN, sizeof(function_entry.locals));
+    _merge(inf, 0u, &entry);
+
+    while (0u < inf->worklist_count)
+    {
+        size_t i = inf->worklist[--inf->worklist_count];
+        bytecode_instruction_t *ins = inf->instructions + i;
+        stack_state_t state = inf->states[i];
+        size_t target;
+
+        inf->states[i].queued = 0u;
+        _transfer(inf, ins, &state);
+
+        switch (ins->opcode)
+        {
+            case OPCODE_END:
+            case OPCODE_RETURN:
+                break;
+
+            case OPCODE_CALL:
+            case OPCODE_TAIL_CALL:
+                /* Functions start with an empty stack, and nothing is known
+                 * about the arguments passed from different calls */
+                if ((target = _jump_target(program, inf, ins)) != SIZE_MAX)
+                {
+                    _merge(inf, target, &function_entry);
+                }
+
+                // Tail calls return straight to the caller of the current function
+                if ((OPCODE_CALL == ins->opcode) && ((i + 1u) < inf->num_instructions))
+                {
+                    _merge(inf, i + 1u, &state);
+                }
+                break;
+
+            default:
+                if (bytecode_utils_is_jump(ins->opcode) &&
+                    ((target = _jump_target(program, inf, ins)) != SIZE_MAX))
+                {
+                    _merge(inf, target, &state);
+                }
+
+                if ((OPCODE_JUMP != ins->opcode) && ((i + 1u) < inf->num_instructions))
+                {
+                    _merge(inf, i + 1u, &state);
+                }
+                break;
+        }
+    }
+}
+
+
+static void _destroy(inference_t *inf)
+{
+    memory_manager_free(inf->offset_map);
+    memory_manager_free(inf->instructions);
+    memory_manager_free(inf->states);
+    memory_manager_free(inf->worklist);
+    memory_manager_free(inf->constant_types);
+}
+
+
+/**
+ * @see type_inference_api.h
+ */
+bytecode_status_e type_inference_specialise(bytecode_t *program,
+                                            type_inference_stats_t *stats)
+{
+    inference_t inf = {0};
+    bytecode_status_e err;
+    size_t arithmetic_ops = 0u;
+    size_t specialised_ops = 0u;
+    size_t compare_jumps = 0u;
+    size_t specialised_jumps = 0u;
+
+    if ((NULL == program) || (0u == program->used_bytes))
+    {
+        return BYTECODE_INVALID_PARAM;
+    }
+
+    if ((err = _decode(program, &inf)) != BYTECODE_OK)
+    {
+        _destroy(&inf);
+        return err;
+    }
+
+    _solve(program, &inf);
+
+    // Specialised instructions don't check their operands, so their types must be proven
+    for (size_t i = 0u; i < inf.num_instructions; i++)
+    {
+        stack_state_t *state = inf.states + i;
+        uint8_t required = _required_type(inf.instructions[i].opcode);
+
+        if ((TYPE_UNKNOWN != required) && state->visited &&
+            ((required != _peek(state, 1u)) || (required != _peek(state, 0u))))
+        {
+            _destroy(&inf);
+            return BYTECODE_INVALID_TYPES;
+        }
+    }
+
+    for (size_t i = 0u; i < inf.num_instructions; i++)
+    {
+        bytecode_instruction_t *ins = inf.instructions + i;
+        stack_state_t *state = inf.states + i;
+
+        int is_compare_jump = bytecode_utils_is_compare_jump(ins->opcode);
+
+        if ((OPCODE_ADD != ins->opcode) && (OPCODE_SUB != ins->opcode) &&
+            (OPCODE_MULT != ins->opcode) && (OPCODE_DIV != ins->opcode) &&
+            !is_compare_jump)
+        {
+            continue;
+        }
+
+        if (is_compare_jump)
+        {
+            compare_jumps += 1u;
+        }
+        else
+        {
+            arithmetic_ops += 1u;
+        }
+
+        if (!state->visited)
+        {
+            continue;
+        }
+
+        opcode_e opcode = _specialised_opcode(ins->opcode, _peek(state, 1u), _peek(state, 0u));
+        if (opcode == ins->opcode)
+        {
+            continue;
+        }
+
+        program->bytecode[ins->offset] = (opcode_t) opcode;
+
+        if (is_compare_jump)
+        {
+            specialised_jumps += 1u;
+        }
+        else
+        {
+            specialised_ops += 1u;
+        }
+    }
+
+    if (NULL != stats)
+    {
+        stats->arithmetic_ops = arithmetic_ops;
+        stats->specialised_ops = specialised_ops;
+        stats->compare_jumps = compare_jumps;
+        stats->specialised_jumps = specialised_jumps;
+    }
+
+    _destroy(&inf);
+    return BYTECODE_OK;
+}
@@ -0,0 +1,53 @@
+/**
+ * Static type inference for bytecode, used to replace generic arithmetic with
+ * opcodes specialised for the operand types
+ */
+
+#ifndef TYPE_INFERENCE_API_H_
+#define TYPE_INFERENCE_API_H_
+
+#include <stddef.h>
+
+#include "bytecode_api.h"
+
+
+/* Statistics reported by a single run of type inference */
+typedef struct
+{
+    size_t arithmetic_ops;    // Number of ADD/SUB/MULT/DIV instructions found
+    size_t specialised_ops;   // Number of those that were specialised
+    size_t compare_jumps;     // Number of compare-and-branch instructions found
+    size_t specialised_jumps; // Number of those that were specialised
+} type_inference_stats_t;
+
+
+/**
+ * Infer the data types of values on the data stack at each instruction, by
+ * abstract interpretation of the bytecode along every path through the
+ * program. Each ADD, SUB, MULT or DIV instruction whose operands are proven
+ * to both be ints, or both be floats, is rewritten in place with the
+ * corresponding specialised opcode (e.g. OPCODE_ADD_INT_INT), which does the
+ * arithmetic inline without looking up the operand types at runtime. Likewise,
+ * each compare-and-branch instruction (e.g. OPCODE_JUMP_IF_LESS) whose operands
+ * are proven to both be ints is rewritten with the corresponding _INT opcode.
+ * Instructions with operand types that can't be proven are left unchanged.
+ * The types of local variables are tracked too, starting out as int since
+ * vm_execute sets every local variable to int 0.
+ *
+ * Instructions that were already specialised must have operands of the types
+ * they were specialised for on every path that reaches them; if that can't be
+ * proven for any of them, nothing is rewritten.
+ *
+ * The structure of the bytecode must already have been checked by vm_verify.
+ *
+ * @param    program    Pointer to bytecode to specialise
+ * @param    stats      Pointer to location to store statistics (may be NULL)
+ *
+ * @return   BYTECODE_OK if successful, BYTECODE_INVALID_TYPES if the operand
+ *           types of a specialised instruction can't be proven
+ */
+bytecode_status_e type_inference_specialise(bytecode_t *program,
+                                            type_inference_stats_t *stats);
+
+
+#endif /* TYPE_INFERENCE_API_H_ */
@@ -38,6 +38,11 @@ typedef enum
 } data_type_e;
 
 
+/* Reference count of objects that must never be freed, e.g. constants that
+ * are owned by a loaded program rather than by the values that refer to them */
+#define OBJECT_REFCOUNT_IMMORTAL (SIZE_MAX)
+
+
 /* Structure representing all objects */
 typedef struct
 {
@@ -63,21 +68,65 @@ typedef struct
 
 
 /**
- * Structure representing a single frame within the call stack
+ * Structure representing a single value, as stored on the data stack. Ints,
+ * floats and bools are stored directly in the value, so they never need to be
+ * allocated; all other data types hold a pointer to an object on the heap.
+ */
+typedef struct
+{
+    data_type_e type;                     // Data type tag
+    union {
+        vm_int_t int_value;               // DATATYPE_INT
+        vm_float_t float_value;           // DATATYPE_FLOAT
+        vm_bool_t bool_value;             // DATATYPE_BOOL
+        object_t *object;                 // DATATYPE_STRING (points to a data_object_t)
+    } payload;
+} value_t;
+
+
+/* Decoded instruction of a loaded program (see runtime_common.h) */
+struct vm_instruction;
+
+
+/**
+ * Structure representing a single frame within the call stack. The data
+ * stacks and the local variables of function calls are windows into a single
+ * value stack, shared by every frame of the call stack.
  */
 typedef struct
 {
-    ulist_t data;
+    value_t *base;       // Bottom of the data stack
+    value_t *sp;         // Next free slot on the data stack
+    value_t *limit;      // End of the space allocated for the data stack
+    value_t *locals;     // Local variable slots
+    size_t num_locals;   // Number of local variable slots allocated
+
+    /* Instruction to continue at when the frame is resumed; only set for
+     * the frames of callers saved by OPCODE_CALL */
+    struct vm_instruction *return_ip;
 } callstack_frame_t;
 
 
 /**
- * Structure representing a call stack for the running program
+ * Structure representing a call stack for the running program. The frame of
+ * the running code never moves, so engines can keep a pointer to it while
+ * functions are called; OPCODE_CALL copies it to the array of saved frames,
+ * and OPCODE_RETURN copies the caller back. Nothing is allocated for a call
+ * once the value stack and the saved frames have grown to the deepest
+ * recursion reached.
  */
 typedef struct
 {
-    ulist_t frames;
-    callstack_frame_t *current_frame;
+    callstack_frame_t frame;            // Frame of the running code; must be first
+    callstack_frame_t *current_frame;   // Always points at 'frame'
+    value_t *stack;                     // Start of the value stack
+    callstack_frame_t *saved;           // Frames of the callers, outermost first
+    size_t depth;                       // Number of saved frames
+    size_t capacity;                    // Number of saved frames allocated
+
+    /* Set by vm_execute for the program being run */
+    size_t frame_locals;                // Local variable slots of each function call
+    size_t frame_depth;                 // Data stack slots reserved for each function call
 } callstack_t;
 
 
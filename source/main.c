@@ -3,6 +3,9 @@
 #include "memory_manager_api.h"
 #include "vm_api.h"
 #include "bytecode_api.h"
+#include "bytecode_optimizer_api.h"
+#include "dead_code_api.h"
+#include "block_layout_api.h"
 #include "disassemble_api.h"
 #include "vm_api.h"
 #include "string_cache_api.h"
@@ -69,6 +72,79 @@ int main(void)
     (void) bytecode_emit_print(&program);
     (void) bytecode_emit_end(&program);
 
+    bytecode_optimizer_stats_t stats;
+
+    if ((bytecode_err = bytecode_optimize(&program, &stats)) != BYTECODE_OK)
+    {
+        printf("bytecode_optimize failed, status %d\n", bytecode_err);
+        return bytecode_err;
+    }
+
+    /* Folding literals may leave conditions that are known, and constants that
+     * are no longer loaded, so dead code is removed after optimizing */
+    dead_code_stats_t dead_code_stats;
+
+    if ((bytecode_err = dead_code_eliminate(&program, &dead_code_stats)) != BYTECODE_OK)
+    {
+        printf("dead_code_eliminate failed, status %d\n", bytecode_err);
+        return bytecode_err;
+    }
+
+    bytecode_optimizer_stats_t dead_code_optimizer_stats;
+
+    // Superinstructions are split up by dead-code elimination
+    if ((bytecode_err = bytecode_optimize(&program, &dead_code_optimizer_stats)) != BYTECODE_OK)
+    {
+        printf("bytecode_optimize failed, status %d\n", bytecode_err);
+        return bytecode_err;
+    }
+
+    stats.instructions_after = dead_code_optimizer_stats.instructions_after;
+    stats.superinstructions = dead_code_optimizer_stats.superinstructions;
+
+#ifndef VM_BRANCH_PROFILE
+    // Lay out blocks for the branches taken by earlier runs of a VM_BRANCH_PROFILE build
+    FILE *branch_fp = fopen(VM_BRANCH_PROFILE_OUTPUT, "r");
+    if (NULL != branch_fp)
+    {
+        block_layout_profile_t branch_profile;
+        block_layout_stats_t layout_stats;
+
+        bytecode_err = block_layout_read_profile(&program, branch_fp, &branch_profile);
+        (void) fclose(branch_fp);
+
+        if ((BYTECODE_OK == bytecode_err) && (0u < branch_profile.num_branches))
+        {
+            bytecode_err = block_layout_apply(&program, &branch_profile, &layout_stats);
+            if (BYTECODE_OK == bytecode_err)
+            {
+                bytecode_optimizer_stats_t relayout_stats;
+
+                // Superinstructions are split up by block layout
+                bytecode_err = bytecode_optimize(&program, &relayout_stats);
+
+                // Counts after optimizing are for the bytecode that will actually run
+                stats.instructions_after = relayout_stats.instructions_after;
+                stats.superinstructions = relayout_stats.superinstructions;
+            }
+        }
+
+        block_layout_destroy_profile(&branch_profile);
+
+        if (BYTECODE_OK != bytecode_err)
+        {
+            printf("block layout failed, status %d\n", bytecode_err);
+            return bytecode_err;
+        }
+    }
+#endif /* VM_BRANCH_PROFILE */
+
+    printf("\n--------- optimizer ----------\n\n");
+    printf("%zu instructions before, %zu after\n", stats.instructions_before,
+           stats.instructions_after);
+    printf("%zu branches folded, %zu blocks removed, %zu constants removed\n",
+           dead_code_stats.branches_folded, dead_code_stats.blocks_removed,
+           dead_code_stats.constants_removed);
 
     printf("\n-------- raw bytecode --------\n\n");
     bytecode_dump_raw(&program);
@@ -80,6 +156,7 @@ int main(void)
 
     vm_status_e vm_err;
     vm_instance_t ins;
+    vm_program_t loaded;
 
     if ((vm_err = vm_verify(&program)) != VM_OK)
     {
@@ -87,6 +164,12 @@ int main(void)
         return vm_err;
     }
 
+    if ((vm_err = vm_load(&program, &loaded)) != VM_OK)
+    {
+        printf("vm_load failed, status %d\n", vm_err);
+        return vm_err;
+    }
+
     if ((vm_err = vm_create(&ins)) != VM_OK)
     {
         printf("vm_create failed, status %d\n", vm_err);
@@ -94,13 +177,31 @@ int main(void)
     }
 
     printf("------- execution output ------\n\n");
-    if ((vm_err = vm_execute(&ins, &program)) != VM_OK)
+    if ((vm_err = vm_execute(&ins, &loaded, VM_ENGINE_STACK)) != VM_OK)
 
     {
         printf("vm_execute failed, status %d\n", vm_err);
         return vm_err;
     }
 
+#ifdef VM_PROFILE
+    FILE *profile_fp = fopen(VM_PROFILE_OUTPUT, "a");
+    if (NULL != profile_fp)
+    {
+        (void) vm_profile_write(&ins, profile_fp);
+        (void) fclose(profile_fp);
+    }
+#endif /* VM_PROFILE */
+
+#ifdef VM_BRANCH_PROFILE
+    FILE *branch_fp = fopen(VM_BRANCH_PROFILE_OUTPUT, "a");
+    if (NULL != branch_fp)
+    {
+        (void) vm_branch_profile_write(&loaded, branch_fp);
+        (void) fclose(branch_fp);
+    }
+#endif /* VM_BRANCH_PROFILE */
+
     if ((vm_err = vm_destroy(&ins)) != VM_OK)
     {
         printf("vm_destroy failed, status %d\n", vm_err);
@@ -108,6 +209,7 @@ int main(void)
     }
 
     printf("\n\n");
+    vm_unload(&loaded);
     bytecode_destroy(&program);
 
     cache_err = string_cache_destroy();
@@ -0,0 +1,660 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <dlfcn.h>
+
+#include "aot_api.h"
+#include "fnv_1a_api.h"
+#include "memory_manager_api.h"
+
+
+/* Signature of AOT_ENTRY_SYMBOL. Takes the instance, whose current frame
+ * receives the values left at the end of the program and whose globals table
+ * holds the global variables, and the constant operands of the register-based
+ * translation. */
+typedef vm_status_e (*aot_function_t)(vm_instance_t *, value_t *);
+
+
+/* Start of every generated file; helpers that behave the same way as the
+ * register engine does for each instruction */
+static const char *_preamble =
+    "#include <stdio.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "#include \"vm_api.h\"\n"
+    "#include \"object_helpers_api.h\"\n"
+    "#include \"type_operations_api.h\"\n"
+    "#include \"print_object_api.h\"\n"
+    "#include \"memory_manager_api.h\"\n"
+    "#include \"data_stack_api.h\"\n"
+    "#include \"globals_api.h\"\n"
+    "\n"
+    "\n"
+    "static inline void _release(value_t value)\n"
+    "{\n"
+    "    RELEASE_VALUE(value);\n"
+    "}\n"
+    "\n"
+    "\n"
+    "static inline int _binary(value_t *dst, value_t lhs, value_t rhs, binary_op_e op)\n"
+    "{\n"
+    "    value_t result;\n"
+    "    type_status_e err = type_binary_op(&lhs, &rhs, &result, op);\n"
+    "\n"
+    "    if (TYPE_OK != err)\n"
+    "    {\n"
+    "        if (TYPE_INVALID_ARITHMETIC == err)\n"
+    "        {\n"
+    "            RUNTIME_ERR(RUNTIME_ERROR_ARITHMETIC, \"Can't do that arithmetic\\n\");\n"
+    "        }\n"
+    "\n"
+    "        _release(lhs);\n"
+    "        _release(rhs);\n"
+    "        return 1;\n"
+    "    }\n"
+    "\n"
+    "    _release(lhs);\n"
+    "    _release(rhs);\n"
+    "    *dst = result;\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "\n"
+    "static inline int _cast(value_t *dst, value_t input, data_type_e type, uint16_t extra_data)\n"
+    "{\n"
+    "    value_t output;\n"
+    "    type_status_e err = type_cast_to(&input, &output, type, extra_data);\n"
+    "\n"
+    "    if (TYPE_NO_CAST_REQUIRED == err)\n"
+    "    {\n"
+    "        *dst = input;\n"
+    "        return 0;\n"
+    "    }\n"
+    "\n"
+    "    if (TYPE_OK != err)\n"
+    "    {\n"
+    "        if (TYPE_RUNTIME_ERROR != err)\n"
+    "        {\n"
+    "            RUNTIME_ERR(RUNTIME_ERROR_CAST, \"Invalid cast\");\n"
+    "        }\n"
+    "\n"
+    "        _release(input);\n"
+    "        return 1;\n"
+    "    }\n"
+    "\n"
+    "    _release(input);\n"
+    "    *dst = output;\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "\n"
+    "static inline int _is_true(value_t value)\n"
+    "{\n"
+    "    int truth = type_is_true(&value);\n"
+    "\n"
+    "    _release(value);\n"
+    "    return truth;\n"
+    "}\n"
+    "\n"
+    "\n"
+    "static inline int _compare(vm_bool_t *result, value_t lhs, value_t rhs, compare_op_e op_type)\n"
+    "{\n"
+    "    if (TYPE_OK != type_compare(&lhs, &rhs, op_type, result))\n"
+    "    {\n"
+    "        RUNTIME_ERR(RUNTIME_ERROR_ARITHMETIC, \"Can't compare those types\");\n"
+    "        _release(lhs);\n"
+    "        _release(rhs);\n"
+    "        return 1;\n"
+    "    }\n"
+    "\n"
+    "    _release(lhs);\n"
+    "    _release(rhs);\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "\n"
+    "static inline value_t *_global(vm_instance_t *instance, vm_inline_cache_t *cache,\n"
+    "                               uint32_t name, uint8_t insert)\n"
+    "{\n"
+    "    value_t *slot = GLOBALS_CACHED_SLOT(&instance->globals, cache);\n"
+    "\n"
+    "    if (NULL != slot)\n"
+    "    {\n"
+    "        return slot;\n"
+    "    }\n"
+    "\n"
+    "    return globals_resolve(&instance->globals, cache, VALUE_STRING(instance->constants[name]),\n"
+    "                           insert);\n"
+    "}\n"
+    "\n"
+    "\n"
+    "static inline vm_status_e _end(callstack_frame_t *frame, value_t *registers, size_t depth)\n"
+    "{\n"
+    "    if (DATA_STACK_OK != data_stack_reserve(frame, depth))\n"
+    "    {\n"
+    "        return VM_MEMORY_ERROR;\n"
+    "    }\n"
+    "\n"
+    "    (void) memcpy(frame->sp, registers, depth * sizeof(value_t));\n"
+    "    frame->sp += depth;\n"
+    "    return VM_OK;\n"
+    "}\n";
+
+
+static const char *_data_type_names[NUM_DATATYPES] =
+{
+    [DATATYPE_INT] = "DATATYPE_INT",
+    [DATATYPE_FLOAT] = "DATATYPE_FLOAT",
+    [DATATYPE_STRING] = "DATATYPE_STRING",
+    [DATATYPE_BOOL] = "DATATYPE_BOOL",
+};
+
+
+static const char *_binary_op_names[] =
+{
+    [BINARY_ADD] = "BINARY_ADD",
+    [BINARY_SUB] = "BINARY_SUB",
+    [BINARY_MULT] = "BINARY_MULT",
+    [BINARY_DIV] = "BINARY_DIV",
+};
+
+
+static const char *_compare_op_names[] =
+{
+    [COMPARE_EQUAL] = "COMPARE_EQUAL",
+    [COMPARE_NOT_EQUAL] = "COMPARE_NOT_EQUAL",
+    [COMPARE_LESS] = "COMPARE_LESS",
+    [COMPARE_LESS_EQUAL] = "COMPARE_LESS_EQUAL",
+    [COMPARE_GREATER] = "COMPARE_GREATER",
+    [COMPARE_GREATER_EQUAL] = "COMPARE_GREATER_EQUAL",
+};
+
+
+/* C operators for comparisons of two ints */
+static const char *_compare_operators[] =
+{
+    [COMPARE_EQUAL] = "==",
+    [COMPARE_NOT_EQUAL] = "!=",
+    [COMPARE_LESS] = "<",
+    [COMPARE_LESS_EQUAL] = "<=",
+    [COMPARE_GREATER] = ">",
+    [COMPARE_GREATER_EQUAL] = ">=",
+};
+
+
+/* Write the value of a register or constant operand */
+static void _write_operand(FILE *output, vm_register_program_t *registers, uint32_t operand)
+{
+    if (operand < registers->num_registers)
+    {
+        fprintf(output, "r[%" PRIu32 "]", operand);
+    }
+    else
+    {
+        fprintf(output, "k[%" PRIu32 "]", operand - registers->num_registers);
+    }
+}
+
+
+/* Write the payload of an operand whose type is known, as a literal if it is
+ * a constant, so that the C compiler can fold it */
+static void _write_payload(FILE *output, vm_register_program_t *registers, uint32_t operand,
+                           data_type_e type)
+{
+    if (operand >= registers->num_registers)
+    {
+        value_t *constant = registers->constants + (operand - registers->num_registers);
+
+        if ((DATATYPE_INT == type) && (DATATYPE_INT == constant->type))
+        {
+            fprintf(output, "((vm_int_t) %" PRId32 ")", constant->payload.int_value);
+            return;
+        }
+
+        if ((DATATYPE_FLOAT == type) && (DATATYPE_FLOAT == constant->type) &&
+            isfinite(constant->payload.float_value))
+        {
+            fprintf(output, "%a", constant->payload.float_value);
+            return;
+        }
+    }
+
+    _write_operand(output, registers, operand);
+    fprintf(output, (DATATYPE_INT == type) ? ".payload.int_value" : ".payload.float_value");
+}
+
+
+/* Write "r[dst] = MAKE_VALUE(lhs op rhs);" for typed arithmetic */
+static void _write_typed_binary_op(FILE *output, vm_register_program_t *registers,
+                                   vm_register_instruction_t *ins, data_type_e type,
+                                   const char *op)
+{
+    fprintf(output, "    r[%" PRIu32 "] = %s(", ins->dst,
+            (DATATYPE_INT == type) ? "INT_VALUE" : "FLOAT_VALUE");
+    _write_payload(output, registers, ins->lhs, type);
+    fprintf(output, " %s ", op);
+    _write_payload(output, registers, ins->rhs, type);
+    fprintf(output, ");\n");
+}
+
+
+/* Write the C code for a single register instruction */
+static void _write_instruction(FILE *output, vm_register_program_t *registers,
+                               vm_register_instruction_t *ins)
+{
+    binary_op_e op = BINARY_ADD;
+
+    switch (ins->opcode)
+    {
+        case REG_OPCODE_MOVE:
+            fprintf(output, "    r[%" PRIu32 "] = ", ins->dst);
+            _write_operand(output, registers, ins->lhs);
+            fprintf(output, ";\n");
+            break;
+
+        case REG_OPCODE_DIV:
+            op += 1;
+            // Falls through
+        case REG_OPCODE_MULT:
+            op += 1;
+            // Falls through
+        case REG_OPCODE_SUB:
+            op += 1;
+            // Falls through
+        case REG_OPCODE_ADD:
+            fprintf(output, "    if (_binary(&r[%" PRIu32 "], ", ins->dst);
+            _write_operand(output, registers, ins->lhs);
+            fprintf(output, ", ");
+            _write_operand(output, registers, ins->rhs);
+            fprintf(output, ", %s)) return VM_RUNTIME_ERROR;\n", _binary_op_names[op]);
+            break;
+
+        case REG_OPCODE_ADD_INT_INT:
+            _write_typed_binary_op(output, registers, ins, DATATYPE_INT, "+");
+            break;
+
+        case REG_OPCODE_SUB_INT_INT:
+            _write_typed_binary_op(output, registers, ins, DATATYPE_INT, "-");
+            break;
+
+        case REG_OPCODE_MULT_INT_INT:
+            _write_typed_binary_op(output, registers, ins, DATATYPE_INT, "*");
+            break;
+
+        case REG_OPCODE_DIV_INT_INT:
+            // Divisor is never written as a literal, so the C compiler doesn't warn about 0
+            fprintf(output, "    if (0 == ");
+            _write_operand(output, registers, ins->rhs);
+            fprintf(output, ".payload.int_value)\n"
+                            "    {\n"
+                            "        RUNTIME_ERR(RUNTIME_ERROR_ARITHMETIC, \"Division by zero\");\n"
+                            "        return VM_RUNTIME_ERROR;\n"
+                            "    }\n"
+                            "    r[%" PRIu32 "] = INT_VALUE(", ins->dst);
+            _write_payload(output, registers, ins->lhs, DATATYPE_INT);
+            fprintf(output, " / ");
+            _write_operand(output, registers, ins->rhs);
+            fprintf(output, ".payload.int_value);\n");
+            break;
+
+        case REG_OPCODE_ADD_FLOAT_FLOAT:
+            _write_typed_binary_op(output, registers, ins, DATATYPE_FLOAT, "+");
+            break;
+
+        case REG_OPCODE_SUB_FLOAT_FLOAT:
+            _write_typed_binary_op(output, registers, ins, DATATYPE_FLOAT, "-");
+            break;
+
+        case REG_OPCODE_MULT_FLOAT_FLOAT:
+            _write_typed_binary_op(output, registers, ins, DATATYPE_FLOAT, "*");
+            break;
+
+        case REG_OPCODE_DIV_FLOAT_FLOAT:
+            _write_typed_binary_op(output, registers, ins, DATATYPE_FLOAT, "/");
+            break;
+
+        case REG_OPCODE_CAST:
+            fprintf(output, "    if (_cast(&r[%" PRIu32 "], ", ins->dst);
+            _write_operand(output, registers, ins->lhs);
+            fprintf(output, ", %s, %" PRIu16 "u)) return VM_RUNTIME_ERROR;\n",
+                    _data_type_names[ins->source->operand.cast.data_type],
+                    ins->source->operand.cast.extra_data);
+            break;
+
+        case REG_OPCODE_PRINT:
+            fprintf(output, "    print_value(&");
+            _write_operand(output, registers, ins->lhs);
+            fprintf(output, ");\n    _release(");
+            _write_operand(output, registers, ins->lhs);
+            fprintf(output, ");\n");
+            break;
+
+        case REG_OPCODE_JUMP:
+            fprintf(output, "    goto L%zu;\n", (size_t) (ins->target - registers->instructions));
+            break;
+
+        case REG_OPCODE_JUMP_IF_FALSE:
+            fprintf(output, "    if (!_is_true(");
+            _write_operand(output, registers, ins->lhs);
+            fprintf(output, ")) goto L%zu;\n", (size_t) (ins->target - registers->instructions));
+            break;
+
+        case REG_OPCODE_JUMP_IF_TRUE:
+            fprintf(output, "    if (_is_true(");
+            _write_operand(output, registers, ins->lhs);
+            fprintf(output, ")) goto L%zu;\n", (size_t) (ins->target - registers->instructions));
+            break;
+
+        case REG_OPCODE_COMPARE:
+        case REG_OPCODE_JUMP_IF_COMPARE:
+            fprintf(output, "    if (_compare(&cond, ");
+            _write_operand(output, registers, ins->lhs);
+            fprintf(output, ", ");
+            _write_operand(output, registers, ins->rhs);
+            fprintf(output, ", %s)) return VM_RUNTIME_ERROR;\n", _compare_op_names[ins->compare]);
+
+            if (REG_OPCODE_COMPARE == ins->opcode)
+            {
+                fprintf(output, "    r[%" PRIu32 "] = BOOL_VALUE(cond);\n", ins->dst);
+            }
+            else
+            {
+                fprintf(output, "    if (cond) goto L%zu;\n",
+                        (size_t) (ins->target - registers->instructions));
+            }
+            break;
+
+        case REG_OPCODE_JUMP_IF_COMPARE_INT:
+            fprintf(output, "    if (");
+            _write_payload(output, registers, ins->lhs, DATATYPE_INT);
+            fprintf(output, " %s ", _compare_operators[ins->compare]);
+            _write_payload(output, registers, ins->rhs, DATATYPE_INT);
+            fprintf(output, ") goto L%zu;\n", (size_t) (ins->target - registers->instructions));
+            break;
+
+        case REG_OPCODE_LOAD_LOCAL:
+            fprintf(output, "    r[%" PRIu32 "] = frame->locals[%" PRIu32 "];\n"
+                            "    RETAIN_VALUE(r[%" PRIu32 "]);\n", ins->dst, ins->lhs, ins->dst);
+            break;
+
+        case REG_OPCODE_STORE_LOCAL:
+            fprintf(output, "    store_value(&frame->locals[%" PRIu32 "], ", ins->dst);
+            _write_operand(output, registers, ins->lhs);
+            fprintf(output, ");\n");
+            break;
+
+        case REG_OPCODE_LOAD_GLOBAL:
+            fprintf(output, "    if (NULL == (slot = _global(instance, &c%zu, %" PRIu32 "u, 0u))) "
+                            "return VM_RUNTIME_ERROR;\n"
+                            "    r[%" PRIu32 "] = *slot;\n"
+                            "    RETAIN_VALUE(*slot);\n",
+                    (size_t) (ins - registers->instructions),
+                    ins->source->operand.const_index, ins->dst);
+            break;
+
+        case REG_OPCODE_STORE_GLOBAL:
+            fprintf(output, "    if (NULL == (slot = _global(instance, &c%zu, %" PRIu32 "u, 1u))) "
+                            "return VM_RUNTIME_ERROR;\n"
+                            "    store_value(slot, ",
+                    (size_t) (ins - registers->instructions), ins->source->operand.const_index);
+            _write_operand(output, registers, ins->lhs);
+            fprintf(output, ");\n");
+            break;
+
+        case REG_OPCODE_END:
+            fprintf(output, "    return _end(frame, r, %" PRIu32 "u);\n", ins->dst);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+/* Hash of the bytecode that a shared object must have been compiled from */
+static uint32_t _bytecode_hash(bytecode_t *bytecode)
+{
+    return fnv_1a_32_hash(bytecode->bytecode, bytecode->used_bytes);
+}
+
+
+/**
+ * @see aot_api.h
+ */
+vm_status_e aot_translate(bytecode_t *bytecode, FILE *output)
+{
+    vm_program_t program;
+    vm_status_e ret;
+
+    if ((NULL == bytecode) || (NULL == output))
+    {
+        return VM_INVALID_PARAM;
+    }
+
+    if ((ret = vm_load(bytecode, &program)) != VM_OK)
+    {
+        return ret;
+    }
+
+    vm_register_program_t *registers = &program.registers;
+    if (NULL == registers->instructions)
+    {
+        (void) vm_unload(&program);
+        return VM_UNSUPPORTED;
+    }
+
+    // Labels are only written for jump targets
+    uint8_t *is_target = memory_manager_alloc(registers->num_instructions);
+    if (NULL == is_target)
+    {
+        (void) vm_unload(&program);
+        return VM_MEMORY_ERROR;
+    }
+
+    int has_compares = 0;
+    int has_globals = 0;
+
+    (void) memset(is_target, 0, registers->num_instructions);
+    for (size_t i = 0u; i < registers->num_instructions; i++)
+    {
+        vm_register_instruction_t *ins = registers->instructions + i;
+
+        if (NULL != ins->target)
+        {
+            is_target[ins->target - registers->instructions] = 1u;
+        }
+
+        has_compares |= (REG_OPCODE_COMPARE == ins->opcode) ||
+                        (REG_OPCODE_JUMP_IF_COMPARE == ins->opcode);
+        has_globals |= (REG_OPCODE_LOAD_GLOBAL == ins->opcode) ||
+                       (REG_OPCODE_STORE_GLOBAL == ins->opcode);
+    }
+
+    fprintf(output, "/* Generated by aot_translate from %zu bytes of bytecode; do not edit */\n\n",
+            bytecode->used_bytes);
+    fprintf(output, "%s\n\n", _preamble);
+    fprintf(output, "const uint32_t %s = 0x%08" PRIx32 "u;\n\n\n", AOT_HASH_SYMBOL,
+            _bytecode_hash(bytecode));
+
+    // One inline cache per global variable access, named after its instruction
+    for (size_t i = 0u; i < registers->num_instructions; i++)
+    {
+        reg_opcode_e opcode = registers->instructions[i].opcode;
+
+        if ((REG_OPCODE_LOAD_GLOBAL == opcode) || (REG_OPCODE_STORE_GLOBAL == opcode))
+        {
+            fprintf(output, "static vm_inline_cache_t c%zu;\n", i);
+        }
+    }
+
+    if (has_globals)
+    {
+        fprintf(output, "\n\n");
+    }
+
+    fprintf(output, "vm_status_e %s(vm_instance_t *instance, value_t *k)\n{\n", AOT_ENTRY_SYMBOL);
+    fprintf(output, "    callstack_frame_t *frame = instance->callstack.current_frame;\n");
+    fprintf(output, "    value_t r[%" PRIu32 "];\n",
+            (0u < registers->num_registers) ? registers->num_registers : 1u);
+
+    if (has_compares)
+    {
+        fprintf(output, "    vm_bool_t cond;\n");
+    }
+
+    if (has_globals)
+    {
+        fprintf(output, "    value_t *slot;\n");
+    }
+
+    fprintf(output, "\n");
+
+    for (size_t i = 0u; i < registers->num_instructions; i++)
+    {
+        if (is_target[i])
+        {
+            fprintf(output, "L%zu:\n", i);
+        }
+
+        _write_instruction(output, registers, registers->instructions + i);
+    }
+
+    fprintf(output, "}\n");
+
+    memory_manager_free(is_target);
+    (void) vm_unload(&program);
+
+    return ferror(output) ? VM_ERROR : VM_OK;
+}
+
+
+/**
+ * @see aot_api.h
+ */
+vm_status_e aot_compile(bytecode_t *bytecode, const char *path)
+{
+    const char *format = "%s " VM_AOT_CFLAGS " " VM_AOT_INCLUDE_FLAGS " -o '%s' '%s.c'";
+    vm_status_e ret;
+
+    if ((NULL == bytecode) || (NULL == path))
+    {
+        return VM_INVALID_PARAM;
+    }
+
+    // The paths are quoted in the compiler command, which is run by the shell
+    if (NULL != strchr(path, '\''))
+    {
+        return VM_INVALID_PARAM;
+    }
+
+    size_t c_path_size = strlen(path) + sizeof(".c");
+    char *c_path = memory_manager_alloc(c_path_size);
+    if (NULL == c_path)
+    {
+        return VM_MEMORY_ERROR;
+    }
+
+    (void) snprintf(c_path, c_path_size, "%s.c", path);
+
+    FILE *output = fopen(c_path, "w");
+    memory_manager_free(c_path);
+
+    if (NULL == output)
+    {
+        return VM_ERROR;
+    }
+
+    ret = aot_translate(bytecode, output);
+    if ((0 != fclose(output)) && (VM_OK == ret))
+    {
+        ret = VM_ERROR;
+    }
+
+    if (VM_OK != ret)
+    {
+        return ret;
+    }
+
+    int command_size = snprintf(NULL, 0, format, VM_AOT_CC, path, path) + 1;
+    char *command = memory_manager_alloc((size_t) command_size);
+    if (NULL == command)
+    {
+        return VM_MEMORY_ERROR;
+    }
+
+    (void) snprintf(command, (size_t) command_size, format, VM_AOT_CC, path, path);
+
+    if (0 != system(command))
+    {
+        ret = VM_ERROR;
+    }
+
+    memory_manager_free(command);
+    return ret;
+}
+
+
+/**
+ * @see aot_api.h
+ */
+vm_status_e aot_load(vm_program_t *program, const char *path)
+{
+    if ((NULL == program) || (NULL == path) || (NULL == program->instructions))
+    {
+        return VM_INVALID_PARAM;
+    }
+
+    // Generated code refers to the constants of the register-based translation
+    if (NULL == program->registers.instructions)
+    {
+        return VM_UNSUPPORTED;
+    }
+
+    void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (NULL == library)
+    {
+        return VM_ERROR;
+    }
+
+    const uint32_t *hash = dlsym(library, AOT_HASH_SYMBOL);
+    void *entry = dlsym(library, AOT_ENTRY_SYMBOL);
+
+    if ((NULL == hash) || (NULL == entry) || (_bytecode_hash(program->bytecode) != *hash))
+    {
+        (void) dlclose(library);
+        return VM_INVALID_PARAM;
+    }
+
+    aot_unload(program);
+    program->aot.library = library;
+    program->aot.entry = entry;
+    return VM_OK;
+}
+
+
+/**
+ * @see aot_api.h
+ */
+void aot_unload(vm_program_t *program)
+{
+    if (NULL != program->aot.library)
+    {
+        (void) dlclose(program->aot.library);
+    }
+
+    program->aot.library = NULL;
+    program->aot.entry = NULL;
+}
+
+
+/**
+ * @see aot_api.h
+ */
+vm_status_e aot_execute(vm_instance_t *instance, vm_program_t *program)
+{
+    aot_function_t function = (aot_function_t) program->aot.entry;
+
+    return function(instance, program->registers.constants);
+}
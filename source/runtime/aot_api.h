@@ -0,0 +1,115 @@
+/**
+ * Ahead-of-time compiler; translates verified bytecode into a standalone C
+ * translation unit, which is compiled by the system C compiler into a shared
+ * object that can be loaded and run by VM_ENGINE_AOT instead of interpreting
+ * the program.
+ *
+ * The C code is generated from the register-based translation of the program
+ * (see register_vm_api.h). Each register instruction becomes a few lines of
+ * straight-line C, with registers held in a local array, typed arithmetic
+ * done inline, generic arithmetic, casts and printing done by calling the
+ * runtime (type_binary_op, type_cast_to, print_value), and jumps done with
+ * goto. Shared objects call back into the runtime of the program that loads
+ * them, so programs using them must be linked with -rdynamic.
+ */
+
+#ifndef AOT_API_H_
+#define AOT_API_H_
+
+
+#include <stdio.h>
+
+#include "vm_api.h"
+#include "runtime_common.h"
+
+
+/* Command used to compile generated C files into shared objects */
+#ifndef VM_AOT_CC
+#define VM_AOT_CC "cc"
+#endif
+
+
+/* Flags used to compile generated C files into shared objects */
+#ifndef VM_AOT_CFLAGS
+#define VM_AOT_CFLAGS "-O2 -shared -fPIC"
+#endif
+
+
+/* Include flags for the runtime headers, which generated C files include.
+ * Set by the Makefile to the absolute paths of the source directories. */
+#ifndef VM_AOT_INCLUDE_FLAGS
+#define VM_AOT_INCLUDE_FLAGS ""
+#endif
+
+
+/* Symbols defined by every generated C file */
+#define AOT_ENTRY_SYMBOL "aot_program"
+#define AOT_HASH_SYMBOL "aot_bytecode_hash"
+
+
+/**
+ * Write a C translation unit for a verified program. The generated file
+ * defines AOT_ENTRY_SYMBOL, and AOT_HASH_SYMBOL holding a hash of the
+ * bytecode, so that aot_load can check that it is given the right program.
+ *
+ * @param    bytecode    Pointer to verified bytecode object to translate
+ * @param    output      Stream to write the C code to
+ *
+ * @return   VM_OK if successful, VM_UNSUPPORTED if the program has no
+ *           register-based translation
+ */
+vm_status_e aot_translate(bytecode_t *bytecode, FILE *output);
+
+
+/**
+ * Translate a verified program with aot_translate, and compile it into a
+ * shared object with VM_AOT_CC. The C code is written to the same path with
+ * ".c" appended, and kept next to the shared object.
+ *
+ * @param    bytecode    Pointer to verified bytecode object to compile
+ * @param    path        Path of the shared object to create, which may not
+ *                       contain single quotes
+ *
+ * @return   VM_OK if successful, VM_INVALID_PARAM if the path contains a single
+ *           quote, VM_ERROR if the C code could not be written or compiled
+ */
+vm_status_e aot_compile(bytecode_t *bytecode, const char *path);
+
+
+/**
+ * Load a shared object created by aot_compile, so that the program can be run
+ * with VM_ENGINE_AOT. Replaces any shared object already loaded for the
+ * program.
+ *
+ * @param    program    Pointer to program loaded by vm_load, from the same
+ *                      bytecode that the shared object was compiled from
+ * @param    path       Path of the shared object to load
+ *
+ * @return   VM_OK if successful, VM_INVALID_PARAM if the shared object was
+ *           compiled from different bytecode, VM_ERROR if it could not be
+ *           loaded
+ */
+vm_status_e aot_load(vm_program_t *program, const char *path);
+
+
+/**
+ * Unload the shared object loaded by aot_load, if any
+ *
+ * @param    program    Pointer to loaded program
+ */
+void aot_unload(vm_program_t *program);
+
+
+/**
+ * Run the shared object loaded for a program. The data stack holds the same
+ * values afterwards as it would with the stack engine.
+ *
+ * @param    instance    Pointer to VM instance to execute the program on
+ * @param    program     Pointer to program to execute
+ *
+ * @return   VM_OK if execution completed successfully
+ */
+vm_status_e aot_execute(vm_instance_t *instance, vm_program_t *program);
+
+
+#endif /* AOT_API_H_ */
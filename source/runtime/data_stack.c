@@ -0,0 +1,330 @@
+#include <string.h>
+
+#include "data_stack_api.h"
+#include "memory_manager_api.h"
+#include "object_helpers_api.h"
+
+
+/* The running frame is the first member of its callstack */
+#define CALLSTACK_OF(frame) ((callstack_t *) (frame))
+
+
+/* Release the local variable slots of the running function, and anything
+ * left on its data stack */
+static void _release_frame(callstack_frame_t *frame)
+{
+    for (value_t *value = frame->base; value < frame->sp; value++)
+    {
+        RELEASE_VALUE(*value);
+    }
+
+    for (size_t i = 0u; i < frame->num_locals; i++)
+    {
+        store_value(frame->locals + i, INT_VALUE(0));
+    }
+}
+
+
+/**
+ * @see data_stack_api.h
+ */
+data_stack_status_e data_stack_create(callstack_t *callstack)
+{
+    if (NULL == callstack)
+    {
+        return DATA_STACK_INVALID_PARAM;
+    }
+
+    callstack->stack = memory_manager_alloc(DATA_STACK_INITIAL_SLOTS * sizeof(value_t));
+    if (NULL == callstack->stack)
+    {
+        return DATA_STACK_MEMORY_ERROR;
+    }
+
+    callstack->frame.base = callstack->stack;
+    callstack->frame.sp = callstack->stack;
+    callstack->frame.limit = callstack->stack + DATA_STACK_INITIAL_SLOTS;
+    callstack->frame.locals = NULL;
+    callstack->frame.num_locals = 0u;
+    callstack->frame.return_ip = NULL;
+    callstack->current_frame = &callstack->frame;
+    callstack->saved = NULL;
+    callstack->depth = 0u;
+    callstack->capacity = 0u;
+    callstack->frame_locals = 0u;
+    callstack->frame_depth = 0u;
+    return DATA_STACK_OK;
+}
+
+
+/**
+ * @see data_stack_api.h
+ */
+data_stack_status_e data_stack_destroy(callstack_t *callstack)
+{
+    if (NULL == callstack)
+    {
+        return DATA_STACK_INVALID_PARAM;
+    }
+
+    data_stack_unwind(callstack);
+
+    callstack_frame_t *frame = &callstack->frame;
+    _release_frame(frame);
+
+    memory_manager_free(callstack->stack);
+    memory_manager_free(callstack->saved);
+    memory_manager_free(frame->locals);
+    callstack->stack = NULL;
+    callstack->saved = NULL;
+    callstack->depth = 0u;
+    callstack->capacity = 0u;
+    frame->base = NULL;
+    frame->sp = NULL;
+    frame->limit = NULL;
+    frame->locals = NULL;
+    frame->num_locals = 0u;
+    return DATA_STACK_OK;
+}
+
+
+/**
+ * @see data_stack_api.h
+ */
+data_stack_status_e data_stack_reserve(callstack_frame_t *frame, size_t slots)
+{
+    if (NULL == frame)
+    {
+        return DATA_STACK_INVALID_PARAM;
+    }
+
+    callstack_t *callstack = CALLSTACK_OF(frame);
+    value_t *old_stack = callstack->stack;
+    size_t used = (size_t) (frame->sp - old_stack);
+    size_t size = (size_t) (frame->limit - old_stack);
+
+    if ((size - used) >= slots)
+    {
+        return DATA_STACK_OK;
+    }
+
+    size_t new_size = size * 2u;
+    if (new_size < (used + slots))
+    {
+        new_size = used + slots;
+    }
+
+    /* Every frame points into the value stack, so the new one is filled in
+     * and the pointers are moved before the old one is freed */
+    value_t *new_stack = memory_manager_alloc(new_size * sizeof(value_t));
+    if (NULL == new_stack)
+    {
+        return DATA_STACK_MEMORY_ERROR;
+    }
+
+    (void) memcpy(new_stack, old_stack, used * sizeof(value_t));
+
+    for (size_t i = 0u; i <= callstack->depth; i++)
+    {
+        callstack_frame_t *f = (i < callstack->depth) ? (callstack->saved + i) : frame;
+
+        f->base = new_stack + (f->base - old_stack);
+        f->sp = new_stack + (f->sp - old_stack);
+        f->limit = new_stack + new_size;
+
+        // Local variables of the outermost frame are not on the value stack
+        if (0u < i)
+        {
+            f->locals = new_stack + (f->locals - old_stack);
+        }
+    }
+
+    memory_manager_free(old_stack);
+    callstack->stack = new_stack;
+    return DATA_STACK_OK;
+}
+
+
+/**
+ * @see data_stack_api.h
+ */
+data_stack_status_e data_stack_push_frame(callstack_t *callstack, vm_instruction_t *return_ip,
+                                          size_t num_args)
+{
+    if ((NULL == callstack) || (DATA_STACK_DEPTH(&callstack->frame) < num_args))
+    {
+        return DATA_STACK_INVALID_PARAM;
+    }
+
+    if (callstack->depth == callstack->capacity)
+    {
+        size_t capacity = (0u == callstack->capacity) ? DATA_STACK_INITIAL_FRAMES :
+                                                        callstack->capacity * 2u;
+        callstack_frame_t *saved = memory_manager_realloc(callstack->saved,
+                                                          capacity * sizeof(callstack_frame_t));
+        if (NULL == saved)
+        {
+            return DATA_STACK_MEMORY_ERROR;
+        }
+
+        callstack->saved = saved;
+        callstack->capacity = capacity;
+    }
+
+    callstack_frame_t *frame = &callstack->frame;
+    size_t num_locals = (callstack->frame_locals > num_args) ? callstack->frame_locals : num_args;
+
+    // The arguments are already in place as the first local variable slots
+    data_stack_status_e err = data_stack_reserve(frame, (num_locals - num_args) +
+                                                        callstack->frame_depth);
+    if (DATA_STACK_OK != err)
+    {
+        return err;
+    }
+
+    value_t *locals = frame->sp - num_args;
+    callstack_frame_t *caller = callstack->saved + callstack->depth;
+
+    *caller = *frame;
+    caller->sp = locals;
+    caller->return_ip = return_ip;
+    callstack->depth += 1u;
+
+    // The references held by the arguments move with them to the local variable slots
+    for (size_t i = num_args; i < num_locals; i++)
+    {
+        locals[i] = INT_VALUE(0);
+    }
+
+    frame->locals = locals;
+    frame->num_locals = num_locals;
+    frame->base = locals + num_locals;
+    frame->sp = frame->base;
+    return DATA_STACK_OK;
+}
+
+
+/**
+ * @see data_stack_api.h
+ */
+data_stack_status_e data_stack_replace_frame(callstack_t *callstack, size_t num_args)
+{
+    if ((NULL == callstack) || (0u == callstack->depth) ||
+        (DATA_STACK_DEPTH(&callstack->frame) < num_args))
+    {
+        return DATA_STACK_INVALID_PARAM;
+    }
+
+    callstack_frame_t *frame = &callstack->frame;
+    size_t num_locals = (callstack->frame_locals > num_args) ? callstack->frame_locals : num_args;
+
+    // The arguments are moved down to the local variable slots, which may need to grow
+    size_t used = (size_t) (frame->sp - frame->locals);
+    size_t needed = num_locals + callstack->frame_depth;
+    if (needed > used)
+    {
+        data_stack_status_e err = data_stack_reserve(frame, needed - used);
+        if (DATA_STACK_OK != err)
+        {
+            return err;
+        }
+    }
+
+    value_t *args = frame->sp - num_args;
+
+    // Arguments hold references of their own, so releasing the slots that held them is safe
+    frame->sp = args;
+    _release_frame(frame);
+
+    (void) memmove(frame->locals, args, num_args * sizeof(value_t));
+
+    for (size_t i = num_args; i < num_locals; i++)
+    {
+        frame->locals[i] = INT_VALUE(0);
+    }
+
+    frame->num_locals = num_locals;
+    frame->base = frame->locals + num_locals;
+    frame->sp = frame->base;
+    return DATA_STACK_OK;
+}
+
+
+/**
+ * @see data_stack_api.h
+ */
+data_stack_status_e data_stack_pop_frame(callstack_t *callstack, value_t result,
+                                         vm_instruction_t **return_ip)
+{
+    if ((NULL == callstack) || (NULL == return_ip) || (0u == callstack->depth))
+    {
+        return DATA_STACK_INVALID_PARAM;
+    }
+
+    callstack_frame_t *frame = &callstack->frame;
+
+    // The result holds a reference of its own, so releasing the slot that held it is safe
+    _release_frame(frame);
+
+    callstack->depth -= 1u;
+    *frame = callstack->saved[callstack->depth];
+    *return_ip = frame->return_ip;
+
+    // The caller's data stack ends where the arguments were, so there is space for the result
+    *(frame->sp++) = result;
+    return DATA_STACK_OK;
+}
+
+
+/**
+ * @see data_stack_api.h
+ */
+void data_stack_unwind(callstack_t *callstack)
+{
+    while (0u < callstack->depth)
+    {
+        _release_frame(&callstack->frame);
+        callstack->depth -= 1u;
+        callstack->frame = callstack->saved[callstack->depth];
+    }
+}
+
+
+/**
+ * @see data_stack_api.h
+ */
+data_stack_status_e data_stack_reset_locals(callstack_frame_t *frame, size_t slots)
+{
+    if (NULL == frame)
+    {
+        return DATA_STACK_INVALID_PARAM;
+    }
+
+    size_t i;
+
+    for (i = 0u; (i < slots) && (i < frame->num_locals); i++)
+    {
+        store_value(frame->locals + i, INT_VALUE(0));
+    }
+
+    if (slots <= frame->num_locals)
+    {
+        return DATA_STACK_OK;
+    }
+
+    value_t *new_locals = memory_manager_realloc(frame->locals,
+                                                   slots * sizeof(value_t));
+    if (NULL == new_locals)
+    {
+        return DATA_STACK_MEMORY_ERROR;
+    }
+
+    for (i = frame->num_locals; i < slots; i++)
+    {
+        new_locals[i] = INT_VALUE(0);
+    }
+
+    frame->locals = new_locals;
+    frame->num_locals = slots;
+    return DATA_STACK_OK;
+}
@@ -0,0 +1,212 @@
+#ifndef DATA_STACK_API_H
+#define DATA_STACK_API_H
+
+#include "data_types.h"
+#include "runtime_common.h"
+
+
+/* Initial number of slots allocated for the value stack of a new callstack */
+#define DATA_STACK_INITIAL_SLOTS (32u)
+
+
+/* Number of saved frames allocated when a callstack first needs them */
+#define DATA_STACK_INITIAL_FRAMES (16u)
+
+
+/**
+ * Status codes returned by data_stack functions
+ */
+typedef enum
+{
+    DATA_STACK_OK,
+    DATA_STACK_INVALID_PARAM,
+    DATA_STACK_MEMORY_ERROR,
+} data_stack_status_e;
+
+
+/* Number of items currently on the data stack of a callstack frame */
+#define DATA_STACK_DEPTH(frame) ((size_t) ((frame)->sp - (frame)->base))
+
+
+/* Push an item onto the data stack of a callstack frame. The stack is only
+ * grown if it is full, which should not happen in the steady state since
+ * vm_execute and OPCODE_CALL reserve the maximum depth calculated by vm_load */
+#define DATA_STACK_PUSH_RT(frame, item)                                       \
+    do {                                                                      \
+        if ((frame)->sp == (frame)->limit)                                    \
+        {                                                                     \
+            CHECK_DATA_STACK_ERR_RT(data_stack_reserve((frame), 1u));         \
+        }                                                                     \
+                                                                              \
+        *((frame)->sp++) = (item);                                            \
+    }                                                                         \
+    while (0)
+
+
+/* Pop an item off the data stack of a callstack frame */
+#define DATA_STACK_POP_RT(frame, item)                                        \
+    do {                                                                      \
+        if ((frame)->sp == (frame)->base)                                     \
+        {                                                                     \
+            RUNTIME_ERR(RUNTIME_ERROR_INTERNAL, "data stack underflow");      \
+            return NULL;                                                      \
+        }                                                                     \
+                                                                              \
+        (item) = *(--(frame)->sp);                                            \
+    }                                                                         \
+    while (0)
+
+
+/* Push an item onto the data stack of a callstack frame, without checking for
+ * space. Only for programs whose maximum depth was proven by vm_load, since
+ * vm_execute and OPCODE_CALL reserve that much space for every frame. */
+#define DATA_STACK_PUSH_UNCHECKED(frame, item) (*((frame)->sp++) = (item))
+
+
+/* Pop an item off the data stack of a callstack frame, without checking for
+ * underflow. Only for programs proven by vm_load never to underflow. */
+#define DATA_STACK_POP_UNCHECKED(frame, item) ((item) = *(--(frame)->sp))
+
+
+#define CHECK_DATA_STACK_ERR_RT(func)                                         \
+    do {                                                                      \
+        data_stack_status_e __err_code = func;                                \
+                                                                              \
+        if (DATA_STACK_OK != __err_code)                                      \
+        {                                                                     \
+            runtime_error_e __rt_err;                                         \
+            if (DATA_STACK_MEMORY_ERROR == __err_code)                        \
+            {                                                                 \
+                __rt_err = RUNTIME_ERROR_MEMORY;                              \
+            }                                                                 \
+            else                                                              \
+            {                                                                 \
+                __rt_err = RUNTIME_ERROR_INTERNAL;                            \
+            }                                                                 \
+                                                                              \
+            RUNTIME_ERR(__rt_err,                                             \
+                        "data stack operation failed, status %d",             \
+                        __err_code);                                          \
+            return NULL;                                                      \
+        }                                                                     \
+    }                                                                         \
+    while(0)
+
+
+/**
+ * Initialize a callstack, and allocate a value stack of DATA_STACK_INITIAL_SLOTS
+ * items. The running frame starts out as the outermost frame of a program,
+ * with an empty data stack and no local variable slots.
+ *
+ * @param   callstack   Pointer to callstack to initialize
+ *
+ * @return  DATA_STACK_OK if the callstack was initialized successfully
+ */
+data_stack_status_e data_stack_create(callstack_t *callstack);
+
+
+/**
+ * Free all memory allocated for a callstack, releasing the values held by
+ * the local variable slots of every frame, and the values left on the data
+ * stack of every frame
+ *
+ * @param   callstack   Pointer to callstack to destroy
+ *
+ * @return  DATA_STACK_OK if the callstack was destroyed successfully
+ */
+data_stack_status_e data_stack_destroy(callstack_t *callstack);
+
+
+/**
+ * Ensure that at least the given number of items can be pushed to the data
+ * stack of a callstack frame without it needing to grow. If the value stack
+ * needs to grow, the allocated size is at least doubled, and every frame of
+ * the callstack is moved along with it.
+ *
+ * @param   frame   Pointer to the running frame of a callstack
+ *                  (callstack_t.current_frame)
+ * @param   slots   Number of free slots required
+ *
+ * @return  DATA_STACK_OK if the requested space is available
+ */
+data_stack_status_e data_stack_reserve(callstack_frame_t *frame, size_t slots);
+
+
+/**
+ * Enter a function. The running frame is saved, and replaced with a frame
+ * whose first local variable slots are the top 'num_args' items on the data
+ * stack, in the order they were pushed; the items are not copied, and the
+ * rest of the callstack's frame_locals slots are set to int 0. The new frame
+ * has an empty data stack, with space for frame_depth items.
+ *
+ * @param   callstack   Pointer to callstack
+ * @param   return_ip   Instruction to continue at when the function returns,
+ *                      or NULL if returning from the function is an error
+ * @param   num_args    Number of items passed from the data stack, which
+ *                      must hold at least that many
+ *
+ * @return  DATA_STACK_OK if the function was entered
+ */
+data_stack_status_e data_stack_push_frame(callstack_t *callstack, vm_instruction_t *return_ip,
+                                          size_t num_args);
+
+
+/**
+ * Replace the running function with another one, for a call in tail position.
+ * The top 'num_args' items on the data stack become the first local variable
+ * slots of the running frame, in the order they were pushed, and the values
+ * it held before are released as by data_stack_pop_frame; the rest of the
+ * callstack's frame_locals slots are set to int 0, and the data stack is left
+ * empty. No frame is saved, so the function that takes over returns straight
+ * to the caller of the one it replaced.
+ *
+ * @param   callstack   Pointer to callstack, with at least one saved frame
+ * @param   num_args    Number of items passed from the data stack, which
+ *                      must hold at least that many
+ *
+ * @return  DATA_STACK_OK if the running frame was replaced
+ */
+data_stack_status_e data_stack_replace_frame(callstack_t *callstack, size_t num_args);
+
+
+/**
+ * Return from a function. The local variable slots of the running frame are
+ * released, along with anything left on its data stack, the caller's frame
+ * is resumed, and the return value is pushed onto the caller's data stack.
+ *
+ * @param   callstack   Pointer to callstack, with at least one saved frame
+ * @param   result      Value returned, already popped off the data stack
+ * @param   return_ip   Pointer to location to store the instruction to
+ *                      continue at
+ *
+ * @return  DATA_STACK_OK if the caller was resumed
+ */
+data_stack_status_e data_stack_pop_frame(callstack_t *callstack, value_t result,
+                                         vm_instruction_t **return_ip);
+
+
+/**
+ * Return from every function that is still running, e.g. after a runtime
+ * error, leaving the outermost frame of the program running; the values
+ * left by each function are released as by data_stack_pop_frame
+ *
+ * @param   callstack   Pointer to callstack
+ */
+void data_stack_unwind(callstack_t *callstack);
+
+
+/**
+ * Make sure the local variable slots of a callstack frame can hold at least
+ * the given number of slots, and reset the first 'slots' slots to int 0,
+ * releasing any values they held. Only for the outermost frame of a program;
+ * the slots of function calls are set up by data_stack_push_frame.
+ *
+ * @param   frame   Pointer to callstack frame
+ * @param   slots   Number of local variable slots required
+ *
+ * @return  DATA_STACK_OK if the local variable slots are ready to use
+ */
+data_stack_status_e data_stack_reset_locals(callstack_frame_t *frame, size_t slots);
+
+
+#endif /* DATA_STACK_API_H */
@@ -0,0 +1,180 @@
+#include <stdio.h>
+
+#include "globals_api.h"
+#include "hashtables_api.h"
+#include "object_helpers_api.h"
+
+
+/* Source of table versions. Versions are unique across all globals tables, so
+ * a program loaded once and run by several VM instances never mistakes an
+ * address cached from one instance's table for one in another's. Starts at
+ * 0, which is never a table version, so that new inline caches always miss. */
+static uint64_t _last_version = 0u;
+
+
+static globals_status_e _hashtable_status(hashtable_status_e err)
+{
+    return (HASHTABLE_MEMORY_ERROR == err) ? GLOBALS_MEMORY_ERROR : GLOBALS_ERROR;
+}
+
+
+/**
+ * @see globals_api.h
+ */
+globals_status_e globals_create(vm_globals_t *globals)
+{
+    if (NULL == globals)
+    {
+        return GLOBALS_INVALID_PARAM;
+    }
+
+    hashtable_status_e err = create_pointer_comparison_hashtable(&globals->table,
+                                                                 sizeof(value_t));
+    if (HASHTABLE_OK != err)
+    {
+        return _hashtable_status(err);
+    }
+
+    globals->version = ++_last_version;
+    globals->count = 0u;
+    return GLOBALS_OK;
+}
+
+
+/**
+ * @see globals_api.h
+ */
+globals_status_e globals_destroy(vm_globals_t *globals)
+{
+    if (NULL == globals)
+    {
+        return GLOBALS_INVALID_PARAM;
+    }
+
+    // Deleted entries are still counted by the hashtable, so stop after the last global
+    for (size_t i = 0u; i < globals->count; i++)
+    {
+        value_t *value;
+        hashtable_status_e err = hashtable_next(&globals->table, (void **) &value);
+
+        if ((HASHTABLE_OK != err) && (HASHTABLE_LAST_ENTRY != err))
+        {
+            return GLOBALS_ERROR;
+        }
+
+        store_value(value, INT_VALUE(0));
+    }
+
+    if (HASHTABLE_OK != hashtable_destroy(&globals->table))
+    {
+        return GLOBALS_ERROR;
+    }
+
+    globals->version = ++_last_version;
+    globals->count = 0u;
+    return GLOBALS_OK;
+}
+
+
+/**
+ * @see globals_api.h
+ */
+globals_status_e globals_lookup(vm_globals_t *globals, byte_string_t *name, value_t **slot)
+{
+    if ((NULL == globals) || (NULL == name) || (NULL == slot))
+    {
+        return GLOBALS_INVALID_PARAM;
+    }
+
+    hashtable_status_e err = hashtable_get(&globals->table, name->bytes, name->size,
+                                           (void **) slot);
+    if (HASHTABLE_NO_ITEM == err)
+    {
+        return GLOBALS_NO_NAME;
+    }
+
+    return (HASHTABLE_OK == err) ? GLOBALS_OK : _hashtable_status(err);
+}
+
+
+/**
+ * @see globals_api.h
+ */
+globals_status_e globals_insert(vm_globals_t *globals, byte_string_t *name, value_t **slot)
+{
+    globals_status_e ret = globals_lookup(globals, name, slot);
+    if (GLOBALS_NO_NAME != ret)
+    {
+        return ret;
+    }
+
+    value_t initial = INT_VALUE(0);
+
+    hashtable_status_e err = hashtable_put(&globals->table, name->bytes, name->size, &initial);
+    if (HASHTABLE_OK != err)
+    {
+        return _hashtable_status(err);
+    }
+
+    // The table may have been resized, moving every value
+    globals->version = ++_last_version;
+    globals->count += 1u;
+    *slot = (value_t *) globals->table.last_written->data;
+    return GLOBALS_OK;
+}
+
+
+/**
+ * @see globals_api.h
+ */
+globals_status_e globals_delete(vm_globals_t *globals, byte_string_t *name)
+{
+    value_t *slot;
+
+    globals_status_e ret = globals_lookup(globals, name, &slot);
+    if (GLOBALS_OK != ret)
+    {
+        return ret;
+    }
+
+    store_value(slot, INT_VALUE(0));
+
+    hashtable_status_e err = hashtable_delete(&globals->table, name->bytes, name->size);
+    if (HASHTABLE_OK != err)
+    {
+        return _hashtable_status(err);
+    }
+
+    globals->version = ++_last_version;
+    globals->count -= 1u;
+    return GLOBALS_OK;
+}
+
+
+/**
+ * @see globals_api.h
+ */
+value_t *globals_resolve(vm_globals_t *globals, vm_inline_cache_t *cache,
+                         byte_string_t *name, uint8_t insert)
+{
+    value_t *slot;
+    globals_status_e ret;
+
+    ret = (insert) ? globals_insert(globals, name, &slot) : globals_lookup(globals, name, &slot);
+    if (GLOBALS_NO_NAME == ret)
+    {
+        RUNTIME_ERR(RUNTIME_ERROR_NAME, "Global '%s' is not defined", name->bytes);
+        return NULL;
+    }
+    else if (GLOBALS_OK != ret)
+    {
+        RUNTIME_ERR((GLOBALS_MEMORY_ERROR == ret) ? RUNTIME_ERROR_MEMORY : RUNTIME_ERROR_INTERNAL,
+                    "globals operation failed, status %d", ret);
+        return NULL;
+    }
+
+    cache->func.global = slot;
+    cache->version = globals->version;
+    cache->misses += 1u;
+    return slot;
+}
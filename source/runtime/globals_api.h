@@ -0,0 +1,115 @@
+/**
+ * Global variables of a VM instance. Each LOAD_GLOBAL and STORE_GLOBAL
+ * instruction caches the address of the value of its global variable in its
+ * inline cache, along with the version of the table it was found in. The
+ * version is changed whenever a global is added or deleted, since that can
+ * move entries around in the hashtable, so while the version is unchanged, a
+ * global is read or written with a version check and a pointer load instead
+ * of a hashtable lookup.
+ */
+
+#ifndef GLOBALS_API_H
+#define GLOBALS_API_H
+
+#include <stdint.h>
+
+#include "runtime_common.h"
+
+
+/**
+ * Status codes returned by globals functions
+ */
+typedef enum
+{
+    GLOBALS_OK,
+    GLOBALS_NO_NAME,
+    GLOBALS_INVALID_PARAM,
+    GLOBALS_MEMORY_ERROR,
+    GLOBALS_ERROR
+} globals_status_e;
+
+
+/* Address of the value of a global variable cached by an instruction, or NULL
+ * if the globals table has changed since the address was cached */
+#define GLOBALS_CACHED_SLOT(globals, cache)                                   \
+    (((cache)->version == (globals)->version) ? (cache)->func.global : NULL)
+
+
+/**
+ * Initialize an empty globals table
+ *
+ * @param   globals   Pointer to globals table to initialize
+ *
+ * @return  GLOBALS_OK if the globals table was initialized successfully
+ */
+globals_status_e globals_create(vm_globals_t *globals);
+
+
+/**
+ * Release the values of all global variables, and free all memory allocated
+ * for a globals table
+ *
+ * @param   globals   Pointer to globals table to destroy
+ *
+ * @return  GLOBALS_OK if the globals table was destroyed successfully
+ */
+globals_status_e globals_destroy(vm_globals_t *globals);
+
+
+/**
+ * Find the value of a global variable. The address is only valid until the
+ * next global is added or deleted.
+ *
+ * @param   globals   Pointer to globals table
+ * @param   name      Name of global variable; must have come from string_cache_add
+ * @param   slot      Pointer to location to store address of value
+ *
+ * @return  GLOBALS_OK if the global was found, GLOBALS_NO_NAME if it doesn't exist
+ */
+globals_status_e globals_lookup(vm_globals_t *globals, byte_string_t *name, value_t **slot);
+
+
+/**
+ * Find the value of a global variable, adding the global with the value int 0
+ * if it doesn't exist yet. The address is only valid until the next global is
+ * added or deleted.
+ *
+ * @param   globals   Pointer to globals table
+ * @param   name      Name of global variable; must have come from string_cache_add
+ * @param   slot      Pointer to location to store address of value
+ *
+ * @return  GLOBALS_OK if successful
+ */
+globals_status_e globals_insert(vm_globals_t *globals, byte_string_t *name, value_t **slot);
+
+
+/**
+ * Delete a global variable, releasing its value
+ *
+ * @param   globals   Pointer to globals table
+ * @param   name      Name of global variable; must have come from string_cache_add
+ *
+ * @return  GLOBALS_OK if the global was deleted, GLOBALS_NO_NAME if it doesn't exist
+ */
+globals_status_e globals_delete(vm_globals_t *globals, byte_string_t *name);
+
+
+/**
+ * Look up the value of a global variable for an instruction whose cached
+ * address is out of date (see GLOBALS_CACHED_SLOT), and cache the address
+ * found in the inline cache of the instruction. Used by every dispatch engine,
+ * so failures generate a runtime error here.
+ *
+ * @param   globals   Pointer to globals table
+ * @param   cache     Inline cache of the LOAD_GLOBAL or STORE_GLOBAL instruction
+ * @param   name      Name of global variable; must have come from string_cache_add
+ * @param   insert    1 to add the global if it doesn't exist (see globals_insert)
+ *
+ * @return  Address of the value of the global, or NULL if a runtime error
+ *          occurred (e.g. loading a global that doesn't exist)
+ */
+value_t *globals_resolve(vm_globals_t *globals, vm_inline_cache_t *cache,
+                         byte_string_t *name, uint8_t insert);
+
+
+#endif /* GLOBALS_API_H */
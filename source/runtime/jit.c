@@ -0,0 +1,1144 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "jit_api.h"
+#include "opcode_handlers.h"
+#include "bytecode_utils_api.h"
+#include "memory_manager_api.h"
+#include "object_helpers_api.h"
+
+
+#ifdef JIT_SUPPORTED
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+/* Native code is entered at the code for an instruction, and returns the next
+ * instruction to continue from, or NULL if a runtime error occurred. Returns
+ * the OPCODE_END instruction when the program is finished. */
+typedef vm_instruction_t *(*jit_function_t)(vm_instance_t *, callstack_frame_t *, uint8_t *);
+
+
+/* Upper bound on the size of the native code for a single instruction */
+#define JIT_MAX_INSTRUCTION_BYTES (256u)
+
+
+/* Size of the code before the first instruction (prologue, error and exit) */
+#define JIT_MAX_PREAMBLE_BYTES (64u)
+
+
+/* Displacements used to address the data stack and the values on it. The
+ * templates assume the layout of value_t on x86-64. */
+#define FRAME_BASE    ((uint8_t) offsetof(callstack_frame_t, base))
+#define FRAME_SP      ((uint8_t) offsetof(callstack_frame_t, sp))
+#define FRAME_LIMIT   ((uint8_t) offsetof(callstack_frame_t, limit))
+#define RHS_TYPE      ((uint8_t) -16)  // Value on top of the stack
+#define RHS_PAYLOAD   ((uint8_t) -8)
+#define LHS_TYPE      ((uint8_t) -32)  // Value below the top of the stack
+#define LHS_PAYLOAD   ((uint8_t) -24)
+
+_Static_assert(16u == sizeof(value_t), "unexpected value_t layout");
+_Static_assert(0u == offsetof(value_t, type), "unexpected value_t layout");
+_Static_assert(8u == offsetof(value_t, payload), "unexpected value_t layout");
+_Static_assert(4u == sizeof(data_type_e), "unexpected value_t layout");
+_Static_assert(0u == offsetof(vm_instruction_t, handler), "unexpected vm_instruction_t layout");
+
+
+/* Append machine code bytes to the buffer */
+#define EMIT(compiler, ...)                                                   \
+    _emit_bytes((compiler), (const uint8_t[]) {__VA_ARGS__},                  \
+                sizeof((const uint8_t[]) {__VA_ARGS__}))
+
+
+/* Maximum number of jumps to the slow path of a single template */
+#define MAX_SLOW_JUMPS (8u)
+
+
+/* A single instruction executed while recording a trace */
+typedef struct
+{
+    vm_instruction_t *ins;   // Instruction that was executed
+    vm_instruction_t *next;  // Instruction that was executed after it
+    data_type_e lhs_type;    // Type of the value below the top of the stack, or NUM_DATATYPES
+    data_type_e rhs_type;    // Type of the value on top of the stack, or NUM_DATATYPES
+} trace_entry_t;
+
+
+/* A jump to the native code of an instruction, resolved once all
+ * instructions have been compiled */
+typedef struct
+{
+    size_t position;   // Position of the rel32 field in the code buffer
+    size_t target;     // Index of the instruction jumped to
+} fixup_t;
+
+
+typedef struct
+{
+    vm_program_t *program;
+    uint8_t *code;
+    size_t used;
+    size_t error;            // Position of the code that returns NULL
+    size_t exit;             // Position of the code that returns the value in rax
+    fixup_t *fixups;
+    size_t num_fixups;
+    size_t slow_jumps[MAX_SLOW_JUMPS];
+    size_t num_slow_jumps;
+} compiler_t;
+
+
+static void _emit_bytes(compiler_t *c, const uint8_t *bytes, size_t size)
+{
+    (void) memcpy(c->code + c->used, bytes, size);
+    c->used += size;
+}
+
+
+static void _emit_u32(compiler_t *c, uint32_t value)
+{
+    (void) memcpy(c->code + c->used, &value, sizeof(value));
+    c->used += sizeof(value);
+}
+
+
+static void _emit_u64(compiler_t *c, uint64_t value)
+{
+    (void) memcpy(c->code + c->used, &value, sizeof(value));
+    c->used += sizeof(value);
+}
+
+
+/* Write a rel32 field, relative to the end of the field */
+static void _patch_rel32(compiler_t *c, size_t position, size_t destination)
+{
+    uint32_t rel = (uint32_t) ((int64_t) destination - (int64_t) (position + 4u));
+    (void) memcpy(c->code + position, &rel, sizeof(rel));
+}
+
+
+/* Emit a jump (or conditional jump) to a position that is already known */
+static void _jump_back(compiler_t *c, const uint8_t *opcode, size_t opcode_size,
+                       size_t destination)
+{
+    _emit_bytes(c, opcode, opcode_size);
+    _emit_u32(c, 0u);
+    _patch_rel32(c, c->used - 4u, destination);
+}
+
+
+/* Emit a jump to a label that hasn't been emitted yet, and return the
+ * position of the rel32 field to patch */
+static size_t _jump_forward(compiler_t *c, const uint8_t *opcode, size_t opcode_size)
+{
+    _emit_bytes(c, opcode, opcode_size);
+    _emit_u32(c, 0u);
+    return c->used - 4u;
+}
+
+
+/* Emit a jump to the native code of an instruction */
+static void _jump_native(compiler_t *c, const uint8_t *opcode, size_t opcode_size,
+                         vm_instruction_t *target)
+{
+    fixup_t *fixup = c->fixups + c->num_fixups;
+
+    fixup->position = _jump_forward(c, opcode, opcode_size);
+    fixup->target = (size_t) (target - c->program->instructions);
+    c->num_fixups += 1u;
+}
+
+
+static const uint8_t JMP[] = {0xE9};
+static const uint8_t JE[] = {0x0F, 0x84};
+static const uint8_t JNE[] = {0x0F, 0x85};
+static const uint8_t JB[] = {0x0F, 0x82};
+
+
+/* Conditional jump to the slow path of the current template */
+static void _jump_slow(compiler_t *c, const uint8_t *opcode, size_t opcode_size)
+{
+    c->slow_jumps[c->num_slow_jumps++] = _jump_forward(c, opcode, opcode_size);
+}
+
+
+/* rax = frame->sp */
+static void _load_sp(compiler_t *c)
+{
+    EMIT(c, 0x48, 0x8B, 0x43, FRAME_SP);
+}
+
+
+/* frame->sp = rax */
+static void _store_sp(compiler_t *c)
+{
+    EMIT(c, 0x48, 0x89, 0x43, FRAME_SP);
+}
+
+
+/* Call the handler of an instruction, and return NULL if it fails */
+static void _call_handler(compiler_t *c, vm_instruction_t *ins)
+{
+    EMIT(c, 0x48, 0xBF);                       // mov rdi, ins
+    _emit_u64(c, (uint64_t) (uintptr_t) ins);
+    EMIT(c, 0x4C, 0x89, 0xE6);                 // mov rsi, r12
+    EMIT(c, 0xFF, 0x17);                       // call [rdi]
+    EMIT(c, 0x48, 0x85, 0xC0);                 // test rax, rax
+    _jump_back(c, JE, sizeof(JE), c->error);
+}
+
+
+/* Carry on with the expected instruction if the handler returned it,
+ * otherwise return the instruction it did return */
+static void _continue_at(compiler_t *c, vm_instruction_t *expected)
+{
+    EMIT(c, 0x48, 0xB9);                       // mov rcx, expected
+    _emit_u64(c, (uint64_t) (uintptr_t) expected);
+    EMIT(c, 0x48, 0x39, 0xC8);                 // cmp rax, rcx
+    _jump_back(c, JNE, sizeof(JNE), c->exit);
+}
+
+
+/* Return an instruction for the interpreter to carry on from */
+static void _exit_to(compiler_t *c, vm_instruction_t *ins)
+{
+    EMIT(c, 0x48, 0xB8);                       // mov rax, ins
+    _emit_u64(c, (uint64_t) (uintptr_t) ins);
+    _jump_back(c, JMP, sizeof(JMP), c->exit);
+}
+
+
+/* Bind the jumps to the slow path of the current template. Returns the
+ * position of a jump over the slow path, to be patched after it. */
+static size_t _bind_slow_jumps(compiler_t *c)
+{
+    size_t done = _jump_forward(c, JMP, sizeof(JMP));
+
+    for (size_t i = 0u; i < c->num_slow_jumps; i++)
+    {
+        _patch_rel32(c, c->slow_jumps[i], c->used);
+    }
+
+    c->num_slow_jumps = 0u;
+    return done;
+}
+
+
+/* Slow path of a template in a compiled program, which calls the normal
+ * handler and carries on with the next instruction */
+static void _slow_path(compiler_t *c, vm_instruction_t *ins)
+{
+    size_t done = _bind_slow_jumps(c);
+
+    _call_handler(c, ins);
+    _continue_at(c, ins + 1);
+    _patch_rel32(c, done, c->used);
+}
+
+
+/* Slow path of a template in a trace, which leaves the trace at the
+ * instruction, before any of it has been done */
+static void _side_exit(compiler_t *c, vm_instruction_t *ins)
+{
+    size_t done = _bind_slow_jumps(c);
+
+    _exit_to(c, ins);
+    _patch_rel32(c, done, c->used);
+}
+
+
+/* Push a value that is known when the code is compiled */
+static void _push_value(compiler_t *c, value_t value)
+{
+    uint64_t words[2];
+
+    (void) memcpy(words, &value, sizeof(words));
+
+    _load_sp(c);
+    EMIT(c, 0x48, 0x3B, 0x43, FRAME_LIMIT);    // cmp rax, [rbx + limit]
+    _jump_slow(c, JE, sizeof(JE));
+
+    EMIT(c, 0x48, 0xB9);                       // mov rcx, first half of value
+    _emit_u64(c, words[0]);
+    EMIT(c, 0x48, 0x89, 0x08);                 // mov [rax], rcx
+    EMIT(c, 0x48, 0xB9);                       // mov rcx, second half of value
+    _emit_u64(c, words[1]);
+    EMIT(c, 0x48, 0x89, 0x48, 0x08);           // mov [rax + 8], rcx
+    EMIT(c, 0x48, 0x83, 0xC0, 0x10);           // add rax, 16
+    _store_sp(c);
+}
+
+
+/* Int arithmetic on the two values on top of the stack, with rax = sp.
+ * Division by zero (and INT_MIN / -1) is left to the handler. */
+static void _int_op(compiler_t *c, binary_op_e op)
+{
+    switch (op)
+    {
+        case BINARY_ADD:
+            EMIT(c, 0x8B, 0x48, RHS_PAYLOAD);      // mov ecx, [rax + rhs]
+            EMIT(c, 0x01, 0x48, LHS_PAYLOAD);      // add [rax + lhs], ecx
+            break;
+
+        case BINARY_SUB:
+            EMIT(c, 0x8B, 0x48, RHS_PAYLOAD);      // mov ecx, [rax + rhs]
+            EMIT(c, 0x29, 0x48, LHS_PAYLOAD);      // sub [rax + lhs], ecx
+            break;
+
+        case BINARY_MULT:
+            EMIT(c, 0x8B, 0x48, RHS_PAYLOAD);      // mov ecx, [rax + rhs]
+            EMIT(c, 0x8B, 0x50, LHS_PAYLOAD);      // mov edx, [rax + lhs]
+            EMIT(c, 0x0F, 0xAF, 0xD1);             // imul edx, ecx
+            EMIT(c, 0x89, 0x50, LHS_PAYLOAD);      // mov [rax + lhs], edx
+            break;
+
+        case BINARY_DIV:
+            EMIT(c, 0x48, 0x89, 0xC6);             // mov rsi, rax
+            EMIT(c, 0x8B, 0x4E, RHS_PAYLOAD);      // mov ecx, [rsi + rhs]
+            EMIT(c, 0x85, 0xC9);                   // test ecx, ecx
+            _jump_slow(c, JE, sizeof(JE));
+            EMIT(c, 0x83, 0xF9, 0xFF);             // cmp ecx, -1
+            _jump_slow(c, JE, sizeof(JE));
+            EMIT(c, 0x8B, 0x46, LHS_PAYLOAD);      // mov eax, [rsi + lhs]
+            EMIT(c, 0x99);                         // cdq
+            EMIT(c, 0xF7, 0xF9);                   // idiv ecx
+            EMIT(c, 0x89, 0x46, LHS_PAYLOAD);      // mov [rsi + lhs], eax
+            EMIT(c, 0x48, 0x89, 0xF0);             // mov rax, rsi
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+/* Float arithmetic on the two values on top of the stack, with rax = sp */
+static void _float_op(compiler_t *c, binary_op_e op)
+{
+    static const uint8_t sse_opcodes[] = {
+        [BINARY_ADD] = 0x58, [BINARY_SUB] = 0x5C, [BINARY_MULT] = 0x59, [BINARY_DIV] = 0x5E
+    };
+
+    EMIT(c, 0xF2, 0x0F, 0x10, 0x40, LHS_PAYLOAD);          // movsd xmm0, [rax + lhs]
+    EMIT(c, 0xF2, 0x0F, sse_opcodes[op], 0x40, RHS_PAYLOAD); // op xmm0, [rax + rhs]
+    EMIT(c, 0xF2, 0x0F, 0x11, 0x40, LHS_PAYLOAD);          // movsd [rax + lhs], xmm0
+}
+
+
+/* Pop the RHS, leaving the result in place of the LHS */
+static void _pop_rhs(compiler_t *c)
+{
+    EMIT(c, 0x48, 0x83, 0xE8, 0x10);           // sub rax, 16
+    _store_sp(c);
+}
+
+
+/* Arithmetic whose operand types are known when the code is compiled */
+static void _typed_binary_op(compiler_t *c, binary_op_e op, data_type_e type)
+{
+    _load_sp(c);
+
+    if (DATATYPE_INT == type)
+    {
+        _int_op(c, op);
+    }
+    else
+    {
+        _float_op(c, op);
+    }
+
+    _pop_rhs(c);
+}
+
+
+/* Generic arithmetic; ints and floats are done inline, once the operand types
+ * have been checked, and everything else is left to the slow path */
+static void _binary_op(compiler_t *c, binary_op_e op)
+{
+    _load_sp(c);
+
+    EMIT(c, 0x83, 0x78, RHS_TYPE, DATATYPE_INT);     // cmp dword [rax + rhs], INT
+    size_t not_int = _jump_forward(c, JNE, sizeof(JNE));
+    EMIT(c, 0x83, 0x78, LHS_TYPE, DATATYPE_INT);     // cmp dword [rax + lhs], INT
+    _jump_slow(c, JNE, sizeof(JNE));
+    _int_op(c, op);
+    size_t int_done = _jump_forward(c, JMP, sizeof(JMP));
+
+    _patch_rel32(c, not_int, c->used);
+    EMIT(c, 0x83, 0x78, RHS_TYPE, DATATYPE_FLOAT);   // cmp dword [rax + rhs], FLOAT
+    _jump_slow(c, JNE, sizeof(JNE));
+    EMIT(c, 0x83, 0x78, LHS_TYPE, DATATYPE_FLOAT);   // cmp dword [rax + lhs], FLOAT
+    _jump_slow(c, JNE, sizeof(JNE));
+    _float_op(c, op);
+
+    _patch_rel32(c, int_done, c->used);
+    _pop_rhs(c);
+}
+
+
+/* Generic arithmetic in a trace, for the operand types that were recorded */
+static void _guarded_binary_op(compiler_t *c, binary_op_e op, data_type_e type)
+{
+    _load_sp(c);
+    EMIT(c, 0x83, 0x78, RHS_TYPE, type);             // cmp dword [rax + rhs], type
+    _jump_slow(c, JNE, sizeof(JNE));
+    EMIT(c, 0x83, 0x78, LHS_TYPE, type);             // cmp dword [rax + lhs], type
+    _jump_slow(c, JNE, sizeof(JNE));
+    _typed_binary_op(c, op, type);
+}
+
+
+/* Call the handler of a conditional jump, and jump to the native code of the
+ * target if the handler took the branch */
+static void _handler_jump(compiler_t *c, vm_instruction_t *ins)
+{
+    _call_handler(c, ins);
+    EMIT(c, 0x48, 0xB9);                             // mov rcx, target
+    _emit_u64(c, (uint64_t) (uintptr_t) ins->target);
+    EMIT(c, 0x48, 0x39, 0xC8);                       // cmp rax, rcx
+    _jump_native(c, JE, sizeof(JE), ins->target);
+}
+
+
+/* Conditional jump, taken if the condition matches the value given; bools
+ * are tested inline, and everything else is cast to a bool by the handler */
+static void _conditional_jump(compiler_t *c, vm_instruction_t *ins, uint8_t jump_when)
+{
+    _load_sp(c);
+    EMIT(c, 0x83, 0x78, RHS_TYPE, DATATYPE_BOOL);    // cmp dword [rax + rhs], BOOL
+    _jump_slow(c, JNE, sizeof(JNE));
+    _pop_rhs(c);
+    EMIT(c, 0x80, 0x78, 0x08, 0x00);                 // cmp byte [rax + 8], 0
+    _jump_native(c, jump_when ? JNE : JE, sizeof(JE), ins->target);
+
+    size_t done = _jump_forward(c, JMP, sizeof(JMP));
+
+    _patch_rel32(c, c->slow_jumps[0], c->used);
+    c->num_slow_jumps = 0u;
+
+    _handler_jump(c, ins);
+    _patch_rel32(c, done, c->used);
+}
+
+
+/* Condition codes for an int comparison, in the same order as compare_op_e.
+ * Flipping the lowest bit gives the opposite condition. */
+static const uint8_t _compare_conditions[] = {
+    [COMPARE_EQUAL] = 0x84,          // je
+    [COMPARE_NOT_EQUAL] = 0x85,      // jne
+    [COMPARE_LESS] = 0x8C,           // jl
+    [COMPARE_LESS_EQUAL] = 0x8E,     // jle
+    [COMPARE_GREATER] = 0x8F,        // jg
+    [COMPARE_GREATER_EQUAL] = 0x8D   // jge
+};
+
+
+/* Compare the two ints on top of the stack, with rax = sp, and pop them both.
+ * The flags are left set by the comparison. */
+static void _int_compare(compiler_t *c)
+{
+    EMIT(c, 0x8B, 0x48, LHS_PAYLOAD);                // mov ecx, [rax + lhs]
+    EMIT(c, 0x3B, 0x48, RHS_PAYLOAD);                // cmp ecx, [rax + rhs]
+    EMIT(c, 0x48, 0x8D, 0x40, 0xE0);                 // lea rax, [rax - 32]
+    _store_sp(c);
+}
+
+
+/* Compare-and-branch whose operands are known to be ints */
+static void _typed_compare_jump(compiler_t *c, vm_instruction_t *ins, compare_op_e op)
+{
+    const uint8_t jcc[] = {0x0F, _compare_conditions[op]};
+
+    _load_sp(c);
+    _int_compare(c);
+    _jump_native(c, jcc, sizeof(jcc), ins->target);
+}
+
+
+/* Emit the code for a single instruction */
+static vm_status_e _compile_instruction(compiler_t *c, vm_instruction_t *ins)
+{
+    vm_program_t *program = c->program;
+    opcode_e opcode = bytecode_utils_base_opcode((opcode_e) program->bytecode->bytecode[ins->offset]);
+
+    switch (opcode)
+    {
+        case OPCODE_NOP:
+        case OPCODE_DEFINE_CONST:
+            break;
+
+        case OPCODE_INT:
+            _push_value(c, INT_VALUE(ins->operand.immediate.int_value));
+            break;
+
+        case OPCODE_FLOAT:
+            _push_value(c, FLOAT_VALUE(ins->operand.immediate.float_value));
+            break;
+
+        case OPCODE_BOOL:
+            _push_value(c, BOOL_VALUE(ins->operand.immediate.bool_value));
+            break;
+
+        case OPCODE_STRING:
+            // Same immortal object that the stack engine creates on first execution
+            if (!VALUE_IS_OBJECT(*ins->value))
+            {
+                if (new_string_value(ins->operand.immediate.string.bytes,
+                                     ins->operand.immediate.string.size, ins->value) != 0)
+                {
+                    return VM_MEMORY_ERROR;
+                }
+
+                ins->value->payload.object->refcount = OBJECT_REFCOUNT_IMMORTAL;
+            }
+
+            _push_value(c, *ins->value);
+            break;
+
+        case OPCODE_LOAD_CONST:
+            _push_value(c, program->constants[ins->operand.const_index]);
+            break;
+
+        case OPCODE_ADD:
+            _binary_op(c, BINARY_ADD);
+            break;
+
+        case OPCODE_SUB:
+            _binary_op(c, BINARY_SUB);
+            break;
+
+        case OPCODE_MULT:
+            _binary_op(c, BINARY_MULT);
+            break;
+
+        case OPCODE_DIV:
+            _binary_op(c, BINARY_DIV);
+            break;
+
+        case OPCODE_ADD_INT_INT:
+            _typed_binary_op(c, BINARY_ADD, DATATYPE_INT);
+            break;
+
+        case OPCODE_SUB_INT_INT:
+            _typed_binary_op(c, BINARY_SUB, DATATYPE_INT);
+            break;
+
+        case OPCODE_MULT_INT_INT:
+            _typed_binary_op(c, BINARY_MULT, DATATYPE_INT);
+            break;
+
+        case OPCODE_DIV_INT_INT:
+            _typed_binary_op(c, BINARY_DIV, DATATYPE_INT);
+            break;
+
+        case OPCODE_ADD_FLOAT_FLOAT:
+            _typed_binary_op(c, BINARY_ADD, DATATYPE_FLOAT);
+            break;
+
+        case OPCODE_SUB_FLOAT_FLOAT:
+            _typed_binary_op(c, BINARY_SUB, DATATYPE_FLOAT);
+            break;
+
+        case OPCODE_MULT_FLOAT_FLOAT:
+            _typed_binary_op(c, BINARY_MULT, DATATYPE_FLOAT);
+            break;
+
+        case OPCODE_DIV_FLOAT_FLOAT:
+            _typed_binary_op(c, BINARY_DIV, DATATYPE_FLOAT);
+            break;
+
+        case OPCODE_JUMP:
+            _jump_native(c, JMP, sizeof(JMP), ins->target);
+            break;
+
+        case OPCODE_JUMP_IF_FALSE:
+            _conditional_jump(c, ins, 0u);
+            break;
+
+        case OPCODE_JUMP_IF_TRUE:
+            _conditional_jump(c, ins, 1u);
+            break;
+
+        case OPCODE_JUMP_IF_EQUAL:
+        case OPCODE_JUMP_IF_NOT_EQUAL:
+        case OPCODE_JUMP_IF_LESS:
+        case OPCODE_JUMP_IF_LESS_EQUAL:
+        case OPCODE_JUMP_IF_GREATER:
+        case OPCODE_JUMP_IF_GREATER_EQUAL:
+            _handler_jump(c, ins);
+            break;
+
+        case OPCODE_JUMP_IF_EQUAL_INT:
+        case OPCODE_JUMP_IF_NOT_EQUAL_INT:
+        case OPCODE_JUMP_IF_LESS_INT:
+        case OPCODE_JUMP_IF_LESS_EQUAL_INT:
+        case OPCODE_JUMP_IF_GREATER_INT:
+        case OPCODE_JUMP_IF_GREATER_EQUAL_INT:
+            _typed_compare_jump(c, ins, (compare_op_e) (opcode - OPCODE_JUMP_IF_EQUAL_INT));
+            break;
+
+        case OPCODE_END:
+            EMIT(c, 0x48, 0xB8);                       // mov rax, ins
+            _emit_u64(c, (uint64_t) (uintptr_t) ins);
+            _jump_back(c, JMP, sizeof(JMP), c->exit);
+            break;
+
+        default:
+            // Strings, casts and printing are done by the handler
+            _call_handler(c, ins);
+            _continue_at(c, ins + 1);
+            break;
+    }
+
+    if (0u < c->num_slow_jumps)
+    {
+        _slow_path(c, ins);
+    }
+
+    return VM_OK;
+}
+
+
+/* Emit the code that every entry into the native code goes through, and the
+ * code that returns to jit_execute */
+static void _compile_preamble(compiler_t *c)
+{
+    EMIT(c, 0x53);                       // push rbx
+    EMIT(c, 0x41, 0x54);                 // push r12
+    EMIT(c, 0x55);                       // push rbp (keeps the stack 16-byte aligned)
+    EMIT(c, 0x49, 0x89, 0xFC);           // mov r12, rdi (instance)
+    EMIT(c, 0x48, 0x89, 0xF3);           // mov rbx, rsi (frame)
+    EMIT(c, 0xFF, 0xE2);                 // jmp rdx (entry point)
+
+    c->error = c->used;
+    EMIT(c, 0x31, 0xC0);                 // xor eax, eax
+
+    c->exit = c->used;
+    EMIT(c, 0x5D);                       // pop rbp
+    EMIT(c, 0x41, 0x5C);                 // pop r12
+    EMIT(c, 0x5B);                       // pop rbx
+    EMIT(c, 0xC3);                       // ret
+}
+
+
+/* Map a writable buffer, big enough for the given number of instructions */
+static uint8_t *_map_code(size_t num_instructions, size_t *size)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    *size = JIT_MAX_PREAMBLE_BYTES + (num_instructions * JIT_MAX_INSTRUCTION_BYTES);
+    *size = ((*size + page_size - 1u) / page_size) * page_size;
+
+    void *code = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (MAP_FAILED == code) ? NULL : code;
+}
+
+
+/**
+ * @see jit_api.h
+ */
+vm_status_e jit_compile(vm_program_t *program)
+{
+    vm_jit_code_t *jit = &program->jit;
+    vm_status_e ret = VM_OK;
+    compiler_t c;
+    size_t size;
+
+    if (NULL != jit->code)
+    {
+        return VM_OK;
+    }
+
+    // Templates pop operands without checking, so the depth must have been proven
+    if (!program->unchecked)
+    {
+        return VM_UNSUPPORTED;
+    }
+
+    uint8_t *code = _map_code(program->num_instructions, &size);
+    if (NULL == code)
+    {
+        return VM_MEMORY_ERROR;
+    }
+
+    c.program = program;
+    c.code = code;
+    c.used = 0u;
+    c.num_fixups = 0u;
+    c.num_slow_jumps = 0u;
+
+    // At most two jumps to other instructions are emitted per instruction
+    c.fixups = memory_manager_alloc(program->num_instructions * 2u * sizeof(fixup_t));
+    jit->entries = memory_manager_alloc(program->num_instructions * sizeof(uint8_t *));
+
+    if ((NULL == c.fixups) || (NULL == jit->entries))
+    {
+        ret = VM_MEMORY_ERROR;
+    }
+    else
+    {
+        _compile_preamble(&c);
+
+        for (size_t i = 0u; (i < program->num_instructions) && (VM_OK == ret); i++)
+        {
+            jit->entries[i] = c.code + c.used;
+            ret = _compile_instruction(&c, program->instructions + i);
+        }
+    }
+
+    if (VM_OK == ret)
+    {
+        for (size_t i = 0u; i < c.num_fixups; i++)
+        {
+            _patch_rel32(&c, c.fixups[i].position,
+                         (size_t) (jit->entries[c.fixups[i].target] - c.code));
+        }
+
+        // Code is never writable and executable at the same time
+        if (0 != mprotect(code, size, PROT_READ | PROT_EXEC))
+        {
+            ret = VM_ERROR;
+        }
+    }
+
+    memory_manager_free(c.fixups);
+
+    if (VM_OK != ret)
+    {
+        (void) munmap(code, size);
+        memory_manager_free(jit->entries);
+        jit->entries = NULL;
+        return ret;
+    }
+
+    jit->code = code;
+    jit->size = size;
+    return VM_OK;
+}
+
+
+/**
+ * @see jit_api.h
+ */
+void jit_unload(vm_program_t *program)
+{
+    if (NULL != program->jit.code)
+    {
+        (void) munmap(program->jit.code, program->jit.size);
+    }
+
+    memory_manager_free(program->jit.entries);
+    program->jit.code = NULL;
+    program->jit.size = 0u;
+    program->jit.entries = NULL;
+
+    for (size_t i = 0u; i < program->num_loops; i++)
+    {
+        vm_loop_t *loop = program->loops + i;
+
+        if (NULL != loop->code)
+        {
+            (void) munmap(loop->code, loop->size);
+        }
+
+        loop->code = NULL;
+        loop->entry = NULL;
+    }
+}
+
+
+/**
+ * @see jit_api.h
+ */
+vm_status_e jit_execute(vm_instance_t *instance, vm_program_t *program)
+{
+    jit_function_t function = (jit_function_t) program->jit.code;
+    callstack_frame_t *frame = instance->callstack.current_frame;
+    vm_instruction_t *ip = program->instructions;
+
+    /* Native code only returns here at the end of the program, on a runtime
+     * error, or if a handler continued somewhere other than the next
+     * instruction (e.g. a superinstruction) */
+    while (1)
+    {
+        ip = function(instance, frame, program->jit.entries[ip - program->instructions]);
+        if (NULL == ip)
+        {
+            return VM_RUNTIME_ERROR;
+        }
+
+        if (OPCODE_END == ip->opcode)
+        {
+            return VM_OK;
+        }
+    }
+}
+
+/* Conditional jump in a trace, for a bool condition; leaves the trace if the
+ * branch doesn't go the same way as it did when the trace was recorded */
+static void _guarded_conditional_jump(compiler_t *c, trace_entry_t *entry, uint8_t jump_when)
+{
+    vm_instruction_t *ins = entry->ins;
+    int fell_through = (entry->next == (ins + 1));
+    int recorded_true = fell_through ? !jump_when : jump_when;
+
+    _load_sp(c);
+    EMIT(c, 0x83, 0x78, RHS_TYPE, DATATYPE_BOOL);    // cmp dword [rax + rhs], BOOL
+    _jump_slow(c, JNE, sizeof(JNE));
+    _pop_rhs(c);
+    EMIT(c, 0x80, 0x78, 0x08, 0x00);                 // cmp byte [rax + 8], 0
+
+    // The condition has been popped, so the exit is to the other branch
+    size_t same_way = recorded_true ? _jump_forward(c, JNE, sizeof(JNE)) :
+                                      _jump_forward(c, JE, sizeof(JE));
+    _exit_to(c, fell_through ? ins->target : (ins + 1));
+    _patch_rel32(c, same_way, c->used);
+}
+
+
+/* Int compare-and-branch in a trace; leaves the trace if the branch doesn't
+ * go the same way as it did when the trace was recorded. The operand types
+ * are checked first, unless they are already known. */
+static void _guarded_compare_jump(compiler_t *c, trace_entry_t *entry, compare_op_e op,
+                                  int check_types)
+{
+    vm_instruction_t *ins = entry->ins;
+    int fell_through = (entry->next == (ins + 1));
+    uint8_t condition = _compare_conditions[op];
+
+    _load_sp(c);
+
+    if (check_types)
+    {
+        EMIT(c, 0x83, 0x78, RHS_TYPE, DATATYPE_INT);     // cmp dword [rax + rhs], INT
+        _jump_slow(c, JNE, sizeof(JNE));
+        EMIT(c, 0x83, 0x78, LHS_TYPE, DATATYPE_INT);     // cmp dword [rax + lhs], INT
+        _jump_slow(c, JNE, sizeof(JNE));
+    }
+
+    _int_compare(c);
+
+    // The operands have been popped, so the exit is to the other branch
+    const uint8_t jcc[] = {0x0F, fell_through ? (uint8_t) (condition ^ 1u) : condition};
+    size_t same_way = _jump_forward(c, jcc, sizeof(jcc));
+    _exit_to(c, fell_through ? ins->target : (ins + 1));
+    _patch_rel32(c, same_way, c->used);
+}
+
+
+/* Emit the code for a single recorded instruction */
+static void _compile_trace_entry(compiler_t *c, trace_entry_t *entry)
+{
+    vm_instruction_t *ins = entry->ins;
+    binary_op_e op = BINARY_ADD;
+
+    // Quickened instructions are compiled as they are now
+    switch ((int) ins->opcode)
+    {
+        case OPCODE_NOP:
+        case OPCODE_DEFINE_CONST:
+        case OPCODE_JUMP:
+            // The trace continues with the instruction that was executed next
+            break;
+
+        case OPCODE_INT:
+            _push_value(c, INT_VALUE(ins->operand.immediate.int_value));
+            break;
+
+        case OPCODE_FLOAT:
+            _push_value(c, FLOAT_VALUE(ins->operand.immediate.float_value));
+            break;
+
+        case OPCODE_BOOL:
+            _push_value(c, BOOL_VALUE(ins->operand.immediate.bool_value));
+            break;
+
+        case VM_OPCODE_LOAD_VALUE:
+            _push_value(c, *ins->value);
+            break;
+
+        case OPCODE_ADD_INT_INT:
+            _typed_binary_op(c, BINARY_ADD, DATATYPE_INT);
+            break;
+
+        case OPCODE_SUB_INT_INT:
+            _typed_binary_op(c, BINARY_SUB, DATATYPE_INT);
+            break;
+
+        case OPCODE_MULT_INT_INT:
+            _typed_binary_op(c, BINARY_MULT, DATATYPE_INT);
+            break;
+
+        case OPCODE_DIV_INT_INT:
+            _typed_binary_op(c, BINARY_DIV, DATATYPE_INT);
+            break;
+
+        case OPCODE_ADD_FLOAT_FLOAT:
+            _typed_binary_op(c, BINARY_ADD, DATATYPE_FLOAT);
+            break;
+
+        case OPCODE_SUB_FLOAT_FLOAT:
+            _typed_binary_op(c, BINARY_SUB, DATATYPE_FLOAT);
+            break;
+
+        case OPCODE_MULT_FLOAT_FLOAT:
+            _typed_binary_op(c, BINARY_MULT, DATATYPE_FLOAT);
+            break;
+
+        case OPCODE_DIV_FLOAT_FLOAT:
+            _typed_binary_op(c, BINARY_DIV, DATATYPE_FLOAT);
+            break;
+
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MULT:
+        case OPCODE_DIV:
+            op = (OPCODE_ADD == ins->opcode) ? BINARY_ADD :
+                 (OPCODE_SUB == ins->opcode) ? BINARY_SUB :
+                 (OPCODE_MULT == ins->opcode) ? BINARY_MULT : BINARY_DIV;
+
+            // Specialised for the operand types that were recorded
+            if ((entry->lhs_type == entry->rhs_type) &&
+                ((DATATYPE_INT == entry->rhs_type) || (DATATYPE_FLOAT == entry->rhs_type)))
+            {
+                _guarded_binary_op(c, op, entry->rhs_type);
+            }
+            else
+            {
+                _call_handler(c, ins);
+                _continue_at(c, entry->next);
+            }
+            break;
+
+        case OPCODE_JUMP_IF_FALSE:
+        case OPCODE_JUMP_IF_TRUE:
+            if (DATATYPE_BOOL == entry->rhs_type)
+            {
+                _guarded_conditional_jump(c, entry, (OPCODE_JUMP_IF_TRUE == ins->opcode) ? 1u : 0u);
+            }
+            else
+            {
+                _call_handler(c, ins);
+                _continue_at(c, entry->next);
+            }
+            break;
+
+        case OPCODE_JUMP_IF_EQUAL:
+        case OPCODE_JUMP_IF_NOT_EQUAL:
+        case OPCODE_JUMP_IF_LESS:
+        case OPCODE_JUMP_IF_LESS_EQUAL:
+        case OPCODE_JUMP_IF_GREATER:
+        case OPCODE_JUMP_IF_GREATER_EQUAL:
+            if ((DATATYPE_INT == entry->lhs_type) && (DATATYPE_INT == entry->rhs_type))
+            {
+                _guarded_compare_jump(c, entry, (compare_op_e) (ins->opcode - OPCODE_JUMP_IF_EQUAL), 1);
+            }
+            else
+            {
+                _call_handler(c, ins);
+                _continue_at(c, entry->next);
+            }
+            break;
+
+        case OPCODE_JUMP_IF_EQUAL_INT:
+        case OPCODE_JUMP_IF_NOT_EQUAL_INT:
+        case OPCODE_JUMP_IF_LESS_INT:
+        case OPCODE_JUMP_IF_LESS_EQUAL_INT:
+        case OPCODE_JUMP_IF_GREATER_INT:
+        case OPCODE_JUMP_IF_GREATER_EQUAL_INT:
+            _guarded_compare_jump(c, entry, (compare_op_e) (ins->opcode - OPCODE_JUMP_IF_EQUAL_INT), 0);
+            break;
+
+        default:
+            // Everything else is done by the handler, including superinstructions
+            _call_handler(c, ins);
+            _continue_at(c, entry->next);
+            break;
+    }
+
+    if (0u < c->num_slow_jumps)
+    {
+        _side_exit(c, ins);
+    }
+}
+
+
+/* Compile a recorded trace, which starts and ends at the loop header */
+static vm_status_e _compile_trace(vm_loop_t *loop, trace_entry_t *entries, size_t num_entries,
+                                  size_t start_depth)
+{
+    compiler_t c;
+    size_t size;
+
+    uint8_t *code = _map_code(num_entries + 1u, &size);
+    if (NULL == code)
+    {
+        return VM_MEMORY_ERROR;
+    }
+
+    c.program = NULL;
+    c.code = code;
+    c.used = 0u;
+    c.fixups = NULL;
+    c.num_fixups = 0u;
+    c.num_slow_jumps = 0u;
+
+    _compile_preamble(&c);
+
+    /* Every iteration does the same stack operations, so if there are at
+     * least as many values on the stack as there were when the trace was
+     * recorded, none of the templates can read below the bottom of it */
+    size_t start = c.used;
+    EMIT(&c, 0x48, 0x8B, 0x43, FRAME_SP);         // mov rax, [rbx + sp]
+    EMIT(&c, 0x48, 0x2B, 0x43, FRAME_BASE);       // sub rax, [rbx + base]
+    EMIT(&c, 0x48, 0x3D);                         // cmp rax, depth
+    _emit_u32(&c, (uint32_t) (start_depth * sizeof(value_t)));
+    _jump_slow(&c, JB, sizeof(JB));
+    _side_exit(&c, entries[0].ins);
+
+    for (size_t i = 0u; i < num_entries; i++)
+    {
+        _compile_trace_entry(&c, entries + i);
+    }
+
+    _jump_back(&c, JMP, sizeof(JMP), start);
+
+    // Code is never writable and executable at the same time
+    if (0 != mprotect(code, size, PROT_READ | PROT_EXEC))
+    {
+        (void) munmap(code, size);
+        return VM_ERROR;
+    }
+
+    loop->code = code;
+    loop->size = size;
+    loop->entry = code + start;
+    return VM_OK;
+}
+
+
+/* Run one iteration of a hot loop in the interpreter, recording each
+ * instruction, and compile the recording if the loop was closed */
+static vm_instruction_t *_record_trace(vm_instruction_t *edge, vm_instance_t *instance)
+{
+    callstack_frame_t *frame = instance->callstack.current_frame;
+    vm_instruction_t *header = edge->target;
+    vm_instruction_t *ip = header;
+    size_t start_depth = (size_t) (frame->sp - frame->base);
+    size_t num_entries = 0u;
+    int closed = 0;
+
+    trace_entry_t *entries = memory_manager_alloc(VM_MAX_TRACE_LENGTH * sizeof(trace_entry_t));
+    if (NULL == entries)
+    {
+        edge->loop->abandoned = 1u;
+        return header;
+    }
+
+    // Loops inside the loop being recorded are recorded along with it
+    instance->trace_loops = 0u;
+
+    // Traces stay within one frame, so loops that call functions are left to the interpreter
+    while ((!closed) && (num_entries < VM_MAX_TRACE_LENGTH) && (OPCODE_END != ip->opcode) &&
+           !bytecode_utils_is_call(ip->opcode) && (OPCODE_RETURN != ip->opcode))
+    {
+        trace_entry_t *entry = entries + num_entries;
+        size_t depth = (size_t) (frame->sp - frame->base);
+
+        entry->ins = ip;
+        entry->rhs_type = (1u <= depth) ? frame->sp[-1].type : NUM_DATATYPES;
+        entry->lhs_type = (2u <= depth) ? frame->sp[-2].type : NUM_DATATYPES;
+
+        ip = ip->handler(ip, instance);
+        if (NULL == ip)
+        {
+            break;
+        }
+
+        entry->next = ip;
+        num_entries += 1u;
+        closed = (header == ip);
+    }
+
+    instance->trace_loops = 1u;
+
+    // Loops that shrink the stack would eventually underflow it
+    if ((!closed) || (start_depth > (size_t) (frame->sp - frame->base)) ||
+        (VM_OK != _compile_trace(edge->loop, entries, num_entries, start_depth)))
+    {
+        edge->loop->abandoned = 1u;
+    }
+
+    memory_manager_free(entries);
+    return ip;
+}
+
+
+/**
+ * @see jit_api.h
+ */
+vm_instruction_t *jit_loop_edge(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    vm_loop_t *loop = ins->loop;
+
+    if (NULL != loop->entry)
+    {
+        jit_function_t function = (jit_function_t) loop->code;
+
+        // Backward jumps taken by handlers called from the trace stay in the interpreter
+        instance->trace_loops = 0u;
+        vm_instruction_t *ip = function(instance, instance->callstack.current_frame, loop->entry);
+        instance->trace_loops = 1u;
+
+        return ip;
+    }
+
+    if ((0u != loop->abandoned) || (VM_HOT_LOOP_THRESHOLD > ++loop->count))
+    {
+        return ins->target;
+    }
+
+    return _record_trace(ins, instance);
+}
+
+#else
+
+/**
+ * @see jit_api.h
+ */
+vm_status_e jit_compile(vm_program_t *program)
+{
+    return VM_UNSUPPORTED;
+}
+
+
+/**
+ * @see jit_api.h
+ */
+void jit_unload(vm_program_t *program)
+{
+    program->jit.code = NULL;
+    program->jit.entries = NULL;
+}
+
+
+/**
+ * @see jit_api.h
+ */
+vm_instruction_t *jit_loop_edge(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    // Nothing can be compiled, so loops are always interpreted
+    ins->loop->abandoned = 1u;
+    return ins->target;
+}
+
+
+/**
+ * @see jit_api.h
+ */
+vm_status_e jit_execute(vm_instance_t *instance, vm_program_t *program)
+{
+    return VM_UNSUPPORTED;
+}
+
+#endif /* JIT_SUPPORTED */
@@ -0,0 +1,104 @@
+/**
+ * Template JIT compiler; translates a loaded program into native x86-64 code.
+ * Each instruction is replaced with a fixed sequence of machine code that
+ * works on the data stack in memory, with the arithmetic for ints and floats
+ * done inline, and everything else done by calling the normal opcode handler.
+ *
+ * The same templates are also used to compile traces of hot loops, for
+ * VM_ENGINE_TRACE_JIT (see jit_loop_edge).
+ */
+
+#ifndef JIT_API_H_
+#define JIT_API_H_
+
+
+#include "vm_api.h"
+#include "runtime_common.h"
+
+
+/* The JIT is only available for x86-64 Linux. Elsewhere, jit_compile always
+ * returns VM_UNSUPPORTED and VM_ENGINE_JIT runs the interpreter instead. */
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED
+#endif
+
+
+/* Number of times a program is run by the interpreter with VM_ENGINE_JIT,
+ * before it is compiled. 0 compiles a program the first time it is run. */
+#ifndef VM_JIT_THRESHOLD
+#define VM_JIT_THRESHOLD (0u)
+#endif
+
+
+/* Number of times a backward jump is taken with VM_ENGINE_TRACE_JIT before the
+ * loop it closes is recorded */
+#ifndef VM_HOT_LOOP_THRESHOLD
+#define VM_HOT_LOOP_THRESHOLD (16u)
+#endif
+
+
+/* Maximum number of instructions recorded in a single trace */
+#ifndef VM_MAX_TRACE_LENGTH
+#define VM_MAX_TRACE_LENGTH (256u)
+#endif
+
+
+/**
+ * Compile a program loaded by vm_load into native code, and store it in
+ * program->jit. Does nothing if the program has already been compiled.
+ *
+ * @param    program    Pointer to loaded program to compile
+ *
+ * @return   VM_OK if successful, VM_UNSUPPORTED if the JIT is not available
+ *           for the host platform, or if vm_load could not prove the data
+ *           stack depth of the program
+ */
+vm_status_e jit_compile(vm_program_t *program);
+
+
+/**
+ * Free the native code created by jit_compile and jit_loop_edge
+ *
+ * @param    program    Pointer to loaded program
+ */
+void jit_unload(vm_program_t *program);
+
+
+/**
+ * Run the native code for a program compiled by jit_compile. The data stack
+ * holds the same values afterwards as it would with the stack engine.
+ *
+ * @param    instance    Pointer to VM instance to execute the program on
+ * @param    program     Pointer to compiled program to execute
+ *
+ * @return   VM_OK if execution completed successfully
+ */
+vm_status_e jit_execute(vm_instance_t *instance, vm_program_t *program);
+
+
+/**
+ * Called by the jump handlers when a backward jump is taken with
+ * VM_ENGINE_TRACE_JIT. Each backward jump counts the number of times it was
+ * taken, and once that reaches VM_HOT_LOOP_THRESHOLD, the next iteration of the
+ * loop is recorded; the instructions executed from the target of the jump
+ * until it is reached again, and the types of the values they found on top of
+ * the stack. The recording is compiled into a linear trace, specialised for
+ * the recorded types and branch directions, that jumps back to its own start
+ * instead of to the loop header.
+ *
+ * The trace is run every time the backward jump is taken after that. Each
+ * specialisation is checked by a guard, which leaves the trace (a side exit)
+ * with the stack in the same state the interpreter would have at the
+ * instruction being guarded, and returns that instruction, so the interpreter
+ * carries on from there. Loops that leave the recording early, or can't be
+ * compiled, are interpreted from then on.
+ *
+ * @param    ins         Backward jump instruction that was taken
+ * @param    instance    Pointer to VM instance executing the program
+ *
+ * @return   Next instruction to execute, or NULL if a runtime error occurred
+ */
+vm_instruction_t *jit_loop_edge(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+#endif /* JIT_API_H_ */
@@ -13,14 +13,14 @@
         return NULL;                                                          \
     }                                                                         \
                                                                               \
-    obj->refcount = 0u;                                                       \
+    obj->refcount = 1u;                                                       \
 }                                                                             \
 
 
 /**
  * @see object_helpers_api.h
  */
-object_t *new_int_object(vm_int_t value)
+object_t *new_string_object(char *string, size_t len)
 {
     object_t *new_obj;
     NEW_OBJECT(sizeof(data_object_t), new_obj);
@@ -28,25 +28,19 @@ object_t *new_int_object(vm_int_t value)
     data_object_t *data_obj = (data_object_t *) new_obj;
 
     data_obj->object.obj_type = OBJTYPE_DATA;
-    data_obj->data_type = DATATYPE_INT;
-    data_obj->payload.int_value = value;
-    return new_obj;
-}
-
+    data_obj->data_type = DATATYPE_STRING;
 
-/**
- * @see object_helpers_api.h
- */
-object_t *new_float_object(vm_float_t value)
-{
-    object_t *new_obj;
-    NEW_OBJECT(sizeof(data_object_t), new_obj);
+    byte_string_t *new_byte_string;
+    string_cache_status_e cache_err = string_cache_add(string, len,
+                                                       &new_byte_string);
+    if (STRING_CACHE_ALREADY_CACHED < cache_err)
+    {
+        return NULL;
+    }
 
-    data_object_t *data_obj = (data_object_t *) new_obj;
+    memcpy(&data_obj->payload.string_value, new_byte_string,
+           sizeof(byte_string_t));
 
-    data_obj->object.obj_type = OBJTYPE_DATA;
-    data_obj->data_type = DATATYPE_FLOAT;
-    data_obj->payload.float_value = value;
     return new_obj;
 }
 
@@ -54,43 +48,26 @@ object_t *new_float_object(vm_float_t value)
 /**
  * @see object_helpers_api.h
  */
-object_t *new_bool_object(vm_bool_t value)
+int new_string_value(char *string, size_t len, value_t *value)
 {
-    object_t *new_obj;
-    NEW_OBJECT(sizeof(data_object_t), new_obj);
-
-    data_object_t *data_obj = (data_object_t *) new_obj;
+    object_t *new_obj = new_string_object(string, len);
+    if (NULL == new_obj)
+    {
+        return 1;
+    }
 
-    data_obj->object.obj_type = OBJTYPE_DATA;
-    data_obj->data_type = DATATYPE_BOOL;
-    data_obj->payload.bool_value = value;
-    return new_obj;
+    *value = OBJECT_VALUE(DATATYPE_STRING, new_obj);
+    return 0;
 }
 
 
 /**
  * @see object_helpers_api.h
  */
-object_t *new_string_object(char *string, size_t len)
+void store_value(value_t *location, value_t value)
 {
-    object_t *new_obj;
-    NEW_OBJECT(sizeof(data_object_t), new_obj);
-
-    data_object_t *data_obj = (data_object_t *) new_obj;
-
-    data_obj->object.obj_type = OBJTYPE_DATA;
-    data_obj->data_type = DATATYPE_STRING;
+    value_t old = *location;
 
-    byte_string_t *new_byte_string;
-    string_cache_status_e cache_err = string_cache_add(string, len,
-                                                       &new_byte_string);
-    if (STRING_CACHE_ALREADY_CACHED < cache_err)
-    {
-        return NULL;
-    }
-
-    memcpy(&data_obj->payload.string_value, new_byte_string,
-           sizeof(byte_string_t));
-
-    return new_obj;
+    *location = value;
+    RELEASE_VALUE(old);
 }
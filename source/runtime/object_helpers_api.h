@@ -2,51 +2,100 @@
 #define OBJECT_HELPERS_API_H
 
 #include "data_types.h"
+#include "memory_manager_api.h"
 
 
-/**
- * Allocate a new int object, intialize it with the given value and return
- * a pointer to the new object
- *
- * @param  value    Initial value
- *
- * @return   Pointer to allocated object, NULL if allocation was unsuccessful
- */
-object_t *new_int_object(vm_int_t value);
+/* Create an int value */
+#define INT_VALUE(value)                                                      \
+    ((value_t) {.type=DATATYPE_INT, .payload={.int_value=(value)}})
+
+/* Create a float value */
+#define FLOAT_VALUE(value)                                                    \
+    ((value_t) {.type=DATATYPE_FLOAT, .payload={.float_value=(value)}})
+
+/* Create a bool value */
+#define BOOL_VALUE(value)                                                     \
+    ((value_t) {.type=DATATYPE_BOOL, .payload={.bool_value=(value)}})
+
+/* Create a value that refers to an object on the heap */
+#define OBJECT_VALUE(data_type, obj)                                          \
+    ((value_t) {.type=(data_type), .payload={.object=(obj)}})
+
+/* Evaluates to 1 if the value refers to an object on the heap */
+#define VALUE_IS_OBJECT(value) (DATATYPE_STRING == (value).type)
+
+/* Pointer to the byte_string_t held by a DATATYPE_STRING value */
+#define VALUE_STRING(value)                                                   \
+    (&((data_object_t *) (value).payload.object)->payload.string_value)
+
+
+/* Take a reference to the object referred to by a value, if it refers to one.
+ * Every copy of a value that is kept, whether on the data stack or in a
+ * variable, holds its own reference; e.g. a value pushed from a variable. */
+#define RETAIN_VALUE(value)                                                   \
+    do {                                                                      \
+        if (VALUE_IS_OBJECT(value) &&                                         \
+            (OBJECT_REFCOUNT_IMMORTAL != (value).payload.object->refcount))   \
+        {                                                                     \
+            (value).payload.object->refcount += 1u;                           \
+        }                                                                     \
+    }                                                                         \
+    while (0)
+
+
+/* Release the reference held by a copy of a value that is no longer needed,
+ * e.g. an operand popped off the data stack, and free the object if that was
+ * the last reference to it */
+#define RELEASE_VALUE(value)                                                  \
+    do {                                                                      \
+        if (VALUE_IS_OBJECT(value) &&                                         \
+            (OBJECT_REFCOUNT_IMMORTAL != (value).payload.object->refcount) && \
+            (0u == --(value).payload.object->refcount))                       \
+        {                                                                     \
+            memory_manager_free((value).payload.object);                      \
+        }                                                                     \
+    }                                                                         \
+    while (0)
 
 
 /**
- * Allocate a new float object, intialize it with the given value and return
- * a pointer to the new object
+ * Allocate a new string object, intialize it with the given value and return
+ * a pointer to the new object. The object starts with a single reference,
+ * which belongs to the caller.
  *
- * @param  value    Initial value
+ * @param  string    Pointer to initial bytes for string value
+ * @param  len       Number of bytes to copy from string data pointer
  *
  * @return   Pointer to allocated object, NULL if allocation was unsuccessful
  */
-object_t *new_float_object(vm_float_t value);
+object_t *new_string_object(char *string, size_t len);
 
 
 /**
- * Allocate a new bool object, intialize it with the given value and return
- * a pointer to the new object
+ * Allocate a new string object, intialize it with the given value and store
+ * a value referring to the new object. The stored value holds the only
+ * reference to the object.
  *
- * @param  value    Initial value
+ * @param  string    Pointer to initial bytes for string value
+ * @param  len       Number of bytes to copy from string data pointer
+ * @param  value     Pointer to location to store new string value
  *
- * @return   Pointer to allocated object, NULL if allocation was unsuccessful
+ * @return   0 if the string object was created successfully, 1 otherwise
  */
-object_t *new_bool_object(vm_bool_t value);
+int new_string_value(char *string, size_t len, value_t *value);
 
 
 /**
- * Allocate a new string object, intialize it with the given value and return
- * a pointer to the new object
- *
- * @param  string    Pointer to initial bytes for string value
- * @param  len       Number of bytes to copy from string data pointer
+ * Store a value in a location that holds a reference to it, such as a local
+ * variable slot. The reference held by the value, e.g. by a value popped off
+ * the data stack, is moved to the location, and the reference held by the old
+ * value is released. Copies of the old value that are still on the data stack
+ * hold references of their own, so they stay valid.
  *
- * @return   Pointer to allocated object, NULL if allocation was unsuccessful
+ * @param  location  Pointer to location holding a referenced value
+ * @param  value     Value to store, whose reference is moved to the location
  */
-object_t *new_string_object(char *string, size_t len);
+void store_value(value_t *location, value_t value);
 
 
 #endif
@@ -4,48 +4,185 @@
 #include "bytecode_api.h"
 #include "ulist_api.h"
 #include "opcode_handlers.h"
+#include "jit_api.h"
 #include "common.h"
 #include "string_cache_api.h"
 #include "memory_manager_api.h"
 #include "object_helpers_api.h"
-
-
-#define FREE_IF_NO_REFS(objptr)                                               \
-    if (0u == objptr->refcount)                                               \
+#include "data_stack_api.h"
+#include "globals_api.h"
+
+
+/* This file is compiled twice; once for the normal handlers, and once by
+ * opcode_handlers_unchecked.c for the handlers used by programs whose data
+ * stack depth was proven by vm_load, which don't check for underflow or for
+ * space before pushing. HANDLER gives the name of a handler in the set being
+ * compiled. */
+#ifdef VM_UNCHECKED_HANDLERS
+#define HANDLER(op_handler) UNCHECKED_HANDLER(op_handler)
+#define STACK_PUSH(frame, item) DATA_STACK_PUSH_UNCHECKED(frame, item)
+#define STACK_POP(frame, item) DATA_STACK_POP_UNCHECKED(frame, item)
+#else
+#define HANDLER(op_handler) op_handler
+#define STACK_PUSH(frame, item) DATA_STACK_PUSH_RT(frame, item)
+#define STACK_POP(frame, item) DATA_STACK_POP_RT(frame, item)
+#endif /* VM_UNCHECKED_HANDLERS */
+
+
+/* Create a new string value, or generate a runtime error on failure */
+#define NEW_STRING_VALUE_RT(string, len, value)                               \
+    if (new_string_value((string), (len), (value)) != 0)                      \
     {                                                                         \
-        memory_manager_free(objptr);                                          \
+        RUNTIME_ERR(RUNTIME_ERROR_MEMORY, "failed to create string object");  \
+        return NULL;                                                          \
     }                                                                         \
 
 
 /* Boilerplate for performing a binary operation by popping two operands
- * off the stack and pushing the result to the stack */
-static opcode_t *_binary_op(opcode_t *opcode, callstack_frame_t *frame,
-                            binary_op_e op_type)
+ * off the stack and pushing the result to the stack. The type operation
+ * function is taken from the instruction's inline cache if the operand types
+ * match the last execution, and looked up again otherwise. */
+static vm_instruction_t *_binary_op(vm_instruction_t *ins, callstack_frame_t *frame,
+                                    binary_op_e op_type)
 {
-    object_t *lhs, *rhs, *result;
+    vm_inline_cache_t *cache = ins->cache;
+    value_t lhs, rhs, result;
+
+    STACK_POP(frame, rhs);
+    STACK_POP(frame, lhs);
+
+    if ((cache->lhs_type == lhs.type) && (cache->rhs_type == rhs.type))
+    {
+        cache->hits += 1u;
+    }
+    else
+    {
+        // Operand types changed since the last execution, look up the function again
+        cache->misses += 1u;
+        cache->func.binary = type_binary_op_lookup(lhs.type, rhs.type);
+        if (NULL == cache->func.binary)
+        {
+            cache->lhs_type = NUM_DATATYPES;
+            RUNTIME_ERR(RUNTIME_ERROR_ARITHMETIC, "Can't do that arithmetic\n");
+            RELEASE_VALUE(lhs);
+            RELEASE_VALUE(rhs);
+            return NULL;
+        }
 
-    CHECK_ULIST_ERR_RT(ulist_pop_item(&frame->data, frame->data.num_items - 1, (void **) &rhs));
-    CHECK_ULIST_ERR_RT(ulist_pop_item(&frame->data, frame->data.num_items - 1, (void **) &lhs));
+        cache->lhs_type = lhs.type;
+        cache->rhs_type = rhs.type;
+    }
 
-    type_status_e err = type_binary_op(lhs, rhs, &result, op_type);
-    if (TYPE_RUNTIME_ERROR == err)
+    if (cache->func.binary(&lhs, &rhs, &result, op_type) != TYPE_OK)
     {
+        RELEASE_VALUE(lhs);
+        RELEASE_VALUE(rhs);
         return NULL;
     }
-    else if (TYPE_OK != err)
+
+    RELEASE_VALUE(lhs);
+    RELEASE_VALUE(rhs);
+
+    STACK_PUSH(frame, result);
+    return ins + 1;
+}
+
+
+/* Push the string for an OPCODE_STRING instruction, creating it the first time.
+ * The object is immortal and kept by the loaded program. */
+static vm_instruction_t *_string(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    callstack_frame_t *frame = instance->callstack.current_frame;
+
+    if (!VALUE_IS_OBJECT(*ins->value))
+    {
+        // Set up new byte string object, in the slot allocated by vm_load
+        NEW_STRING_VALUE_RT(ins->operand.immediate.string.bytes,
+                            ins->operand.immediate.string.size, ins->value);
+
+        ins->value->payload.object->refcount = OBJECT_REFCOUNT_IMMORTAL;
+    }
+
+    // Push byte string value onto stack
+    STACK_PUSH(frame, *ins->value);
+
+    return ins + 1;
+}
+
+
+/* Generic cast, using the instruction's inline cache to find the cast function */
+static vm_instruction_t *_cast(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    callstack_frame_t *frame = instance->callstack.current_frame;
+    vm_inline_cache_t *cache = ins->cache;
+    value_t input, output;
+
+    STACK_POP(frame, input);
+
+    if (ins->operand.cast.data_type == input.type)
     {
-        RUNTIME_ERR(RUNTIME_ERROR_ARITHMETIC, "Can't do that arithmetic\n");
+        // Value already has the requested type, put it back as-is
+        STACK_PUSH(frame, input);
+        return ins + 1;
+    }
+
+    if (cache->lhs_type == input.type)
+    {
+        cache->hits += 1u;
+    }
+    else
+    {
+        // Input type changed since the last execution, look up the function again
+        cache->misses += 1u;
+        cache->func.cast = type_cast_lookup(input.type, ins->operand.cast.data_type);
+        if (NULL == cache->func.cast)
+        {
+            cache->lhs_type = NUM_DATATYPES;
+            RUNTIME_ERR(RUNTIME_ERROR_CAST, "Invalid cast");
+            RELEASE_VALUE(input);
+            return NULL;
+        }
+
+        cache->lhs_type = input.type;
+    }
+
+    if (cache->func.cast(&input, &output, ins->operand.cast.extra_data) != TYPE_OK)
+    {
+        RELEASE_VALUE(input);
         return NULL;
     }
 
-    FREE_IF_NO_REFS(lhs);
-    FREE_IF_NO_REFS(rhs);
+    // Push result of cast onto stack
+    STACK_PUSH(frame, output);
+
+    RELEASE_VALUE(input);
 
-    CHECK_ULIST_ERR_RT(ulist_append_item(&frame->data, &result));
-    return opcode + 1;
+    return ins + 1;
 }
 
 
+/* Rewrite an instruction in the loaded program, so that it runs a different
+ * handler the next time it is executed (see vm_opcode_e) */
+#define QUICKEN(ins, new_opcode, new_handler)                                 \
+    do {                                                                      \
+        (ins)->opcode = (opcode_e) (new_opcode);                              \
+        (ins)->handler = (new_handler);                                       \
+    }                                                                         \
+    while (0)
+
+
+/* Boilerplate for arithmetic on two operands whose types were proven by type
+ * inference. Both operands are guaranteed to be on the stack with the right
+ * type, so the result is written over the LHS without any checks. */
+#define TYPED_BINARY_OP(frame, field, op)                                     \
+    do {                                                                      \
+        value_t *__rhs = --(frame)->sp;                                       \
+        value_t *__lhs = __rhs - 1;                                           \
+        __lhs->payload.field = __lhs->payload.field op __rhs->payload.field;  \
+    }                                                                         \
+    while (0)
+
+
 /**
  * Does nothing for a single cycle of the virtual machine
  *
@@ -53,9 +190,9 @@ static opcode_t *_binary_op(opcode_t *opcode, callstack_frame_t *frame,
  *
  * 0000  opcode  (1 byte)
  */
-opcode_t *opcode_handler_nop(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_nop)(vm_instruction_t *ins, vm_instance_t *instance)
 {
-    return opcode + 1;
+    return ins + 1;
 }
 
 
@@ -65,9 +202,9 @@ opcode_t *opcode_handler_nop(opcode_t *opcode, vm_instance_t *instance)
  *
  * 0000  opcode  (1 byte)
  */
-opcode_t *opcode_handler_add(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_add)(vm_instruction_t *ins, vm_instance_t *instance)
 {
-    return _binary_op(opcode, instance->callstack.current_frame, BINARY_ADD);
+    return _binary_op(ins, instance->callstack.current_frame, BINARY_ADD);
 }
 
 
@@ -77,9 +214,9 @@ opcode_t *opcode_handler_add(opcode_t *opcode, vm_instance_t *instance)
  *
  * 0000  opcode  (1 byte)
  */
-opcode_t *opcode_handler_sub(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_sub)(vm_instruction_t *ins, vm_instance_t *instance)
 {
-    return _binary_op(opcode, instance->callstack.current_frame, BINARY_SUB);
+    return _binary_op(ins, instance->callstack.current_frame, BINARY_SUB);
 }
 
 
@@ -89,9 +226,9 @@ opcode_t *opcode_handler_sub(opcode_t *opcode, vm_instance_t *instance)
  *
  * 0000  opcode  (1 byte)
  */
-opcode_t *opcode_handler_mult(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_mult)(vm_instruction_t *ins, vm_instance_t *instance)
 {
-    return _binary_op(opcode, instance->callstack.current_frame, BINARY_MULT);
+    return _binary_op(ins, instance->callstack.current_frame, BINARY_MULT);
 }
 
 
@@ -101,115 +238,197 @@ opcode_t *opcode_handler_mult(opcode_t *opcode, vm_instance_t *instance)
  *
  * 0000  opcode  (1 byte)
  */
-opcode_t *opcode_handler_div(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_div)(vm_instruction_t *ins, vm_instance_t *instance)
 {
-    return _binary_op(opcode, instance->callstack.current_frame, BINARY_DIV);
+    return _binary_op(ins, instance->callstack.current_frame, BINARY_DIV);
 }
 
 
 /**
- * Creates an  object with the provided integer value and pushes it to the stack
+ * Pops two ints off the stack, adds them together, and pushes the result to the stack.
+ * Only emitted when type inference has proven the types of both operands.
  *
- * 0000  opcode    (1 byte)
- * 0001  int value (4 bytes, signed integer)
+ * 0000  opcode  (1 byte)
  */
-opcode_t *opcode_handler_int(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_add_int_int)(vm_instruction_t *ins, vm_instance_t *instance)
 {
-    callstack_frame_t *frame = instance->callstack.current_frame;
+    TYPED_BINARY_OP(instance->callstack.current_frame, int_value, +);
+    return ins + 1;
+}
 
-    // Increment past the opcode
-    opcode = (opcode_t *) INCREMENT_PTR_BYTES(opcode, 1);
 
-    // Grab int value after opcode and create new int object
-    object_t *new_obj = new_int_object(*((vm_int_t *) opcode));
+/**
+ * Pops two ints off the stack, subtracts the first popped from the second popped, and pushes the result to the stack.
+ * Only emitted when type inference has proven the types of both operands.
+ *
+ * 0000  opcode  (1 byte)
+ */
+vm_instruction_t *HANDLER(opcode_handler_sub_int_int)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    TYPED_BINARY_OP(instance->callstack.current_frame, int_value, -);
+    return ins + 1;
+}
 
-    // Push int value onto stack
-    CHECK_ULIST_ERR_RT(ulist_append_item(&frame->data, &new_obj));
 
-    // Increment past the int value and return
-    return INCREMENT_PTR_BYTES(opcode, sizeof(vm_int_t));
+/**
+ * Pops two ints off the stack, multiplies them, and pushes the result to the stack.
+ * Only emitted when type inference has proven the types of both operands.
+ *
+ * 0000  opcode  (1 byte)
+ */
+vm_instruction_t *HANDLER(opcode_handler_mult_int_int)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    TYPED_BINARY_OP(instance->callstack.current_frame, int_value, *);
+    return ins + 1;
 }
 
 
 /**
- * Creates a float object with the provided floating point value and pushes it
- * to the stack
+ * Pops two ints off the stack, divides the second popped by the first popped, and pushes the result to the stack.
+ * Only emitted when type inference has proven the types of both operands.
  *
- * 0000  opcode      (1 byte)
- * 0001  float value (8 bytes, double-precision float)
+ * 0000  opcode  (1 byte)
  */
-opcode_t *opcode_handler_float(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_div_int_int)(vm_instruction_t *ins, vm_instance_t *instance)
 {
     callstack_frame_t *frame = instance->callstack.current_frame;
 
-    // Increment past the opcode
-    opcode = (opcode_t *) INCREMENT_PTR_BYTES(opcode, 1);
+    if (0 == frame->sp[-1].payload.int_value)
+    {
+        RUNTIME_ERR(RUNTIME_ERROR_ARITHMETIC, "Division by zero");
+        return NULL;
+    }
 
-    // Grab int value after opcode and create new float object
-    object_t *new_obj = new_int_object(*((vm_float_t *) opcode));
+    TYPED_BINARY_OP(frame, int_value, /);
+    return ins + 1;
+}
 
-    // Push int value onto stack
-    CHECK_ULIST_ERR_RT(ulist_append_item(&frame->data, &new_obj));
 
-    // Increment past the float value and return
-    return INCREMENT_PTR_BYTES(opcode, sizeof(vm_float_t));
+/**
+ * Pops two floats off the stack, adds them together, and pushes the result to the stack.
+ * Only emitted when type inference has proven the types of both operands.
+ *
+ * 0000  opcode  (1 byte)
+ */
+vm_instruction_t *HANDLER(opcode_handler_add_float_float)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    TYPED_BINARY_OP(instance->callstack.current_frame, float_value, +);
+    return ins + 1;
 }
 
 
 /**
- * Creates a string object with the provided string data and pushes it to the stack
+ * Pops two floats off the stack, subtracts the first popped from the second popped, and pushes the result to the stack.
+ * Only emitted when type inference has proven the types of both operands.
  *
- * 0000  opcode                       (1 byte)
- * 0001  size of string data in bytes (4 bytes, unsigned integer)
- * 0005  string data                  (no. of bytes specified by previous field)
+ * 0000  opcode  (1 byte)
+ */
+vm_instruction_t *HANDLER(opcode_handler_sub_float_float)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    TYPED_BINARY_OP(instance->callstack.current_frame, float_value, -);
+    return ins + 1;
+}
+
+
+/**
+ * Pops two floats off the stack, multiplies them, and pushes the result to the stack.
+ * Only emitted when type inference has proven the types of both operands.
+ *
+ * 0000  opcode  (1 byte)
  */
-opcode_t *opcode_handler_string(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_mult_float_float)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    TYPED_BINARY_OP(instance->callstack.current_frame, float_value, *);
+    return ins + 1;
+}
+
+
+/**
+ * Pops two floats off the stack, divides the second popped by the first popped, and pushes the result to the stack.
+ * Only emitted when type inference has proven the types of both operands.
+ *
+ * 0000  opcode  (1 byte)
+ */
+vm_instruction_t *HANDLER(opcode_handler_div_float_float)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    TYPED_BINARY_OP(instance->callstack.current_frame, float_value, /);
+    return ins + 1;
+}
+
+
+/**
+ * Pushes the provided integer value to the stack
+ *
+ * 0000  opcode    (1 byte)
+ * 0001  int value (4 bytes, signed integer)
+ */
+vm_instruction_t *HANDLER(opcode_handler_int)(vm_instruction_t *ins, vm_instance_t *instance)
 {
     callstack_frame_t *frame = instance->callstack.current_frame;
 
-    // Increment past the opcode
-    opcode = (opcode_t *) INCREMENT_PTR_BYTES(opcode, 1);
+    // Push int value onto stack
+    STACK_PUSH(frame, INT_VALUE(ins->operand.immediate.int_value));
 
-    // Read size of the upcoming string data
-    uint32_t string_size = *(uint32_t *) opcode;
+    return ins + 1;
+}
 
-    // Increment past the string size
-    opcode = (opcode_t *) INCREMENT_PTR_BYTES(opcode, sizeof(uint32_t));
 
-    // Set up new byte string object
-    object_t *new_obj = new_string_object((char *) opcode, string_size);
+/**
+ * Pushes the provided floating point value to the stack
+ *
+ * 0000  opcode      (1 byte)
+ * 0001  float value (8 bytes, double-precision float)
+ */
+vm_instruction_t *HANDLER(opcode_handler_float)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    callstack_frame_t *frame = instance->callstack.current_frame;
 
-    // Push byte string value onto stack
-    CHECK_ULIST_ERR_RT(ulist_append_item(&frame->data, &new_obj));
+    // Push float value onto stack
+    STACK_PUSH(frame, FLOAT_VALUE(ins->operand.immediate.float_value));
 
-    // Increment past string data
-    return INCREMENT_PTR_BYTES(opcode, string_size);
+    return ins + 1;
 }
 
 
+/**
+ * Creates a string object with the provided string data and pushes it to the
+ * stack. The object is immortal and kept by the loaded program, and the
+ * instruction is quickened to VM_OPCODE_LOAD_VALUE, so the string is only
+ * looked up in the string cache on the first execution.
+ *
+ * 0000  opcode                       (1 byte)
+ * 0001  size of string data in bytes (4 bytes, unsigned integer)
+ * 0005  string data                  (no. of bytes specified by previous field)
+ */
+vm_instruction_t *HANDLER(opcode_handler_string)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    vm_instruction_t *next = _string(ins, instance);
+
+    // The string is only kept by the program if it was created successfully
+    if (NULL != next)
+    {
+        QUICKEN(ins, VM_OPCODE_LOAD_VALUE, HANDLER(opcode_handler_load_value));
+    }
+
+    return next;
+}
+
 
 
 /**
- * Creates a bool object with the provided boolean value and pushes it to the stack
+ * Pushes the provided boolean value to the stack
  *
  * 0000  opcode      (1 byte)
  * 0001  bool value  (1 byte, unsigned integer, 1=true 0=false)
  */
-opcode_t *opcode_handler_bool(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_bool)(vm_instruction_t *ins, vm_instance_t *instance)
 {
     callstack_frame_t *frame = instance->callstack.current_frame;
 
-    // Increment past the opcode
-    opcode = (opcode_t *) INCREMENT_PTR_BYTES(opcode, 1);
-
-    // Grab bool value after opcode
-    object_t *new_obj = new_bool_object(*((vm_bool_t *) opcode));
-
     // Push new bool value onto stack
-    CHECK_ULIST_ERR_RT(ulist_append_item(&frame->data, &new_obj));
+    STACK_PUSH(frame, BOOL_VALUE(ins->operand.immediate.bool_value));
 
-    // Increment past the bool value and return
-    return INCREMENT_PTR_BYTES(opcode, sizeof(vm_bool_t));
+    return ins + 1;
 }
 
 
@@ -218,17 +437,17 @@ opcode_t *opcode_handler_bool(opcode_t *opcode, vm_instance_t *instance)
  *
  * 0000  opcode      (1 byte)
  */
-opcode_t *opcode_handler_print(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_print)(vm_instruction_t *ins, vm_instance_t *instance)
 {
     callstack_frame_t *frame = instance->callstack.current_frame;
-    object_t *obj;
+    value_t value;
 
-    CHECK_ULIST_ERR_RT(ulist_pop_item(&frame->data, frame->data.num_items - 1, (void **) &obj));
+    STACK_POP(frame, value);
 
-    print_object(obj);
-    FREE_IF_NO_REFS(obj);
+    print_value(&value);
+    RELEASE_VALUE(value);
 
-    return INCREMENT_PTR_BYTES(opcode, 1);
+    return ins + 1;
 }
 
 
@@ -250,211 +469,633 @@ opcode_t *opcode_handler_print(opcode_t *opcode, vm_instance_t *instance)
  *     - when converting float to string, it is used to specify the number of digits
  *       after the decimal point that should be included in the output string.
  */
-opcode_t *opcode_handler_cast(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_cast)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    vm_instruction_t *next = _cast(ins, instance);
+
+    // Assume the input type will be the same next time, if a cast was needed
+    if ((NULL != next) && (NUM_DATATYPES != ins->cache->lhs_type))
+    {
+        QUICKEN(ins, VM_OPCODE_CAST_TYPED, HANDLER(opcode_handler_cast_typed));
+    }
+
+    return next;
+}
+
+
+/**
+ * Jump unconditionally to the given offset in the program data
+ *
+ * 0000  opcode                                   (1 byte)
+ * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
+ */
+vm_instruction_t *HANDLER(opcode_handler_jump)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    // Backward jumps close loops, which may be traced (see jit_loop_edge)
+    if ((NULL != ins->loop) && (0u != instance->trace_loops))
+    {
+        return jit_loop_edge(ins, instance);
+    }
+
+    return ins->target;
+}
+
+
+/* Boilerplate for the end of every conditional jump; counts the direction
+ * taken when profiling branches, and returns the next instruction to execute */
+static vm_instruction_t *_branch(vm_instruction_t *ins, vm_instance_t *instance,
+                                 uint8_t taken)
+{
+#ifdef VM_BRANCH_PROFILE
+    if (taken)
+    {
+        ins->branch->taken += 1u;
+    }
+    else
+    {
+        ins->branch->not_taken += 1u;
+    }
+#endif /* VM_BRANCH_PROFILE */
+
+    if (!taken)
+    {
+        return ins + 1;
+    }
+
+    // Backward jumps close loops, which may be traced (see jit_loop_edge)
+    if ((NULL != ins->loop) && (0u != instance->trace_loops))
+    {
+        return jit_loop_edge(ins, instance);
+    }
+
+    return ins->target;
+}
+
+
+/* Boilerplate for conditional jumps; pops a value, and takes the jump if its
+ * truth value matches the value given. The truth value is tested directly, so
+ * no bool value is created. */
+static vm_instruction_t *_conditional_jump(vm_instruction_t *ins, vm_instance_t *instance,
+                                           uint8_t jump_when)
 {
     callstack_frame_t *frame = instance->callstack.current_frame;
-    object_t *input, *output;
-    type_status_e err;
+    value_t value;
+
+    STACK_POP(frame, value);
 
-    CHECK_ULIST_ERR_RT(ulist_pop_item(&frame->data, frame->data.num_items - 1, (void **) &input));
+    uint8_t truth = type_is_true(&value);
+    RELEASE_VALUE(value);
 
-    // Increment past the opcode
-    opcode = (opcode_t *) INCREMENT_PTR_BYTES(opcode, 1);
+    return _branch(ins, instance, (jump_when == truth) ? 1u : 0u);
+}
 
-    // Read data type
-    uint8_t data_type_u8 = *((uint8_t *) opcode);
-    data_type_e data_type = (data_type_e) data_type_u8;
 
-    // Increment past the data type
-    opcode = (opcode_t *) INCREMENT_PTR_BYTES(opcode, 1);
+/* Boilerplate for comparisons; pops two values, and stores the result of
+ * comparing them. Returns the next instruction, or NULL on error. */
+static vm_instruction_t *_compare(vm_instruction_t *ins, callstack_frame_t *frame,
+                                  compare_op_e op_type, vm_bool_t *result)
+{
+    value_t lhs, rhs;
 
-    // Read extra data
-    uint16_t extra_data = *((uint16_t *) opcode);
+    STACK_POP(frame, rhs);
+    STACK_POP(frame, lhs);
 
-    err = type_cast_to(input, &output, data_type, extra_data);
-    if (TYPE_OK != err)
+    if (type_compare(&lhs, &rhs, op_type, result) != TYPE_OK)
     {
-        if (TYPE_RUNTIME_ERROR != err)
-        {
-            RUNTIME_ERR(RUNTIME_ERROR_CAST, "Failed to cast, status %d", err);
-        }
+        RUNTIME_ERR(RUNTIME_ERROR_ARITHMETIC, "Can't compare those types");
+        RELEASE_VALUE(lhs);
+        RELEASE_VALUE(rhs);
+        return NULL;
+    }
+
+    RELEASE_VALUE(lhs);
+    RELEASE_VALUE(rhs);
+
+    return ins + 1;
+}
+
+
+/* Boilerplate for comparisons that push their result to the stack */
+static vm_instruction_t *_compare_push(vm_instruction_t *ins, vm_instance_t *instance,
+                                       compare_op_e op_type)
+{
+    callstack_frame_t *frame = instance->callstack.current_frame;
+    vm_bool_t result;
 
+    if (NULL == _compare(ins, frame, op_type, &result))
+    {
         return NULL;
     }
 
-    // Push result of cast onto stack
-    CHECK_ULIST_ERR_RT(ulist_append_item(&frame->data, &output));
+    STACK_PUSH(frame, BOOL_VALUE(result));
+    return ins + 1;
+}
+
 
-    FREE_IF_NO_REFS(input);
+/* Boilerplate for fused compare-and-branch; pops two values, and takes the
+ * jump if the comparison is true */
+static vm_instruction_t *_compare_jump(vm_instruction_t *ins, vm_instance_t *instance,
+                                       compare_op_e op_type)
+{
+    vm_bool_t result;
+
+    if (NULL == _compare(ins, instance->callstack.current_frame, op_type, &result))
+    {
+        return NULL;
+    }
 
-    // Increment past extra data and return
-    return INCREMENT_PTR_BYTES(opcode, sizeof(uint16_t));
+    return _branch(ins, instance, result);
 }
 
 
+/* Boilerplate for compare-and-branch on two ints whose types were proven by
+ * type inference. Both operands are guaranteed to be on the stack with the
+ * right type, so they are compared without any checks. */
+#define TYPED_COMPARE_JUMP(ins, instance, op)                                 \
+    do {                                                                      \
+        callstack_frame_t *__frame = (instance)->callstack.current_frame;     \
+        __frame->sp -= 2;                                                     \
+        uint8_t __taken = (__frame->sp[0].payload.int_value op                \
+                           __frame->sp[1].payload.int_value) ? 1u : 0u;       \
+        return _branch((ins), (instance), __taken);                           \
+    }                                                                         \
+    while (0)
+
+
 /**
- * Jump unconditionally to the given offset in the program data
+ * Pop a value from the stack, and test its truth value. If false, jump to the
+ *   given offset in the program data.
  *
  * 0000  opcode                                   (1 byte)
  * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
  */
-opcode_t *opcode_handler_jump(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_jump_if_false)(vm_instruction_t *ins, vm_instance_t *instance)
 {
-    int32_t offset = *((int32_t *) (((uint8_t *) opcode) + 1));
-    return INCREMENT_PTR_BYTES(opcode, offset);
+    return _conditional_jump(ins, instance, 0u);
 }
 
 
 /**
- * Pop a value from the stack, and cast it to a bool. If false, jump to the
+ * Pop a value from the stack, and test its truth value. If true, jump to the
  *   given offset in the program data.
  *
  * 0000  opcode                                   (1 byte)
  * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
  */
-opcode_t *opcode_handler_jump_if_false(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_jump_if_true)(vm_instruction_t *ins, vm_instance_t *instance)
 {
-    callstack_frame_t *frame = instance->callstack.current_frame;
-    object_t *obj, *bool_obj;
-    data_object_t *bool_data_ptr;
-    type_status_e err;
+    return _conditional_jump(ins, instance, 1u);
+}
 
-    bool_obj = NULL;
-    CHECK_ULIST_ERR_RT(ulist_pop_item(&frame->data, frame->data.num_items - 1,
-                                      (void **) &obj));
 
-    // Cast popped item to bool
-    err = type_cast_to(obj, &bool_obj, DATATYPE_BOOL, 0u);
-    if (TYPE_NO_CAST_REQUIRED == err)
-    {
-        bool_data_ptr = (data_object_t *) obj;
-    }
-    else if (TYPE_OK == err)
-    {
-        bool_data_ptr = (data_object_t *) bool_obj;
-    }
-    else
-    {
-        if (TYPE_RUNTIME_ERROR != err)
-        {
-            RUNTIME_ERR(RUNTIME_ERROR_CAST, "Failed to cast, status %d\n", err);
-        }
+/**
+ * Pops two items off the stack and compares them, and pushes a bool to the
+ * stack which is true if they are equal
+ * (see type_compare)
+ *
+ * 0000  opcode  (1 byte)
+ */
+vm_instruction_t *HANDLER(opcode_handler_equal)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    return _compare_push(ins, instance, COMPARE_EQUAL);
+}
 
-        return NULL;
-    }
 
-    opcode_t *ret;
+/**
+ * Pops two items off the stack and compares them, and pushes a bool to the
+ * stack which is true if they are not equal
+ * (see type_compare)
+ *
+ * 0000  opcode  (1 byte)
+ */
+vm_instruction_t *HANDLER(opcode_handler_not_equal)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    return _compare_push(ins, instance, COMPARE_NOT_EQUAL);
+}
 
-    if (bool_data_ptr->payload.bool_value)
-    {
-        // Increment past the opcode and offset data
-        ret = INCREMENT_PTR_BYTES(opcode, 1 + sizeof(int32_t));
-    }
-    else
-    {
-        // Jump to the given offset
-        int32_t offset = *((int32_t *) (((uint8_t *) opcode) + 1));
-        ret = INCREMENT_PTR_BYTES(opcode, offset);
-    }
 
-    FREE_IF_NO_REFS(obj);
+/**
+ * Pops two items off the stack and compares them, and pushes a bool to the
+ * stack which is true if the second popped is less than the first popped
+ * (see type_compare)
+ *
+ * 0000  opcode  (1 byte)
+ */
+vm_instruction_t *HANDLER(opcode_handler_less)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    return _compare_push(ins, instance, COMPARE_LESS);
+}
+
+
+/**
+ * Pops two items off the stack and compares them, and pushes a bool to the
+ * stack which is true if the second popped is less than or equal to the first popped
+ * (see type_compare)
+ *
+ * 0000  opcode  (1 byte)
+ */
+vm_instruction_t *HANDLER(opcode_handler_less_equal)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    return _compare_push(ins, instance, COMPARE_LESS_EQUAL);
+}
+
+
+/**
+ * Pops two items off the stack and compares them, and pushes a bool to the
+ * stack which is true if the second popped is greater than the first popped
+ * (see type_compare)
+ *
+ * 0000  opcode  (1 byte)
+ */
+vm_instruction_t *HANDLER(opcode_handler_greater)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    return _compare_push(ins, instance, COMPARE_GREATER);
+}
+
+
+/**
+ * Pops two items off the stack and compares them, and pushes a bool to the
+ * stack which is true if the second popped is greater than or equal to the first popped
+ * (see type_compare)
+ *
+ * 0000  opcode  (1 byte)
+ */
+vm_instruction_t *HANDLER(opcode_handler_greater_equal)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    return _compare_push(ins, instance, COMPARE_GREATER_EQUAL);
+}
+
+
+/**
+ * Pops two items off the stack and compares them, and jumps to the given offset
+ *   in the program data if they are equal.
+ *
+ * 0000  opcode                                   (1 byte)
+ * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
+ */
+vm_instruction_t *HANDLER(opcode_handler_jump_if_equal)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    return _compare_jump(ins, instance, COMPARE_EQUAL);
+}
 
-    if (NULL != bool_obj)
-    {
-        memory_manager_free(bool_obj);
-    }
 
-    return ret;
+/**
+ * Pops two items off the stack and compares them, and jumps to the given offset
+ *   in the program data if they are not equal.
+ *
+ * 0000  opcode                                   (1 byte)
+ * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
+ */
+vm_instruction_t *HANDLER(opcode_handler_jump_if_not_equal)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    return _compare_jump(ins, instance, COMPARE_NOT_EQUAL);
 }
 
 
 /**
- * Appends a new value to the constant pool
+ * Pops two items off the stack and compares them, and jumps to the given offset
+ *   in the program data if the second popped is less than the first popped.
+ *
+ * 0000  opcode                                   (1 byte)
+ * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
+ */
+vm_instruction_t *HANDLER(opcode_handler_jump_if_less)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    return _compare_jump(ins, instance, COMPARE_LESS);
+}
+
+
+/**
+ * Pops two items off the stack and compares them, and jumps to the given offset
+ *   in the program data if the second popped is less than or equal to the first popped.
+ *
+ * 0000  opcode                                   (1 byte)
+ * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
+ */
+vm_instruction_t *HANDLER(opcode_handler_jump_if_less_equal)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    return _compare_jump(ins, instance, COMPARE_LESS_EQUAL);
+}
+
+
+/**
+ * Pops two items off the stack and compares them, and jumps to the given offset
+ *   in the program data if the second popped is greater than the first popped.
+ *
+ * 0000  opcode                                   (1 byte)
+ * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
+ */
+vm_instruction_t *HANDLER(opcode_handler_jump_if_greater)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    return _compare_jump(ins, instance, COMPARE_GREATER);
+}
+
+
+/**
+ * Pops two items off the stack and compares them, and jumps to the given offset
+ *   in the program data if the second popped is greater than or equal to the first popped.
+ *
+ * 0000  opcode                                   (1 byte)
+ * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
+ */
+vm_instruction_t *HANDLER(opcode_handler_jump_if_greater_equal)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    return _compare_jump(ins, instance, COMPARE_GREATER_EQUAL);
+}
+
+
+/**
+ * Pops two ints off the stack, and jumps to the given offset in the program data
+ *   if they are equal.
+ *   Only emitted when type inference has proven the types of both operands.
+ *
+ * 0000  opcode                                   (1 byte)
+ * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
+ */
+vm_instruction_t *HANDLER(opcode_handler_jump_if_equal_int)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    TYPED_COMPARE_JUMP(ins, instance, ==);
+}
+
+
+/**
+ * Pops two ints off the stack, and jumps to the given offset in the program data
+ *   if they are not equal.
+ *   Only emitted when type inference has proven the types of both operands.
+ *
+ * 0000  opcode                                   (1 byte)
+ * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
+ */
+vm_instruction_t *HANDLER(opcode_handler_jump_if_not_equal_int)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    TYPED_COMPARE_JUMP(ins, instance, !=);
+}
+
+
+/**
+ * Pops two ints off the stack, and jumps to the given offset in the program data
+ *   if the second popped is less than the first popped.
+ *   Only emitted when type inference has proven the types of both operands.
+ *
+ * 0000  opcode                                   (1 byte)
+ * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
+ */
+vm_instruction_t *HANDLER(opcode_handler_jump_if_less_int)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    TYPED_COMPARE_JUMP(ins, instance, <);
+}
+
+
+/**
+ * Pops two ints off the stack, and jumps to the given offset in the program data
+ *   if the second popped is less than or equal to the first popped.
+ *   Only emitted when type inference has proven the types of both operands.
+ *
+ * 0000  opcode                                   (1 byte)
+ * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
+ */
+vm_instruction_t *HANDLER(opcode_handler_jump_if_less_equal_int)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    TYPED_COMPARE_JUMP(ins, instance, <=);
+}
+
+
+/**
+ * Pops two ints off the stack, and jumps to the given offset in the program data
+ *   if the second popped is greater than the first popped.
+ *   Only emitted when type inference has proven the types of both operands.
+ *
+ * 0000  opcode                                   (1 byte)
+ * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
+ */
+vm_instruction_t *HANDLER(opcode_handler_jump_if_greater_int)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    TYPED_COMPARE_JUMP(ins, instance, >);
+}
+
+
+/**
+ * Pops two ints off the stack, and jumps to the given offset in the program data
+ *   if the second popped is greater than or equal to the first popped.
+ *   Only emitted when type inference has proven the types of both operands.
+ *
+ * 0000  opcode                                   (1 byte)
+ * 0001  offset (in bytes) from current position  (4 bytes, signed integer)
+ */
+vm_instruction_t *HANDLER(opcode_handler_jump_if_greater_equal_int)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    TYPED_COMPARE_JUMP(ins, instance, >=);
+}
+
+
+/**
+ * Defines a new value in the constant pool. Constants are created once by
+ * vm_load, so there is nothing left to do when this instruction is executed.
  *
  * 0000  opcode          (1 byte)
  * 0001  data type       (1 byte, unsigned integer, values defined in in data_type_e)
  * 0002  immediate value (size depends on the value of data type field)
  */
-opcode_t *opcode_handler_define_const(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_define_const)(vm_instruction_t *ins, vm_instance_t *instance)
 {
-    object_t *new_const;
+    return ins + 1;
+}
 
-    // Increment past the opcode
-    opcode = INCREMENT_PTR_BYTES(opcode, 1);
 
-    data_type_e data_type = (data_type_e) *((uint8_t *) opcode);
+/**
+ * Loads a value from the constants pool and pushes it to the stack. Constant
+ * objects are immortal, so the pushed value needs no reference counting. The
+ * instruction is quickened to VM_OPCODE_LOAD_VALUE, pointing directly at the
+ * constant.
+ *
+ * 0000  opcode   (1 byte)
+ * 0001  index    (4 bytes, unsigned integer, const pool index to load from)
+ */
+vm_instruction_t *HANDLER(opcode_handler_load_const)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    // Index was checked by vm_load
+    ins->value = instance->constants + ins->operand.const_index;
+    QUICKEN(ins, VM_OPCODE_LOAD_VALUE, HANDLER(opcode_handler_load_value));
 
-    // Increment past data type
-    opcode = INCREMENT_PTR_BYTES(opcode, 1);
+    return HANDLER(opcode_handler_load_value)(ins, instance);
+}
 
-    switch (data_type)
-    {
-        case DATATYPE_INT:
-            new_const = new_int_object(*((vm_int_t *) opcode));
-            opcode = INCREMENT_PTR_BYTES(opcode, sizeof(vm_int_t));
-            break;
 
-        case DATATYPE_FLOAT:
-            new_const = new_float_object(*((vm_float_t *) opcode));
-            opcode = INCREMENT_PTR_BYTES(opcode, sizeof(vm_float_t));
-            break;
+/**
+ * Pushes the value held by a local variable slot of the current call frame.
+ * The pushed copy takes a reference of its own, so the value stays valid if
+ * the slot is stored to before the copy is used.
+ *
+ * 0000  opcode   (1 byte)
+ * 0001  slot     (2 bytes, unsigned integer, local variable slot to load from)
+ */
+vm_instruction_t *HANDLER(opcode_handler_load_local)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    callstack_frame_t *frame = instance->callstack.current_frame;
 
-        case DATATYPE_BOOL:
-            new_const = new_bool_object(*((vm_bool_t *) opcode));
-            opcode = INCREMENT_PTR_BYTES(opcode, sizeof(vm_bool_t));
-            break;
+    // Slot was checked by vm_load, and reserved by vm_execute
+    value_t value = frame->locals[ins->operand.local_index];
 
-        case DATATYPE_STRING:
-        {
-            // Read size of the upcoming string data
-            uint32_t string_size = *((uint32_t *) opcode);
+    RETAIN_VALUE(value);
+    STACK_PUSH(frame, value);
+    return ins + 1;
+}
 
-            // Increment past the string size
-            opcode = INCREMENT_PTR_BYTES(opcode, sizeof(uint32_t));
 
-            // Create new byte string object
-            new_const = new_string_object((char *) opcode, string_size);
+/**
+ * Pops a value off the stack and stores it in a local variable slot of the
+ * current call frame, releasing the value previously held by the slot.
+ *
+ * 0000  opcode   (1 byte)
+ * 0001  slot     (2 bytes, unsigned integer, local variable slot to store to)
+ */
+vm_instruction_t *HANDLER(opcode_handler_store_local)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    callstack_frame_t *frame = instance->callstack.current_frame;
+    value_t value;
 
-            // Increment past string data
-            opcode = INCREMENT_PTR_BYTES(opcode, string_size);
-            break;
-        }
+    STACK_POP(frame, value);
+    store_value(&frame->locals[ins->operand.local_index], value);
+    return ins + 1;
+}
 
-        default:
-            break;
+
+/**
+ * Pushes the value of a global variable. The address of the value is cached by
+ * the instruction, and only looked up again after a global has been added or
+ * deleted. Loading a global that doesn't exist is a runtime error. The pushed
+ * copy takes a reference of its own, as for OPCODE_LOAD_LOCAL.
+ *
+ * 0000  opcode   (1 byte)
+ * 0001  name     (4 bytes, unsigned integer, const pool index of name string)
+ */
+vm_instruction_t *HANDLER(opcode_handler_load_global)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    value_t *slot = GLOBALS_CACHED_SLOT(&instance->globals, ins->cache);
+
+    if (NULL == slot)
+    {
+        // Name was checked by vm_load
+        slot = globals_resolve(&instance->globals, ins->cache,
+                               VALUE_STRING(instance->constants[ins->operand.const_index]), 0u);
+        if (NULL == slot)
+        {
+            return NULL;
+        }
     }
 
-    // Append new const value to the constants pool
-    CHECK_ULIST_ERR_RT(ulist_append_item(&instance->constants, &new_const));
-    return opcode;
+    RETAIN_VALUE(*slot);
+    STACK_PUSH(instance->callstack.current_frame, *slot);
+    return ins + 1;
 }
 
 
 /**
- * Loads a value from the constants pool and pushes it to the stack
+ * Pops a value off the stack and stores it in a global variable, creating the
+ * global if it doesn't exist yet. The address of the value is cached in the
+ * same way as for OPCODE_LOAD_GLOBAL.
  *
  * 0000  opcode   (1 byte)
- * 0001  index    (4 bytes, unsigned integer, const pool index to load from)
+ * 0001  name     (4 bytes, unsigned integer, const pool index of name string)
  */
-opcode_t *opcode_handler_load_const(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_store_global)(vm_instruction_t *ins, vm_instance_t *instance)
 {
-    callstack_frame_t *frame = instance->callstack.current_frame;
-    object_t *entry;
+    value_t *slot = GLOBALS_CACHED_SLOT(&instance->globals, ins->cache);
+    value_t value;
+
+    if (NULL == slot)
+    {
+        slot = globals_resolve(&instance->globals, ins->cache,
+                               VALUE_STRING(instance->constants[ins->operand.const_index]), 1u);
+        if (NULL == slot)
+        {
+            return NULL;
+        }
+    }
+
+    STACK_POP(instance->callstack.current_frame, value);
+    store_value(slot, value);
+    return ins + 1;
+}
+
+
+/**
+ * Calls a function. The top 'num_args' values on the stack become the first
+ * local variable slots of the function, without being copied, and the
+ * function starts with an empty data stack just above them. Nothing is
+ * allocated unless the call is deeper than any call before it.
+ *
+ * 0000  opcode    (1 byte)
+ * 0001  offset    (4 bytes, signed integer, offset of the function)
+ * 0005  num_args  (1 byte, unsigned integer, values passed from the stack)
+ */
+vm_instruction_t *HANDLER(opcode_handler_call)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    CHECK_DATA_STACK_ERR_RT(data_stack_push_frame(&instance->callstack, ins + 1,
+                                                  ins->operand.call.num_args));
+    return ins->target;
+}
+
+
+/**
+ * Calls a function in tail position, like OPCODE_CALL followed by
+ * OPCODE_RETURN. The function takes over the frame of the current one, so
+ * that recursion through tail calls doesn't use any more frames, and returns
+ * straight to the current function's caller. Outside of a function this is
+ * an ordinary call, whose RETURN fails once the function returns.
+ *
+ * 0000  opcode    (1 byte)
+ * 0001  offset    (4 bytes, signed integer, offset of the function)
+ * 0005  num_args  (1 byte, unsigned integer, values passed from the stack)
+ */
+vm_instruction_t *HANDLER(opcode_handler_tail_call)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    callstack_t *callstack = &instance->callstack;
+
+    // The frame has nowhere to return to, since this is the outermost frame
+    if (0u == callstack->depth)
+    {
+        CHECK_DATA_STACK_ERR_RT(data_stack_push_frame(callstack, NULL, ins->operand.call.num_args));
+    }
+    else
+    {
+        CHECK_DATA_STACK_ERR_RT(data_stack_replace_frame(callstack, ins->operand.call.num_args));
+    }
+
+    return ins->target;
+}
 
-    // Increment past the opcode
-    opcode = INCREMENT_PTR_BYTES(opcode, 1);
 
-    uint32_t index = *((uint32_t *) opcode);
+/**
+ * Pops a value off the stack and returns it from the current function; the
+ * value is pushed onto the data stack of the caller, which continues after
+ * its OPCODE_CALL instruction.
+ *
+ * 0000  opcode    (1 byte)
+ */
+vm_instruction_t *HANDLER(opcode_handler_return)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    callstack_t *callstack = &instance->callstack;
+    vm_instruction_t *return_ip;
+    value_t result;
+
+    if (0u == callstack->depth)
+    {
+        RUNTIME_ERR(RUNTIME_ERROR_INTERNAL, "return outside of a function");
+        return NULL;
+    }
 
-    CHECK_ULIST_ERR_RT(ulist_get_item(&instance->constants,
-                                      (unsigned long long) index,
-                                      (void **) &entry));
+    STACK_POP(callstack->current_frame, result);
+    CHECK_DATA_STACK_ERR_RT(data_stack_pop_frame(callstack, result, &return_ip));
 
-    // Push loaded constant onto stack
-    CHECK_ULIST_ERR_RT(ulist_append_item(&frame->data, &entry));
+    // Returning from a tail call made outside of a function, which returns in turn
+    if (NULL == return_ip)
+    {
+        RUNTIME_ERR(RUNTIME_ERROR_INTERNAL, "return outside of a function");
+        return NULL;
+    }
 
-    // Increment past the index
-    return INCREMENT_PTR_BYTES(opcode, sizeof(uint32_t));
+    return return_ip;
 }
 
 
@@ -464,7 +1105,101 @@ opcode_t *opcode_handler_load_const(opcode_t *opcode, vm_instance_t *instance)
  *
  * 0000  opcode      (1 byte)
  */
-opcode_t *opcode_handler_end(opcode_t *opcode, vm_instance_t *instance)
+vm_instruction_t *HANDLER(opcode_handler_end)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    return ins;
+}
+
+
+/**
+ * Quickened OPCODE_STRING or OPCODE_LOAD_CONST; pushes an immortal value owned
+ * by the loaded program, without looking anything up
+ */
+vm_instruction_t *HANDLER(opcode_handler_load_value)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    STACK_PUSH(instance->callstack.current_frame, *ins->value);
+    return ins + 1;
+}
+
+
+/**
+ * Quickened OPCODE_CAST; calls the cast function cached on the first execution
+ * directly, as long as the input has the same type it had then. If the input
+ * type changes, the instruction goes back to being a generic OPCODE_CAST.
+ */
+vm_instruction_t *HANDLER(opcode_handler_cast_typed)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    callstack_frame_t *frame = instance->callstack.current_frame;
+    vm_inline_cache_t *cache = ins->cache;
+    value_t input, output;
+
+    STACK_POP(frame, input);
+
+    if (cache->lhs_type != input.type)
+    {
+        // Put the input back, and handle it as a generic cast
+        frame->sp += 1;
+        QUICKEN(ins, OPCODE_CAST, HANDLER(opcode_handler_cast));
+        return HANDLER(opcode_handler_cast)(ins, instance);
+    }
+
+    cache->hits += 1u;
+
+    if (cache->func.cast(&input, &output, ins->operand.cast.extra_data) != TYPE_OK)
+    {
+        RELEASE_VALUE(input);
+        return NULL;
+    }
+
+    STACK_PUSH(frame, output);
+    RELEASE_VALUE(input);
+
+    return ins + 1;
+}
+
+
+#define FIRST_INSTRUCTION_CASE(op, op_handler, pops, pushes)                  \
+    case op:                                                                  \
+        return HANDLER(op_handler)(ins, instance);
+
+
+/**
+ * Execute the first instruction of a superinstruction. The handlers that
+ * quicken their instruction can't be used, since that would replace the
+ * superinstruction, so the same work is done here without quickening.
+ */
+static inline vm_instruction_t *_execute_first(vm_instruction_t *ins, vm_instance_t *instance,
+                                               opcode_e opcode)
 {
-    return opcode;
+    switch (opcode)
+    {
+        case OPCODE_STRING:
+            return _string(ins, instance);
+
+        case OPCODE_CAST:
+            return _cast(ins, instance);
+
+        case OPCODE_LOAD_CONST:
+            // Index was checked by vm_load
+            STACK_PUSH(instance->callstack.current_frame,
+                       instance->constants[ins->operand.const_index]);
+            return ins + 1;
+
+        default:
+            break;
+    }
+
+    switch ((int) opcode)
+    {
+        VM_OPCODE_LIST(FIRST_INSTRUCTION_CASE)
+
+        default:
+            RUNTIME_ERR(RUNTIME_ERROR_INTERNAL, "invalid superinstruction");
+            return NULL;
+    }
 }
+
+
+/* Handlers for superinstructions, generated by tools/gen_superinstructions.py.
+ * These call the handlers above directly, so they must be defined after them. */
+#include "superinstruction_handlers.h"
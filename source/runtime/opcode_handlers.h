@@ -10,69 +10,261 @@
 
 
 /**
- * Structure representing all object types that can be pushed to the data stack
+ * Opcodes that never appear in bytecode. Some instructions in a loaded program
+ * are rewritten in place (quickened) to use one of these after they have been
+ * executed once, so that subsequent executions skip work that only needed to
+ * be done the first time.
  */
-typedef struct
+typedef enum
 {
-    union
-    {
-        object_t object;
-        data_object_t data_object;
-    } payload;
-} data_stack_entry_t;
+    VM_OPCODE_LOAD_VALUE = NUM_OPCODES,  // Quickened STRING or LOAD_CONST
+    VM_OPCODE_CAST_TYPED,                // Quickened CAST, for a single input type
+    VM_NUM_OPCODES
+} vm_opcode_e;
 
 
-/* Handler function for opcodes */
-typedef opcode_t *(*op_handler_t)(opcode_t *, vm_instance_t *);
+/**
+ * Single definition of every opcode known to the virtual machine. Each of the
+ * dispatch engines in vm.c generates its dispatch table from this list, so a
+ * new instruction only needs to be added here (and to opcode_e). The number of
+ * items popped and pushed is used by vm_load to calculate the maximum depth
+ * of the data stack; OPCODE_CALL and OPCODE_TAIL_CALL also pop the number of
+ * arguments given by their operand.
+ *
+ * Format: X(opcode, handler function, items popped, items pushed)
+ */
+#define VM_OPCODE_LIST(X)                                                                 \
+    X(OPCODE_NOP,                       opcode_handler_nop,                       0u, 0u) \
+    X(OPCODE_ADD,                       opcode_handler_add,                       2u, 1u) \
+    X(OPCODE_SUB,                       opcode_handler_sub,                       2u, 1u) \
+    X(OPCODE_MULT,                      opcode_handler_mult,                      2u, 1u) \
+    X(OPCODE_DIV,                       opcode_handler_div,                       2u, 1u) \
+    X(OPCODE_INT,                       opcode_handler_int,                       0u, 1u) \
+    X(OPCODE_FLOAT,                     opcode_handler_float,                     0u, 1u) \
+    X(OPCODE_STRING,                    opcode_handler_string,                    0u, 1u) \
+    X(OPCODE_BOOL,                      opcode_handler_bool,                      0u, 1u) \
+    X(OPCODE_PRINT,                     opcode_handler_print,                     1u, 0u) \
+    X(OPCODE_CAST,                      opcode_handler_cast,                      1u, 1u) \
+    X(OPCODE_JUMP,                      opcode_handler_jump,                      0u, 0u) \
+    X(OPCODE_JUMP_IF_FALSE,             opcode_handler_jump_if_false,             1u, 0u) \
+    X(OPCODE_DEFINE_CONST,              opcode_handler_define_const,              0u, 0u) \
+    X(OPCODE_LOAD_CONST,                opcode_handler_load_const,                0u, 1u) \
+    X(OPCODE_END,                       opcode_handler_end,                       0u, 0u) \
+    X(OPCODE_ADD_INT_INT,               opcode_handler_add_int_int,               2u, 1u) \
+    X(OPCODE_SUB_INT_INT,               opcode_handler_sub_int_int,               2u, 1u) \
+    X(OPCODE_MULT_INT_INT,              opcode_handler_mult_int_int,              2u, 1u) \
+    X(OPCODE_DIV_INT_INT,               opcode_handler_div_int_int,               2u, 1u) \
+    X(OPCODE_ADD_FLOAT_FLOAT,           opcode_handler_add_float_float,           2u, 1u) \
+    X(OPCODE_SUB_FLOAT_FLOAT,           opcode_handler_sub_float_float,           2u, 1u) \
+    X(OPCODE_MULT_FLOAT_FLOAT,          opcode_handler_mult_float_float,          2u, 1u) \
+    X(OPCODE_DIV_FLOAT_FLOAT,           opcode_handler_div_float_float,           2u, 1u) \
+    X(OPCODE_JUMP_IF_TRUE,              opcode_handler_jump_if_true,              1u, 0u) \
+    X(OPCODE_EQUAL,                     opcode_handler_equal,                     2u, 1u) \
+    X(OPCODE_NOT_EQUAL,                 opcode_handler_not_equal,                 2u, 1u) \
+    X(OPCODE_LESS,                      opcode_handler_less,                      2u, 1u) \
+    X(OPCODE_LESS_EQUAL,                opcode_handler_less_equal,                2u, 1u) \
+    X(OPCODE_GREATER,                   opcode_handler_greater,                   2u, 1u) \
+    X(OPCODE_GREATER_EQUAL,             opcode_handler_greater_equal,             2u, 1u) \
+    X(OPCODE_JUMP_IF_EQUAL,             opcode_handler_jump_if_equal,             2u, 0u) \
+    X(OPCODE_JUMP_IF_NOT_EQUAL,         opcode_handler_jump_if_not_equal,         2u, 0u) \
+    X(OPCODE_JUMP_IF_LESS,              opcode_handler_jump_if_less,              2u, 0u) \
+    X(OPCODE_JUMP_IF_LESS_EQUAL,        opcode_handler_jump_if_less_equal,        2u, 0u) \
+    X(OPCODE_JUMP_IF_GREATER,           opcode_handler_jump_if_greater,           2u, 0u) \
+    X(OPCODE_JUMP_IF_GREATER_EQUAL,     opcode_handler_jump_if_greater_equal,     2u, 0u) \
+    X(OPCODE_JUMP_IF_EQUAL_INT,         opcode_handler_jump_if_equal_int,         2u, 0u) \
+    X(OPCODE_JUMP_IF_NOT_EQUAL_INT,     opcode_handler_jump_if_not_equal_int,     2u, 0u) \
+    X(OPCODE_JUMP_IF_LESS_INT,          opcode_handler_jump_if_less_int,          2u, 0u) \
+    X(OPCODE_JUMP_IF_LESS_EQUAL_INT,    opcode_handler_jump_if_less_equal_int,    2u, 0u) \
+    X(OPCODE_JUMP_IF_GREATER_INT,       opcode_handler_jump_if_greater_int,       2u, 0u) \
+    X(OPCODE_JUMP_IF_GREATER_EQUAL_INT, opcode_handler_jump_if_greater_equal_int, 2u, 0u) \
+    X(OPCODE_LOAD_LOCAL,                opcode_handler_load_local,                0u, 1u) \
+    X(OPCODE_STORE_LOCAL,               opcode_handler_store_local,               1u, 0u) \
+    X(OPCODE_LOAD_GLOBAL,               opcode_handler_load_global,               0u, 1u) \
+    X(OPCODE_STORE_GLOBAL,              opcode_handler_store_global,              1u, 0u) \
+    X(OPCODE_CALL,                      opcode_handler_call,                      0u, 1u) \
+    X(OPCODE_TAIL_CALL,                 opcode_handler_tail_call,                 0u, 0u) \
+    X(OPCODE_RETURN,                    opcode_handler_return,                    1u, 0u) \
+    SUPERINSTRUCTION_LIST(X)                                                              \
+    X(VM_OPCODE_LOAD_VALUE,             opcode_handler_load_value,                0u, 1u) \
+    X(VM_OPCODE_CAST_TYPED,             opcode_handler_cast_typed,                1u, 1u)
+
+
+vm_instruction_t *opcode_handler_nop(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_add(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_sub(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_mult(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_div(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_add_int_int(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_sub_int_int(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_mult_int_int(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_div_int_int(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_add_float_float(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_sub_float_float(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_mult_float_float(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_div_float_float(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_int(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_float(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_string(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_bool(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_print(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_cast(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_jump(vm_instruction_t *ins, vm_instance_t *instance);
 
 
+vm_instruction_t *opcode_handler_jump_if_false(vm_instruction_t *ins, vm_instance_t *instance);
 
-opcode_t *opcode_handler_nop(opcode_t *opcode, vm_instance_t *instance);
 
+vm_instruction_t *opcode_handler_jump_if_true(vm_instruction_t *ins, vm_instance_t *instance);
 
-opcode_t *opcode_handler_add(opcode_t *opcode, vm_instance_t *instance);
 
+vm_instruction_t *opcode_handler_equal(vm_instruction_t *ins, vm_instance_t *instance);
 
-opcode_t *opcode_handler_sub(opcode_t *opcode, vm_instance_t *instance);
 
+vm_instruction_t *opcode_handler_not_equal(vm_instruction_t *ins, vm_instance_t *instance);
 
-opcode_t *opcode_handler_mult(opcode_t *opcode, vm_instance_t *instance);
 
+vm_instruction_t *opcode_handler_less(vm_instruction_t *ins, vm_instance_t *instance);
 
-opcode_t *opcode_handler_div(opcode_t *opcode, vm_instance_t *instance);
 
+vm_instruction_t *opcode_handler_less_equal(vm_instruction_t *ins, vm_instance_t *instance);
 
-opcode_t *opcode_handler_int(opcode_t *opcode, vm_instance_t *instance);
 
+vm_instruction_t *opcode_handler_greater(vm_instruction_t *ins, vm_instance_t *instance);
 
-opcode_t *opcode_handler_float(opcode_t *opcode, vm_instance_t *instance);
 
+vm_instruction_t *opcode_handler_greater_equal(vm_instruction_t *ins, vm_instance_t *instance);
 
-opcode_t *opcode_handler_string(opcode_t *opcode, vm_instance_t *instance);
 
+vm_instruction_t *opcode_handler_jump_if_equal(vm_instruction_t *ins, vm_instance_t *instance);
 
-opcode_t *opcode_handler_bool(opcode_t *opcode, vm_instance_t *instance);
 
+vm_instruction_t *opcode_handler_jump_if_not_equal(vm_instruction_t *ins, vm_instance_t *instance);
 
-opcode_t *opcode_handler_print(opcode_t *opcode, vm_instance_t *instance);
 
+vm_instruction_t *opcode_handler_jump_if_less(vm_instruction_t *ins, vm_instance_t *instance);
 
-opcode_t *opcode_handler_cast(opcode_t *opcode, vm_instance_t *instance);
 
+vm_instruction_t *opcode_handler_jump_if_less_equal(vm_instruction_t *ins, vm_instance_t *instance);
 
-opcode_t *opcode_handler_jump(opcode_t *opcode, vm_instance_t *instance);
 
+vm_instruction_t *opcode_handler_jump_if_greater(vm_instruction_t *ins, vm_instance_t *instance);
 
-opcode_t *opcode_handler_jump_if_false(opcode_t *opcode, vm_instance_t *instance);
 
+vm_instruction_t *opcode_handler_jump_if_greater_equal(vm_instruction_t *ins, vm_instance_t *instance);
 
-opcode_t *opcode_handler_define_const(opcode_t *opcode, vm_instance_t *instance);
 
+vm_instruction_t *opcode_handler_jump_if_equal_int(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_jump_if_not_equal_int(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_jump_if_less_int(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_jump_if_less_equal_int(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_jump_if_greater_int(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_jump_if_greater_equal_int(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_define_const(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_load_const(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_load_local(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_store_local(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_load_global(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_store_global(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_call(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_tail_call(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_return(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_end(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_load_value(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+vm_instruction_t *opcode_handler_cast_typed(vm_instruction_t *ins, vm_instance_t *instance);
+
+
+#define SUPERINSTRUCTION_HANDLER_DECL(op, op_handler, pops, pushes)           \
+    vm_instruction_t *op_handler(vm_instruction_t *ins, vm_instance_t *instance);
+
+SUPERINSTRUCTION_LIST(SUPERINSTRUCTION_HANDLER_DECL)
+
+
+/**
+ * Name of the copy of a handler that doesn't check the data stack for
+ * underflow, or for space before pushing (see opcode_handlers_unchecked.c).
+ * vm_load uses these for programs whose stack depth it has proven, and
+ * vm_execute reserves the maximum depth before running them.
+ */
+#define UNCHECKED_HANDLER(op_handler) op_handler##_unchecked
 
-opcode_t *opcode_handler_load_const(opcode_t *opcode, vm_instance_t *instance);
 
+#define UNCHECKED_HANDLER_DECL(op, op_handler, pops, pushes)                  \
+    vm_instruction_t *UNCHECKED_HANDLER(op_handler)(vm_instruction_t *ins,   \
+                                                    vm_instance_t *instance);
 
-opcode_t *opcode_handler_end(opcode_t *opcode, vm_instance_t *instance);
+VM_OPCODE_LIST(UNCHECKED_HANDLER_DECL)
 
 
 #endif /* OPCODE_HANDLERS_H_ */
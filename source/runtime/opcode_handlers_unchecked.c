@@ -0,0 +1,8 @@
+/**
+ * Opcode handlers for programs whose data stack depth was proven by vm_load.
+ * The same handlers as opcode_handlers.c, compiled again without the checks
+ * for data stack underflow and for space before pushing.
+ */
+
+#define VM_UNCHECKED_HANDLERS
+#include "opcode_handlers.c"
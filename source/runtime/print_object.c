@@ -62,3 +62,30 @@ void print_object(object_t *object)
             break;
     }
 }
+
+
+void print_value(value_t *value)
+{
+    switch (value->type)
+    {
+        case DATATYPE_INT:
+            printf("%d\n", value->payload.int_value);
+            break;
+
+        case DATATYPE_FLOAT:
+            printf("%.4f\n", value->payload.float_value);
+            break;
+
+        case DATATYPE_BOOL:
+            printf("%s\n", value->payload.bool_value ? "True" : "False");
+            break;
+
+        case DATATYPE_STRING:
+            print_object(value->payload.object);
+            break;
+
+        default:
+            printf("Unable to print data type %d\n", value->type);
+            break;
+    }
+}
@@ -8,4 +8,7 @@
 void print_object(object_t *object);
 
 
+void print_value(value_t *value);
+
+
 #endif /* PRINT_OBJECT_API_H_ */
@@ -0,0 +1,1029 @@
+#include <string.h>
+
+#include "register_vm_api.h"
+#include "print_object_api.h"
+#include "memory_manager_api.h"
+#include "object_helpers_api.h"
+#include "data_stack_api.h"
+#include "globals_api.h"
+
+
+/* Set on operands that refer to a constant, until the number of registers is
+ * known and the operand can be turned into an index past the registers */
+#define CONSTANT_OPERAND (0x80000000u)
+
+
+/* Mapped to instructions that are never reached */
+#define UNMAPPED (SIZE_MAX)
+
+
+/* Arithmetic on two operands whose types were proven by type inference */
+#define TYPED_BINARY_OP(regs, ins, make_value, field, op)                     \
+    (regs)[(ins)->dst] = make_value((regs)[(ins)->lhs].payload.field op       \
+                                    (regs)[(ins)->rhs].payload.field)
+
+
+typedef struct
+{
+    vm_program_t *program;
+    vm_register_program_t *output;
+    size_t capacity;            // Number of instructions allocated in output
+    int64_t *depths;            // Data stack depth before each stack instruction
+    uint8_t *is_target;         // 1 for each stack instruction that is a jump target
+    size_t *map;                // Index of the first register instruction for each stack instruction
+    uint32_t *operands;         // Operand holding each value on the simulated data stack
+    size_t depth;               // Depth of the simulated data stack
+} translator_t;
+
+
+/* Returns the opcode that a loaded instruction was decoded from. The loaded
+ * opcode can't be used, since it may be a superinstruction, or quickened. */
+static opcode_e _source_opcode(vm_program_t *program, vm_instruction_t *ins)
+{
+    return bytecode_utils_base_opcode((opcode_e) program->bytecode->bytecode[ins->offset]);
+}
+
+
+/**
+ * Find the data stack depth before each instruction, by following every path
+ * through the program. Fails if two paths reach an instruction with different
+ * depths, or if an instruction would pop from an empty stack.
+ *
+ * @return   VM_OK if every reachable instruction has a single depth
+ */
+static vm_status_e _find_depths(translator_t *t)
+{
+    vm_program_t *program = t->program;
+    size_t *worklist;
+    size_t worklist_count = 0u;
+    vm_status_e ret = VM_OK;
+
+    if ((worklist = memory_manager_alloc(program->num_instructions * sizeof(size_t))) == NULL)
+    {
+        return VM_MEMORY_ERROR;
+    }
+
+    for (size_t i = 0u; i < program->num_instructions; i++)
+    {
+        t->depths[i] = -1;
+        t->is_target[i] = 0u;
+    }
+
+    t->depths[0] = 0;
+    worklist[worklist_count++] = 0u;
+
+    while ((0u < worklist_count) && (VM_OK == ret))
+    {
+        size_t i = worklist[--worklist_count];
+        vm_instruction_t *ins = program->instructions + i;
+        int64_t depth = t->depths[i];
+        size_t successors[2];
+        size_t num_successors = 0u;
+
+        switch (_source_opcode(program, ins))
+        {
+            case OPCODE_INT:
+            case OPCODE_FLOAT:
+            case OPCODE_STRING:
+            case OPCODE_BOOL:
+            case OPCODE_LOAD_CONST:
+            case OPCODE_LOAD_LOCAL:
+            case OPCODE_LOAD_GLOBAL:
+                depth += 1;
+                break;
+
+            case OPCODE_ADD:
+            case OPCODE_SUB:
+            case OPCODE_MULT:
+            case OPCODE_DIV:
+            case OPCODE_ADD_INT_INT:
+            case OPCODE_SUB_INT_INT:
+            case OPCODE_MULT_INT_INT:
+            case OPCODE_DIV_INT_INT:
+            case OPCODE_ADD_FLOAT_FLOAT:
+            case OPCODE_SUB_FLOAT_FLOAT:
+            case OPCODE_MULT_FLOAT_FLOAT:
+            case OPCODE_DIV_FLOAT_FLOAT:
+            case OPCODE_EQUAL:
+            case OPCODE_NOT_EQUAL:
+            case OPCODE_LESS:
+            case OPCODE_LESS_EQUAL:
+            case OPCODE_GREATER:
+            case OPCODE_GREATER_EQUAL:
+            case OPCODE_PRINT:
+            case OPCODE_STORE_LOCAL:
+            case OPCODE_STORE_GLOBAL:
+            case OPCODE_JUMP_IF_FALSE:
+            case OPCODE_JUMP_IF_TRUE:
+                depth -= 1;
+                break;
+
+            default:
+                if (bytecode_utils_is_compare_jump(_source_opcode(program, ins)))
+                {
+                    depth -= 2;
+                }
+                break;
+        }
+
+        switch (_source_opcode(program, ins))
+        {
+            case OPCODE_ADD:
+            case OPCODE_SUB:
+            case OPCODE_MULT:
+            case OPCODE_DIV:
+            case OPCODE_ADD_INT_INT:
+            case OPCODE_SUB_INT_INT:
+            case OPCODE_MULT_INT_INT:
+            case OPCODE_DIV_INT_INT:
+            case OPCODE_ADD_FLOAT_FLOAT:
+            case OPCODE_SUB_FLOAT_FLOAT:
+            case OPCODE_MULT_FLOAT_FLOAT:
+            case OPCODE_DIV_FLOAT_FLOAT:
+            case OPCODE_EQUAL:
+            case OPCODE_NOT_EQUAL:
+            case OPCODE_LESS:
+            case OPCODE_LESS_EQUAL:
+            case OPCODE_GREATER:
+            case OPCODE_GREATER_EQUAL:
+            case OPCODE_CAST:
+                // Both operands, or the value being cast, must have been on the stack
+                if (1 > depth)
+                {
+                    ret = VM_UNSUPPORTED;
+                }
+
+                successors[num_successors++] = i + 1u;
+                break;
+
+            case OPCODE_CALL:
+            case OPCODE_TAIL_CALL:
+            case OPCODE_RETURN:
+                // Functions have frames of their own, which are not mapped to registers
+                ret = VM_UNSUPPORTED;
+                break;
+
+            case OPCODE_END:
+                break;
+
+            case OPCODE_JUMP:
+                successors[num_successors++] = (size_t) (ins->target - program->instructions);
+                break;
+
+            default:
+                if (bytecode_utils_is_conditional_jump(_source_opcode(program, ins)))
+                {
+                    successors[num_successors++] = (size_t) (ins->target - program->instructions);
+                }
+
+                successors[num_successors++] = i + 1u;
+                break;
+        }
+
+        if (0 > depth)
+        {
+            ret = VM_UNSUPPORTED;
+        }
+
+        for (size_t j = 0u; (j < num_successors) && (VM_OK == ret); j++)
+        {
+            size_t next = successors[j];
+
+            if (0 > t->depths[next])
+            {
+                t->depths[next] = depth;
+                worklist[worklist_count++] = next;
+            }
+            else if (t->depths[next] != depth)
+            {
+                ret = VM_UNSUPPORTED;
+            }
+        }
+    }
+
+    for (size_t i = 0u; i < program->num_instructions; i++)
+    {
+        opcode_e opcode = _source_opcode(program, program->instructions + i);
+
+        if (bytecode_utils_is_jump(opcode))
+        {
+            t->is_target[program->instructions[i].target - program->instructions] = 1u;
+        }
+    }
+
+    memory_manager_free(worklist);
+    return ret;
+}
+
+
+/* Append a register instruction to the translated program */
+static vm_status_e _emit(translator_t *t, reg_opcode_e opcode, uint32_t dst, uint32_t lhs,
+                         uint32_t rhs, vm_instruction_t *source)
+{
+    vm_register_program_t *output = t->output;
+
+    if (output->num_instructions == t->capacity)
+    {
+        size_t capacity = t->capacity * 2u;
+        vm_register_instruction_t *instructions;
+
+        instructions = memory_manager_realloc(output->instructions,
+                                              capacity * sizeof(vm_register_instruction_t));
+        if (NULL == instructions)
+        {
+            return VM_MEMORY_ERROR;
+        }
+
+        output->instructions = instructions;
+        t->capacity = capacity;
+    }
+
+    vm_register_instruction_t *ins = output->instructions + output->num_instructions;
+
+    ins->opcode = opcode;
+    ins->dst = dst;
+    ins->lhs = lhs;
+    ins->rhs = rhs;
+    ins->compare = COMPARE_EQUAL;
+    ins->target = NULL;
+    ins->source = source;
+
+    output->num_instructions += 1u;
+    return VM_OK;
+}
+
+
+/* Push a constant operand to the simulated data stack */
+static void _push_constant(translator_t *t, value_t value)
+{
+    vm_register_program_t *output = t->output;
+
+    output->constants[output->num_constants] = value;
+    t->operands[t->depth++] = CONSTANT_OPERAND | output->num_constants;
+    output->num_constants += 1u;
+}
+
+
+/* Push the result of an instruction, which is always written to the register
+ * for the stack slot that it would occupy */
+static uint32_t _push_register(translator_t *t)
+{
+    uint32_t reg = (uint32_t) t->depth;
+
+    t->operands[t->depth++] = reg;
+    return reg;
+}
+
+
+/* Move every constant on the simulated data stack into its register, so that
+ * all values are in registers at the start of the next basic block */
+static vm_status_e _flush(translator_t *t)
+{
+    for (size_t i = 0u; i < t->depth; i++)
+    {
+        if (CONSTANT_OPERAND & t->operands[i])
+        {
+            vm_status_e err = _emit(t, REG_OPCODE_MOVE, (uint32_t) i, t->operands[i], 0u, NULL);
+            if (VM_OK != err)
+            {
+                return err;
+            }
+
+            t->operands[i] = (uint32_t) i;
+        }
+    }
+
+    return VM_OK;
+}
+
+
+/* Returns the register opcode for arithmetic on the stack, or NUM_REG_OPCODES */
+static reg_opcode_e _arithmetic_opcode(opcode_e opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+            return REG_OPCODE_ADD;
+        case OPCODE_SUB:
+            return REG_OPCODE_SUB;
+        case OPCODE_MULT:
+            return REG_OPCODE_MULT;
+        case OPCODE_DIV:
+            return REG_OPCODE_DIV;
+        case OPCODE_ADD_INT_INT:
+            return REG_OPCODE_ADD_INT_INT;
+        case OPCODE_SUB_INT_INT:
+            return REG_OPCODE_SUB_INT_INT;
+        case OPCODE_MULT_INT_INT:
+            return REG_OPCODE_MULT_INT_INT;
+        case OPCODE_DIV_INT_INT:
+            return REG_OPCODE_DIV_INT_INT;
+        case OPCODE_ADD_FLOAT_FLOAT:
+            return REG_OPCODE_ADD_FLOAT_FLOAT;
+        case OPCODE_SUB_FLOAT_FLOAT:
+            return REG_OPCODE_SUB_FLOAT_FLOAT;
+        case OPCODE_MULT_FLOAT_FLOAT:
+            return REG_OPCODE_MULT_FLOAT_FLOAT;
+        case OPCODE_DIV_FLOAT_FLOAT:
+            return REG_OPCODE_DIV_FLOAT_FLOAT;
+        default:
+            return NUM_REG_OPCODES;
+    }
+}
+
+
+/* Returns the comparison done by a comparison or compare-and-branch opcode. Each
+ * group of opcodes is in the same order as compare_op_e. */
+static compare_op_e _compare_op(opcode_e opcode)
+{
+    if (OPCODE_JUMP_IF_EQUAL_INT <= opcode)
+    {
+        return (compare_op_e) (opcode - OPCODE_JUMP_IF_EQUAL_INT);
+    }
+
+    if (OPCODE_JUMP_IF_EQUAL <= opcode)
+    {
+        return (compare_op_e) (opcode - OPCODE_JUMP_IF_EQUAL);
+    }
+
+    return (compare_op_e) (opcode - OPCODE_EQUAL);
+}
+
+
+/* Append a comparison or compare-and-branch to the translated program */
+static vm_status_e _emit_compare(translator_t *t, reg_opcode_e opcode, uint32_t dst, uint32_t lhs,
+                                 uint32_t rhs, vm_instruction_t *source)
+{
+    vm_status_e err = _emit(t, opcode, dst, lhs, rhs, source);
+
+    if (VM_OK == err)
+    {
+        opcode_e source_opcode = _source_opcode(t->program, source);
+        t->output->instructions[t->output->num_instructions - 1u].compare = _compare_op(source_opcode);
+    }
+
+    return err;
+}
+
+
+/* Translate a single reachable stack instruction */
+static vm_status_e _translate_instruction(translator_t *t, vm_instruction_t *ins)
+{
+    opcode_e opcode = _source_opcode(t->program, ins);
+    reg_opcode_e arithmetic = _arithmetic_opcode(opcode);
+    uint32_t lhs, rhs, dst;
+    vm_status_e err;
+
+    if (NUM_REG_OPCODES != arithmetic)
+    {
+        rhs = t->operands[--t->depth];
+        lhs = t->operands[--t->depth];
+        dst = _push_register(t);
+        return _emit(t, arithmetic, dst, lhs, rhs, ins);
+    }
+
+    switch (opcode)
+    {
+        case OPCODE_INT:
+            _push_constant(t, INT_VALUE(ins->operand.immediate.int_value));
+            break;
+
+        case OPCODE_FLOAT:
+            _push_constant(t, FLOAT_VALUE(ins->operand.immediate.float_value));
+            break;
+
+        case OPCODE_BOOL:
+            _push_constant(t, BOOL_VALUE(ins->operand.immediate.bool_value));
+            break;
+
+        case OPCODE_STRING:
+            // Same immortal object that the stack engine creates on first execution
+            if (!VALUE_IS_OBJECT(*ins->value))
+            {
+                if (new_string_value(ins->operand.immediate.string.bytes,
+                                     ins->operand.immediate.string.size, ins->value) != 0)
+                {
+                    return VM_MEMORY_ERROR;
+                }
+
+                ins->value->payload.object->refcount = OBJECT_REFCOUNT_IMMORTAL;
+            }
+
+            _push_constant(t, *ins->value);
+            break;
+
+        case OPCODE_LOAD_CONST:
+            _push_constant(t, t->program->constants[ins->operand.const_index]);
+            break;
+
+        case OPCODE_CAST:
+            lhs = t->operands[--t->depth];
+            dst = _push_register(t);
+            return _emit(t, REG_OPCODE_CAST, dst, lhs, 0u, ins);
+
+        case OPCODE_PRINT:
+            lhs = t->operands[--t->depth];
+            return _emit(t, REG_OPCODE_PRINT, 0u, lhs, 0u, ins);
+
+        case OPCODE_LOAD_LOCAL:
+            // Read straight away, since the slot may be stored to before the value is used
+            dst = _push_register(t);
+            return _emit(t, REG_OPCODE_LOAD_LOCAL, dst, ins->operand.local_index, 0u, ins);
+
+        case OPCODE_STORE_LOCAL:
+            lhs = t->operands[--t->depth];
+            return _emit(t, REG_OPCODE_STORE_LOCAL, ins->operand.local_index, lhs, 0u, ins);
+
+        case OPCODE_LOAD_GLOBAL:
+            dst = _push_register(t);
+            return _emit(t, REG_OPCODE_LOAD_GLOBAL, dst, 0u, 0u, ins);
+
+        case OPCODE_STORE_GLOBAL:
+            lhs = t->operands[--t->depth];
+            return _emit(t, REG_OPCODE_STORE_GLOBAL, 0u, lhs, 0u, ins);
+
+        case OPCODE_JUMP:
+            if ((err = _flush(t)) != VM_OK)
+            {
+                return err;
+            }
+
+            return _emit(t, REG_OPCODE_JUMP, 0u, 0u, 0u, ins);
+
+        case OPCODE_JUMP_IF_FALSE:
+            // Condition is above every register written by _flush, so it can't be overwritten
+            lhs = t->operands[--t->depth];
+            if ((err = _flush(t)) != VM_OK)
+            {
+                return err;
+            }
+
+            return _emit(t, REG_OPCODE_JUMP_IF_FALSE, 0u, lhs, 0u, ins);
+
+        case OPCODE_JUMP_IF_TRUE:
+            lhs = t->operands[--t->depth];
+            if ((err = _flush(t)) != VM_OK)
+            {
+                return err;
+            }
+
+            return _emit(t, REG_OPCODE_JUMP_IF_TRUE, 0u, lhs, 0u, ins);
+
+        case OPCODE_EQUAL:
+        case OPCODE_NOT_EQUAL:
+        case OPCODE_LESS:
+        case OPCODE_LESS_EQUAL:
+        case OPCODE_GREATER:
+        case OPCODE_GREATER_EQUAL:
+            rhs = t->operands[--t->depth];
+            lhs = t->operands[--t->depth];
+            dst = _push_register(t);
+            return _emit_compare(t, REG_OPCODE_COMPARE, dst, lhs, rhs, ins);
+
+        case OPCODE_END:
+            if ((err = _flush(t)) != VM_OK)
+            {
+                return err;
+            }
+
+            return _emit(t, REG_OPCODE_END, (uint32_t) t->depth, 0u, 0u, ins);
+
+        default:
+            if (bytecode_utils_is_compare_jump(opcode))
+            {
+                // Operands are above every register written by _flush
+                rhs = t->operands[--t->depth];
+                lhs = t->operands[--t->depth];
+                if ((err = _flush(t)) != VM_OK)
+                {
+                    return err;
+                }
+
+                return _emit_compare(t, (OPCODE_JUMP_IF_EQUAL_INT <= opcode) ?
+                                        REG_OPCODE_JUMP_IF_COMPARE_INT : REG_OPCODE_JUMP_IF_COMPARE,
+                                     0u, lhs, rhs, ins);
+            }
+
+            // NOP and DEFINE_CONST have nothing to do at runtime
+            break;
+    }
+
+    return VM_OK;
+}
+
+
+/* Translate every reachable stack instruction, in program order */
+static vm_status_e _translate(translator_t *t)
+{
+    vm_program_t *program = t->program;
+    int falls_through = 0;
+    vm_status_e err;
+
+    for (size_t i = 0u; i < program->num_instructions; i++)
+    {
+        vm_instruction_t *ins = program->instructions + i;
+
+        if (0 > t->depths[i])
+        {
+            t->map[i] = UNMAPPED;
+            falls_through = 0;
+            continue;
+        }
+
+        if (t->is_target[i] || !falls_through)
+        {
+            // Start of a basic block; every value is in its own register
+            if (falls_through && ((err = _flush(t)) != VM_OK))
+            {
+                return err;
+            }
+
+            t->depth = (size_t) t->depths[i];
+            for (size_t j = 0u; j < t->depth; j++)
+            {
+                t->operands[j] = (uint32_t) j;
+            }
+        }
+
+        t->map[i] = t->output->num_instructions;
+
+        if ((err = _translate_instruction(t, ins)) != VM_OK)
+        {
+            return err;
+        }
+
+        opcode_e opcode = _source_opcode(program, ins);
+        falls_through = (OPCODE_JUMP != opcode) && !bytecode_utils_is_exit(opcode);
+    }
+
+    return VM_OK;
+}
+
+
+/* Resolve jump targets and constant operands, once all instructions exist */
+static void _resolve(translator_t *t)
+{
+    vm_register_program_t *output = t->output;
+
+    for (size_t i = 0u; i < output->num_instructions; i++)
+    {
+        vm_register_instruction_t *ins = output->instructions + i;
+
+        if (CONSTANT_OPERAND & ins->lhs)
+        {
+            ins->lhs = output->num_registers + (ins->lhs & ~CONSTANT_OPERAND);
+        }
+
+        if (CONSTANT_OPERAND & ins->rhs)
+        {
+            ins->rhs = output->num_registers + (ins->rhs & ~CONSTANT_OPERAND);
+        }
+
+        if ((REG_OPCODE_JUMP == ins->opcode) || (REG_OPCODE_JUMP_IF_FALSE == ins->opcode) ||
+            (REG_OPCODE_JUMP_IF_TRUE == ins->opcode) || (REG_OPCODE_JUMP_IF_COMPARE == ins->opcode) ||
+            (REG_OPCODE_JUMP_IF_COMPARE_INT == ins->opcode))
+        {
+            size_t target = (size_t) (ins->source->target - t->program->instructions);
+            ins->target = output->instructions + t->map[target];
+        }
+    }
+}
+
+
+/**
+ * @see register_vm_api.h
+ */
+vm_status_e register_vm_translate(vm_program_t *program)
+{
+    vm_register_program_t *output = &program->registers;
+    size_t num_instructions = program->num_instructions;
+    translator_t t;
+    vm_status_e ret;
+
+    output->instructions = NULL;
+    output->num_instructions = 0u;
+    output->num_registers = 0u;
+    output->constants = NULL;
+    output->num_constants = 0u;
+
+    t.program = program;
+    t.output = output;
+    t.capacity = num_instructions;
+    t.depth = 0u;
+    t.depths = memory_manager_alloc(num_instructions * sizeof(int64_t));
+    t.is_target = memory_manager_alloc(num_instructions * sizeof(uint8_t));
+    t.map = memory_manager_alloc(num_instructions * sizeof(size_t));
+
+    // Each stack instruction pushes at most one value
+    t.operands = memory_manager_alloc(num_instructions * sizeof(uint32_t));
+    output->constants = memory_manager_alloc(num_instructions * sizeof(value_t));
+    output->instructions = memory_manager_alloc(t.capacity * sizeof(vm_register_instruction_t));
+
+    if ((NULL == t.depths) || (NULL == t.is_target) || (NULL == t.map) ||
+        (NULL == t.operands) || (NULL == output->constants) || (NULL == output->instructions))
+    {
+        ret = VM_MEMORY_ERROR;
+    }
+    else if ((ret = _find_depths(&t)) == VM_OK)
+    {
+        ret = _translate(&t);
+    }
+
+    if (VM_OK == ret)
+    {
+        for (size_t i = 0u; i < num_instructions; i++)
+        {
+            if ((int64_t) output->num_registers < t.depths[i])
+            {
+                output->num_registers = (uint32_t) t.depths[i];
+            }
+        }
+
+        _resolve(&t);
+    }
+    else
+    {
+        register_vm_unload(program);
+    }
+
+    memory_manager_free(t.depths);
+    memory_manager_free(t.is_target);
+    memory_manager_free(t.map);
+    memory_manager_free(t.operands);
+    return ret;
+}
+
+
+/**
+ * @see register_vm_api.h
+ */
+void register_vm_unload(vm_program_t *program)
+{
+    // Constants are copies of values owned by the stack program
+    memory_manager_free(program->registers.instructions);
+    memory_manager_free(program->registers.constants);
+    program->registers.instructions = NULL;
+    program->registers.num_instructions = 0u;
+    program->registers.constants = NULL;
+    program->registers.num_constants = 0u;
+}
+
+
+/* Generic arithmetic, using the inline cache of the stack instruction */
+static vm_register_instruction_t *_binary_op(vm_register_instruction_t *ins, value_t *regs,
+                                             binary_op_e op_type)
+{
+    vm_inline_cache_t *cache = ins->source->cache;
+    value_t lhs = regs[ins->lhs];
+    value_t rhs = regs[ins->rhs];
+    value_t result;
+
+    if ((cache->lhs_type == lhs.type) && (cache->rhs_type == rhs.type))
+    {
+        cache->hits += 1u;
+    }
+    else
+    {
+        cache->misses += 1u;
+        cache->func.binary = type_binary_op_lookup(lhs.type, rhs.type);
+        if (NULL == cache->func.binary)
+        {
+            cache->lhs_type = NUM_DATATYPES;
+            RUNTIME_ERR(RUNTIME_ERROR_ARITHMETIC, "Can't do that arithmetic\n");
+            RELEASE_VALUE(lhs);
+            RELEASE_VALUE(rhs);
+            return NULL;
+        }
+
+        cache->lhs_type = lhs.type;
+        cache->rhs_type = rhs.type;
+    }
+
+    if (cache->func.binary(&lhs, &rhs, &result, op_type) != TYPE_OK)
+    {
+        RELEASE_VALUE(lhs);
+        RELEASE_VALUE(rhs);
+        return NULL;
+    }
+
+    RELEASE_VALUE(lhs);
+    RELEASE_VALUE(rhs);
+
+    regs[ins->dst] = result;
+    return ins + 1;
+}
+
+
+/* Cast, using the inline cache of the stack instruction */
+static vm_register_instruction_t *_cast(vm_register_instruction_t *ins, value_t *regs)
+{
+    vm_instruction_t *source = ins->source;
+    vm_inline_cache_t *cache = source->cache;
+    value_t input = regs[ins->lhs];
+    value_t output;
+
+    if (source->operand.cast.data_type == input.type)
+    {
+        regs[ins->dst] = input;
+        return ins + 1;
+    }
+
+    if (cache->lhs_type == input.type)
+    {
+        cache->hits += 1u;
+    }
+    else
+    {
+        cache->misses += 1u;
+        cache->func.cast = type_cast_lookup(input.type, source->operand.cast.data_type);
+        if (NULL == cache->func.cast)
+        {
+            cache->lhs_type = NUM_DATATYPES;
+            RUNTIME_ERR(RUNTIME_ERROR_CAST, "Invalid cast");
+            RELEASE_VALUE(input);
+            return NULL;
+        }
+
+        cache->lhs_type = input.type;
+    }
+
+    if (cache->func.cast(&input, &output, source->operand.cast.extra_data) != TYPE_OK)
+    {
+        RELEASE_VALUE(input);
+        return NULL;
+    }
+
+    RELEASE_VALUE(input);
+
+    regs[ins->dst] = output;
+    return ins + 1;
+}
+
+
+/* Test the truth value of a register, and jump if it matches the value given */
+static vm_register_instruction_t *_conditional_jump(vm_register_instruction_t *ins, value_t *regs,
+                                                    uint8_t jump_when)
+{
+    value_t value = regs[ins->lhs];
+
+    uint8_t truth = type_is_true(&value);
+    RELEASE_VALUE(value);
+
+    return (jump_when == truth) ? ins->target : ins + 1;
+}
+
+
+/* Compare two registers, and store the result. Returns 0 on error. */
+static int _compare(vm_register_instruction_t *ins, value_t *regs, vm_bool_t *result)
+{
+    value_t lhs = regs[ins->lhs];
+    value_t rhs = regs[ins->rhs];
+
+    if (type_compare(&lhs, &rhs, ins->compare, result) != TYPE_OK)
+    {
+        RUNTIME_ERR(RUNTIME_ERROR_ARITHMETIC, "Can't compare those types");
+        RELEASE_VALUE(lhs);
+        RELEASE_VALUE(rhs);
+        return 0;
+    }
+
+    RELEASE_VALUE(lhs);
+    RELEASE_VALUE(rhs);
+    return 1;
+}
+
+
+/* Compare two ints whose types were proven by type inference */
+static inline int _compare_ints(vm_int_t lhs, vm_int_t rhs, compare_op_e op_type)
+{
+    switch (op_type)
+    {
+        case COMPARE_EQUAL:
+            return lhs == rhs;
+        case COMPARE_NOT_EQUAL:
+            return lhs != rhs;
+        case COMPARE_LESS:
+            return lhs < rhs;
+        case COMPARE_LESS_EQUAL:
+            return lhs <= rhs;
+        case COMPARE_GREATER:
+            return lhs > rhs;
+        default:
+            return lhs >= rhs;
+    }
+}
+
+
+/* Address of the value of the global variable named by a LOAD_GLOBAL or
+ * STORE_GLOBAL instruction, taken from its inline cache if it is still valid */
+static inline value_t *_global(vm_instance_t *instance, vm_instruction_t *source, uint8_t insert)
+{
+    value_t *slot = GLOBALS_CACHED_SLOT(&instance->globals, source->cache);
+
+    if (NULL != slot)
+    {
+        return slot;
+    }
+
+    return globals_resolve(&instance->globals, source->cache,
+                           VALUE_STRING(instance->constants[source->operand.const_index]), insert);
+}
+
+
+/**
+ * @see register_vm_api.h
+ */
+vm_status_e register_vm_execute(vm_instance_t *instance, vm_program_t *program)
+{
+    vm_register_program_t *registers = &program->registers;
+    callstack_frame_t *frame = instance->callstack.current_frame;
+
+    if (DATA_STACK_OK != data_stack_reserve(frame, registers->num_registers +
+                                                   registers->num_constants))
+    {
+        return VM_MEMORY_ERROR;
+    }
+
+    // Registers start at the current top of the data stack, followed by the constants
+    value_t *regs = frame->sp;
+    (void) memcpy(regs + registers->num_registers, registers->constants,
+                  registers->num_constants * sizeof(value_t));
+
+    vm_register_instruction_t *ip = registers->instructions;
+
+    while (NULL != ip)
+    {
+        switch (ip->opcode)
+        {
+            case REG_OPCODE_MOVE:
+                regs[ip->dst] = regs[ip->lhs];
+                ip += 1;
+                break;
+
+            case REG_OPCODE_ADD:
+                ip = _binary_op(ip, regs, BINARY_ADD);
+                break;
+
+            case REG_OPCODE_SUB:
+                ip = _binary_op(ip, regs, BINARY_SUB);
+                break;
+
+            case REG_OPCODE_MULT:
+                ip = _binary_op(ip, regs, BINARY_MULT);
+                break;
+
+            case REG_OPCODE_DIV:
+                ip = _binary_op(ip, regs, BINARY_DIV);
+                break;
+
+            case REG_OPCODE_ADD_INT_INT:
+                TYPED_BINARY_OP(regs, ip, INT_VALUE, int_value, +);
+                ip += 1;
+                break;
+
+            case REG_OPCODE_SUB_INT_INT:
+                TYPED_BINARY_OP(regs, ip, INT_VALUE, int_value, -);
+                ip += 1;
+                break;
+
+            case REG_OPCODE_MULT_INT_INT:
+                TYPED_BINARY_OP(regs, ip, INT_VALUE, int_value, *);
+                ip += 1;
+                break;
+
+            case REG_OPCODE_DIV_INT_INT:
+                if (0 == regs[ip->rhs].payload.int_value)
+                {
+                    RUNTIME_ERR(RUNTIME_ERROR_ARITHMETIC, "Division by zero");
+                    return VM_RUNTIME_ERROR;
+                }
+
+                TYPED_BINARY_OP(regs, ip, INT_VALUE, int_value, /);
+                ip += 1;
+                break;
+
+            case REG_OPCODE_ADD_FLOAT_FLOAT:
+                TYPED_BINARY_OP(regs, ip, FLOAT_VALUE, float_value, +);
+                ip += 1;
+                break;
+
+            case REG_OPCODE_SUB_FLOAT_FLOAT:
+                TYPED_BINARY_OP(regs, ip, FLOAT_VALUE, float_value, -);
+                ip += 1;
+                break;
+
+            case REG_OPCODE_MULT_FLOAT_FLOAT:
+                TYPED_BINARY_OP(regs, ip, FLOAT_VALUE, float_value, *);
+                ip += 1;
+                break;
+
+            case REG_OPCODE_DIV_FLOAT_FLOAT:
+                TYPED_BINARY_OP(regs, ip, FLOAT_VALUE, float_value, /);
+                ip += 1;
+                break;
+
+            case REG_OPCODE_CAST:
+                ip = _cast(ip, regs);
+                break;
+
+            case REG_OPCODE_PRINT:
+                print_value(regs + ip->lhs);
+                RELEASE_VALUE(regs[ip->lhs]);
+                ip += 1;
+                break;
+
+            case REG_OPCODE_JUMP:
+                ip = ip->target;
+                break;
+
+            case REG_OPCODE_JUMP_IF_FALSE:
+                ip = _conditional_jump(ip, regs, 0u);
+                break;
+
+            case REG_OPCODE_JUMP_IF_TRUE:
+                ip = _conditional_jump(ip, regs, 1u);
+                break;
+
+            case REG_OPCODE_COMPARE:
+            {
+                vm_bool_t result;
+
+                if (!_compare(ip, regs, &result))
+                {
+                    return VM_RUNTIME_ERROR;
+                }
+
+                regs[ip->dst] = BOOL_VALUE(result);
+                ip += 1;
+                break;
+            }
+
+            case REG_OPCODE_JUMP_IF_COMPARE:
+            {
+                vm_bool_t result;
+
+                if (!_compare(ip, regs, &result))
+                {
+                    return VM_RUNTIME_ERROR;
+                }
+
+                ip = (result) ? ip->target : ip + 1;
+                break;
+            }
+
+            case REG_OPCODE_JUMP_IF_COMPARE_INT:
+                ip = _compare_ints(regs[ip->lhs].payload.int_value, regs[ip->rhs].payload.int_value,
+                                   ip->compare) ? ip->target : ip + 1;
+                break;
+
+            case REG_OPCODE_LOAD_LOCAL:
+                regs[ip->dst] = frame->locals[ip->lhs];
+                RETAIN_VALUE(regs[ip->dst]);
+                ip += 1;
+                break;
+
+            case REG_OPCODE_STORE_LOCAL:
+                store_value(frame->locals + ip->dst, regs[ip->lhs]);
+                ip += 1;
+                break;
+
+            case REG_OPCODE_LOAD_GLOBAL:
+            {
+                value_t *slot = _global(instance, ip->source, 0u);
+                if (NULL == slot)
+                {
+                    return VM_RUNTIME_ERROR;
+                }
+
+                regs[ip->dst] = *slot;
+                RETAIN_VALUE(*slot);
+                ip += 1;
+                break;
+            }
+
+            case REG_OPCODE_STORE_GLOBAL:
+            {
+                value_t *slot = _global(instance, ip->source, 1u);
+                if (NULL == slot)
+                {
+                    return VM_RUNTIME_ERROR;
+                }
+
+                store_value(slot, regs[ip->lhs]);
+                ip += 1;
+                break;
+            }
+
+            case REG_OPCODE_END:
+                // Leave the values that would be on the stack at the end of the program
+                frame->sp = regs + ip->dst;
+                return VM_OK;
+
+            default:
+                RUNTIME_ERR(RUNTIME_ERROR_INTERNAL, "invalid register opcode %d", ip->opcode);
+                return VM_RUNTIME_ERROR;
+        }
+    }
+
+    return VM_RUNTIME_ERROR;
+}
@@ -0,0 +1,53 @@
+/**
+ * Register-based execution engine. Loaded stack programs are translated into
+ * three-address instructions (e.g. ADD r1, r2, r3), where each register is a
+ * slot of the data stack, and immediate values and constants are operands of
+ * the instructions that use them instead of being pushed separately.
+ */
+
+#ifndef REGISTER_VM_API_H_
+#define REGISTER_VM_API_H_
+
+
+#include "vm_api.h"
+#include "runtime_common.h"
+
+
+/**
+ * Translate a program loaded by vm_load into register-based instructions, and
+ * store them in program->registers. Register N holds the value that would be
+ * at depth N of the data stack, and values are only moved into registers at
+ * the start of basic blocks, so jumps see the same register contents no matter
+ * which path they came from. String objects for OPCODE_STRING instructions
+ * are created here, in the slots that the stack engine would use.
+ *
+ * @param    program    Pointer to loaded program to translate
+ *
+ * @return   VM_OK if successful, VM_UNSUPPORTED if the data stack depth at
+ *           any instruction depends on the path taken to reach it
+ */
+vm_status_e register_vm_translate(vm_program_t *program);
+
+
+/**
+ * Free the register-based instructions created by register_vm_translate
+ *
+ * @param    program    Pointer to loaded program
+ */
+void register_vm_unload(vm_program_t *program);
+
+
+/**
+ * Execute the register-based translation of a loaded program. The registers
+ * are placed on the data stack of the current callstack frame, so the data
+ * stack holds the same values afterwards as it would with the stack engine.
+ *
+ * @param    instance    Pointer to VM instance to execute the program on
+ * @param    program     Pointer to translated program to execute
+ *
+ * @return   VM_OK if execution completed successfully
+ */
+vm_status_e register_vm_execute(vm_instance_t *instance, vm_program_t *program);
+
+
+#endif /* REGISTER_VM_API_H_ */
@@ -5,7 +5,11 @@
 #include "data_types.h"
 #include "byte_string_api.h"
 #include "ulist_api.h"
+#include "hashtable_api.h"
 #include "runtime_error_api.h"
+#include "bytecode_common.h"
+#include "bytecode_utils_api.h"
+#include "type_operations_api.h"
 
 
 #define __RUNTIME_ERR(file, line, error_code, fmt, ...)                       \
@@ -103,13 +107,265 @@
     while (0)
 
 
+/* Structure representing a single instruction in a loaded program */
+typedef struct vm_instruction vm_instruction_t;
+
+
+/* Hot loop state for a single backward jump, see jit_api.h */
+typedef struct
+{
+    uint32_t count;                // Number of times the backward jump was taken
+    uint32_t abandoned;            // Nonzero if the loop could not be traced
+    uint8_t *code;                 // Executable buffer holding the trace, or NULL
+    size_t size;                   // Size of the executable buffer in bytes
+    uint8_t *entry;                // Start of the native code for the trace
+} vm_loop_t;
+
+
+#ifdef VM_BRANCH_PROFILE
+
+/* Number of times a single conditional jump went each way, see
+ * vm_branch_profile_write */
+typedef struct
+{
+    uint64_t taken;                // Executions that jumped to the target
+    uint64_t not_taken;            // Executions that continued with the next instruction
+} vm_branch_count_t;
+
+#endif /* VM_BRANCH_PROFILE */
+
+
 /* Structure for data representing a VM instance */
+typedef struct vm_instance vm_instance_t;
+
+
+/* Handler function for opcodes. Returns a pointer to the next instruction to
+ * execute, or NULL if a runtime error occurred */
+typedef vm_instruction_t *(*op_handler_t)(vm_instruction_t *, vm_instance_t *);
+
+
+/**
+ * Inline cache for a single ADD/SUB/MULT/DIV or CAST instruction. Holds the
+ * type operation function that was resolved for the operand types seen the
+ * last time the instruction was executed, so that it can be called directly
+ * the next time the same operand types are seen.
+ *
+ * LOAD_GLOBAL and STORE_GLOBAL instructions use the same cache to hold the
+ * address of the value of their global variable, which stays valid for as
+ * long as the version of the globals table is unchanged (see globals_api.h).
+ */
 typedef struct
+{
+    data_type_e lhs_type;          // Type of the LHS operand, or of the value being cast
+    data_type_e rhs_type;          // Type of the RHS operand (unused for casts)
+    union
+    {
+        binary_func_t binary;      // ADD, SUB, MULT, DIV
+        cast_func_t cast;          // CAST
+        value_t *global;           // LOAD_GLOBAL, STORE_GLOBAL
+    } func;
+    uint64_t version;              // Globals table version that func.global was found in
+    size_t hits;                   // Executions that used the cached function (not counted for globals)
+    size_t misses;                 // Executions that had to look up the function
+} vm_inline_cache_t;
+
+
+/**
+ * Global variables of a VM instance. Names are cached strings, so that entries
+ * can be found by comparing string pointers.
+ */
+typedef struct
+{
+    hashtable_t table;             // Value of each global, keyed by the bytes of its cached name
+    uint64_t version;              // Changed whenever a global is added or deleted
+    size_t count;                  // Number of globals
+} vm_globals_t;
+
+
+struct vm_instruction
+{
+    op_handler_t handler;          // Handler for this instruction
+    opcode_e opcode;               // Opcode, used by the dispatch engines
+    uint32_t offset;               // Offset of instruction in the bytecode, in bytes
+    bytecode_operand_t operand;    // Decoded operands
+    vm_instruction_t *target;      // Resolved target of jump instructions
+    vm_inline_cache_t *cache;      // Inline cache, for arithmetic and casts only
+    value_t *value;                // Value pushed by VM_OPCODE_LOAD_VALUE
+    vm_loop_t *loop;               // Hot loop state, for backward jumps only
+#ifdef VM_BRANCH_PROFILE
+    vm_branch_count_t *branch;     // Branch counts, for conditional jumps only
+#endif /* VM_BRANCH_PROFILE */
+};
+
+
+/* Opcodes of the register-based instruction format, see register_vm_api.h */
+typedef enum
+{
+    REG_OPCODE_MOVE,                 // dst = lhs
+    REG_OPCODE_ADD,                  // dst = lhs + rhs
+    REG_OPCODE_SUB,                  // dst = lhs - rhs
+    REG_OPCODE_MULT,                 // dst = lhs * rhs
+    REG_OPCODE_DIV,                  // dst = lhs / rhs
+    REG_OPCODE_ADD_INT_INT,          // ADD, both operands are known to be ints
+    REG_OPCODE_SUB_INT_INT,          // SUB, both operands are known to be ints
+    REG_OPCODE_MULT_INT_INT,         // MULT, both operands are known to be ints
+    REG_OPCODE_DIV_INT_INT,          // DIV, both operands are known to be ints
+    REG_OPCODE_ADD_FLOAT_FLOAT,      // ADD, both operands are known to be floats
+    REG_OPCODE_SUB_FLOAT_FLOAT,      // SUB, both operands are known to be floats
+    REG_OPCODE_MULT_FLOAT_FLOAT,     // MULT, both operands are known to be floats
+    REG_OPCODE_DIV_FLOAT_FLOAT,      // DIV, both operands are known to be floats
+    REG_OPCODE_CAST,                 // dst = lhs cast to another type
+    REG_OPCODE_PRINT,                // Print lhs
+    REG_OPCODE_JUMP,                 // Jump to target unconditionally
+    REG_OPCODE_JUMP_IF_FALSE,        // Jump to target if lhs is false
+    REG_OPCODE_JUMP_IF_TRUE,         // Jump to target if lhs is true
+    REG_OPCODE_COMPARE,              // dst = result of comparing lhs with rhs
+    REG_OPCODE_JUMP_IF_COMPARE,      // Jump to target if comparing lhs with rhs is true
+    REG_OPCODE_JUMP_IF_COMPARE_INT,  // JUMP_IF_COMPARE, both operands are known to be ints
+    REG_OPCODE_LOAD_LOCAL,           // dst = local variable slot lhs
+    REG_OPCODE_STORE_LOCAL,          // Local variable slot dst = lhs
+    REG_OPCODE_LOAD_GLOBAL,          // dst = global variable named by the source instruction
+    REG_OPCODE_STORE_GLOBAL,         // Global variable named by the source instruction = lhs
+    REG_OPCODE_END,                  // End of the program, dst is the final stack depth
+    NUM_REG_OPCODES
+} reg_opcode_e;
+
+
+/* Structure representing a single register-based instruction */
+typedef struct vm_register_instruction vm_register_instruction_t;
+
+struct vm_register_instruction
+{
+    reg_opcode_e opcode;
+    uint32_t dst;                          // Index of the register written
+    uint32_t lhs;                          // Index of the first operand
+    uint32_t rhs;                          // Index of the second operand
+    compare_op_e compare;                  // Comparison, for REG_OPCODE_COMPARE and compare-and-branch
+    vm_register_instruction_t *target;     // Resolved target of jump instructions
+    vm_instruction_t *source;              // Stack instruction this was translated from
+};
+
+
+/**
+ * Register-based translation of a loaded program. Operands index a single
+ * array of values, holding the registers followed by the constants, so an
+ * operand can refer to either without being decoded.
+ */
+typedef struct
+{
+    vm_register_instruction_t *instructions;  // Translated instructions, or NULL if unavailable
+    size_t num_instructions;                  // Number of translated instructions
+    uint32_t num_registers;                   // Registers used, one per data stack slot
+    value_t *constants;                       // Constant operands, copied after the registers
+    uint32_t num_constants;                   // Number of constant operands
+} vm_register_program_t;
+
+
+/* Native code compiled from a loaded program, see jit_api.h */
+typedef struct
+{
+    uint8_t *code;             // Executable buffer holding the native code, or NULL
+    size_t size;               // Size of the executable buffer in bytes
+    uint8_t **entries;         // Address of the native code for each instruction
+    size_t executions;         // Number of times the program was run with VM_ENGINE_JIT
+} vm_jit_code_t;
+
+
+/* Shared object compiled ahead of time from a program, see aot_api.h */
+typedef struct
+{
+    void *library;             // Handle returned by dlopen, or NULL
+    void *entry;               // Address of the compiled program
+} vm_aot_code_t;
+
+
+/**
+ * Structure representing a program that has been decoded from bytecode and
+ * is ready to be executed. Jump targets and operands are resolved once at load
+ * time, so the handlers never need to decode the packed bytecode.
+ */
+typedef struct
+{
+    vm_instruction_t *instructions;  // Array of decoded instructions, ending in OPCODE_END
+    size_t num_instructions;         // Number of decoded instructions
+    size_t max_stack_depth;          // Maximum depth reached by the data stack
+    uint8_t unchecked;               // 1 if the depth was proven, and the handlers don't check it
+    value_t *constants;              // Constant pool, built from OPCODE_DEFINE_CONST
+    uint32_t num_constants;          // Number of values in the constant pool
+    uint32_t num_locals;             // Number of local variable slots used by the program
+    vm_inline_cache_t *caches;       // Inline caches for arithmetic and casts
+    size_t num_caches;               // Number of inline caches
+    value_t *strings;                // Strings created by quickened OPCODE_STRING instructions
+    size_t num_strings;              // Number of OPCODE_STRING instructions
+    bytecode_t *bytecode;            // Bytecode that this program was loaded from
+    vm_register_program_t registers; // Register-based translation, for VM_ENGINE_REGISTER
+    vm_jit_code_t jit;               // Native code, for VM_ENGINE_JIT
+    vm_aot_code_t aot;               // Shared object loaded by aot_load, for VM_ENGINE_AOT
+    vm_loop_t *loops;                // Hot loop state for each backward jump
+    size_t num_loops;                // Number of backward jumps
+#ifdef VM_BRANCH_PROFILE
+    vm_branch_count_t *branches;     // Branch counts for each conditional jump
+    size_t num_branches;             // Number of conditional jumps
+#endif /* VM_BRANCH_PROFILE */
+} vm_program_t;
+
+
+#ifdef VM_TRACE
+
+/* Number of entries in the instruction trace ring buffer (must be a power of 2) */
+#ifndef VM_TRACE_ENTRIES
+#define VM_TRACE_ENTRIES (64u)
+#endif
+
+/* A single executed instruction, as recorded in the trace ring buffer */
+typedef struct
+{
+    uint32_t offset;       // Offset of the instruction in the bytecode, in bytes
+    opcode_t opcode;       // Opcode of the instruction
+    uint32_t stack_depth;  // Data stack depth before the instruction was executed
+} vm_trace_entry_t;
+
+/* Ring buffer holding the last VM_TRACE_ENTRIES executed instructions */
+typedef struct
+{
+    vm_trace_entry_t entries[VM_TRACE_ENTRIES];
+    size_t count;          // Total instructions recorded since the last vm_execute
+    bytecode_t *program;   // Program being traced
+} vm_trace_t;
+
+#endif /* VM_TRACE */
+
+
+#ifdef VM_PROFILE
+
+/* Counts of opcode sequences executed one after another, see vm_profile_write */
+typedef struct
+{
+    uint64_t pairs[NUM_OPCODES][NUM_OPCODES];
+    uint64_t triples[NUM_OPCODES][NUM_OPCODES][NUM_OPCODES];
+    const vm_instruction_t *previous;  // Last instruction executed
+    opcode_t history[2];               // Opcodes of the last two instructions in sequence
+    size_t history_length;             // Number of valid opcodes in history
+    bytecode_t *program;               // Program being profiled
+} vm_profile_t;
+
+#endif /* VM_PROFILE */
+
+
+struct vm_instance
 {
     runtime_error_e runtime_error;
     callstack_t callstack;
-    ulist_t constants;
-} vm_instance_t;
+    value_t *constants;  // Constant pool of the program being executed
+    vm_globals_t globals;
+    uint8_t trace_loops; // Nonzero if backward jumps count towards traces (VM_ENGINE_TRACE_JIT)
+#ifdef VM_TRACE
+    vm_trace_t trace;
+#endif /* VM_TRACE */
+#ifdef VM_PROFILE
+    vm_profile_t *profile;
+#endif /* VM_PROFILE */
+};
 
 
 #endif /* RUNTIME_COMMON_H_ */
@@ -9,6 +9,7 @@ typedef enum
     RUNTIME_ERROR_ARITHMETIC,
     RUNTIME_ERROR_CAST,
     RUNTIME_ERROR_INTERNAL,
+    RUNTIME_ERROR_NAME,
     NUM_RUNTIME_ERRORS
 } runtime_error_e;
 
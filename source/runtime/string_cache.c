@@ -1,6 +1,11 @@
 #include <string.h>
 #include <stdint.h>
 #include "string_cache_api.h"
+#include "memory_manager_api.h"
+
+
+/* Strings shorter than this are null-terminated on the stack for lookup */
+#define LOOKUP_KEY_STACK_SIZE (256u)
 
 
 static hashtable_t string_table;
@@ -105,17 +110,12 @@ string_cache_status_e string_cache_stats(string_cache_stats_t *stats)
 
 
 /**
- * @see string_cache_api.h
+ * Add a null-terminated string to the cache. Keys are compared with strcmp,
+ * so the string must be terminated even though its size is also given.
  */
-string_cache_status_e string_cache_add(char *string_to_add,
-                                       unsigned size,
-                                       byte_string_t **cached_string)
+static string_cache_status_e _cache_add(char *string_to_add, unsigned size,
+                                        byte_string_t **cached_string)
 {
-    if (NULL == string_to_add)
-    {
-        return STRING_CACHE_INVALID_PARAM;
-    }
-
     string_cache_status_e ret = STRING_CACHE_ALREADY_CACHED;
     byte_string_t *cached;
     hashtable_status_e err;
@@ -159,3 +159,43 @@ string_cache_status_e string_cache_add(char *string_to_add,
 
     return ret;
 }
+
+
+/**
+ * @see string_cache_api.h
+ */
+string_cache_status_e string_cache_add(char *string_to_add,
+                                       unsigned size,
+                                       byte_string_t **cached_string)
+{
+    char stack_key[LOOKUP_KEY_STACK_SIZE];
+    char *key = stack_key;
+    string_cache_status_e ret;
+
+    if (NULL == string_to_add)
+    {
+        return STRING_CACHE_INVALID_PARAM;
+    }
+
+    /* Strings are not always null-terminated (e.g. string data in bytecode),
+     * so take a terminated copy to use as the key */
+    if (LOOKUP_KEY_STACK_SIZE <= size)
+    {
+        if ((key = memory_manager_alloc(size + 1u)) == NULL)
+        {
+            return STRING_CACHE_MEMORY_ERROR;
+        }
+    }
+
+    (void) memcpy(key, string_to_add, size);
+    key[size] = '\0';
+
+    ret = _cache_add(key, size, cached_string);
+
+    if (stack_key != key)
+    {
+        memory_manager_free(key);
+    }
+
+    return ret;
+}
@@ -0,0 +1,229 @@
+/**
+ * Handlers for superinstructions (see superinstructions.h), included by
+ * opcode_handlers.c only. Each one runs the handlers of every instruction in
+ * the sequence directly, so they can be inlined into a single body, and returns
+ * the next instruction to the dispatch engine once at the end. The first
+ * instruction holds the superinstruction opcode, so it is run by _execute_first.
+ * The other instructions are decoded separately, and may have been specialised
+ * by type inference or quickened, so their opcodes are checked before picking
+ * a handler.
+ *
+ * Generated by tools/gen_superinstructions.py from tools/opcode_profile.txt;
+ * do not edit by hand, run "make superinstructions" to regenerate.
+ */
+
+#ifndef SUPERINSTRUCTION_HANDLERS_H_
+#define SUPERINSTRUCTION_HANDLERS_H_
+
+
+/**
+ * LOAD_LOCAL, INT
+ */
+vm_instruction_t *HANDLER(opcode_handler_load_local_int)(vm_instruction_t *ins,
+                                                         vm_instance_t *instance)
+{
+    vm_instruction_t *next = _execute_first(ins, instance, OPCODE_LOAD_LOCAL);
+
+    if (NULL == next)
+    {
+        return NULL;
+    }
+
+    return HANDLER(opcode_handler_int)(next, instance);
+}
+
+
+/**
+ * LOAD_LOCAL, INT, JUMP_IF_GREATER_EQUAL
+ */
+vm_instruction_t *HANDLER(opcode_handler_load_local_int_jump_if_greater_equal)(vm_instruction_t *ins,
+                                                                               vm_instance_t *instance)
+{
+    vm_instruction_t *next = _execute_first(ins, instance, OPCODE_LOAD_LOCAL);
+
+    if (NULL == next)
+    {
+        return NULL;
+    }
+
+    next = HANDLER(opcode_handler_int)(next, instance);
+
+    if (NULL == next)
+    {
+        return NULL;
+    }
+
+    switch ((int) next->opcode)
+    {
+        case OPCODE_JUMP_IF_GREATER_EQUAL_INT:
+            return HANDLER(opcode_handler_jump_if_greater_equal_int)(next, instance);
+
+        default:
+            return HANDLER(opcode_handler_jump_if_greater_equal)(next, instance);
+    }
+}
+
+
+/**
+ * INT, ADD, STORE_LOCAL
+ */
+vm_instruction_t *HANDLER(opcode_handler_int_add_store_local)(vm_instruction_t *ins,
+                                                              vm_instance_t *instance)
+{
+    vm_instruction_t *next = _execute_first(ins, instance, OPCODE_INT);
+
+    if (NULL == next)
+    {
+        return NULL;
+    }
+
+    switch ((int) next->opcode)
+    {
+        case OPCODE_ADD_FLOAT_FLOAT:
+            next = HANDLER(opcode_handler_add_float_float)(next, instance);
+            break;
+
+        case OPCODE_ADD_INT_INT:
+            next = HANDLER(opcode_handler_add_int_int)(next, instance);
+            break;
+
+        default:
+            next = HANDLER(opcode_handler_add)(next, instance);
+            break;
+    }
+
+    if (NULL == next)
+    {
+        return NULL;
+    }
+
+    return HANDLER(opcode_handler_store_local)(next, instance);
+}
+
+
+/**
+ * LOAD_LOCAL, INT, ADD
+ */
+vm_instruction_t *HANDLER(opcode_handler_load_local_int_add)(vm_instruction_t *ins,
+                                                             vm_instance_t *instance)
+{
+    vm_instruction_t *next = _execute_first(ins, instance, OPCODE_LOAD_LOCAL);
+
+    if (NULL == next)
+    {
+        return NULL;
+    }
+
+    next = HANDLER(opcode_handler_int)(next, instance);
+
+    if (NULL == next)
+    {
+        return NULL;
+    }
+
+    switch ((int) next->opcode)
+    {
+        case OPCODE_ADD_FLOAT_FLOAT:
+            return HANDLER(opcode_handler_add_float_float)(next, instance);
+
+        case OPCODE_ADD_INT_INT:
+            return HANDLER(opcode_handler_add_int_int)(next, instance);
+
+        default:
+            return HANDLER(opcode_handler_add)(next, instance);
+    }
+}
+
+
+/**
+ * INT, JUMP_IF_GREATER_EQUAL
+ */
+vm_instruction_t *HANDLER(opcode_handler_int_jump_if_greater_equal)(vm_instruction_t *ins,
+                                                                    vm_instance_t *instance)
+{
+    vm_instruction_t *next = _execute_first(ins, instance, OPCODE_INT);
+
+    if (NULL == next)
+    {
+        return NULL;
+    }
+
+    switch ((int) next->opcode)
+    {
+        case OPCODE_JUMP_IF_GREATER_EQUAL_INT:
+            return HANDLER(opcode_handler_jump_if_greater_equal_int)(next, instance);
+
+        default:
+            return HANDLER(opcode_handler_jump_if_greater_equal)(next, instance);
+    }
+}
+
+
+/**
+ * STORE_LOCAL, LOAD_LOCAL, INT
+ */
+vm_instruction_t *HANDLER(opcode_handler_store_local_load_local_int)(vm_instruction_t *ins,
+                                                                     vm_instance_t *instance)
+{
+    vm_instruction_t *next = _execute_first(ins, instance, OPCODE_STORE_LOCAL);
+
+    if (NULL == next)
+    {
+        return NULL;
+    }
+
+    next = HANDLER(opcode_handler_load_local)(next, instance);
+
+    if (NULL == next)
+    {
+        return NULL;
+    }
+
+    return HANDLER(opcode_handler_int)(next, instance);
+}
+
+
+/**
+ * INT, ADD
+ */
+vm_instruction_t *HANDLER(opcode_handler_int_add)(vm_instruction_t *ins, vm_instance_t *instance)
+{
+    vm_instruction_t *next = _execute_first(ins, instance, OPCODE_INT);
+
+    if (NULL == next)
+    {
+        return NULL;
+    }
+
+    switch ((int) next->opcode)
+    {
+        case OPCODE_ADD_FLOAT_FLOAT:
+            return HANDLER(opcode_handler_add_float_float)(next, instance);
+
+        case OPCODE_ADD_INT_INT:
+            return HANDLER(opcode_handler_add_int_int)(next, instance);
+
+        default:
+            return HANDLER(opcode_handler_add)(next, instance);
+    }
+}
+
+
+/**
+ * STORE_LOCAL, JUMP
+ */
+vm_instruction_t *HANDLER(opcode_handler_store_local_jump)(vm_instruction_t *ins,
+                                                           vm_instance_t *instance)
+{
+    vm_instruction_t *next = _execute_first(ins, instance, OPCODE_STORE_LOCAL);
+
+    if (NULL == next)
+    {
+        return NULL;
+    }
+
+    return HANDLER(opcode_handler_jump)(next, instance);
+}
+
+
+#endif /* SUPERINSTRUCTION_HANDLERS_H_ */
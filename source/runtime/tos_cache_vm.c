@@ -0,0 +1,261 @@
+#include "tos_cache_vm_api.h"
+#include "opcode_handlers.h"
+#include "object_helpers_api.h"
+#include "data_stack_api.h"
+
+
+/* Number of top-of-stack states; zero, one or two cached values */
+#define TOS_NUM_STATES (3u)
+
+
+/* Case label for an opcode in a single top-of-stack state */
+#define TOS_KEY(state, opcode) ((((uint32_t) (opcode)) * TOS_NUM_STATES) + (state))
+
+
+/* Write a cached value to the data stack in memory */
+#define TOS_SPILL(frame, value)                                               \
+    do {                                                                      \
+        if ((frame)->sp == (frame)->limit)                                    \
+        {                                                                     \
+            if (DATA_STACK_OK != data_stack_reserve((frame), 1u))             \
+            {                                                                 \
+                RUNTIME_ERR(RUNTIME_ERROR_MEMORY, "failed to grow data stack"); \
+                return VM_RUNTIME_ERROR;                                      \
+            }                                                                 \
+        }                                                                     \
+                                                                              \
+        *((frame)->sp++) = (value);                                           \
+    }                                                                         \
+    while (0)
+
+
+/* Read a value below the cached values from the data stack in memory */
+#define TOS_FILL(frame, value)                                                \
+    do {                                                                      \
+        if ((frame)->sp == (frame)->base)                                     \
+        {                                                                     \
+            RUNTIME_ERR(RUNTIME_ERROR_INTERNAL, "data stack underflow");      \
+            return VM_RUNTIME_ERROR;                                          \
+        }                                                                     \
+                                                                              \
+        (value) = *(--(frame)->sp);                                           \
+    }                                                                         \
+    while (0)
+
+
+/* Write all cached values to the data stack in memory, deepest first */
+#define TOS_SPILL_ALL(frame)                                                  \
+    do {                                                                      \
+        if (2u == state)                                                      \
+        {                                                                     \
+            TOS_SPILL(frame, tos1);                                           \
+        }                                                                     \
+                                                                              \
+        if (1u <= state)                                                      \
+        {                                                                     \
+            TOS_SPILL(frame, tos0);                                           \
+        }                                                                     \
+                                                                              \
+        state = 0u;                                                           \
+    }                                                                         \
+    while (0)
+
+
+/* Transitions for an instruction that pushes a value and has no other effect.
+ * With two values already cached, the deeper one is spilled to make room. */
+#define TOS_PUSH_CASES(opcode, value)                                         \
+    case TOS_KEY(0u, opcode):                                                 \
+        tos0 = (value);                                                       \
+        state = 1u;                                                           \
+        ip += 1;                                                              \
+        break;                                                                \
+                                                                              \
+    case TOS_KEY(1u, opcode):                                                 \
+        tos1 = tos0;                                                          \
+        tos0 = (value);                                                       \
+        state = 2u;                                                           \
+        ip += 1;                                                              \
+        break;                                                                \
+                                                                              \
+    case TOS_KEY(2u, opcode):                                                 \
+        TOS_SPILL(frame, tos1);                                               \
+        tos1 = tos0;                                                          \
+        tos0 = (value);                                                       \
+        ip += 1;                                                              \
+        break;
+
+
+/* Transitions for arithmetic whose operand types were proven by type
+ * inference. Operands that aren't cached are read from memory, and the result
+ * is always left as the only cached value. */
+#define TOS_TYPED_BINARY_CASES(opcode, make_value, field, op)                 \
+    case TOS_KEY(0u, opcode):                                                 \
+        TOS_FILL(frame, tos0);                                                \
+        TOS_FILL(frame, tos1);                                                \
+        tos0 = make_value(tos1.payload.field op tos0.payload.field);          \
+        state = 1u;                                                           \
+        ip += 1;                                                              \
+        break;                                                                \
+                                                                              \
+    case TOS_KEY(1u, opcode):                                                 \
+        TOS_FILL(frame, tos1);                                                \
+        tos0 = make_value(tos1.payload.field op tos0.payload.field);          \
+        ip += 1;                                                              \
+        break;                                                                \
+                                                                              \
+    case TOS_KEY(2u, opcode):                                                 \
+        tos0 = make_value(tos1.payload.field op tos0.payload.field);          \
+        state = 1u;                                                           \
+        ip += 1;                                                              \
+        break;
+
+
+/* Transitions for compare-and-branch whose operand types were proven by type
+ * inference. Operands that aren't cached are read from memory, and both are
+ * consumed, so nothing is left cached. */
+#define TOS_TYPED_COMPARE_JUMP_CASES(opcode, op)                              \
+    case TOS_KEY(0u, opcode):                                                 \
+        TOS_FILL(frame, tos0);                                                \
+        TOS_FILL(frame, tos1);                                                \
+        ip = (tos1.payload.int_value op tos0.payload.int_value) ? ip->target : ip + 1; \
+        state = 0u;                                                           \
+        break;                                                                \
+                                                                              \
+    case TOS_KEY(1u, opcode):                                                 \
+        TOS_FILL(frame, tos1);                                                \
+        ip = (tos1.payload.int_value op tos0.payload.int_value) ? ip->target : ip + 1; \
+        state = 0u;                                                           \
+        break;                                                                \
+                                                                              \
+    case TOS_KEY(2u, opcode):                                                 \
+        ip = (tos1.payload.int_value op tos0.payload.int_value) ? ip->target : ip + 1; \
+        state = 0u;                                                           \
+        break;
+
+
+/* Transitions for an instruction that doesn't touch the data stack */
+#define TOS_ANY_STATE_CASES(opcode, next)                                     \
+    case TOS_KEY(0u, opcode):                                                 \
+    case TOS_KEY(1u, opcode):                                                 \
+    case TOS_KEY(2u, opcode):                                                 \
+        ip = (next);                                                          \
+        break;
+
+
+/**
+ * @see tos_cache_vm_api.h
+ */
+vm_status_e tos_cache_vm_execute(vm_instance_t *instance, vm_program_t *program)
+{
+    callstack_frame_t *frame = instance->callstack.current_frame;
+    vm_instruction_t *ip = program->instructions;
+    value_t tos0 = INT_VALUE(0);  // Top of the stack, if state is 1 or 2
+    value_t tos1 = INT_VALUE(0);  // Value below the top of the stack, if state is 2
+    uint32_t state = 0u;          // Number of cached values
+
+    while (1)
+    {
+        switch (TOS_KEY(state, ip->opcode))
+        {
+            TOS_PUSH_CASES(OPCODE_INT, INT_VALUE(ip->operand.immediate.int_value))
+            TOS_PUSH_CASES(OPCODE_FLOAT, FLOAT_VALUE(ip->operand.immediate.float_value))
+            TOS_PUSH_CASES(OPCODE_BOOL, BOOL_VALUE(ip->operand.immediate.bool_value))
+            TOS_PUSH_CASES(VM_OPCODE_LOAD_VALUE, *ip->value)
+
+            TOS_TYPED_BINARY_CASES(OPCODE_ADD_INT_INT, INT_VALUE, int_value, +)
+            TOS_TYPED_BINARY_CASES(OPCODE_SUB_INT_INT, INT_VALUE, int_value, -)
+            TOS_TYPED_BINARY_CASES(OPCODE_MULT_INT_INT, INT_VALUE, int_value, *)
+            TOS_TYPED_BINARY_CASES(OPCODE_ADD_FLOAT_FLOAT, FLOAT_VALUE, float_value, +)
+            TOS_TYPED_BINARY_CASES(OPCODE_SUB_FLOAT_FLOAT, FLOAT_VALUE, float_value, -)
+            TOS_TYPED_BINARY_CASES(OPCODE_MULT_FLOAT_FLOAT, FLOAT_VALUE, float_value, *)
+            TOS_TYPED_BINARY_CASES(OPCODE_DIV_FLOAT_FLOAT, FLOAT_VALUE, float_value, /)
+
+            TOS_TYPED_COMPARE_JUMP_CASES(OPCODE_JUMP_IF_EQUAL_INT, ==)
+            TOS_TYPED_COMPARE_JUMP_CASES(OPCODE_JUMP_IF_NOT_EQUAL_INT, !=)
+            TOS_TYPED_COMPARE_JUMP_CASES(OPCODE_JUMP_IF_LESS_INT, <)
+            TOS_TYPED_COMPARE_JUMP_CASES(OPCODE_JUMP_IF_LESS_EQUAL_INT, <=)
+            TOS_TYPED_COMPARE_JUMP_CASES(OPCODE_JUMP_IF_GREATER_INT, >)
+            TOS_TYPED_COMPARE_JUMP_CASES(OPCODE_JUMP_IF_GREATER_EQUAL_INT, >=)
+
+            TOS_ANY_STATE_CASES(OPCODE_NOP, ip + 1)
+            TOS_ANY_STATE_CASES(OPCODE_DEFINE_CONST, ip + 1)
+            TOS_ANY_STATE_CASES(OPCODE_JUMP, ip->target)
+
+            // Division by zero is reported by the normal handler
+            case TOS_KEY(2u, OPCODE_DIV_INT_INT):
+                if (0 == tos0.payload.int_value)
+                {
+                    goto slow_path;
+                }
+
+                tos0 = INT_VALUE(tos1.payload.int_value / tos0.payload.int_value);
+                state = 1u;
+                ip += 1;
+                break;
+
+            // Conditions that aren't objects have nothing to free
+            case TOS_KEY(1u, OPCODE_JUMP_IF_FALSE):
+                if (VALUE_IS_OBJECT(tos0))
+                {
+                    goto slow_path;
+                }
+
+                ip = type_is_true(&tos0) ? ip + 1 : ip->target;
+                state = 0u;
+                break;
+
+            case TOS_KEY(2u, OPCODE_JUMP_IF_FALSE):
+                if (VALUE_IS_OBJECT(tos0))
+                {
+                    goto slow_path;
+                }
+
+                ip = type_is_true(&tos0) ? ip + 1 : ip->target;
+                tos0 = tos1;
+                state = 1u;
+                break;
+
+            case TOS_KEY(1u, OPCODE_JUMP_IF_TRUE):
+                if (VALUE_IS_OBJECT(tos0))
+                {
+                    goto slow_path;
+                }
+
+                ip = type_is_true(&tos0) ? ip->target : ip + 1;
+                state = 0u;
+                break;
+
+            case TOS_KEY(2u, OPCODE_JUMP_IF_TRUE):
+                if (VALUE_IS_OBJECT(tos0))
+                {
+                    goto slow_path;
+                }
+
+                ip = type_is_true(&tos0) ? ip->target : ip + 1;
+                tos0 = tos1;
+                state = 1u;
+                break;
+
+            case TOS_KEY(0u, OPCODE_END):
+            case TOS_KEY(1u, OPCODE_END):
+            case TOS_KEY(2u, OPCODE_END):
+                TOS_SPILL_ALL(frame);
+                return VM_OK;
+
+            default:
+                goto slow_path;
+        }
+
+        continue;
+
+slow_path:
+        // Everything else runs the normal handler, with nothing cached
+        TOS_SPILL_ALL(frame);
+
+        ip = ip->handler(ip, instance);
+        if (NULL == ip)
+        {
+            return VM_RUNTIME_ERROR;
+        }
+    }
+}
@@ -0,0 +1,36 @@
+/**
+ * Stack-based execution engine that caches the top of the data stack. Up to
+ * two values from the top of the stack are kept in local variables (which the
+ * compiler can keep in machine registers), so that the common instructions can
+ * pass values to each other without going through the data stack in memory.
+ */
+
+#ifndef TOS_CACHE_VM_API_H_
+#define TOS_CACHE_VM_API_H_
+
+
+#include "vm_api.h"
+#include "runtime_common.h"
+
+
+/**
+ * Execute a program loaded by vm_load, caching the top of the data stack.
+ *
+ * The engine is always in one of three states, holding zero, one or two
+ * cached values. Pushes, typed arithmetic, jumps and bool conditions have a
+ * version for each state, which moves to the state matching the number of
+ * cached values afterwards. A push in the two-value state spills only the
+ * deeper cached value to memory. Every other instruction spills all cached
+ * values to memory first, and then runs the normal opcode handler in the
+ * zero-value state. At the end of the program all cached values are spilled,
+ * so the data stack holds the same values as it would with the stack engine.
+ *
+ * @param    instance    Pointer to VM instance to execute the program on
+ * @param    program     Pointer to loaded program to execute
+ *
+ * @return   VM_OK if execution completed successfully
+ */
+vm_status_e tos_cache_vm_execute(vm_instance_t *instance, vm_program_t *program);
+
+
+#endif /* TOS_CACHE_VM_API_H_ */
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include "type_operations_api.h"
 #include "opcode_handlers.h"
 #include "string_cache_api.h"
@@ -7,20 +8,6 @@
 #include "object_helpers_api.h"
 
 
-/* Size allocated for string data in a DATATYPE_STRING object created to
- * hold the string-ified representation of an integer */
-#define MAX_STRING_NUM_SIZE (32u)
-
-
-/* Highest values allowed for number of decimal places when converting
- * a float object to a string object */
-#define MAX_FLOAT_PLACES (32)
-
-
-/* Size allocated for string data when coverting a bool to a string object */
-#define BOOL_STRING_SIZE (6)
-
-
 /* Strings used when converting bools to string objects */
 #define BOOL_STRING_TRUE   "true"
 #define BOOL_STRING_FALSE  "false"
@@ -50,14 +37,6 @@
 }                                                                             \
 
 
-/* Function for casting one data type to another type, creating a new object */
-typedef type_status_e (*cast_func_t) (object_t *, object_t **, uint16_t);
-
-/* Function for performing a binary operation using two objects as operands,
- * and creating a new object containing the result */
-typedef type_status_e (*binary_func_t) (object_t *, object_t *, object_t **,
-                                        binary_op_e);
-
 /**
  * Structure to hold function pointers for handling casting and binary/unary
  * operations for a single data type
@@ -70,50 +49,50 @@ typedef struct
 
 
 /* Casting functions for ints */
-static type_status_e _int_to_float(object_t *, object_t **, uint16_t);     /* Cast int to float */
-static type_status_e _int_to_string(object_t *, object_t **, uint16_t);    /* Cast int to string */
-static type_status_e _int_to_bool(object_t *, object_t **, uint16_t);      /* Cast int to bool */
+static type_status_e _int_to_float(value_t *, value_t *, uint16_t);     /* Cast int to float */
+static type_status_e _int_to_string(value_t *, value_t *, uint16_t);    /* Cast int to string */
+static type_status_e _int_to_bool(value_t *, value_t *, uint16_t);      /* Cast int to bool */
 
 /* Casting functions for floats */
-static type_status_e _float_to_int(object_t *, object_t **, uint16_t);     /* Cast float to int */
-static type_status_e _float_to_string(object_t *, object_t **, uint16_t);  /* Cast float to string */
-static type_status_e _float_to_bool(object_t *, object_t **, uint16_t);    /* Cast float to bool */
+static type_status_e _float_to_int(value_t *, value_t *, uint16_t);     /* Cast float to int */
+static type_status_e _float_to_string(value_t *, value_t *, uint16_t);  /* Cast float to string */
+static type_status_e _float_to_bool(value_t *, value_t *, uint16_t);    /* Cast float to bool */
 
 /* Casting functions for strings */
-static type_status_e _string_to_int(object_t *, object_t **, uint16_t);    /* Cast string to int */
-static type_status_e _string_to_float(object_t *, object_t **, uint16_t);  /* Cast string to float */
-static type_status_e _string_to_bool(object_t *, object_t **, uint16_t);   /* Cast string to bool */
+static type_status_e _string_to_int(value_t *, value_t *, uint16_t);    /* Cast string to int */
+static type_status_e _string_to_float(value_t *, value_t *, uint16_t);  /* Cast string to float */
+static type_status_e _string_to_bool(value_t *, value_t *, uint16_t);   /* Cast string to bool */
 
 /* Casting functions for bools */
-static type_status_e _bool_to_int(object_t *, object_t **, uint16_t);      /* Cast bool to int */
-static type_status_e _bool_to_float(object_t *, object_t **, uint16_t);    /* Cast bool to float */
-static type_status_e _bool_to_string(object_t *, object_t **, uint16_t);   /* Cast bool to string */
+static type_status_e _bool_to_int(value_t *, value_t *, uint16_t);      /* Cast bool to int */
+static type_status_e _bool_to_float(value_t *, value_t *, uint16_t);    /* Cast bool to float */
+static type_status_e _bool_to_string(value_t *, value_t *, uint16_t);   /* Cast bool to string */
 
 
 /* Arithmetic when LHS is an int */
-static type_status_e _binary_int_int(object_t *, object_t *, object_t **, binary_op_e);
-static type_status_e _binary_int_float(object_t *, object_t *, object_t **, binary_op_e);
-static type_status_e _binary_int_string(object_t *, object_t *, object_t **, binary_op_e);
-/* static type_status_e _binary_int_bool(object_t *, object_t *, object_t **, binary_op_e);       (TODO) */
+static type_status_e _binary_int_int(value_t *, value_t *, value_t *, binary_op_e);
+static type_status_e _binary_int_float(value_t *, value_t *, value_t *, binary_op_e);
+static type_status_e _binary_int_string(value_t *, value_t *, value_t *, binary_op_e);
+/* static type_status_e _binary_int_bool(value_t *, value_t *, value_t *, binary_op_e);       (TODO) */
 
 
 /* Arithmetic when LHS is a float */
-static type_status_e _binary_float_int(object_t *, object_t *, object_t **, binary_op_e);
-static type_status_e _binary_float_float(object_t *, object_t *, object_t **, binary_op_e);
-/* static type_status_e _binary_float_string(object_t *, object_t *, object_t **, binary_op_e);   (TODO) */
-/* static type_status_e _binary_float_bool(object_t *, object_t *, object_t **, binary_op_e);     (TODO) */
+static type_status_e _binary_float_int(value_t *, value_t *, value_t *, binary_op_e);
+static type_status_e _binary_float_float(value_t *, value_t *, value_t *, binary_op_e);
+/* static type_status_e _binary_float_string(value_t *, value_t *, value_t *, binary_op_e);   (TODO) */
+/* static type_status_e _binary_float_bool(value_t *, value_t *, value_t *, binary_op_e);     (TODO) */
 
 
 /* Arithmetic when LHS is a string */
-static type_status_e _binary_string_int(object_t *, object_t *, object_t **, binary_op_e);
-/* static type_status_e _binary_string_float(object_t *, object_t *, object_t **, binary_op_e);   (TODO) */
-static type_status_e _binary_string_string(object_t *, object_t *, object_t **, binary_op_e);
+static type_status_e _binary_string_int(value_t *, value_t *, value_t *, binary_op_e);
+/* static type_status_e _binary_string_float(value_t *, value_t *, value_t *, binary_op_e);   (TODO) */
+static type_status_e _binary_string_string(value_t *, value_t *, value_t *, binary_op_e);
 
 
 /* Arithmetic when LHS is a bool */
-static type_status_e _binary_bool_int(object_t *, object_t *, object_t **, binary_op_e);
-static type_status_e _binary_bool_float(object_t *, object_t *, object_t **, binary_op_e);
-/* static type_status_e _binary_bool_bool(object_t *, object_t *, object_t **, binary_op_e);      (TODO) */
+static type_status_e _binary_bool_int(value_t *, value_t *, value_t *, binary_op_e);
+static type_status_e _binary_bool_float(value_t *, value_t *, value_t *, binary_op_e);
+/* static type_status_e _binary_bool_bool(value_t *, value_t *, value_t *, binary_op_e);      (TODO) */
 
 
 /**
@@ -156,8 +135,20 @@ static type_operations_t _type_ops[NUM_DATATYPES] =
 };
 
 
+static type_status_e _new_string(char *string, size_t len, value_t *output)
+{
+    if (new_string_value(string, len, output) != 0)
+    {
+        RUNTIME_ERR(RUNTIME_ERROR_MEMORY, "failed to create string object");
+        return TYPE_RUNTIME_ERROR;
+    }
+
+    return TYPE_OK;
+}
+
+
 static type_status_e _multiply_string(vm_int_t int_value, byte_string_t *string_value,
-                                      object_t **result)
+                                      value_t *result)
 {
     /* Ensure result string has enough space to hold multiple copies of string data,
      * excluding all null bytes */
@@ -178,47 +169,39 @@ static type_status_e _multiply_string(vm_int_t int_value, byte_string_t *string_
         (void) memcpy(target, string_value->bytes, string_value->size - 1);
     }
 
-
-    *result = new_string_object(temp_string, result_string_size);
-    return TYPE_OK;
+    type_status_e ret = _new_string(temp_string, result_string_size, result);
+    memory_manager_free(temp_string);
+    return ret;
 }
 
 
 /* Casting functions */
-static type_status_e _int_to_float(object_t *object, object_t **output, uint16_t data)
+static type_status_e _int_to_float(value_t *value, value_t *output, uint16_t data)
 {
-    data_object_t *data_obj = (data_object_t *) object;
-    *output = new_float_object((vm_float_t) data_obj->payload.int_value);
+    *output = FLOAT_VALUE((vm_float_t) value->payload.int_value);
     return TYPE_OK;
 }
 
 
-static type_status_e _int_to_string(object_t *object, object_t **output, uint16_t data)
+static type_status_e _int_to_string(value_t *value, value_t *output, uint16_t data)
 {
-    data_object_t *data_obj = (data_object_t *) object;
+    char temp_string[TYPE_MAX_STRING_NUM_SIZE];
 
-    vm_int_t int_value = data_obj->payload.int_value;
-    char temp_string[MAX_STRING_NUM_SIZE];
-
-    int printed = snprintf(temp_string, MAX_STRING_NUM_SIZE, "%d", int_value);
-    *output = new_string_object(temp_string, printed);
-    return TYPE_OK;
+    int printed = type_format_int(value->payload.int_value, temp_string, sizeof(temp_string));
+    return _new_string(temp_string, printed, output);
 }
 
 
-static type_status_e _int_to_bool(object_t *object, object_t **output, uint16_t data)
+static type_status_e _int_to_bool(value_t *value, value_t *output, uint16_t data)
 {
-    data_object_t *data_obj = (data_object_t *) object;
-    *output = new_bool_object((data_obj->payload.int_value == 0) ? 0u : 1u);
+    *output = BOOL_VALUE((value->payload.int_value == 0) ? 0u : 1u);
     return TYPE_OK;
 }
 
 
 
-static type_status_e _string_to_int(object_t *object, object_t **output, uint16_t base)
+static type_status_e _string_to_int(value_t *value, value_t *output, uint16_t base)
 {
-    data_object_t *data_obj = (data_object_t *) object;
-
     long int longval;
     char *endptr;
 
@@ -229,163 +212,143 @@ static type_status_e _string_to_int(object_t *object, object_t **output, uint16_
         return TYPE_RUNTIME_ERROR;
     }
 
-    longval = strtol((char *) data_obj->payload.string_value.bytes, &endptr, (int) base);
+    longval = strtol((char *) VALUE_STRING(*value)->bytes, &endptr, (int) base);
     if (('\0' != *endptr) && ('.' != *endptr))
     {
         /* If endptr is not pointing at the null termination byte, then not all
          * characters in the string are valid */
         RUNTIME_ERR(RUNTIME_ERROR_CAST,
                     "Can't convert string '%s' to int",
-                    data_obj->payload.string_value.bytes);
+                    VALUE_STRING(*value)->bytes);
         return TYPE_RUNTIME_ERROR;
     }
 
-    *output = new_int_object((vm_int_t) longval);
+    *output = INT_VALUE((vm_int_t) longval);
 
     return TYPE_OK;
 }
 
 
-static type_status_e _string_to_float(object_t *object, object_t **output, uint16_t data)
+static type_status_e _string_to_float(value_t *value, value_t *output, uint16_t data)
 {
-    data_object_t *data_obj = (data_object_t *) object;
-
     double doubleval;
     char *endptr;
 
-    doubleval = strtod((char *) data_obj->payload.string_value.bytes, &endptr);
+    doubleval = strtod((char *) VALUE_STRING(*value)->bytes, &endptr);
     if ('\0' != *endptr)
     {
         /* If endptr is not pointing at the null termination byte, then not all
          * characters in the string are valid */
         RUNTIME_ERR(RUNTIME_ERROR_CAST,
                     "Can't convert string '%s' to float",
-                    data_obj->payload.string_value.bytes);
+                    VALUE_STRING(*value)->bytes);
         return TYPE_RUNTIME_ERROR;
     }
 
-    *output = new_float_object((vm_float_t) doubleval);
+    *output = FLOAT_VALUE((vm_float_t) doubleval);
 
     return TYPE_OK;
 }
 
 
-static type_status_e _string_to_bool(object_t *object, object_t **output, uint16_t base)
+static type_status_e _string_to_bool(value_t *value, value_t *output, uint16_t base)
 {
-    data_object_t *data_obj = (data_object_t *) object;
-    *output = new_bool_object((data_obj->payload.string_value.size > 0u) ? 1u : 0u);
+    *output = BOOL_VALUE((VALUE_STRING(*value)->size > 0u) ? 1u : 0u);
     return TYPE_OK;
 }
 
 
-static type_status_e _float_to_int(object_t *object, object_t **output, uint16_t data)
+static type_status_e _float_to_int(value_t *value, value_t *output, uint16_t data)
 {
-    data_object_t *data_obj = (data_object_t *) object;
-    *output = new_int_object((vm_int_t) data_obj->payload.float_value);
+    *output = INT_VALUE((vm_int_t) value->payload.float_value);
     return TYPE_OK;
 }
 
 
-static type_status_e _float_to_string(object_t *object, object_t **output, uint16_t places)
+static type_status_e _float_to_string(value_t *value, value_t *output, uint16_t places)
 {
-    data_object_t *data_obj = (data_object_t *) object;
-
     char *temp_string;
-    size_t string_size = MAX_STRING_NUM_SIZE + places;
 
-    if (MAX_FLOAT_PLACES < places)
+    if (TYPE_MAX_FLOAT_PLACES < places)
     {
         RUNTIME_ERR(RUNTIME_ERROR_CAST,
-                    "decimal places must be between 0-%d\n", MAX_FLOAT_PLACES);
+                    "decimal places must be between 0-%d\n", TYPE_MAX_FLOAT_PLACES);
         return TYPE_RUNTIME_ERROR;
     }
 
-    if ((temp_string = memory_manager_alloc(string_size)) == NULL)
-    {
-        RUNTIME_ERR(RUNTIME_ERROR_MEMORY, "memory_manager_alloc failed");
-        return TYPE_RUNTIME_ERROR;
-    }
+    // Large floats can have more digits than TYPE_MAX_STRING_NUM_SIZE
+    int printed = type_format_float(value->payload.float_value, places, NULL, 0u);
 
-    // Build format string with requested number of places
-    char fmt_string[16];
-    if (snprintf(fmt_string, sizeof(fmt_string), "%%.%df", places) >= sizeof(fmt_string))
+    if ((temp_string = memory_manager_alloc((size_t) printed + 1u)) == NULL)
     {
-        RUNTIME_ERR(RUNTIME_ERROR_INTERNAL, "snprintf output truncated\n");
+        RUNTIME_ERR(RUNTIME_ERROR_MEMORY, "memory_manager_alloc failed");
         return TYPE_RUNTIME_ERROR;
     }
 
-    int printed = snprintf(temp_string, string_size, fmt_string,
-                           data_obj->payload.float_value);
-
-    *output = new_string_object(temp_string, printed);
+    (void) type_format_float(value->payload.float_value, places, temp_string,
+                             (size_t) printed + 1u);
+    type_status_e ret = _new_string(temp_string, printed, output);
     memory_manager_free(temp_string);
-    return TYPE_OK;
+    return ret;
 }
 
 
-static type_status_e _float_to_bool(object_t *object, object_t **output, uint16_t data)
+static type_status_e _float_to_bool(value_t *value, value_t *output, uint16_t data)
 {
-    data_object_t *data_obj = (data_object_t *) object;
-    *output = new_bool_object((data_obj->payload.float_value == 0.0) ? 0u : 1u);
+    *output = BOOL_VALUE((value->payload.float_value == 0.0) ? 0u : 1u);
     return TYPE_OK;
 }
 
 
-static type_status_e _bool_to_int(object_t *object, object_t **output, uint16_t data)
+static type_status_e _bool_to_int(value_t *value, value_t *output, uint16_t data)
 {
-    data_object_t *data_obj = (data_object_t *) object;
-    *output = new_int_object((vm_int_t) data_obj->payload.bool_value);
+    *output = INT_VALUE((vm_int_t) value->payload.bool_value);
     return TYPE_OK;
 }
 
 
-static type_status_e _bool_to_float(object_t *object, object_t **output, uint16_t data)
+static type_status_e _bool_to_float(value_t *value, value_t *output, uint16_t data)
 {
-    data_object_t *data_obj = (data_object_t *) object;
-    *output = new_float_object((vm_float_t) data_obj->payload.bool_value);
+    *output = FLOAT_VALUE((vm_float_t) value->payload.bool_value);
     return TYPE_OK;
 }
 
 
-static type_status_e _bool_to_string(object_t *object, object_t **output, uint16_t data)
+static type_status_e _bool_to_string(value_t *value, value_t *output, uint16_t data)
 {
-    data_object_t *data_obj = (data_object_t *) object;
-
-    char temp_string[BOOL_STRING_SIZE];
-
-    int printed = snprintf(temp_string, BOOL_STRING_SIZE, "%s",
-                           (data_obj->payload.bool_value) ? BOOL_STRING_TRUE : BOOL_STRING_FALSE);
-
-    *output = new_string_object(temp_string, printed);
-    return TYPE_OK;
+    const char *string = type_format_bool(value->payload.bool_value);
+    return _new_string((char *) string, strlen(string), output);
 }
 
 
 /* Arithmetic functions */
-static type_status_e _binary_int_int(object_t *int_a, object_t *int_b, object_t **result,
+static type_status_e _binary_int_int(value_t *int_a, value_t *int_b, value_t *result,
                            binary_op_e op_type)
 {
-    data_object_t *data_a = (data_object_t *) int_a;
-    data_object_t *data_b = (data_object_t *) int_b;
-
     vm_int_t result_int;
 
     switch (op_type)
     {
         case BINARY_ADD:
-            result_int = data_a->payload.int_value + data_b->payload.int_value;
+            result_int = int_a->payload.int_value + int_b->payload.int_value;
             break;
 
         case BINARY_SUB:
-            result_int = data_a->payload.int_value - data_b->payload.int_value;
+            result_int = int_a->payload.int_value - int_b->payload.int_value;
             break;
 
         case BINARY_MULT:
-            result_int = data_a->payload.int_value * data_b->payload.int_value;
+            result_int = int_a->payload.int_value * int_b->payload.int_value;
             break;
 
         case BINARY_DIV:
-            result_int = data_a->payload.int_value / data_b->payload.int_value;
+            if (0 == int_b->payload.int_value)
+            {
+                RUNTIME_ERR(RUNTIME_ERROR_ARITHMETIC, "Division by zero");
+                return TYPE_RUNTIME_ERROR;
+            }
+
+            result_int = int_a->payload.int_value / int_b->payload.int_value;
             break;
 
         default:
@@ -393,39 +356,36 @@ static type_status_e _binary_int_int(object_t *int_a, object_t *int_b, object_t
             break;
     }
 
-    *result = new_int_object(result_int);
+    *result = INT_VALUE(result_int);
     return TYPE_OK;
 }
 
 
-static type_status_e _binary_int_float(object_t *int_a, object_t *float_b,
-                             object_t **result, binary_op_e op_type)
+static type_status_e _binary_int_float(value_t *int_a, value_t *float_b,
+                             value_t *result, binary_op_e op_type)
 {
-    data_object_t *data_a = (data_object_t *) int_a;
-    data_object_t *data_b = (data_object_t *) float_b;
-
     vm_float_t result_float;
 
     switch (op_type)
     {
         case BINARY_ADD:
-            result_float = (vm_float_t) data_a->payload.int_value +
-                           data_b->payload.float_value;
+            result_float = (vm_float_t) int_a->payload.int_value +
+                           float_b->payload.float_value;
             break;
 
         case BINARY_SUB:
-            result_float = (vm_float_t) data_a->payload.int_value -
-                           data_b->payload.float_value;
+            result_float = (vm_float_t) int_a->payload.int_value -
+                           float_b->payload.float_value;
             break;
 
         case BINARY_MULT:
-            result_float = (vm_float_t) data_a->payload.int_value *
-                           data_b->payload.float_value;
+            result_float = (vm_float_t) int_a->payload.int_value *
+                           float_b->payload.float_value;
             break;
 
         case BINARY_DIV:
-            result_float = (vm_float_t) data_a->payload.int_value /
-                           data_b->payload.float_value;
+            result_float = (vm_float_t) int_a->payload.int_value /
+                           float_b->payload.float_value;
             break;
 
         default:
@@ -433,13 +393,13 @@ static type_status_e _binary_int_float(object_t *int_a, object_t *float_b,
             break;
     }
 
-    *result = new_float_object(result_float);
+    *result = FLOAT_VALUE(result_float);
     return TYPE_OK;
 }
 
 
-static type_status_e _binary_int_string(object_t *int_a, object_t *string_b,
-                                        object_t **result, binary_op_e op_type)
+static type_status_e _binary_int_string(value_t *int_a, value_t *string_b,
+                                        value_t *result, binary_op_e op_type)
 {
     if (BINARY_MULT != op_type)
     {
@@ -448,8 +408,8 @@ static type_status_e _binary_int_string(object_t *int_a, object_t *string_b,
         return TYPE_RUNTIME_ERROR;
     }
 
-    vm_int_t int_value = ((data_object_t *) int_a)->payload.int_value;
-    byte_string_t *string_value = &((data_object_t *) string_b)->payload.string_value;
+    vm_int_t int_value = int_a->payload.int_value;
+    byte_string_t *string_value = VALUE_STRING(*string_b);
 
     if (TYPE_OK != _multiply_string(int_value, string_value, result))
     {
@@ -461,34 +421,31 @@ static type_status_e _binary_int_string(object_t *int_a, object_t *string_b,
 }
 
 
-static type_status_e _binary_float_int(object_t *float_a, object_t *int_b,
-                                       object_t **result, binary_op_e op_type)
+static type_status_e _binary_float_int(value_t *float_a, value_t *int_b,
+                                       value_t *result, binary_op_e op_type)
 {
-    data_object_t *data_a = (data_object_t *) float_a;
-    data_object_t *data_b = (data_object_t *) int_b;
-
     vm_float_t result_float;
 
     switch (op_type)
     {
         case BINARY_ADD:
-            result_float = data_a->payload.float_value +
-                           (vm_float_t) data_b->payload.int_value;
+            result_float = float_a->payload.float_value +
+                           (vm_float_t) int_b->payload.int_value;
             break;
 
         case BINARY_SUB:
-            result_float = data_a->payload.float_value -
-                           (vm_float_t) data_b->payload.int_value;
+            result_float = float_a->payload.float_value -
+                           (vm_float_t) int_b->payload.int_value;
             break;
 
         case BINARY_MULT:
-            result_float = data_a->payload.float_value *
-                           (vm_float_t) data_b->payload.int_value;
+            result_float = float_a->payload.float_value *
+                           (vm_float_t) int_b->payload.int_value;
             break;
 
         case BINARY_DIV:
-            result_float = data_a->payload.float_value /
-                           (vm_float_t) data_b->payload.int_value;
+            result_float = float_a->payload.float_value /
+                           (vm_float_t) int_b->payload.int_value;
             break;
 
         default:
@@ -496,39 +453,36 @@ static type_status_e _binary_float_int(object_t *float_a, object_t *int_b,
             break;
     }
 
-    *result = new_float_object(result_float);
+    *result = FLOAT_VALUE(result_float);
     return TYPE_OK;
 }
 
 
-static type_status_e _binary_float_float(object_t *float_a, object_t *float_b,
-                                         object_t **result, binary_op_e op_type)
+static type_status_e _binary_float_float(value_t *float_a, value_t *float_b,
+                                         value_t *result, binary_op_e op_type)
 {
-    data_object_t *data_a = (data_object_t *) float_a;
-    data_object_t *data_b = (data_object_t *) float_b;
-
     vm_float_t result_float;
 
     switch (op_type)
     {
         case BINARY_ADD:
-            result_float = data_a->payload.float_value +
-                           data_b->payload.float_value;
+            result_float = float_a->payload.float_value +
+                           float_b->payload.float_value;
             break;
 
         case BINARY_SUB:
-            result_float = data_a->payload.float_value -
-                           data_b->payload.float_value;
+            result_float = float_a->payload.float_value -
+                           float_b->payload.float_value;
             break;
 
         case BINARY_MULT:
-            result_float = data_a->payload.float_value *
-                           data_b->payload.float_value;
+            result_float = float_a->payload.float_value *
+                           float_b->payload.float_value;
             break;
 
         case BINARY_DIV:
-            result_float = data_a->payload.float_value /
-                           data_b->payload.float_value;
+            result_float = float_a->payload.float_value /
+                           float_b->payload.float_value;
             break;
 
         default:
@@ -536,17 +490,14 @@ static type_status_e _binary_float_float(object_t *float_a, object_t *float_b,
             break;
     }
 
-    *result = new_float_object(result_float);
+    *result = FLOAT_VALUE(result_float);
     return TYPE_OK;
 }
 
 
-static type_status_e _binary_string_string(object_t *str_a, object_t *str_b,
-                                           object_t **result, binary_op_e op_type)
+static type_status_e _binary_string_string(value_t *str_a, value_t *str_b,
+                                           value_t *result, binary_op_e op_type)
 {
-    data_object_t *data_a = (data_object_t *) str_a;
-    data_object_t *data_b = (data_object_t *) str_b;
-
     if ((BINARY_DIV == op_type) ||
         (BINARY_DIV == op_type) ||
         (BINARY_MULT == op_type))
@@ -557,8 +508,8 @@ static type_status_e _binary_string_string(object_t *str_a, object_t *str_b,
             return TYPE_RUNTIME_ERROR;
     }
 
-    byte_string_t *lhs_string = &data_a->payload.string_value;
-    byte_string_t *rhs_string = &data_b->payload.string_value;
+    byte_string_t *lhs_string = VALUE_STRING(*str_a);
+    byte_string_t *rhs_string = VALUE_STRING(*str_b);
 
     size_t new_string_size = (lhs_string->size + rhs_string->size) - 2;
     char *temp_string;
@@ -576,15 +527,14 @@ static type_status_e _binary_string_string(object_t *str_a, object_t *str_b,
     (void) memcpy(temp_string + (lhs_string->size - 1),
                   rhs_string->bytes, rhs_string->size - 1);
 
-
-    *result = new_string_object(temp_string, new_string_size);
+    type_status_e ret = _new_string(temp_string, new_string_size, result);
     memory_manager_free(temp_string);
-    return TYPE_OK;
+    return ret;
 }
 
 
-static type_status_e _binary_string_int(object_t *string_a, object_t *int_b,
-                                        object_t **result, binary_op_e op_type)
+static type_status_e _binary_string_int(value_t *string_a, value_t *int_b,
+                                        value_t *result, binary_op_e op_type)
 {
     if (BINARY_MULT != op_type)
     {
@@ -593,8 +543,8 @@ static type_status_e _binary_string_int(object_t *string_a, object_t *int_b,
         return TYPE_RUNTIME_ERROR;
     }
 
-    vm_int_t int_value = ((data_object_t *) int_b)->payload.int_value;
-    byte_string_t *string_value = &((data_object_t *) string_a)->payload.string_value;
+    vm_int_t int_value = int_b->payload.int_value;
+    byte_string_t *string_value = VALUE_STRING(*string_a);
 
     if (TYPE_OK != _multiply_string(int_value, string_value, result))
     {
@@ -606,34 +556,37 @@ static type_status_e _binary_string_int(object_t *string_a, object_t *int_b,
 }
 
 
-static type_status_e _binary_bool_int(object_t *bool_a, object_t *int_b,
-                                      object_t **result, binary_op_e op_type)
+static type_status_e _binary_bool_int(value_t *bool_a, value_t *int_b,
+                                      value_t *result, binary_op_e op_type)
 {
-    data_object_t *data_a = (data_object_t *) bool_a;
-    data_object_t *data_b = (data_object_t *) int_b;
-
     vm_int_t result_int;
 
     switch (op_type)
     {
         case BINARY_ADD:
-            result_int = (vm_int_t) data_a->payload.bool_value +
-                         data_b->payload.int_value;
+            result_int = (vm_int_t) bool_a->payload.bool_value +
+                         int_b->payload.int_value;
             break;
 
         case BINARY_SUB:
-            result_int = (vm_int_t) data_a->payload.bool_value -
-                         data_b->payload.int_value;
+            result_int = (vm_int_t) bool_a->payload.bool_value -
+                         int_b->payload.int_value;
             break;
 
         case BINARY_MULT:
-            result_int = (vm_int_t) data_a->payload.bool_value *
-                         data_b->payload.int_value;
+            result_int = (vm_int_t) bool_a->payload.bool_value *
+                         int_b->payload.int_value;
             break;
 
         case BINARY_DIV:
-            result_int = (vm_int_t) data_a->payload.bool_value /
-                         data_b->payload.int_value;
+            if (0 == int_b->payload.int_value)
+            {
+                RUNTIME_ERR(RUNTIME_ERROR_ARITHMETIC, "Division by zero");
+                return TYPE_RUNTIME_ERROR;
+            }
+
+            result_int = (vm_int_t) bool_a->payload.bool_value /
+                         int_b->payload.int_value;
             break;
 
         default:
@@ -641,39 +594,36 @@ static type_status_e _binary_bool_int(object_t *bool_a, object_t *int_b,
             break;
     }
 
-    *result = new_int_object(result_int);
+    *result = INT_VALUE(result_int);
     return TYPE_OK;
 }
 
 
-static type_status_e _binary_bool_float(object_t *bool_a, object_t *float_b,
-                                        object_t **result, binary_op_e op_type)
+static type_status_e _binary_bool_float(value_t *bool_a, value_t *float_b,
+                                        value_t *result, binary_op_e op_type)
 {
-    data_object_t *data_a = (data_object_t *) bool_a;
-    data_object_t *data_b = (data_object_t *) float_b;
-
     vm_float_t result_float;
 
     switch (op_type)
     {
         case BINARY_ADD:
-            result_float = (vm_float_t) data_a->payload.bool_value +
-                           data_b->payload.float_value;
+            result_float = (vm_float_t) bool_a->payload.bool_value +
+                           float_b->payload.float_value;
             break;
 
         case BINARY_SUB:
-            result_float = (vm_float_t) data_a->payload.bool_value -
-                           data_b->payload.float_value;
+            result_float = (vm_float_t) bool_a->payload.bool_value -
+                           float_b->payload.float_value;
             break;
 
         case BINARY_MULT:
-            result_float = (vm_float_t) data_a->payload.bool_value *
-                           data_b->payload.float_value;
+            result_float = (vm_float_t) bool_a->payload.bool_value *
+                           float_b->payload.float_value;
             break;
 
         case BINARY_DIV:
-            result_float = (vm_float_t) data_a->payload.bool_value /
-                           data_b->payload.float_value;
+            result_float = (vm_float_t) bool_a->payload.bool_value /
+                           float_b->payload.float_value;
             break;
 
         default:
@@ -681,27 +631,176 @@ static type_status_e _binary_bool_float(object_t *bool_a, object_t *float_b,
             break;
     }
 
-    *result = new_float_object(result_float);
+    *result = FLOAT_VALUE(result_float);
     return TYPE_OK;
 }
 
 
+/* Three-way comparison of two numbers; floats are totally ordered, with NaN
+ * equal to itself and greater than any other number */
+static int _order_numbers(vm_float_t a, vm_float_t b)
+{
+    if (a < b)
+    {
+        return -1;
+    }
+
+    if (a > b)
+    {
+        return 1;
+    }
+
+    if (a == b)
+    {
+        return 0;
+    }
+
+    // At least one of the numbers is NaN
+    return (isnan(a) ? 1 : 0) - (isnan(b) ? 1 : 0);
+}
+
+
+/* Three-way comparison of two strings, byte-wise */
+static int _order_strings(byte_string_t *a, byte_string_t *b)
+{
+    size_t common = (a->size < b->size) ? a->size : b->size;
+    int ret = memcmp(a->bytes, b->bytes, common);
+
+    if (0 != ret)
+    {
+        return (0 > ret) ? -1 : 1;
+    }
+
+    return (a->size < b->size) ? -1 : ((a->size > b->size) ? 1 : 0);
+}
+
+
+/* Numerical value of an int, float or bool, for comparisons */
+static vm_float_t _number(value_t *value)
+{
+    switch (value->type)
+    {
+        case DATATYPE_INT:
+            return (vm_float_t) value->payload.int_value;
+
+        case DATATYPE_FLOAT:
+            return value->payload.float_value;
+
+        default:
+            return (vm_float_t) value->payload.bool_value;
+    }
+}
+
+
 /**
  * @see type_operations_api.h
  */
-type_status_e type_binary_op(object_t *lhs, object_t *rhs, object_t **result,
-                             binary_op_e op_type)
+vm_bool_t type_is_true(value_t *value)
 {
-    if ((OBJTYPE_DATA != lhs->obj_type) || (OBJTYPE_DATA != rhs->obj_type))
+    switch (value->type)
+    {
+        case DATATYPE_INT:
+            return (0 != value->payload.int_value) ? 1u : 0u;
+
+        case DATATYPE_FLOAT:
+            return (0.0 != value->payload.float_value) ? 1u : 0u;
+
+        case DATATYPE_STRING:
+            return (VALUE_STRING(*value)->size > 0u) ? 1u : 0u;
+
+        case DATATYPE_BOOL:
+            return (value->payload.bool_value) ? 1u : 0u;
+
+        default:
+            return 0u;
+    }
+}
+
+
+/**
+ * @see type_operations_api.h
+ */
+type_status_e type_compare(value_t *lhs, value_t *rhs, compare_op_e op_type,
+                           vm_bool_t *result)
+{
+    int lhs_string = (DATATYPE_STRING == lhs->type);
+    int rhs_string = (DATATYPE_STRING == rhs->type);
+    int order;
+
+    if ((NUM_DATATYPES <= lhs->type) || (NUM_DATATYPES <= rhs->type))
     {
         return TYPE_INVALID_ARITHMETIC;
     }
 
-    data_object_t *rdata = (data_object_t *) rhs;
-    data_object_t *ldata = (data_object_t *) lhs;
+    if (lhs_string != rhs_string)
+    {
+        // Strings are never equal to numbers, and have no order with them
+        if ((COMPARE_EQUAL != op_type) && (COMPARE_NOT_EQUAL != op_type))
+        {
+            return TYPE_INVALID_ARITHMETIC;
+        }
+
+        *result = (COMPARE_NOT_EQUAL == op_type) ? 1u : 0u;
+        return TYPE_OK;
+    }
+
+    if (lhs_string)
+    {
+        order = _order_strings(VALUE_STRING(*lhs), VALUE_STRING(*rhs));
+    }
+    else if ((DATATYPE_INT == lhs->type) && (DATATYPE_INT == rhs->type))
+    {
+        vm_int_t a = lhs->payload.int_value;
+        vm_int_t b = rhs->payload.int_value;
+        order = (a < b) ? -1 : ((a > b) ? 1 : 0);
+    }
+    else
+    {
+        order = _order_numbers(_number(lhs), _number(rhs));
+    }
+
+    switch (op_type)
+    {
+        case COMPARE_EQUAL:
+            *result = (0 == order) ? 1u : 0u;
+            break;
 
-    type_operations_t *ops = &_type_ops[ldata->data_type];
-    binary_func_t binary_func = ops->binary_functions[rdata->data_type];
+        case COMPARE_NOT_EQUAL:
+            *result = (0 != order) ? 1u : 0u;
+            break;
+
+        case COMPARE_LESS:
+            *result = (0 > order) ? 1u : 0u;
+            break;
+
+        case COMPARE_LESS_EQUAL:
+            *result = (0 >= order) ? 1u : 0u;
+            break;
+
+        case COMPARE_GREATER:
+            *result = (0 < order) ? 1u : 0u;
+            break;
+
+        case COMPARE_GREATER_EQUAL:
+            *result = (0 <= order) ? 1u : 0u;
+            break;
+
+        default:
+            return TYPE_INVALID_ARITHMETIC;
+    }
+
+    return TYPE_OK;
+}
+
+
+/**
+ * @see type_operations_api.h
+ */
+type_status_e type_binary_op(value_t *lhs, value_t *rhs, value_t *result,
+                             binary_op_e op_type)
+{
+    type_operations_t *ops = &_type_ops[lhs->type];
+    binary_func_t binary_func = ops->binary_functions[rhs->type];
 
     if (NULL == binary_func)
     {
@@ -715,7 +814,7 @@ type_status_e type_binary_op(object_t *lhs, object_t *rhs, object_t **result,
 /**
  * @see type_operations_api.h
  */
-type_status_e type_cast_to(object_t *object, object_t **output, data_type_e type,
+type_status_e type_cast_to(value_t *value, value_t *output, data_type_e type,
                            uint16_t data)
 {
     if (NUM_DATATYPES <= type)
@@ -723,25 +822,73 @@ type_status_e type_cast_to(object_t *object, object_t **output, data_type_e type
         return TYPE_ERROR;
     }
 
-    if (OBJTYPE_DATA != object->obj_type)
+    if (value->type == type)
+    {
+        return TYPE_NO_CAST_REQUIRED;
+    }
+
+    type_operations_t *ops = &_type_ops[value->type];
+    cast_func_t cast_func = ops->cast_functions[type];
+
+    if (NULL == cast_func)
     {
         return TYPE_INVALID_CAST;
     }
 
-    data_object_t *data_obj = (data_object_t *) object;
+    return cast_func(value, output, data);
+}
 
-    if (data_obj->data_type == type)
+
+/**
+ * @see type_operations_api.h
+ */
+binary_func_t type_binary_op_lookup(data_type_e lhs_type, data_type_e rhs_type)
+{
+    if ((NUM_DATATYPES <= lhs_type) || (NUM_DATATYPES <= rhs_type))
     {
-        return TYPE_NO_CAST_REQUIRED;
+        return NULL;
     }
 
-    type_operations_t *ops = &_type_ops[data_obj->data_type];
-    cast_func_t cast_func = ops->cast_functions[type];
+    return _type_ops[lhs_type].binary_functions[rhs_type];
+}
 
-    if (NULL == cast_func)
+
+/**
+ * @see type_operations_api.h
+ */
+cast_func_t type_cast_lookup(data_type_e from_type, data_type_e to_type)
+{
+    if ((NUM_DATATYPES <= from_type) || (NUM_DATATYPES <= to_type))
     {
-        return TYPE_INVALID_CAST;
+        return NULL;
     }
 
-    return cast_func(object, output, data);
+    return _type_ops[from_type].cast_functions[to_type];
+}
+
+
+/**
+ * @see type_operations_api.h
+ */
+int type_format_int(vm_int_t value, char *buf, size_t size)
+{
+    return snprintf(buf, size, "%d", value);
+}
+
+
+/**
+ * @see type_operations_api.h
+ */
+int type_format_float(vm_float_t value, uint16_t places, char *buf, size_t size)
+{
+    return snprintf(buf, size, "%.*f", (int) places, value);
+}
+
+
+/**
+ * @see type_operations_api.h
+ */
+const char *type_format_bool(vm_bool_t value)
+{
+    return value ? BOOL_STRING_TRUE : BOOL_STRING_FALSE;
 }
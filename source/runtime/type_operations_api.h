@@ -1,9 +1,21 @@
 #ifndef TYPE_OPERATIONS_API_H_
 #define TYPE_OPERATIONS_API_H_
 
+#include <stddef.h>
+
 #include "data_types.h"
 
 
+/* Size of the buffer needed for the string created by casting an int to a
+ * string, including the null byte. Casting a float to a string needs this
+ * many bytes plus the number of decimal places. */
+#define TYPE_MAX_STRING_NUM_SIZE (32u)
+
+
+/* Highest number of decimal places allowed when casting a float to a string */
+#define TYPE_MAX_FLOAT_PLACES (32)
+
+
 typedef enum
 {
     TYPE_OK,
@@ -26,11 +38,31 @@ typedef enum
 } binary_op_e;
 
 
+typedef enum
+{
+    COMPARE_EQUAL,
+    COMPARE_NOT_EQUAL,
+    COMPARE_LESS,
+    COMPARE_LESS_EQUAL,
+    COMPARE_GREATER,
+    COMPARE_GREATER_EQUAL
+} compare_op_e;
+
+
+/* Function for casting one data type to another type, creating a new value */
+typedef type_status_e (*cast_func_t) (value_t *, value_t *, uint16_t);
+
+/* Function for performing a binary operation using two values as operands,
+ * and creating a new value containing the result */
+typedef type_status_e (*binary_func_t) (value_t *, value_t *, value_t *,
+                                        binary_op_e);
+
+
 /**
- * Creates a new object by casting the provided object to the specified data type
+ * Creates a new value by casting the provided value to the specified data type
  *
- * @param    object      Pointer to the object to cast
- * @param    output      Pointer location to store pointer to output object
+ * @param    value       Pointer to the value to cast
+ * @param    output      Pointer location to store output value
  * @param    type        Data type to cast to
  * @param    extra_data  If casting from string to int, this value specifies the
  *                       numerical base that the source string is written in, from
@@ -42,7 +74,7 @@ typedef enum
  *           then TYPE_RUNTIME_ERROR will be returned, otherwise TYPE_INVALID_CAST
  *           if the source type cannot be converted to the requested type.
  */
-type_status_e type_cast_to(object_t *object, object_t **output,
+type_status_e type_cast_to(value_t *value, value_t *output,
                            data_type_e type, uint16_t extra_data);
 
 
@@ -52,15 +84,111 @@ type_status_e type_cast_to(object_t *object, object_t **output,
  *
  * @param    lhs         Pointer to LHS value for the operation
  * @param    rhs         Pointer to RHS value for the operation
- * @param    result      Pointer location to store pointer to result value
+ * @param    result      Pointer location to store result value
  * @param    op_type  Arithmetic operation to perform
  *
  * @return   TYPE_OK if operation succeeded. If a runtime error was generated,
  *           then TYPE_RUNTIME_ERROR will be returned, otherwise TYPE_INVALID_ARITHMETIC
  *           if no function exists for handling the given LHS and RHS types
  */
-type_status_e type_binary_op(object_t *lhs, object_t *rhs, object_t **result,
+type_status_e type_binary_op(value_t *lhs, value_t *rhs, value_t *result,
                              binary_op_e op_type);
 
 
+/**
+ * Find the function that type_binary_op would use for operands of the given
+ * data types, so that it can be cached and called directly
+ *
+ * @param    lhs_type    Data type of the LHS operand
+ * @param    rhs_type    Data type of the RHS operand
+ *
+ * @return   Pointer to binary operation function, or NULL if arithmetic is not
+ *           possible with the given data types
+ */
+binary_func_t type_binary_op_lookup(data_type_e lhs_type, data_type_e rhs_type);
+
+
+/**
+ * Find the function that type_cast_to would use to cast between the given data
+ * types, so that it can be cached and called directly
+ *
+ * @param    from_type    Data type of the value being cast
+ * @param    to_type      Data type to cast to
+ *
+ * @return   Pointer to cast function, or NULL if the cast is not possible (or not
+ *           required, because both data types are the same)
+ */
+cast_func_t type_cast_lookup(data_type_e from_type, data_type_e to_type);
+
+
+/**
+ * Returns the truth value of the provided value, i.e. the value it would have
+ * if it was cast to a bool, without creating a new value
+ *
+ * @param    value       Pointer to the value to test
+ *
+ * @return   1 if the value is true, 0 if it is false
+ */
+vm_bool_t type_is_true(value_t *value);
+
+
+/**
+ * Compare two values. Ints, floats and bools are compared by their numerical
+ * values, and strings are compared byte-wise. Floats are totally ordered, so
+ * that each comparison is always the opposite of its inverse; NaN is equal to
+ * itself, and greater than any other number. Strings are never equal to
+ * numbers, and can't be ordered against them.
+ *
+ * @param    lhs         Pointer to LHS value for the comparison
+ * @param    rhs         Pointer to RHS value for the comparison
+ * @param    op_type     Comparison to perform
+ * @param    result      Pointer to location to store result of comparison
+ *
+ * @return   TYPE_OK if the comparison succeeded, otherwise TYPE_INVALID_ARITHMETIC
+ *           if the values can't be compared
+ */
+type_status_e type_compare(value_t *lhs, value_t *rhs, compare_op_e op_type,
+                           vm_bool_t *result);
+
+
+/**
+ * Write the characters of the string created by casting an int to a string
+ *
+ * @param    value       Int to format
+ * @param    buf         Pointer to buffer to write the characters to, followed
+ *                       by a null byte (may be NULL if size is 0)
+ * @param    size        Size of the buffer in bytes
+ *
+ * @return   Number of characters in the string, not counting the null byte.
+ *           If this is not less than size, the output was truncated.
+ */
+int type_format_int(vm_int_t value, char *buf, size_t size);
+
+
+/**
+ * Write the characters of the string created by casting a float to a string
+ *
+ * @param    value       Float to format
+ * @param    places      Number of digits after the decimal point, which must not
+ *                       be more than TYPE_MAX_FLOAT_PLACES
+ * @param    buf         Pointer to buffer to write the characters to, followed
+ *                       by a null byte (may be NULL if size is 0)
+ * @param    size        Size of the buffer in bytes
+ *
+ * @return   Number of characters in the string, not counting the null byte.
+ *           If this is not less than size, the output was truncated.
+ */
+int type_format_float(vm_float_t value, uint16_t places, char *buf, size_t size);
+
+
+/**
+ * Returns the string created by casting a bool to a string
+ *
+ * @param    value       Bool to format
+ *
+ * @return   Pointer to null-terminated string
+ */
+const char *type_format_bool(vm_bool_t value);
+
+
 #endif /* TYPE_OPERATIONS_API_H_ */
@@ -1,78 +1,244 @@
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "vm_api.h"
+#include "register_vm_api.h"
+#include "tos_cache_vm_api.h"
+#include "jit_api.h"
+#include "aot_api.h"
 #include "bytecode_utils_api.h"
+#include "type_inference_api.h"
 #include "opcode_handlers.h"
 #include "common.h"
 #include "disassemble_api.h"
+#include "memory_manager_api.h"
+#include "data_stack_api.h"
+#include "object_helpers_api.h"
+#include "fnv_1a_api.h"
+#include "globals_api.h"
 
 
-#define CALLSTACK_ITEMS_PER_NODE (32)
-#define DATASTACK_ITEMS_PER_NODE (32)
-#define CONSTPOOL_ITEMS_PER_NODE (32)
+/* Select the dispatch engine used by vm_execute. Exactly one of these may be
+ * defined at build time (see VM_CONFIG_OPTS in the Makefile); if none are
+ * defined then the function pointer table is used. */
+#if defined(VM_DISPATCH_COMPUTED_GOTO) && defined(VM_DISPATCH_TAILCALL)
+#error "Only one of VM_DISPATCH_COMPUTED_GOTO and VM_DISPATCH_TAILCALL may be defined"
+#endif
 
+#if !defined(VM_DISPATCH_COMPUTED_GOTO) && !defined(VM_DISPATCH_TAILCALL) && \
+    !defined(VM_DISPATCH_TABLE)
+#define VM_DISPATCH_TABLE
+#endif
 
-#define CHECK_ULIST_ERR(func) {                                               \
-    ulist_status_e _err_code = func;                                          \
-    if (ULIST_ERROR_MEM == _err_code)                                         \
-    {                                                                         \
-        return VM_MEMORY_ERROR;                                               \
-    }                                                                         \
-    else if (ULIST_OK != _err_code)                                           \
-    {                                                                         \
-        return VM_ERROR;                                                      \
-    }                                                                         \
-}
 
-typedef struct{
-    op_handler_t handler;    // handler for opcode
-    size_t bytes;            // bytecode size in bytes, excluding the opcode
-} op_handler_info_t;
+#if defined(VM_DISPATCH_TAILCALL)
+
+/* Clang (and GCC 15+) can be told that a tail call must be compiled as a jump.
+ * Older GCC versions only turn the calls into jumps when sibling call
+ * optimization is enabled, so the tail-call handlers are always optimized,
+ * even in debug builds; otherwise every executed instruction would use more of
+ * the C stack. */
+#if defined(__has_attribute)
+#if __has_attribute(musttail)
+#define VM_MUSTTAIL __attribute__((musttail))
+#define VM_TAIL_HANDLER_ATTR
+#endif
+#endif
+
+#ifndef VM_MUSTTAIL
+#if defined(__GNUC__) && !defined(__clang__)
+#define VM_MUSTTAIL
+#define VM_TAIL_HANDLER_ATTR __attribute__((optimize("O2", "optimize-sibling-calls")))
+#else
+#error "VM_DISPATCH_TAILCALL requires a compiler that supports musttail"
+#endif
+#endif
+
+#endif /* VM_DISPATCH_TAILCALL */
+
+
+#ifdef VM_TRACE
+
+#if (VM_TRACE_ENTRIES & (VM_TRACE_ENTRIES - 1u))
+#error "VM_TRACE_ENTRIES must be a power of 2"
+#endif
+
+/* Records the instruction about to be executed in the trace ring buffer */
+#define VM_TRACE_RECORD(ip)                                                         \
+    do {                                                                            \
+        vm_trace_t *__trace = &instance->trace;                                     \
+        vm_trace_entry_t *__entry = __trace->entries +                              \
+                                    (__trace->count & (VM_TRACE_ENTRIES - 1u));     \
+                                                                                    \
+        __entry->offset = (ip)->offset;                                             \
+        __entry->opcode = (opcode_t) (ip)->opcode;                                  \
+        __entry->stack_depth =                                                      \
+            (uint32_t) DATA_STACK_DEPTH(instance->callstack.current_frame);         \
+        __trace->count += 1u;                                                       \
+    }                                                                               \
+    while (0)
+
+#else
+
+#define VM_TRACE_RECORD(ip)
+
+#endif /* VM_TRACE */
+
+
+#ifdef VM_PROFILE
+
+/* Counts the instruction about to be executed, along with the one or two
+ * instructions that were executed immediately before it, if they are next to
+ * each other in the program (i.e. they could be fused into a superinstruction) */
+#define VM_PROFILE_RECORD(ip) _profile_record(instance->profile, (ip))
+
+#else
+
+#define VM_PROFILE_RECORD(ip)
+
+#endif /* VM_PROFILE */
+
+
+/* Runs before each instruction is dispatched, in every dispatch engine */
+#define VM_PRE_DISPATCH(ip)                                                         \
+    do {                                                                            \
+        VM_TRACE_RECORD(ip);                                                        \
+        VM_PROFILE_RECORD(ip);                                                      \
+    }                                                                               \
+    while (0)
+
+
+#define HANDLER_ENTRY(op, op_handler, pops, pushes) [op] = op_handler,
 
 
 /* Handlers for virtual machine instructions. Arranged so that the opcode_e
  * value can be used to index the array for speedy dispatch. */
-static op_handler_info_t _op_handlers[NUM_OPCODES] = {
-    {.handler=opcode_handler_nop,           .bytes=0u},                 // OPCODE_NOP
-    {.handler=opcode_handler_add,           .bytes=0u},                 // OPCODE_ADD
-    {.handler=opcode_handler_sub,           .bytes=0u},                 // OPCODE_SUB
-    {.handler=opcode_handler_mult,          .bytes=0u},                 // OPCODE_MULT
-    {.handler=opcode_handler_div,           .bytes=0u},                 // OPCODE_DIV
-    {.handler=opcode_handler_int,           .bytes=sizeof(vm_int_t)},   // OPCODE_INT
-    {.handler=opcode_handler_float,         .bytes=sizeof(vm_float_t)}, // OPCODE_FLOAT
-    {.handler=opcode_handler_string,        .bytes=0u},                 // OPCODE_STRING
-    {.handler=opcode_handler_bool,          .bytes=sizeof(vm_bool_t)},  // OPCODE_BOOL
-    {.handler=opcode_handler_print,         .bytes=0u},                 // OPCODE_PRINT
-    {.handler=opcode_handler_cast,          .bytes=sizeof(uint16_t)},   // OPCODE_CAST
-    {.handler=opcode_handler_jump,          .bytes=sizeof(int32_t)},    // OPCODE_JUMP
-    {.handler=opcode_handler_jump_if_false, .bytes=sizeof(int32_t)},    // OPCODE_JUMP_IF_FALSE
-    {.handler=opcode_handler_define_const,  .bytes=0u},                 // OPCODE_DEFINE_CONST
-    {.handler=opcode_handler_load_const,    .bytes=sizeof(uint32_t)},   // OPCODE_LOAD_CONST
-    {.handler=opcode_handler_end,           .bytes=0u},                 // OPCODE_END
+static op_handler_t _op_handlers[VM_NUM_OPCODES] = {
+    VM_OPCODE_LIST(HANDLER_ENTRY)
 };
 
 
-/**
- * Creates a new stack frame and intializes the data stack in the newly-created
- * frame with the correct size for data_stack_entry_t
- */
-static vm_status_e init_next_callstack_frame(callstack_t *callstack)
+#define UNCHECKED_HANDLER_ENTRY(op, op_handler, pops, pushes)                 \
+    [op] = UNCHECKED_HANDLER(op_handler),
+
+
+/* Handlers for programs whose stack depth was proven by vm_load, which don't
+ * check the data stack for underflow, or for space before pushing */
+static op_handler_t _unchecked_op_handlers[VM_NUM_OPCODES] = {
+    VM_OPCODE_LIST(UNCHECKED_HANDLER_ENTRY)
+};
+
+
+typedef struct
+{
+    uint8_t pops;      // Number of items popped from the data stack
+    uint8_t pushes;    // Number of items pushed to the data stack
+} stack_effect_t;
+
+
+#define STACK_EFFECT_ENTRY(op, op_handler, op_pops, op_pushes)                \
+    [op] = {.pops=op_pops, .pushes=op_pushes},
+
+
+/* Data stack effect of each instruction, indexed by opcode_e/vm_opcode_e value */
+static const stack_effect_t _stack_effects[VM_NUM_OPCODES] = {
+    VM_OPCODE_LIST(STACK_EFFECT_ENTRY)
+};
+
+
+#ifdef VM_PROFILE
+
+#define OPCODE_NAME_ENTRY(op, op_handler, pops, pushes) [op] = #op,
+
+
+/* Names of opcodes as written by vm_profile_write, indexed by opcode_e value */
+static const char *_opcode_names[VM_NUM_OPCODES] = {
+    VM_OPCODE_LIST(OPCODE_NAME_ENTRY)
+};
+
+
+/* Records an executed instruction in the profile. The opcode is read from the
+ * bytecode rather than the loaded instruction, since quickening may already
+ * have replaced the opcode of the loaded instruction. */
+static inline void _profile_record(vm_profile_t *profile, const vm_instruction_t *ip)
+{
+    opcode_t opcode = profile->program->bytecode[ip->offset];
+
+    // A sequence is broken by any jump, taken or not, to a different instruction
+    if ((NULL == profile->previous) || ((profile->previous + 1) != ip))
+    {
+        profile->history_length = 0u;
+    }
+
+    if (1u <= profile->history_length)
+    {
+        profile->pairs[profile->history[1]][opcode] += 1u;
+    }
+
+    if (2u <= profile->history_length)
+    {
+        profile->triples[profile->history[0]][profile->history[1]][opcode] += 1u;
+    }
+
+    profile->history[0] = profile->history[1];
+    profile->history[1] = opcode;
+    profile->previous = ip;
+
+    if (2u > profile->history_length)
+    {
+        profile->history_length += 1u;
+    }
+}
+
+#endif /* VM_PROFILE */
+
+
+#ifdef VM_BRANCH_PROFILE
+
+/* Give each conditional jump in a loaded program a count of the times it went
+ * each way, starting at zero */
+static vm_status_e _create_branch_counts(vm_program_t *program)
 {
-    callstack_frame_t *top_frame;
+    size_t total = 0u;
+
+    for (size_t i = 0u; i < program->num_instructions; i++)
+    {
+        total += bytecode_utils_is_conditional_jump(program->instructions[i].opcode) ? 1u : 0u;
+    }
+
+    program->branches = NULL;
+    program->num_branches = 0u;
+
+    if (0u < total)
+    {
+        program->branches = memory_manager_alloc(total * sizeof(vm_branch_count_t));
+        if (NULL == program->branches)
+        {
+            return VM_MEMORY_ERROR;
+        }
+    }
 
-    // Get pointer to the new top stack frame
-    CHECK_ULIST_ERR(ulist_alloc(&callstack->frames,
-                    callstack->frames.num_items, (void **) &top_frame));
+    for (size_t i = 0u; i < program->num_instructions; i++)
+    {
+        vm_instruction_t *ins = program->instructions + i;
+        ins->branch = NULL;
 
-    // Initialize data stack for the top callstack frame
-    CHECK_ULIST_ERR(ulist_create(&top_frame->data, sizeof(object_t *),
-                                 DATASTACK_ITEMS_PER_NODE));
+        if (bytecode_utils_is_conditional_jump(ins->opcode))
+        {
+            ins->branch = program->branches + program->num_branches;
+            ins->branch->taken = 0u;
+            ins->branch->not_taken = 0u;
+            program->num_branches += 1u;
+        }
+    }
 
-    callstack->current_frame = top_frame;
     return VM_OK;
 }
 
+#endif /* VM_BRANCH_PROFILE */
+
 
 /**
  * @see vm_api.h
@@ -84,16 +250,37 @@ vm_status_e vm_create(vm_instance_t *instance)
         return VM_INVALID_PARAM;
     }
 
-    // Create callstack
-    CHECK_ULIST_ERR(ulist_create(&instance->callstack.frames,
-                                 sizeof(callstack_frame_t),
-                                 CALLSTACK_ITEMS_PER_NODE));
+    // Create callstack, with the value stack shared by all of its frames
+    if (DATA_STACK_OK != data_stack_create(&instance->callstack))
+    {
+        return VM_MEMORY_ERROR;
+    }
+
+    // Constant pool is provided by the program passed to vm_execute
+    instance->constants = NULL;
+    instance->trace_loops = 0u;
 
-    // Initialize constants pool
-    CHECK_ULIST_ERR(ulist_create(&instance->constants, sizeof(object_t *),
-                                 CONSTPOOL_ITEMS_PER_NODE));
+    globals_status_e globals_err = globals_create(&instance->globals);
+    if (GLOBALS_OK != globals_err)
+    {
+        return (GLOBALS_MEMORY_ERROR == globals_err) ? VM_MEMORY_ERROR : VM_ERROR;
+    }
+
+#ifdef VM_TRACE
+    instance->trace.count = 0u;
+    instance->trace.program = NULL;
+#endif /* VM_TRACE */
+
+#ifdef VM_PROFILE
+    if ((instance->profile = memory_manager_alloc(sizeof(vm_profile_t))) == NULL)
+    {
+        return VM_MEMORY_ERROR;
+    }
 
-    return init_next_callstack_frame(&instance->callstack);
+    (void) memset(instance->profile, 0, sizeof(vm_profile_t));
+#endif /* VM_PROFILE */
+
+    return VM_OK;
 }
 
 
@@ -102,89 +289,313 @@ vm_status_e vm_create(vm_instance_t *instance)
  */
 vm_status_e vm_destroy(vm_instance_t *instance)
 {
-    callstack_frame_t *frame = NULL;
+    if (GLOBALS_OK != globals_destroy(&instance->globals))
+    {
+        return VM_ERROR;
+    }
+
+    // Releases the local variables of every frame, including any unfinished calls
+    if (DATA_STACK_OK != data_stack_destroy(&instance->callstack))
+    {
+        return VM_ERROR;
+    }
+
+#ifdef VM_PROFILE
+    memory_manager_free(instance->profile);
+    instance->profile = NULL;
+#endif /* VM_PROFILE */
+
+    return VM_OK;
+}
+
+
+/* Instruction boundary bitmap, with one bit for each byte of the bytecode */
+#define BOUNDARY_SET(bitmap, offset)                                          \
+    ((bitmap)[(offset) >> 3u] |= (uint8_t) (1u << ((offset) & 7u)))
+
+#define BOUNDARY_TEST(bitmap, offset)                                         \
+    (((bitmap)[(offset) >> 3u] >> ((offset) & 7u)) & 1u)
+
+
+/**
+ * Follow every path through the program, and track the range of data stack
+ * depths that each instruction can be reached with, until no range changes.
+ * Functions are followed from each call with an empty data stack, since every
+ * call has a frame of its own. Fails if any instruction can be reached with
+ * fewer items on the stack than it pops. The depth can only exceed the total
+ * number of items pushed by all instructions if some loop grows the stack on
+ * every iteration, in which case the depth is unbounded, and the ranges are
+ * capped at that total.
+ */
+static vm_status_e _analyse_stack_depth(bytecode_t *bytecode, size_t num_instructions,
+                                        int64_t limit, size_t *max_depth, uint8_t *bounded)
+{
+    bytecode_instruction_t decoded;
+    size_t worklist_count = 0u;
+    int64_t deepest = 0;
+    vm_status_e ret = VM_OK;
+
+    int64_t *min_depths = memory_manager_alloc(bytecode->used_bytes * sizeof(int64_t));
+    int64_t *max_depths = memory_manager_alloc(bytecode->used_bytes * sizeof(int64_t));
+    size_t *worklist = memory_manager_alloc(num_instructions * sizeof(size_t));
+    uint8_t *queued = memory_manager_alloc(bytecode->used_bytes);
+
+    if ((NULL == min_depths) || (NULL == max_depths) || (NULL == worklist) || (NULL == queued))
+    {
+        memory_manager_free(min_depths);
+        memory_manager_free(max_depths);
+        memory_manager_free(worklist);
+        memory_manager_free(queued);
+        return VM_MEMORY_ERROR;
+    }
+
+    // A maximum depth of -1 marks instructions that haven't been reached yet
+    (void) memset(max_depths, 0xff, bytecode->used_bytes * sizeof(int64_t));
+    (void) memset(queued, 0, bytecode->used_bytes);
 
-    CHECK_ULIST_ERR(ulist_set_iteration_start_index(&instance->callstack.frames, 0u));
+    *bounded = 1u;
+    min_depths[0] = 0;
+    max_depths[0] = 0;
+    queued[0] = 1u;
+    worklist[worklist_count++] = 0u;
 
-    if (instance->callstack.frames.num_items > 0)
+    while (0u < worklist_count)
     {
-        /* Iterate over callstack frames, and destroy the list used for the data
-         * stack in each callstack frame */
-        while (1)
+        size_t offset = worklist[--worklist_count];
+        queued[offset] = 0u;
+
+        (void) bytecode_utils_decode_instruction(bytecode, offset, &decoded);
+        const stack_effect_t *effect = _stack_effects + decoded.opcode;
+
+        // Superinstructions have the operands of their first instruction
+        opcode_e base = bytecode_utils_base_opcode(decoded.opcode);
+        int64_t pops = bytecode_utils_is_call(base) ? decoded.operand.call.num_args : effect->pops;
+
+        if (min_depths[offset] < pops)
         {
-            ulist_status_e err;
+            ret = VM_INVALID_STACK;
+            break;
+        }
 
-            err = ulist_get_next_item(&instance->callstack.frames, (void **) &frame);
-            if (ULIST_END == err)
-            {
-                // No more frames in callstack
+        // Range of depths after this instruction, which its successors are reached with
+        int64_t min_after = (min_depths[offset] - pops) + effect->pushes;
+        int64_t max_after = (max_depths[offset] - pops) + effect->pushes;
+
+        if (limit < max_after)
+        {
+            max_after = limit;
+            *bounded = 0u;
+        }
+
+        if (deepest < max_after)
+        {
+            deepest = max_after;
+        }
+
+        size_t successors[2];
+        int64_t min_entry[2] = {min_after, min_after};
+        int64_t max_entry[2] = {max_after, max_after};
+        size_t num_successors = 0u;
+
+        switch (base)
+        {
+            case OPCODE_END:
+            case OPCODE_RETURN:
+                break;
+
+            case OPCODE_JUMP:
+                successors[num_successors++] = offset + decoded.operand.jump_offset;
+                break;
+
+            case OPCODE_CALL:
+            case OPCODE_TAIL_CALL:
+                // The function is entered with an empty data stack
+                min_entry[num_successors] = 0;
+                max_entry[num_successors] = 0;
+                successors[num_successors++] = offset + decoded.operand.jump_offset;
+
+                // Tail calls return straight to the caller of the current function
+                if (OPCODE_CALL == base)
+                {
+                    successors[num_successors++] = offset + decoded.size;
+                }
+                break;
+
+            default:
+                if (bytecode_utils_is_conditional_jump(base))
+                {
+                    successors[num_successors++] = offset + decoded.operand.jump_offset;
+                }
+
+                successors[num_successors++] = offset + decoded.size;
                 break;
+        }
+
+        for (size_t k = 0u; k < num_successors; k++)
+        {
+            size_t next = successors[k];
+            uint8_t changed = 0u;
+
+            if (0 > max_depths[next])
+            {
+                min_depths[next] = min_entry[k];
+                max_depths[next] = max_entry[k];
+                changed = 1u;
+            }
+
+            if (min_depths[next] > min_entry[k])
+            {
+                min_depths[next] = min_entry[k];
+                changed = 1u;
             }
-            else if (ULIST_OK != err)
+
+            if (max_depths[next] < max_entry[k])
             {
-                return VM_ERROR;
+                max_depths[next] = max_entry[k];
+                changed = 1u;
             }
 
-            // Destroy datastack for this frame
-            CHECK_ULIST_ERR(ulist_destroy(&frame->data));
+            if (changed && !queued[next])
+            {
+                queued[next] = 1u;
+                worklist[worklist_count++] = next;
+            }
         }
     }
 
-    // Destroy constants table
-    CHECK_ULIST_ERR(ulist_destroy(&instance->constants));
+    memory_manager_free(min_depths);
+    memory_manager_free(max_depths);
+    memory_manager_free(worklist);
+    memory_manager_free(queued);
 
-    // Finally, destroy the list that holds the callstack
-    CHECK_ULIST_ERR(ulist_destroy(&instance->callstack.frames));
+    *max_depth = (size_t) deepest;
+    return ret;
+}
 
-    return VM_OK;
+
+/* Returns 1 if the const_index operand of an instruction refers to the constant pool */
+static int _uses_constant(opcode_e opcode)
+{
+    return (OPCODE_LOAD_CONST == opcode) || (OPCODE_LOAD_GLOBAL == opcode) ||
+           (OPCODE_STORE_GLOBAL == opcode);
 }
 
 
-vm_status_e vm_verify(bytecode_t *program)
+/**
+ * Check the structure of a program; every instruction must be valid and the
+ * last one must be OPCODE_END, every jump and call must land on the start of
+ * an instruction, every constant pool index must be in range, and no path
+ * through the program may pop more items than it pushed. Also calculates the
+ * maximum depth that the data stack can reach, and whether it is bounded.
+ */
+static vm_status_e _analyse_program(bytecode_t *bytecode, size_t *max_depth, uint8_t *bounded)
 {
-    uint8_t *bytes = (uint8_t *) program->bytecode;
-    uint32_t i;
+    bytecode_instruction_t decoded;
+    size_t num_instructions = 0u;
+    uint32_t num_constants = 0u;
+    int64_t total_pushes = 0;
+    size_t offset;
+    vm_status_e ret = VM_OK;
+
+    uint8_t *boundaries = memory_manager_alloc((bytecode->used_bytes + 7u) / 8u);
+    if (NULL == boundaries)
+    {
+        return VM_MEMORY_ERROR;
+    }
 
-    for (i = 0; i < program->used_bytes; i++)
+    (void) memset(boundaries, 0, (bytecode->used_bytes + 7u) / 8u);
+
+    // First pass; decode every instruction, and find instruction boundaries
+    for (offset = 0u; offset < bytecode->used_bytes; offset += decoded.size)
     {
-        if (NUM_OPCODES <= bytes[i])
+        if (!bytecode_utils_decode_instruction(bytecode, offset, &decoded))
         {
+            memory_manager_free(boundaries);
             return VM_INVALID_OPCODE;
         }
 
-        opcode_e op = (opcode_e) bytes[i];
-        op_handler_info_t *handler_info = _op_handlers + op;
-        size_t extra_bytes_to_increment = handler_info->bytes;
+        BOUNDARY_SET(boundaries, offset);
+        num_instructions += 1u;
+        total_pushes += _stack_effects[decoded.opcode].pushes;
 
-        switch (op)
+        if (OPCODE_DEFINE_CONST == bytecode_utils_base_opcode(decoded.opcode))
         {
-            // Special case for string, variable bytecode length
-            case OPCODE_STRING:
-            {
-                uint32_t string_bytes = *((uint32_t *) (bytes + i + 1u));
-                extra_bytes_to_increment += string_bytes;
-                break;
-            }
-            // Special case for defining consts, variable bytecode length
-            case OPCODE_DEFINE_CONST:
+            num_constants += 1u;
+        }
+    }
+
+    // Last decoded instruction must be the end of the program
+    if (OPCODE_END != decoded.opcode)
+    {
+        memory_manager_free(boundaries);
+        return VM_INVALID_OPCODE;
+    }
+
+    // Second pass; check jump and call targets, and constant pool indices
+    for (offset = 0u; offset < bytecode->used_bytes; offset += decoded.size)
+    {
+        (void) bytecode_utils_decode_instruction(bytecode, offset, &decoded);
+        opcode_e base = bytecode_utils_base_opcode(decoded.opcode);
+
+        if (bytecode_utils_has_target(base))
+        {
+            int64_t target = ((int64_t) offset) + decoded.operand.jump_offset;
+
+            if ((0 > target) || (((int64_t) bytecode->used_bytes) <= target) ||
+                !BOUNDARY_TEST(boundaries, (size_t) target))
             {
-                opcode_t *data_val = (opcode_t *) (bytes + i + 1u);
-                extra_bytes_to_increment = bytecode_utils_data_object_size_bytes(data_val);
+                ret = VM_INVALID_JUMP;
                 break;
             }
-
-            default:
-                ;// Nothing to do
-                break;
         }
+        else if (_uses_constant(base) && (num_constants <= decoded.operand.const_index))
+        {
+            ret = VM_INVALID_CONSTANT;
+            break;
+        }
+    }
+
+    if (VM_OK == ret)
+    {
+        ret = _analyse_stack_depth(bytecode, num_instructions, total_pushes, max_depth,
+                                   bounded);
+    }
+
+    memory_manager_free(boundaries);
+    return ret;
+}
+
+
+vm_status_e vm_verify(bytecode_t *program)
+{
+    size_t max_depth;
+    uint8_t bounded;
+    vm_status_e ret;
 
-        i += extra_bytes_to_increment;
+    if ((NULL == program) || (0u == program->used_bytes))
+    {
+        return VM_INVALID_PARAM;
     }
 
-    opcode_e last_op = bytes[i - 1];
-    if (OPCODE_END != last_op)
+    if ((ret = _analyse_program(program, &max_depth, &bounded)) != VM_OK)
     {
-        return VM_INVALID_OPCODE;
+        return ret;
+    }
+
+    /* Check the operand types of specialised instructions, and replace generic
+     * arithmetic with specialised opcodes where possible */
+    bytecode_status_e err = type_inference_specialise(program, NULL);
+    if (BYTECODE_MEMORY_ERROR == err)
+    {
+        return VM_MEMORY_ERROR;
+    }
+    else if (BYTECODE_INVALID_TYPES == err)
+    {
+        return VM_INVALID_TYPES;
+    }
+    else if (BYTECODE_OK != err)
+    {
+        return VM_ERROR;
     }
 
     return VM_OK;
@@ -192,31 +603,852 @@ vm_status_e vm_verify(bytecode_t *program)
 
 
 /**
- * @see vm_api.h
+ * Create the value for a single OPCODE_DEFINE_CONST instruction. String
+ * constants are immortal; they belong to the program, and are only freed
+ * by vm_unload.
  */
-vm_status_e vm_execute(vm_instance_t *instance, bytecode_t *program)
+static vm_status_e _create_constant(bytecode_operand_t *operand, value_t *value)
 {
-    // Reset instruction pointer to beginning of bytecode stream
-    program->ip = program->bytecode;
+    bytecode_immediate_t *immediate = &operand->constant.value;
 
-    while (OPCODE_END != (opcode_e) *program->ip)
+    switch (operand->constant.data_type)
     {
-        opcode_e op = (opcode_e) *program->ip;
-        op_handler_info_t *handler_info = _op_handlers + op;
+        case DATATYPE_INT:
+            *value = INT_VALUE(immediate->int_value);
+            break;
+
+        case DATATYPE_FLOAT:
+            *value = FLOAT_VALUE(immediate->float_value);
+            break;
+
+        case DATATYPE_BOOL:
+            *value = BOOL_VALUE(immediate->bool_value);
+            break;
+
+        case DATATYPE_STRING:
+            if (new_string_value(immediate->string.bytes, immediate->string.size, value) != 0)
+            {
+                return VM_MEMORY_ERROR;
+            }
 
-        (void) disassemble_bytecode(program,
-                                    (size_t) (program->ip - program->bytecode), 1u);
+            value->payload.object->refcount = OBJECT_REFCOUNT_IMMORTAL;
+            break;
+
+        default:
+            return VM_INVALID_OPCODE;
+    }
+
+    return VM_OK;
+}
 
-        opcode_t *next_instruction = handler_info->handler(program->ip, instance);
 
-        if (NULL == next_instruction)
+/**
+ * Free all values in the constant pool of a program
+ */
+static void _destroy_constants(vm_program_t *program)
+{
+    for (uint32_t i = 0u; i < program->num_constants; i++)
+    {
+        if (VALUE_IS_OBJECT(program->constants[i]))
         {
-            instance->runtime_error = runtime_error_get();
-            return VM_RUNTIME_ERROR;
+            memory_manager_free(program->constants[i].payload.object);
         }
+    }
+
+    memory_manager_free(program->constants);
+    program->constants = NULL;
+    program->num_constants = 0u;
+}
+
 
-        program->ip = next_instruction;
+/**
+ * Free the strings created by quickened OPCODE_STRING instructions. Slots for
+ * instructions that were never executed don't hold an object.
+ */
+static void _destroy_strings(vm_program_t *program)
+{
+    for (size_t i = 0u; i < program->num_strings; i++)
+    {
+        if (VALUE_IS_OBJECT(program->strings[i]))
+        {
+            memory_manager_free(program->strings[i].payload.object);
+        }
     }
 
-    return VM_OK;
+    memory_manager_free(program->strings);
+    program->strings = NULL;
+    program->num_strings = 0u;
+}
+
+
+/* Free everything allocated by vm_load before the program could be run */
+static void _destroy_loaded(vm_program_t *program)
+{
+    _destroy_constants(program);
+    _destroy_strings(program);
+    memory_manager_free(program->instructions);
+    memory_manager_free(program->caches);
+    memory_manager_free(program->loops);
+    program->instructions = NULL;
+    program->caches = NULL;
+    program->loops = NULL;
+}
+
+
+/* Returns 1 if instructions with the given opcode need an inline cache */
+static int _has_inline_cache(opcode_e opcode)
+{
+    return (OPCODE_ADD == opcode) || (OPCODE_SUB == opcode) || (OPCODE_MULT == opcode) ||
+           (OPCODE_DIV == opcode) || (OPCODE_CAST == opcode) ||
+           (OPCODE_LOAD_GLOBAL == opcode) || (OPCODE_STORE_GLOBAL == opcode);
 }
+
+
+/**
+ * @see vm_api.h
+ */
+vm_status_e vm_load(bytecode_t *bytecode, vm_program_t *program)
+{
+    bytecode_instruction_t decoded;
+    opcode_e base;
+    uint32_t *offset_map;
+    uint32_t total_constants = 0u;
+    size_t total_caches = 0u;
+    size_t total_strings = 0u;
+    size_t total_loops = 0u;
+    size_t offset, i;
+    vm_status_e ret = VM_OK;
+
+    if ((NULL == bytecode) || (NULL == program))
+    {
+        return VM_INVALID_PARAM;
+    }
+
+    /* Maps each byte offset in the bytecode to the index of the instruction
+     * that starts there, or UINT32_MAX if no instruction starts there */
+    if ((offset_map = memory_manager_alloc(bytecode->used_bytes * sizeof(uint32_t))) == NULL)
+    {
+        return VM_MEMORY_ERROR;
+    }
+
+    (void) memset(offset_map, 0xff, bytecode->used_bytes * sizeof(uint32_t));
+
+    // First pass; count instructions and find instruction boundaries
+    program->num_instructions = 0u;
+    for (offset = 0u; offset < bytecode->used_bytes; offset += decoded.size)
+    {
+        if (!bytecode_utils_decode_instruction(bytecode, offset, &decoded))
+        {
+            memory_manager_free(offset_map);
+            return VM_INVALID_OPCODE;
+        }
+
+        offset_map[offset] = (uint32_t) program->num_instructions;
+        program->num_instructions += 1u;
+
+        // Superinstructions have the operands of their first instruction
+        base = bytecode_utils_base_opcode(decoded.opcode);
+
+        if (OPCODE_DEFINE_CONST == base)
+        {
+            total_constants += 1u;
+        }
+        else if (_has_inline_cache(base))
+        {
+            total_caches += 1u;
+        }
+        else if (OPCODE_STRING == base)
+        {
+            total_strings += 1u;
+        }
+        else if (bytecode_utils_is_jump(base) && (0 >= decoded.operand.jump_offset))
+        {
+            total_loops += 1u;
+        }
+    }
+
+    program->instructions = memory_manager_alloc(program->num_instructions *
+                                                 sizeof(vm_instruction_t));
+    program->constants = NULL;
+    program->num_constants = 0u;
+    program->num_locals = 0u;
+    program->caches = NULL;
+    program->num_caches = 0u;
+    program->strings = NULL;
+    program->num_strings = 0u;
+    program->loops = NULL;
+    program->num_loops = 0u;
+
+    if (0u < total_constants)
+    {
+        program->constants = memory_manager_alloc(total_constants * sizeof(value_t));
+    }
+
+    if (0u < total_caches)
+    {
+        program->caches = memory_manager_alloc(total_caches * sizeof(vm_inline_cache_t));
+    }
+
+    if (0u < total_strings)
+    {
+        program->strings = memory_manager_alloc(total_strings * sizeof(value_t));
+    }
+
+    if (0u < total_loops)
+    {
+        program->loops = memory_manager_alloc(total_loops * sizeof(vm_loop_t));
+    }
+
+    if ((NULL == program->instructions) ||
+        ((NULL == program->constants) && (0u < total_constants)) ||
+        ((NULL == program->caches) && (0u < total_caches)) ||
+        ((NULL == program->strings) && (0u < total_strings)) ||
+        ((NULL == program->loops) && (0u < total_loops)))
+    {
+        memory_manager_free(program->instructions);
+        memory_manager_free(program->constants);
+        memory_manager_free(program->caches);
+        memory_manager_free(program->strings);
+        memory_manager_free(program->loops);
+        memory_manager_free(offset_map);
+        return VM_MEMORY_ERROR;
+    }
+
+    // Second pass; populate decoded instructions and resolve jump and call targets
+    for (offset = 0u, i = 0u; offset < bytecode->used_bytes; offset += decoded.size, i++)
+    {
+        vm_instruction_t *ins = program->instructions + i;
+
+        (void) bytecode_utils_decode_instruction(bytecode, offset, &decoded);
+        base = bytecode_utils_base_opcode(decoded.opcode);
+
+        ins->handler = _op_handlers[decoded.opcode];
+        ins->opcode = decoded.opcode;
+        ins->offset = decoded.offset;
+        ins->operand = decoded.operand;
+        ins->target = NULL;
+        ins->cache = NULL;
+        ins->value = NULL;
+        ins->loop = NULL;
+
+        if (_has_inline_cache(base))
+        {
+            // Cache starts out empty, so the first execution is always a miss
+            ins->cache = program->caches + program->num_caches;
+            ins->cache->lhs_type = NUM_DATATYPES;
+            ins->cache->rhs_type = NUM_DATATYPES;
+            ins->cache->func.binary = NULL;
+            ins->cache->version = 0u;
+            ins->cache->hits = 0u;
+            ins->cache->misses = 0u;
+            program->num_caches += 1u;
+        }
+        else if (OPCODE_STRING == base)
+        {
+            // String object is only created when the instruction is first executed
+            ins->value = program->strings + program->num_strings;
+            *ins->value = INT_VALUE(0);
+            program->num_strings += 1u;
+        }
+
+        if (bytecode_utils_has_target(base))
+        {
+            int64_t target = ((int64_t) offset) + decoded.operand.jump_offset;
+
+            if ((0 > target) || (((int64_t) bytecode->used_bytes) <= target) ||
+                (UINT32_MAX == offset_map[target]))
+            {
+                ret = VM_INVALID_JUMP;
+                break;
+            }
+
+            ins->target = program->instructions + offset_map[target];
+
+            if (bytecode_utils_is_jump(base) && (0 >= decoded.operand.jump_offset))
+            {
+                // Backward jump; count the times it is taken, for VM_ENGINE_TRACE_JIT
+                ins->loop = program->loops + program->num_loops;
+                ins->loop->count = 0u;
+                ins->loop->abandoned = 0u;
+                ins->loop->code = NULL;
+                ins->loop->size = 0u;
+                ins->loop->entry = NULL;
+                program->num_loops += 1u;
+            }
+        }
+        else if (OPCODE_DEFINE_CONST == base)
+        {
+            ret = _create_constant(&decoded.operand,
+                                   program->constants + program->num_constants);
+            if (VM_OK != ret)
+            {
+                break;
+            }
+
+            program->num_constants += 1u;
+        }
+        else if (_uses_constant(base) && (total_constants <= decoded.operand.const_index))
+        {
+            ret = VM_INVALID_CONSTANT;
+            break;
+        }
+        else if (((OPCODE_LOAD_LOCAL == base) || (OPCODE_STORE_LOCAL == base)) &&
+                 (program->num_locals <= decoded.operand.local_index))
+        {
+            program->num_locals = decoded.operand.local_index + 1u;
+        }
+    }
+
+    memory_manager_free(offset_map);
+
+    if ((VM_OK == ret) &&
+        (OPCODE_END != program->instructions[program->num_instructions - 1u].opcode))
+    {
+        ret = VM_INVALID_OPCODE;
+    }
+
+    // Global variables are named by string constants
+    for (i = 0u; (VM_OK == ret) && (i < program->num_instructions); i++)
+    {
+        vm_instruction_t *ins = program->instructions + i;
+
+        if (((OPCODE_LOAD_GLOBAL == ins->opcode) || (OPCODE_STORE_GLOBAL == ins->opcode)) &&
+            !VALUE_IS_OBJECT(program->constants[ins->operand.const_index]))
+        {
+            ret = VM_INVALID_CONSTANT;
+        }
+    }
+
+    if (VM_OK != ret)
+    {
+        _destroy_loaded(program);
+        return ret;
+    }
+
+    program->bytecode = bytecode;
+    program->jit.code = NULL;
+    program->jit.size = 0u;
+    program->jit.entries = NULL;
+    program->jit.executions = 0u;
+    program->aot.library = NULL;
+    program->aot.entry = NULL;
+
+    // Programs that might underflow the data stack can still run the checked handlers
+    uint8_t bounded;
+    ret = _analyse_program(bytecode, &program->max_stack_depth, &bounded);
+    if (VM_MEMORY_ERROR == ret)
+    {
+        _destroy_loaded(program);
+        return ret;
+    }
+
+    program->unchecked = ((VM_OK == ret) && bounded) ? 1u : 0u;
+    if (program->unchecked)
+    {
+        for (i = 0u; i < program->num_instructions; i++)
+        {
+            vm_instruction_t *ins = program->instructions + i;
+            ins->handler = _unchecked_op_handlers[ins->opcode];
+        }
+    }
+
+    // Programs that can't be translated can still be run by the stack engine
+    ret = register_vm_translate(program);
+    if (VM_UNSUPPORTED == ret)
+    {
+        ret = VM_OK;
+    }
+
+#ifdef VM_BRANCH_PROFILE
+    if (VM_OK == ret)
+    {
+        ret = _create_branch_counts(program);
+    }
+#endif /* VM_BRANCH_PROFILE */
+
+    return ret;
+}
+
+
+/**
+ * @see vm_api.h
+ */
+vm_status_e vm_unload(vm_program_t *program)
+{
+    if (NULL == program)
+    {
+        return VM_INVALID_PARAM;
+    }
+
+    _destroy_constants(program);
+    program->num_locals = 0u;
+
+    memory_manager_free(program->instructions);
+    program->instructions = NULL;
+    program->num_instructions = 0u;
+
+    memory_manager_free(program->caches);
+    program->caches = NULL;
+    program->num_caches = 0u;
+
+    _destroy_strings(program);
+    register_vm_unload(program);
+    jit_unload(program);
+    aot_unload(program);
+
+    memory_manager_free(program->loops);
+    program->loops = NULL;
+    program->num_loops = 0u;
+
+#ifdef VM_BRANCH_PROFILE
+    memory_manager_free(program->branches);
+    program->branches = NULL;
+    program->num_branches = 0u;
+#endif /* VM_BRANCH_PROFILE */
+
+    return VM_OK;
+}
+
+
+/**
+ * @see vm_api.h
+ */
+vm_status_e vm_inline_cache_stats(vm_program_t *program, vm_inline_cache_stats_t *stats)
+{
+    if ((NULL == program) || (NULL == stats))
+    {
+        return VM_INVALID_PARAM;
+    }
+
+    stats->sites = program->num_caches;
+    stats->hits = 0u;
+    stats->misses = 0u;
+
+    for (size_t i = 0u; i < program->num_caches; i++)
+    {
+        stats->hits += program->caches[i].hits;
+        stats->misses += program->caches[i].misses;
+    }
+
+    return VM_OK;
+}
+
+
+#if defined(VM_DISPATCH_TABLE)
+
+/**
+ * Function pointer table dispatch; one indirect call per instruction, through
+ * the handler pointer stored in each decoded instruction
+ */
+static vm_status_e _dispatch(vm_instance_t *instance, vm_program_t *program)
+{
+    vm_instruction_t *ip = program->instructions;
+
+    while (OPCODE_END != ip->opcode)
+    {
+        VM_PRE_DISPATCH(ip);
+
+        ip = ip->handler(ip, instance);
+        if (NULL == ip)
+        {
+            return VM_RUNTIME_ERROR;
+        }
+    }
+
+    return VM_OK;
+}
+
+#elif defined(VM_DISPATCH_COMPUTED_GOTO)
+
+#define GOTO_LABEL_ENTRY(op, op_handler, pops, pushes) [op] = &&label_##op,
+
+#define UNCHECKED_GOTO_LABEL_ENTRY(op, op_handler, pops, pushes)              \
+    [op] = &&unchecked_label_##op,
+
+/* Every label calls the (out-of-line) handler for its opcode, and gets its own
+ * copy of the indirect jump to the next label, so the branch predictor can learn
+ * opcode-to-opcode transitions separately */
+#define GOTO_HANDLER_BODY(op, label, handler, table)                          \
+    label:                                                                    \
+        if (OPCODE_END == (opcode_e) (op))                                    \
+        {                                                                     \
+            return VM_OK;                                                     \
+        }                                                                     \
+                                                                              \
+        VM_PRE_DISPATCH(ip);                                                  \
+        ip = handler(ip, instance);                                           \
+        if (NULL == ip)                                                       \
+        {                                                                     \
+            return VM_RUNTIME_ERROR;                                          \
+        }                                                                     \
+                                                                              \
+        goto *table[ip->opcode];
+
+#define GOTO_HANDLER(op, op_handler, pops, pushes)                            \
+    GOTO_HANDLER_BODY(op, label_##op, op_handler, dispatch_table)
+
+#define UNCHECKED_GOTO_HANDLER(op, op_handler, pops, pushes)                  \
+    GOTO_HANDLER_BODY(op, unchecked_label_##op, UNCHECKED_HANDLER(op_handler), \
+                      unchecked_dispatch_table)
+
+
+/**
+ * Computed goto dispatch; a single function with one label per opcode, and the
+ * instruction pointer held in a local variable for the duration of the program.
+ * Each label makes a direct call to its handler; only the dispatch between
+ * instructions is threaded. Programs whose stack depth was proven by vm_load run a second set of labels,
+ * which call the unchecked handlers.
+ */
+static vm_status_e _dispatch(vm_instance_t *instance, vm_program_t *program)
+{
+    static void *dispatch_table[VM_NUM_OPCODES] = {
+        VM_OPCODE_LIST(GOTO_LABEL_ENTRY)
+    };
+
+    static void *unchecked_dispatch_table[VM_NUM_OPCODES] = {
+        VM_OPCODE_LIST(UNCHECKED_GOTO_LABEL_ENTRY)
+    };
+
+    vm_instruction_t *ip = program->instructions;
+
+    if (program->unchecked)
+    {
+        goto *unchecked_dispatch_table[ip->opcode];
+    }
+
+    goto *dispatch_table[ip->opcode];
+
+    VM_OPCODE_LIST(GOTO_HANDLER)
+    VM_OPCODE_LIST(UNCHECKED_GOTO_HANDLER)
+
+    // Not reachable, the END handler returns
+    return VM_ERROR;
+}
+
+#elif defined(VM_DISPATCH_TAILCALL)
+
+/* Tail-call threaded handler; each one runs an instruction and then jumps
+ * straight to the handler for the next instruction, so ip and instance stay in
+ * argument registers instead of being written back to memory */
+typedef vm_status_e (*tail_handler_t)(vm_instruction_t *, vm_instance_t *,
+                                      vm_program_t *);
+
+
+#define TAIL_HANDLER_DECL(op, op_handler, pops, pushes)                       \
+    VM_TAIL_HANDLER_ATTR                                                      \
+    static vm_status_e _tail_##op(vm_instruction_t *ip,                       \
+                                  vm_instance_t *instance,                    \
+                                  vm_program_t *program);                     \
+    VM_TAIL_HANDLER_ATTR                                                      \
+    static vm_status_e _unchecked_tail_##op(vm_instruction_t *ip,             \
+                                            vm_instance_t *instance,          \
+                                            vm_program_t *program);
+
+#define TAIL_HANDLER_ENTRY(op, op_handler, pops, pushes) [op] = _tail_##op,
+
+#define UNCHECKED_TAIL_HANDLER_ENTRY(op, op_handler, pops, pushes)            \
+    [op] = _unchecked_tail_##op,
+
+#define TAIL_HANDLER_BODY(op, name, handler, table)                           \
+    static vm_status_e name(vm_instruction_t *ip,                             \
+                            vm_instance_t *instance,                          \
+                            vm_program_t *program)                            \
+    {                                                                         \
+        if (OPCODE_END == (opcode_e) (op))                                    \
+        {                                                                     \
+            return VM_OK;                                                     \
+        }                                                                     \
+                                                                              \
+        VM_PRE_DISPATCH(ip);                                                  \
+        ip = handler(ip, instance);                                           \
+        if (NULL == ip)                                                       \
+        {                                                                     \
+            return VM_RUNTIME_ERROR;                                          \
+        }                                                                     \
+                                                                              \
+        VM_MUSTTAIL return table[ip->opcode](ip, instance, program);          \
+    }
+
+#define TAIL_HANDLER_DEF(op, op_handler, pops, pushes)                        \
+    TAIL_HANDLER_BODY(op, _tail_##op, op_handler, _tail_handlers)
+
+#define UNCHECKED_TAIL_HANDLER_DEF(op, op_handler, pops, pushes)              \
+    TAIL_HANDLER_BODY(op, _unchecked_tail_##op, UNCHECKED_HANDLER(op_handler), \
+                      _unchecked_tail_handlers)
+
+
+VM_OPCODE_LIST(TAIL_HANDLER_DECL)
+
+static const tail_handler_t _tail_handlers[VM_NUM_OPCODES] = {
+    VM_OPCODE_LIST(TAIL_HANDLER_ENTRY)
+};
+
+/* Chain of handlers for programs whose stack depth was proven by vm_load */
+static const tail_handler_t _unchecked_tail_handlers[VM_NUM_OPCODES] = {
+    VM_OPCODE_LIST(UNCHECKED_TAIL_HANDLER_ENTRY)
+};
+
+VM_OPCODE_LIST(TAIL_HANDLER_DEF)
+VM_OPCODE_LIST(UNCHECKED_TAIL_HANDLER_DEF)
+
+
+/**
+ * Tail-call threaded dispatch; enters the chain of handlers at the first
+ * instruction, and returns when the END handler is reached
+ */
+static vm_status_e _dispatch(vm_instance_t *instance, vm_program_t *program)
+{
+    vm_instruction_t *ip = program->instructions;
+
+    if (program->unchecked)
+    {
+        return _unchecked_tail_handlers[ip->opcode](ip, instance, program);
+    }
+
+    return _tail_handlers[ip->opcode](ip, instance, program);
+}
+
+#endif /* VM_DISPATCH_TABLE */
+
+
+#ifdef VM_TRACE
+
+/**
+ * @see vm_api.h
+ */
+void vm_trace_dump(vm_instance_t *instance)
+{
+    vm_trace_t *trace = &instance->trace;
+    size_t first = 0u;
+    size_t num_entries = trace->count;
+
+    if (VM_TRACE_ENTRIES < num_entries)
+    {
+        first = num_entries - VM_TRACE_ENTRIES;
+        num_entries = VM_TRACE_ENTRIES;
+    }
+
+    if (NULL == trace->program)
+    {
+        return;
+    }
+
+    printf("\n-------- last %zu of %zu instructions --------\n\n",
+           num_entries, trace->count);
+
+    for (size_t i = first; i < trace->count; i++)
+    {
+        vm_trace_entry_t *entry = trace->entries + (i & (VM_TRACE_ENTRIES - 1u));
+
+        printf("[depth %4u] ", entry->stack_depth);
+        (void) disassemble_bytecode(trace->program, (size_t) entry->offset, 1u);
+    }
+
+    printf("\n");
+}
+
+#endif /* VM_TRACE */
+
+
+/**
+ * @see vm_api.h
+ */
+vm_status_e vm_execute(vm_instance_t *instance, vm_program_t *program, vm_engine_e engine)
+{
+    vm_status_e err;
+
+    if ((NULL == instance) || (NULL == program) || (NULL == program->instructions) ||
+        (NUM_VM_ENGINES <= engine))
+    {
+        return VM_INVALID_PARAM;
+    }
+
+    // Frames left behind by a run that stopped inside a function are discarded
+    data_stack_unwind(&instance->callstack);
+
+    // Every function call gets the same number of local variables and data stack slots
+    instance->callstack.frame_locals = program->num_locals;
+    instance->callstack.frame_depth = program->max_stack_depth;
+
+    // Every run starts with all local variables holding int 0
+    if (DATA_STACK_OK != data_stack_reset_locals(instance->callstack.current_frame,
+                                                 program->num_locals))
+    {
+        return VM_MEMORY_ERROR;
+    }
+
+    if ((VM_ENGINE_REGISTER == engine) || (VM_ENGINE_AOT == engine))
+    {
+        if ((NULL == program->registers.instructions) ||
+            ((VM_ENGINE_AOT == engine) && (NULL == program->aot.entry)))
+        {
+            return VM_UNSUPPORTED;
+        }
+
+        instance->constants = program->constants;
+
+        if (VM_ENGINE_AOT == engine)
+        {
+            err = aot_execute(instance, program);
+        }
+        else
+        {
+            err = register_vm_execute(instance, program);
+        }
+
+        if (VM_RUNTIME_ERROR == err)
+        {
+            instance->runtime_error = runtime_error_get();
+        }
+
+        return err;
+    }
+
+    // Make sure the data stack won't need to grow while the program is running
+    if (DATA_STACK_OK != data_stack_reserve(instance->callstack.current_frame,
+                                            program->max_stack_depth))
+    {
+        return VM_MEMORY_ERROR;
+    }
+
+    instance->constants = program->constants;
+
+#ifdef VM_TRACE
+    instance->trace.count = 0u;
+    instance->trace.program = program->bytecode;
+#endif /* VM_TRACE */
+
+#ifdef VM_PROFILE
+    // Counts accumulate over every program executed by this instance
+    instance->profile->program = program->bytecode;
+    instance->profile->previous = NULL;
+#endif /* VM_PROFILE */
+
+    if (VM_ENGINE_JIT == engine)
+    {
+        // Programs are only compiled once they have been run a few times
+        if ((VM_JIT_THRESHOLD == program->jit.executions) && (NULL == program->jit.code))
+        {
+            err = jit_compile(program);
+            if ((VM_OK != err) && (VM_UNSUPPORTED != err))
+            {
+                return err;
+            }
+        }
+
+        program->jit.executions += 1u;
+    }
+
+    if (VM_ENGINE_TOS_CACHE == engine)
+    {
+        err = tos_cache_vm_execute(instance, program);
+    }
+    else if ((VM_ENGINE_JIT == engine) && (NULL != program->jit.code))
+    {
+        err = jit_execute(instance, program);
+    }
+    else
+    {
+        instance->trace_loops = (VM_ENGINE_TRACE_JIT == engine) ? 1u : 0u;
+        err = _dispatch(instance, program);
+        instance->trace_loops = 0u;
+    }
+
+    if (VM_RUNTIME_ERROR == err)
+    {
+        instance->runtime_error = runtime_error_get();
+#ifdef VM_TRACE
+        vm_trace_dump(instance);
+#endif /* VM_TRACE */
+    }
+
+    return err;
+}
+
+
+#ifdef VM_PROFILE
+
+/* Writes a single profile line, if the sequence was executed at least once */
+static void _profile_write_sequence(FILE *fp, uint64_t count, opcode_t *opcodes,
+                                    size_t num_opcodes)
+{
+    if (0u == count)
+    {
+        return;
+    }
+
+    fprintf(fp, "%" PRIu64, count);
+
+    for (size_t i = 0u; i < num_opcodes; i++)
+    {
+        // Strip the OPCODE_ prefix
+        fprintf(fp, " %s", _opcode_names[opcodes[i]] + (sizeof("OPCODE_") - 1u));
+    }
+
+    fprintf(fp, "\n");
+}
+
+
+/**
+ * @see vm_api.h
+ */
+vm_status_e vm_profile_write(vm_instance_t *instance, FILE *fp)
+{
+    if ((NULL == instance) || (NULL == instance->profile) || (NULL == fp))
+    {
+        return VM_INVALID_PARAM;
+    }
+
+    vm_profile_t *profile = instance->profile;
+    opcode_t opcodes[3];
+
+    for (opcodes[0] = 0u; opcodes[0] < NUM_OPCODES; opcodes[0]++)
+    {
+        for (opcodes[1] = 0u; opcodes[1] < NUM_OPCODES; opcodes[1]++)
+        {
+            _profile_write_sequence(fp, profile->pairs[opcodes[0]][opcodes[1]], opcodes, 2u);
+
+            for (opcodes[2] = 0u; opcodes[2] < NUM_OPCODES; opcodes[2]++)
+            {
+                _profile_write_sequence(fp, profile->triples[opcodes[0]][opcodes[1]][opcodes[2]],
+                                        opcodes, 3u);
+            }
+        }
+    }
+
+    return VM_OK;
+}
+
+#endif /* VM_PROFILE */
+
+
+#ifdef VM_BRANCH_PROFILE
+
+/**
+ * @see vm_api.h
+ */
+vm_status_e vm_branch_profile_write(vm_program_t *program, FILE *fp)
+{
+    if ((NULL == program) || (NULL == program->bytecode) || (NULL == fp))
+    {
+        return VM_INVALID_PARAM;
+    }
+
+    bytecode_t *bytecode = program->bytecode;
+    uint32_t hash = fnv_1a_32_hash(bytecode->bytecode, bytecode->used_bytes);
+
+    for (size_t i = 0u; i < program->num_instructions; i++)
+    {
+        vm_instruction_t *ins = program->instructions + i;
+
+        if (NULL != ins->branch)
+        {
+            fprintf(fp, "%08" PRIx32 " %" PRIu32 " %" PRIu64 " %" PRIu64 "\n", hash,
+                    ins->offset, ins->branch->taken, ins->branch->not_taken);
+        }
+    }
+
+    return VM_OK;
+}
+
+#endif /* VM_BRANCH_PROFILE */
@@ -2,6 +2,8 @@
 #define VM_API_H_
 
 
+#include <stdio.h>
+
 #include "ulist_api.h"
 #include "data_types.h"
 #include "bytecode_api.h"
@@ -15,11 +17,38 @@ typedef enum
     VM_MEMORY_ERROR,
     VM_INVALID_PARAM,
     VM_INVALID_OPCODE,
+    VM_INVALID_JUMP,
+    VM_INVALID_CONSTANT,
+    VM_INVALID_STACK,
+    VM_INVALID_TYPES,
     VM_RUNTIME_ERROR,
+    VM_UNSUPPORTED,
     VM_ERROR
 } vm_status_e;
 
 
+/* Execution engines that vm_execute can run a loaded program with */
+typedef enum
+{
+    VM_ENGINE_STACK,      // Stack-based instructions, using the dispatch engine selected at build time
+    VM_ENGINE_REGISTER,   // Register-based translation of the program (see register_vm_api.h)
+    VM_ENGINE_TOS_CACHE,  // Stack-based instructions, caching the top of the stack (see tos_cache_vm_api.h)
+    VM_ENGINE_JIT,        // Native code compiled from the program, where supported (see jit_api.h)
+    VM_ENGINE_TRACE_JIT,  // Stack-based instructions, with hot loops compiled to native traces (see jit_api.h)
+    VM_ENGINE_AOT,        // Shared object compiled ahead of time and loaded by aot_load (see aot_api.h)
+    NUM_VM_ENGINES
+} vm_engine_e;
+
+
+/* Inline cache statistics for a loaded program, see vm_inline_cache_stats */
+typedef struct
+{
+    size_t sites;   // Number of instructions with an inline cache
+    size_t hits;    // Total executions that used a cached function
+    size_t misses;  // Total executions that had to look up the function
+} vm_inline_cache_stats_t;
+
+
 /**
  * Initializes a virtual machine instance; allocates memory for the first
  * stack frame and sets up the data stack for that frame.
@@ -32,17 +61,80 @@ vm_status_e vm_create(vm_instance_t *instance);
 
 
 /**
- * Verify the provided bytecode contains only valid opcodes. Should be called
- * before executing a chunk of bytecode; avoids requiring vm_execute to check
- * each opcode before executing.
+ * Verify the provided bytecode contains only valid opcodes, that every jump
+ * lands on the start of an instruction, that every constant pool index is in
+ * range, and that no path through the program pops an item off the data stack
+ * that it didn't push. Should be called before executing a chunk of bytecode;
+ * avoids requiring vm_execute to check each opcode before executing. Once
+ * verified, arithmetic instructions whose operand types can be proven are
+ * rewritten in place with specialised opcodes (see type_inference_api.h).
+ * Instructions that are already specialised (e.g. OPCODE_ADD_INT_INT) don't
+ * check their operand types at runtime, so the operand types of each one must
+ * be proven by type inference too.
  *
  * @param    program    Pointer to bytecode object to verify
  *
- * @return   VM_OK if bytecode was verified successfully, VM_INVALID_OPCODE otherwise
+ * @return   VM_OK if bytecode was verified successfully, VM_INVALID_OPCODE if
+ *           an opcode is invalid, VM_INVALID_JUMP if a jump does not land on
+ *           an instruction boundary, VM_INVALID_CONSTANT if a constant pool
+ *           index is out of range, VM_INVALID_STACK if the data stack could
+ *           underflow, VM_INVALID_TYPES if a specialised instruction could be
+ *           executed with operands of the wrong type
  */
 vm_status_e vm_verify(bytecode_t *program);
 
 
+/**
+ * Load verified bytecode into a program that can be executed by vm_execute.
+ * Every instruction is decoded once into an aligned array of vm_instruction_t,
+ * holding the handler, operands and resolved jump target, so that operands are
+ * never decoded from the bytecode while the program is running. The values
+ * defined by OPCODE_DEFINE_CONST are also created here, once, in a flat array
+ * indexed directly by OPCODE_LOAD_CONST. The program is also translated for
+ * VM_ENGINE_REGISTER, if possible. The bytecode object must outlive the
+ * loaded program.
+ *
+ * The maximum depth of the data stack is calculated here, the same way as by
+ * vm_verify. If the data stack can't underflow, and its depth is bounded (no
+ * loop grows it on every iteration), then the program runs handlers that don't
+ * check the data stack, since vm_execute reserves the maximum depth first.
+ *
+ * @param    bytecode   Pointer to verified bytecode object to load
+ * @param    program    Pointer to program object to populate
+ *
+ * @return   VM_OK if the program was loaded successfully, VM_INVALID_JUMP if
+ *           a jump instruction does not land on an instruction boundary,
+ *           VM_INVALID_CONSTANT if a constant pool index is out of range
+ */
+vm_status_e vm_load(bytecode_t *bytecode, vm_program_t *program);
+
+
+/**
+ * Free all memory associated with a program loaded by vm_load
+ *
+ * @param    program    Pointer to program object to unload
+ *
+ * @return   VM_OK if the program was unloaded successfully
+ */
+vm_status_e vm_unload(vm_program_t *program);
+
+
+/**
+ * Get the total number of inline cache hits and misses for all arithmetic and
+ * cast instructions in a loaded program. Each of these instructions caches the
+ * type operation function resolved for the operand types it saw last; a hit
+ * calls the cached function directly, and a miss looks it up again and
+ * replaces the cached function. Counts accumulate over every vm_execute call
+ * until the program is unloaded.
+ *
+ * @param    program    Pointer to loaded program
+ * @param    stats      Pointer to location to store statistics
+ *
+ * @return   VM_OK if successful
+ */
+vm_status_e vm_inline_cache_stats(vm_program_t *program, vm_inline_cache_stats_t *stats);
+
+
 /**
  * Tears down an initialized VM instance and deallocates all memory, including
  * memory used for all call stack frames and data stacks
@@ -55,14 +147,90 @@ vm_status_e vm_destroy(vm_instance_t *instance);
 
 
 /**
- * Executes a chunk of bytecode. Assumes the bytecode has already been verified.
+ * Executes a program that was loaded by vm_load. Some instructions are
+ * rewritten in the loaded program after they are first executed (see
+ * vm_opcode_e in opcode_handlers.h), so later executions of the same program
+ * may run faster than the first one. Either engine can be used for any call,
+ * and they all leave the same values on the data stack. Instruction traces
+ * and profiles are only recorded by VM_ENGINE_STACK, and by
+ * VM_ENGINE_TRACE_JIT outside of compiled loops.
  *
- * @param    instance    Pointer to VM instance to destroy
- * @param    program     Pointer to bytecode object to execute
+ * @param    instance    Pointer to VM instance to execute the program on
+ * @param    program     Pointer to loaded program to execute
+ * @param    engine      Execution engine to run the program with
+ *
+ * @return   VM_OK if execution completed successfully, VM_UNSUPPORTED if the
+ *           program could not be translated for the requested engine, or no
+ *           shared object was loaded for it with VM_ENGINE_AOT
+ */
+vm_status_e vm_execute(vm_instance_t *instance, vm_program_t *program, vm_engine_e engine);
+
+
+#ifdef VM_TRACE
+
+/**
+ * Print the most recently executed instructions (up to VM_TRACE_ENTRIES), along
+ * with the data stack depth before each one was executed. Called automatically
+ * when vm_execute encounters a runtime error, and may also be called on demand.
  *
- * @return   VM_OK if execution completed successfully
+ * @param    instance    Pointer to VM instance to dump the trace for
  */
-vm_status_e vm_execute(vm_instance_t *instance, bytecode_t *program);
+void vm_trace_dump(vm_instance_t *instance);
+
+#endif /* VM_TRACE */
+
+
+#ifdef VM_PROFILE
+
+/* File that programs built with VM_PROFILE append their opcode profile to */
+#ifndef VM_PROFILE_OUTPUT
+#define VM_PROFILE_OUTPUT "opcode_profile.txt"
+#endif
+
+/**
+ * Write the number of times each sequence of two or three opcodes was executed
+ * one after another by a VM instance, over every vm_execute call since the
+ * instance was created. Each line holds an execution count followed by the
+ * opcode names in the sequence, e.g. "1200 LOAD_CONST LOAD_CONST ADD". This is
+ * the input format for tools/gen_superinstructions.py.
+ *
+ * @param    instance    Pointer to VM instance to write the profile for
+ * @param    fp          File to write the profile to
+ *
+ * @return   VM_OK if the profile was written successfully
+ */
+vm_status_e vm_profile_write(vm_instance_t *instance, FILE *fp);
+
+#endif /* VM_PROFILE */
+
+
+/* File that programs built with VM_BRANCH_PROFILE append their branch profile
+ * to, and that a branch profile is read from for block_layout_apply */
+#ifndef VM_BRANCH_PROFILE_OUTPUT
+#define VM_BRANCH_PROFILE_OUTPUT "branch_profile.txt"
+#endif
+
+
+#ifdef VM_BRANCH_PROFILE
+
+/**
+ * Write the number of times each conditional jump in a loaded program jumped
+ * and didn't jump, over every vm_execute call since the program was loaded.
+ * Each line holds the FNV-1a hash of the bytecode (8 hex digits), the offset
+ * of the jump in the bytecode, the taken count and the not-taken count, e.g.
+ * "5a1f03c2 117 9000 1". Profiles of several programs, or several runs of the
+ * same program, can be appended to the same file; see block_layout_api.h.
+ * Branches are only counted by the engines that run the opcode handlers
+ * (VM_ENGINE_STACK, and VM_ENGINE_TRACE_JIT outside of compiled loops).
+ *
+ * @param    program    Pointer to loaded program to write the profile for
+ * @param    fp         File to write the profile to
+ *
+ * @return   VM_OK if the profile was written successfully
+ */
+vm_status_e vm_branch_profile_write(vm_program_t *program, FILE *fp);
+
+#endif /* VM_BRANCH_PROFILE */
 
 
 #endif /* VM_API_H_ */
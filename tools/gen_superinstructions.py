@@ -0,0 +1,339 @@
+#!/usr/bin/env python3
+"""
+Generates source/backend/superinstructions.h, and the superinstruction handlers
+in source/runtime/superinstruction_handlers.h, from an opcode profile written by
+a VM_PROFILE build (see vm_profile_write in source/runtime/vm_api.h).
+
+Each line of the profile holds an execution count followed by a sequence of two
+or three opcode names, for instructions that were executed one after another.
+Lines for the same sequence (e.g. from several runs) are added together. The
+sequences that would save the most dispatches are turned into superinstructions.
+
+Usage:
+
+    gen_superinstructions.py <profile> <opcode_handlers.h> <output header>
+                             <output handlers> [max]
+"""
+
+import re
+import sys
+
+
+# Default maximum number of superinstructions to generate
+DEFAULT_MAX_SUPERINSTRUCTIONS = 8
+
+# Opcodes that can never be part of a superinstruction
+EXCLUDED_OPCODES = ["NOP", "END", "DEFINE_CONST"]
+
+# Opcodes that change control flow, only allowed as the last instruction
+JUMP_OPCODES = ["JUMP", "JUMP_IF_FALSE", "JUMP_IF_TRUE", "JUMP_IF_EQUAL",
+                "JUMP_IF_NOT_EQUAL", "JUMP_IF_LESS", "JUMP_IF_LESS_EQUAL",
+                "JUMP_IF_GREATER", "JUMP_IF_GREATER_EQUAL"]
+
+# Generic arithmetic, which can't be the first instruction because type
+# inference would no longer be able to specialise it
+ARITHMETIC_OPCODES = ["ADD", "SUB", "MULT", "DIV"]
+
+# Opcodes that push a literal value
+LITERAL_OPCODES = ["INT", "FLOAT", "BOOL", "STRING", "LOAD_CONST"]
+
+# Opcodes that push a number
+NUMBER_OPCODES = ["INT", "FLOAT"]
+
+# Comparisons, which the optimizer folds like arithmetic when both operands are numbers
+COMPARISON_OPCODES = ["EQUAL", "NOT_EQUAL", "LESS", "LESS_EQUAL", "GREATER", "GREATER_EQUAL"]
+
+# Arithmetic that always raises a runtime error on two strings
+STRING_ERROR_OPCODES = ["SUB", "MULT", "DIV"]
+
+# Specialised arithmetic is counted as the generic opcode, since superinstructions
+# are substituted by the optimizer before type inference runs
+SPECIALISED_ARITHMETIC = re.compile(r"^(ADD|SUB|MULT|DIV)_(INT_INT|FLOAT_FLOAT)$")
+
+# Specialised compare-and-branch is counted as the generic opcode, for the same reason
+SPECIALISED_JUMP = re.compile(r"^(JUMP_IF_\w+)_INT$")
+
+# Opcodes that a handler may rewrite its instruction to use after the first
+# execution (see vm_opcode_e), with the handler for the rewritten instruction
+QUICKENED_OPCODES = {
+    "STRING": [("VM_OPCODE_LOAD_VALUE", "opcode_handler_load_value")],
+    "LOAD_CONST": [("VM_OPCODE_LOAD_VALUE", "opcode_handler_load_value")],
+    "CAST": [("VM_OPCODE_CAST_TYPED", "opcode_handler_cast_typed")],
+}
+
+# Generated lines longer than this are wrapped
+MAX_LINE_LENGTH = 100
+
+# Matches an entry in VM_OPCODE_LIST
+OPCODE_LIST_ENTRY = re.compile(r"X\(OPCODE_(\w+),\s*(\w+),\s*(\d+)u,\s*(\d+)u\)")
+
+HEADER_TEMPLATE = """/**
+ * Superinstructions; commonly executed sequences of instructions that the VM
+ * executes with a single dispatch. The opcode of the first instruction in the
+ * sequence is replaced with the superinstruction opcode, and the remaining
+ * instructions are left in place, so jumps into the middle of a sequence still
+ * work (see bytecode_optimize).
+ *
+ * Generated by tools/gen_superinstructions.py from tools/opcode_profile.txt;
+ * do not edit by hand, run "make superinstructions" to regenerate.
+ */
+
+#ifndef SUPERINSTRUCTIONS_H_
+#define SUPERINSTRUCTIONS_H_
+
+
+/**
+ * Format: X(opcode, handler function, items popped, items pushed), the same as
+ * VM_OPCODE_LIST. The stack effect is that of the first instruction only, since
+ * the remaining instructions are still decoded separately.
+ */
+#define SUPERINSTRUCTION_LIST(X)%s
+
+
+/**
+ * Format: X(opcode, handler function, number of instructions, first, second, third)
+ * Unused instructions are given as OPCODE_NOP.
+ */
+#define SUPERINSTRUCTION_SEQUENCES(X)%s
+
+
+#endif /* SUPERINSTRUCTIONS_H_ */
+"""
+
+HANDLERS_TEMPLATE = """/**
+ * Handlers for superinstructions (see superinstructions.h), included by
+ * opcode_handlers.c only. Each one runs the handlers of every instruction in
+ * the sequence directly, so they can be inlined into a single body, and returns
+ * the next instruction to the dispatch engine once at the end. The first
+ * instruction holds the superinstruction opcode, so it is run by _execute_first.
+ * The other instructions are decoded separately, and may have been specialised
+ * by type inference or quickened, so their opcodes are checked before picking
+ * a handler.
+ *
+ * Generated by tools/gen_superinstructions.py from tools/opcode_profile.txt;
+ * do not edit by hand, run "make superinstructions" to regenerate.
+ */
+
+#ifndef SUPERINSTRUCTION_HANDLERS_H_
+#define SUPERINSTRUCTION_HANDLERS_H_%s
+
+
+#endif /* SUPERINSTRUCTION_HANDLERS_H_ */
+"""
+
+
+def read_opcode_list(filename):
+    """
+    Returns the stack effect of each opcode in VM_OPCODE_LIST, and the name of
+    its handler
+    """
+    effects = {}
+    handlers = {}
+
+    with open(filename, "r") as fh:
+        for match in OPCODE_LIST_ENTRY.finditer(fh.read()):
+            effects[match.group(1)] = (int(match.group(3)), int(match.group(4)))
+            handlers[match.group(1)] = match.group(2)
+
+    return effects, handlers
+
+
+def base_opcode(name):
+    """
+    Returns the opcode that a specialised opcode was created from, or the same
+    name for opcodes that are not specialised
+    """
+    return SPECIALISED_JUMP.sub(r"\1", SPECIALISED_ARITHMETIC.sub(r"\1", name))
+
+
+def read_profile(filename):
+    counts = {}
+
+    with open(filename, "r") as fh:
+        for line in fh:
+            fields = line.split("#", 1)[0].split()
+            if not fields:
+                continue
+
+            names = tuple(base_opcode(name) for name in fields[1:])
+            counts[names] = counts.get(names, 0) + int(fields[0])
+
+    return counts
+
+
+def is_candidate(sequence, effects):
+    if len(sequence) not in [2, 3]:
+        return False
+
+    for name in sequence:
+        if (name not in effects) or (name in EXCLUDED_OPCODES):
+            return False
+
+    for name in sequence[:-1]:
+        if name in JUMP_OPCODES:
+            return False
+
+    if sequence[0] in ARITHMETIC_OPCODES:
+        return False
+
+    return not (is_folded(sequence) or always_fails(sequence))
+
+
+def is_folded(sequence):
+    """
+    Sequences that the optimizer replaces with a single literal, or removes,
+    before superinstructions are substituted; these only appear in profiles of
+    unoptimized bytecode
+    """
+    for start in range(len(sequence) - 1):
+        first, second = sequence[start], sequence[start + 1]
+
+        if (first in LITERAL_OPCODES) and (second in ["JUMP_IF_FALSE", "JUMP_IF_TRUE", "CAST"]):
+            return True
+
+        if (start + 2 < len(sequence)) and (first in NUMBER_OPCODES) and \
+           (second in NUMBER_OPCODES) and \
+           (sequence[start + 2] in ARITHMETIC_OPCODES + COMPARISON_OPCODES):
+            return True
+
+    return False
+
+
+def always_fails(sequence):
+    """
+    Sequences that raise a runtime error every time they are executed, so are
+    never worth a superinstruction however often a profile shows them
+    """
+    for start in range(len(sequence) - 2):
+        if (sequence[start] == "STRING") and (sequence[start + 1] == "STRING") and \
+           (sequence[start + 2] in STRING_ERROR_OPCODES):
+            return True
+
+    return False
+
+
+def list_macro(entries):
+    if not entries:
+        return ""
+
+    lines = [" \\\n    %s" % entry for entry in entries]
+    return "".join(lines)
+
+
+def variants(name, handlers):
+    """
+    Returns (opcode, handler) for every opcode that an instruction emitted as
+    the given opcode may have when it is executed, other than the opcode itself
+    """
+    result = [("OPCODE_%s" % other, handlers[other]) for other in sorted(handlers)
+              if (other != name) and (base_opcode(other) == name)]
+
+    return result + QUICKENED_OPCODES.get(name, [])
+
+
+def handler_call(name, handlers, result, indent):
+    """
+    Returns lines of C that run the instruction pointed to by 'next', which was
+    emitted as the given opcode, and assign the next instruction to 'result'
+    """
+    call = "HANDLER(%s)(next, instance);"
+    others = variants(name, handlers)
+
+    if not others:
+        return ["%s%s%s" % (indent, result, call % handlers[name])]
+
+    lines = ["%sswitch ((int) next->opcode)" % indent, "%s{" % indent]
+
+    for opcode, handler in others:
+        lines += ["%s    case %s:" % (indent, opcode),
+                  "%s        %s%s" % (indent, result, call % handler)]
+        if result != "return ":
+            lines.append("%s        break;" % indent)
+        lines.append("")
+
+    lines += ["%s    default:" % indent,
+              "%s        %s%s" % (indent, result, call % handlers[name])]
+    if result != "return ":
+        lines.append("%s        break;" % indent)
+
+    return lines + ["%s}" % indent]
+
+
+def handler_definition(seq, handlers):
+    """
+    Returns the C definition of the handler for a superinstruction
+    """
+    name = "HANDLER(opcode_handler_%s)" % "_".join(seq).lower()
+    signature = "vm_instruction_t *%s(vm_instruction_t *ins, vm_instance_t *instance)" % name
+    if len(signature) > MAX_LINE_LENGTH:
+        signature = "vm_instruction_t *%s(vm_instruction_t *ins,\n%svm_instance_t *instance)" % \
+                    (name, " " * len("vm_instruction_t *%s(" % name))
+
+    lines = ["", "", "",
+             "/**",
+             " * %s" % ", ".join(seq),
+             " */",
+             signature,
+             "{",
+             "    vm_instruction_t *next = _execute_first(ins, instance, OPCODE_%s);" % seq[0]]
+
+    for index, name in enumerate(seq[1:]):
+        result = "return " if (index == (len(seq) - 2)) else "next = "
+        lines += ["",
+                  "    if (NULL == next)",
+                  "    {",
+                  "        return NULL;",
+                  "    }",
+                  ""]
+        lines += handler_call(name, handlers, result, "    ")
+
+    lines.append("}")
+    return "\n".join(lines)
+
+
+def main():
+    if len(sys.argv) < 5:
+        print(__doc__)
+        return 1
+
+    profile_file, opcode_list_file, output_file, handlers_file = sys.argv[1:5]
+    max_superinstructions = DEFAULT_MAX_SUPERINSTRUCTIONS
+    if len(sys.argv) > 5:
+        max_superinstructions = int(sys.argv[5])
+
+    effects, handlers = read_opcode_list(opcode_list_file)
+    counts = read_profile(profile_file)
+
+    # Each execution of a superinstruction saves one dispatch per extra instruction
+    candidates = [seq for seq in counts if is_candidate(seq, effects)]
+    candidates.sort(key=lambda seq: (-(counts[seq] * (len(seq) - 1)), seq))
+    chosen = candidates[:max_superinstructions]
+
+    list_entries = []
+    sequence_entries = []
+
+    for seq in chosen:
+        name = "_".join(seq)
+        opcode = "OPCODE_%s" % name
+        handler = "opcode_handler_%s" % name.lower()
+        pops, pushes = effects[seq[0]]
+        components = ["OPCODE_%s" % op for op in seq] + ["OPCODE_NOP"] * (3 - len(seq))
+
+        list_entries.append("X(%s, %s, %du, %du)" % (opcode, handler, pops, pushes))
+        sequence_entries.append("X(%s, %s, %du, %s)" % (opcode, handler, len(seq),
+                                                        ", ".join(components)))
+
+    with open(output_file, "w") as fh:
+        fh.write(HEADER_TEMPLATE % (list_macro(list_entries), list_macro(sequence_entries)))
+
+    with open(handlers_file, "w") as fh:
+        fh.write(HANDLERS_TEMPLATE % "".join(handler_definition(seq, handlers) for seq in chosen))
+
+    for seq in chosen:
+        print("%10d  %s" % (counts[seq], " ".join(seq)))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,459 @@
+/**
+ * Runs a set of programs typical of what the compiler produces (loops over
+ * locals and globals, function calls, float arithmetic and string building),
+ * after dead code elimination and optimization, and writes the opcode profile
+ * to stdout. Input for tools/gen_superinstructions.py; must be built with
+ * VM_PROFILE, see "make opcode_profile".
+ */
+
+#include <stdio.h>
+
+#include "memory_manager_api.h"
+#include "string_cache_api.h"
+#include "bytecode_api.h"
+#include "bytecode_optimizer_api.h"
+#include "dead_code_api.h"
+#include "scope_api.h"
+#include "vm_api.h"
+
+
+#ifndef VM_PROFILE
+#error "opcode_workload must be built with VM_PROFILE"
+#endif /* VM_PROFILE */
+
+
+// Number of iterations of each loop in the workload
+#define WORKLOAD_ITERATIONS (10000)
+
+// Argument passed to the recursive fibonacci function
+#define WORKLOAD_FIB_ARG (20)
+
+// Number of times a string is appended to in the string building loop
+#define WORKLOAD_STRING_APPENDS (200)
+
+
+// Signature for functions that emit the bytecode for a single workload program
+typedef void (*build_program_t)(bytecode_t *);
+
+
+typedef struct
+{
+    const char *name;          // Program name, printed with the profile
+    build_program_t build;     // Emits the bytecode for the program
+} workload_t;
+
+
+/**
+ * Emit the start of a loop that runs while a local is less than a limit
+ *
+ * @return   Position of the loop, to jump back to at the end of the body
+ */
+static uint32_t _emit_loop_start(bytecode_t *program, uint16_t counter, vm_int_t limit,
+                                 uint32_t *exit)
+{
+    uint32_t loop = program->used_bytes;
+
+    (void) bytecode_emit_load_local(program, counter);
+    (void) bytecode_emit_int(program, limit);
+    (void) bytecode_emit_less(program);
+    (void) bytecode_emit_backpatched_jump_if_false(program, exit);
+    return loop;
+}
+
+
+/**
+ * Emit the end of a loop started by _emit_loop_start, incrementing the local
+ */
+static void _emit_loop_end(bytecode_t *program, uint16_t counter, uint32_t loop,
+                           uint32_t exit)
+{
+    (void) bytecode_emit_load_local(program, counter);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, counter);
+
+    (void) bytecode_emit_jump(program, (int32_t) loop - (int32_t) program->used_bytes);
+    (void) bytecode_backpatch_jump(program, exit, program->used_bytes - exit);
+}
+
+
+/* sum = sum + i, for i in 0 to WORKLOAD_ITERATIONS */
+static void _build_local_sum(bytecode_t *program)
+{
+    scope_t scope;
+    uint16_t i, sum;
+    uint32_t exit;
+
+    (void) scope_create(&scope);
+    (void) scope_resolve(&scope, "i", 1u, &i);
+    (void) scope_resolve(&scope, "sum", 3u, &sum);
+
+    uint32_t loop = _emit_loop_start(program, i, WORKLOAD_ITERATIONS, &exit);
+    (void) bytecode_emit_load_local(program, sum);
+    (void) bytecode_emit_load_local(program, i);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, sum);
+    _emit_loop_end(program, i, loop, exit);
+
+    (void) bytecode_emit_load_local(program, sum);
+    (void) bytecode_emit_end(program);
+    (void) scope_destroy(&scope);
+}
+
+
+/* total = total + (i * j) - 1, for i and j in 0 to 100 */
+static void _build_nested_loops(bytecode_t *program)
+{
+    scope_t scope;
+    uint16_t i, j, total;
+    uint32_t outer_exit, inner_exit;
+
+    (void) scope_create(&scope);
+    (void) scope_resolve(&scope, "i", 1u, &i);
+    (void) scope_resolve(&scope, "j", 1u, &j);
+    (void) scope_resolve(&scope, "total", 5u, &total);
+
+    uint32_t outer = _emit_loop_start(program, i, 100, &outer_exit);
+    (void) bytecode_emit_int(program, 0);
+    (void) bytecode_emit_store_local(program, j);
+
+    uint32_t inner = _emit_loop_start(program, j, 100, &inner_exit);
+    (void) bytecode_emit_load_local(program, total);
+    (void) bytecode_emit_load_local(program, i);
+    (void) bytecode_emit_load_local(program, j);
+    (void) bytecode_emit_mult(program);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_sub(program);
+    (void) bytecode_emit_store_local(program, total);
+    _emit_loop_end(program, j, inner, inner_exit);
+
+    _emit_loop_end(program, i, outer, outer_exit);
+
+    (void) bytecode_emit_load_local(program, total);
+    (void) bytecode_emit_end(program);
+    (void) scope_destroy(&scope);
+}
+
+
+/* sum = sum + i, for i in 0 to WORKLOAD_ITERATIONS, held in global variables */
+static void _build_global_sum(bytecode_t *program)
+{
+    uint32_t exit;
+
+    (void) bytecode_emit_define_const(program, DATATYPE_STRING, "i");
+    (void) bytecode_emit_define_const(program, DATATYPE_STRING, "sum");
+    (void) bytecode_emit_int(program, 0);
+    (void) bytecode_emit_store_global(program, 0u);
+    (void) bytecode_emit_int(program, 0);
+    (void) bytecode_emit_store_global(program, 1u);
+
+    uint32_t loop = program->used_bytes;
+    (void) bytecode_emit_load_global(program, 0u);
+    (void) bytecode_emit_int(program, WORKLOAD_ITERATIONS);
+    (void) bytecode_emit_less(program);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &exit);
+
+    (void) bytecode_emit_load_global(program, 1u);
+    (void) bytecode_emit_load_global(program, 0u);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_global(program, 1u);
+
+    (void) bytecode_emit_load_global(program, 0u);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_global(program, 0u);
+
+    (void) bytecode_emit_jump(program, (int32_t) loop - (int32_t) program->used_bytes);
+    (void) bytecode_backpatch_jump(program, exit, program->used_bytes - exit);
+
+    (void) bytecode_emit_load_global(program, 1u);
+    (void) bytecode_emit_end(program);
+}
+
+
+/* x = x * 0.5 + 1.0, WORKLOAD_ITERATIONS times */
+static void _build_float_loop(bytecode_t *program)
+{
+    scope_t scope;
+    uint16_t i, x;
+    uint32_t exit;
+
+    (void) scope_create(&scope);
+    (void) scope_resolve(&scope, "i", 1u, &i);
+    (void) scope_resolve(&scope, "x", 1u, &x);
+
+    (void) bytecode_emit_float(program, 0.0);
+    (void) bytecode_emit_store_local(program, x);
+
+    uint32_t loop = _emit_loop_start(program, i, WORKLOAD_ITERATIONS, &exit);
+    (void) bytecode_emit_load_local(program, x);
+    (void) bytecode_emit_float(program, 0.5);
+    (void) bytecode_emit_mult(program);
+    (void) bytecode_emit_float(program, 1.0);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, x);
+    _emit_loop_end(program, i, loop, exit);
+
+    (void) bytecode_emit_load_local(program, x);
+    (void) bytecode_emit_end(program);
+    (void) scope_destroy(&scope);
+}
+
+
+/* count = count + 1 if i < half, count = count + 2 otherwise */
+static void _build_branchy_loop(bytecode_t *program)
+{
+    scope_t scope;
+    uint16_t i, count;
+    uint32_t exit, other, join;
+
+    (void) scope_create(&scope);
+    (void) scope_resolve(&scope, "i", 1u, &i);
+    (void) scope_resolve(&scope, "count", 5u, &count);
+
+    uint32_t loop = _emit_loop_start(program, i, WORKLOAD_ITERATIONS, &exit);
+    (void) bytecode_emit_load_local(program, i);
+    (void) bytecode_emit_int(program, WORKLOAD_ITERATIONS / 2);
+    (void) bytecode_emit_less(program);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &other);
+
+    (void) bytecode_emit_load_local(program, count);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, count);
+    (void) bytecode_emit_backpatched_jump(program, &join);
+
+    (void) bytecode_backpatch_jump(program, other, program->used_bytes - other);
+    (void) bytecode_emit_load_local(program, count);
+    (void) bytecode_emit_int(program, 2);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, count);
+
+    (void) bytecode_backpatch_jump(program, join, program->used_bytes - join);
+    _emit_loop_end(program, i, loop, exit);
+
+    (void) bytecode_emit_load_local(program, count);
+    (void) bytecode_emit_end(program);
+    (void) scope_destroy(&scope);
+}
+
+
+/* fib(n): n if n < 2, otherwise fib(n - 1) + fib(n - 2) */
+static void _build_fibonacci(bytecode_t *program)
+{
+    uint32_t call, position;
+
+    (void) bytecode_emit_int(program, WORKLOAD_FIB_ARG);
+    (void) bytecode_emit_backpatched_call(program, 1u, &call);
+    (void) bytecode_emit_end(program);
+
+    uint32_t fib = program->used_bytes;
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_int(program, 2);
+    (void) bytecode_emit_less(program);
+    (void) bytecode_emit_backpatched_jump_if_false(program, &position);
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_return(program);
+    (void) bytecode_backpatch_jump(program, position, program->used_bytes - position);
+
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_int(program, 1);
+    (void) bytecode_emit_sub(program);
+    (void) bytecode_emit_call(program, (int32_t) fib - (int32_t) program->used_bytes, 1u);
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_int(program, 2);
+    (void) bytecode_emit_sub(program);
+    (void) bytecode_emit_call(program, (int32_t) fib - (int32_t) program->used_bytes, 1u);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_return(program);
+    (void) bytecode_emit_end(program);
+
+    (void) bytecode_backpatch_jump(program, call, fib - call);
+}
+
+
+/* sum = sum + scale(i, 3, 1), where scale(x, a, b) is x * a + b */
+static void _build_call_in_loop(bytecode_t *program)
+{
+    scope_t scope;
+    uint16_t i, sum;
+    uint32_t exit;
+
+    (void) scope_create(&scope);
+    (void) scope_resolve(&scope, "i", 1u, &i);
+    (void) scope_resolve(&scope, "sum", 3u, &sum);
+
+    uint32_t loop = _emit_loop_start(program, i, WORKLOAD_ITERATIONS, &exit);
+    (void) bytecode_emit_load_local(program, sum);
+    (void) bytecode_emit_load_local(program, i);
+    (void) bytecode_emit_int(program, 3);
+    (void) bytecode_emit_int(program, 1);
+
+    uint32_t call;
+    (void) bytecode_emit_backpatched_call(program, 3u, &call);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, sum);
+    _emit_loop_end(program, i, loop, exit);
+
+    (void) bytecode_emit_load_local(program, sum);
+    (void) bytecode_emit_end(program);
+
+    uint32_t scale = program->used_bytes;
+    (void) bytecode_emit_load_local(program, 0u);
+    (void) bytecode_emit_load_local(program, 1u);
+    (void) bytecode_emit_mult(program);
+    (void) bytecode_emit_load_local(program, 2u);
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_return(program);
+    (void) bytecode_emit_end(program);
+
+    (void) bytecode_backpatch_jump(program, call, scale - call);
+    (void) scope_destroy(&scope);
+}
+
+
+/* s = s + "ab", WORKLOAD_STRING_APPENDS times */
+static void _build_string_building(bytecode_t *program)
+{
+    scope_t scope;
+    uint16_t i, s;
+    uint32_t exit;
+
+    (void) scope_create(&scope);
+    (void) scope_resolve(&scope, "i", 1u, &i);
+    (void) scope_resolve(&scope, "s", 1u, &s);
+
+    (void) bytecode_emit_string(program, "");
+    (void) bytecode_emit_store_local(program, s);
+
+    uint32_t loop = _emit_loop_start(program, i, WORKLOAD_STRING_APPENDS, &exit);
+    (void) bytecode_emit_load_local(program, s);
+    (void) bytecode_emit_string(program, "ab");
+    (void) bytecode_emit_add(program);
+    (void) bytecode_emit_store_local(program, s);
+    _emit_loop_end(program, i, loop, exit);
+
+    (void) bytecode_emit_load_local(program, s);
+    (void) bytecode_emit_end(program);
+    (void) scope_destroy(&scope);
+}
+
+
+static workload_t _workload[] =
+{
+    {"local sum", _build_local_sum},
+    {"nested loops", _build_nested_loops},
+    {"global sum", _build_global_sum},
+    {"float loop", _build_float_loop},
+    {"branchy loop", _build_branchy_loop},
+    {"fibonacci", _build_fibonacci},
+    {"call in loop", _build_call_in_loop},
+    {"string building", _build_string_building}
+};
+
+
+#define WORKLOAD_SIZE (sizeof(_workload) / sizeof(_workload[0]))
+
+
+/**
+ * Build, optimize and run a single workload program
+ *
+ * @return   0 if successful, 1 otherwise
+ */
+static int _run_program(workload_t *workload, vm_instance_t *instance)
+{
+    bytecode_t program;
+    vm_program_t loaded;
+    bytecode_optimizer_stats_t stats;
+    bytecode_status_e bytecode_err;
+    vm_status_e err;
+
+    if (BYTECODE_OK != bytecode_create(&program))
+    {
+        fprintf(stderr, "%s: bytecode_create failed\n", workload->name);
+        return 1;
+    }
+
+    workload->build(&program);
+
+    if (((bytecode_err = dead_code_eliminate(&program, NULL)) != BYTECODE_OK) ||
+        ((bytecode_err = bytecode_optimize(&program, &stats)) != BYTECODE_OK))
+    {
+        fprintf(stderr, "%s: optimization failed, status %d\n", workload->name,
+                bytecode_err);
+        (void) bytecode_destroy(&program);
+        return 1;
+    }
+
+    if (((err = vm_verify(&program)) != VM_OK) ||
+        ((err = vm_load(&program, &loaded)) != VM_OK))
+    {
+        fprintf(stderr, "%s: loading failed, status %d\n", workload->name, err);
+        (void) bytecode_destroy(&program);
+        return 1;
+    }
+
+    if ((err = vm_execute(instance, &loaded, VM_ENGINE_STACK)) != VM_OK)
+    {
+        fprintf(stderr, "%s: vm_execute failed, status %d\n", workload->name, err);
+    }
+
+    (void) vm_unload(&loaded);
+    (void) bytecode_destroy(&program);
+    return VM_OK != err;
+}
+
+
+int main(int argc, char *argv[])
+{
+    vm_instance_t instance;
+    vm_status_e err;
+    int failures = 0;
+
+    memory_manager_status_e mem_err = memory_manager_init();
+    if (MEMORY_MANAGER_OK != mem_err)
+    {
+        fprintf(stderr, "Failed to initialize memory manager, status %d\n", mem_err);
+        return mem_err;
+    }
+
+    string_cache_status_e cache_err = string_cache_init();
+    if (STRING_CACHE_OK != cache_err)
+    {
+        fprintf(stderr, "Failed to initialize string cache, status %d\n", cache_err);
+        return cache_err;
+    }
+
+    if ((err = vm_create(&instance)) != VM_OK)
+    {
+        fprintf(stderr, "vm_create failed, status %d\n", err);
+        return err;
+    }
+
+    printf("# Opcode sequence counts from tools/opcode_workload.c, with the optimizer\n"
+           "# enabled. Input for tools/gen_superinstructions.py.\n"
+           "#\n"
+           "# Regenerate with:\n"
+           "#\n"
+           "#   make clean && make opcode_profile\n"
+           "#\n"
+           "# Programs:\n");
+
+    for (size_t i = 0; i < WORKLOAD_SIZE; i++)
+    {
+        printf("#   %s\n", _workload[i].name);
+        failures += _run_program(_workload + i, &instance);
+    }
+
+    printf("\n");
+    (void) vm_profile_write(&instance, stdout);
+
+    if ((err = vm_destroy(&instance)) != VM_OK)
+    {
+        fprintf(stderr, "vm_destroy failed, status %d\n", err);
+        failures += 1;
+    }
+
+    return failures;
+}